@@ -4,6 +4,19 @@ This program is free software; you can redistribute it and/or modify
 it under the terms of the GNU General Public License version 2 as
 published by the Free Software Foundation.
 
+Note:
+1. func_xxx(x, f, token) are per element transfer functions, as
+   transfunc of NVCELL/NVLAYER/CONV3X3.
+2. actfs_forward()/actfs_backward() apply a transfunc to a whole
+   array, with vectorized(AVX2) kernels for the known functions.
+   Sigmoid/TanSigmoid use a vectorized exp() with range reduction
+   and a polynomial, within ~1ulp of libm exp().
+
+Journal:
+2026-10-17:
+   1. Add enum nnc_act_id, actfs_id(), actfs_func(), actfs_forward(), actfs_backward()
+      and actfs_set_simd(), AVX2 kernels selected at startup by actfs_cpu_dispatch().
+
 Midas Zhou
 midaszhou@yahoo.com
 -----------------------------------------------------------------------*/
@@ -11,9 +24,27 @@ midaszhou@yahoo.com
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <math.h>
 #include <sys/time.h>
 
+/* x86 SIMD kernels, selected at startup by CPUID, see actfs_cpu_dispatch() */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ACTFS_X86_SIMD	1
+#include <immintrin.h>
+#endif
+
+#define PRELU_A		0.5	/* Slope of func_PReLU for x<0 */
+
+/* Whole-array kernels of an activation, see actfs_forward()/actfs_backward() */
+typedef void (*actfs_fwd_t)(const nnc_real_t *x, nnc_real_t *y, unsigned long n);
+typedef void (*actfs_bwd_t)(const nnc_real_t *x, const nnc_real_t *y, const nnc_real_t *derr, nnc_real_t *g, unsigned long n);
+
+/* SIMD kernels as per enum nnc_act_id, NULL to use scalar loops */
+static actfs_fwd_t actfs_simd_forward[NNC_ACT_CUSTOM];
+static actfs_bwd_t actfs_simd_backward[NNC_ACT_CUSTOM];
+static bool actfs_simd_allowed=true;
+
 
 
 /*-----------------------------------------------
@@ -22,9 +53,9 @@ midaszhou@yahoo.com
  * Params:
  * 	@u	input param for transfer function;
  * Return:
- *		a double.
+ *		a nnc_real_t.
 ------------------------------------------------*/
-double func_step(double x, double f, int token)
+nnc_real_t func_step(nnc_real_t x, nnc_real_t f, int token)
 {
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -53,9 +84,9 @@ double func_step(double x, double f, int token)
  *		if token!=0:  f=f(x), f'(x)=f(x)(1-f(-x)), where a=1.
  *	@token	0 ---normal func; 1 ---derivative func
  * Return:
- *		a double.
+ *		a nnc_real_t.
 ---------------------------------------------------------------------*/
-double func_sigmoid(double x, double f, int token)
+nnc_real_t func_sigmoid(nnc_real_t x, nnc_real_t f, int token)
 {
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -85,11 +116,11 @@ double func_sigmoid(double x, double f, int token)
  *		if token!=0: f=f(x)  for f'(x)=1-f(x)^2  where a=2
  *	@token	0 ---normal func; 1 ---derivative func
  * Return:
- *		a double.
+ *		a nnc_real_t.
 ---------------------------------------------------------------------*/
-double func_TanSigmoid(double x, double f, int token)
+nnc_real_t func_TanSigmoid(nnc_real_t x, nnc_real_t f, int token)
 {
-   double a=2.0;
+   nnc_real_t a=2.0;
 
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -118,9 +149,9 @@ double func_TanSigmoid(double x, double f, int token)
  * 	@x,f=f(x)  input param for function;
  *	@token	0 ---normal func; 1 ---derivative func
  * Return:
- *		a double.
+ *		a nnc_real_t.
 ---------------------------------------------------------------------*/
-double func_ReLU(double x, double f, int token)
+nnc_real_t func_ReLU(nnc_real_t x, nnc_real_t f, int token)
 {
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -149,11 +180,11 @@ double func_ReLU(double x, double f, int token)
  * 	@x,f=f(x)  input param for function;
  *	@token	0 ---normal func; 1 ---derivative func
  * Return:
- *		a double.
+ *		a nnc_real_t.
 ---------------------------------------------------------------------*/
-double func_PReLU(double x, double f, int token)
+nnc_real_t func_PReLU(nnc_real_t x, nnc_real_t f, int token)
 {
-    double a=0.5;
+    nnc_real_t a=PRELU_A;
 
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -169,3 +200,414 @@ double func_PReLU(double x, double f, int token)
   }
 }
 
+
+
+////////////////////////      Whole-array kernels     //////////////////////////
+
+/*-------------------------------------------------------------------
+ * Map a transfunc to its id.
+ * Return:
+ *	enum nnc_act_id, NNC_ACT_CUSTOM for unknown functions.
+---------------------------------------------------------------------*/
+int actfs_id(nnc_transfunc_t transfunc)
+{
+	if(transfunc==NULL)
+		return NNC_ACT_NONE;
+	else if(transfunc==func_step)
+		return NNC_ACT_STEP;
+	else if(transfunc==func_sigmoid)
+		return NNC_ACT_SIGMOID;
+	else if(transfunc==func_TanSigmoid)
+		return NNC_ACT_TANSIGMOID;
+	else if(transfunc==func_ReLU)
+		return NNC_ACT_RELU;
+	else if(transfunc==func_PReLU)
+		return NNC_ACT_PRELU;
+	else
+		return NNC_ACT_CUSTOM;
+}
+
+/*-------------------------------------------------------------------
+ * Map an id to its transfunc.
+ * Return:
+ *	The transfunc, NULL for NNC_ACT_NONE/NNC_ACT_CUSTOM OR invalid id.
+---------------------------------------------------------------------*/
+nnc_transfunc_t actfs_func(int id)
+{
+	switch(id) {
+	    case NNC_ACT_STEP:		return func_step;
+	    case NNC_ACT_SIGMOID:	return func_sigmoid;
+	    case NNC_ACT_TANSIGMOID:	return func_TanSigmoid;
+	    case NNC_ACT_RELU:		return func_ReLU;
+	    case NNC_ACT_PRELU:		return func_PReLU;
+	    default:			return NULL;
+	}
+}
+
+
+/*-------------------------------------------------------------------
+ * Note:
+ *	y[k]=transfunc(x[k]), k in [0 n).
+ *	y may be the same as x, for in place.
+ * Params:
+ *	@transfunc	A transfer function, NULL for f(x)=x.
+ *	@x		Input, as dsums.
+ *	@y		Output, as douts.
+ *	@n		Number of elements.
+---------------------------------------------------------------------*/
+void actfs_forward(nnc_transfunc_t transfunc, const nnc_real_t *x, nnc_real_t *y, unsigned long n)
+{
+	unsigned long k;
+	int id=actfs_id(transfunc);
+
+	if(id<NNC_ACT_CUSTOM && actfs_simd_forward[id]) {
+		actfs_simd_forward[id](x, y, n);
+		return;
+	}
+
+	switch(id) {
+	    case NNC_ACT_NONE:
+		if(y!=x)
+			memcpy(y, x, n*sizeof(nnc_real_t));
+		break;
+	    case NNC_ACT_STEP:
+		for(k=0; k<n; k++)
+			y[k]= x[k]>=0 ? 1.0 : 0.0;
+		break;
+	    case NNC_ACT_SIGMOID:
+		for(k=0; k<n; k++)
+			y[k]=1.0/(1.0+exp(-x[k]));
+		break;
+	    case NNC_ACT_TANSIGMOID:
+		for(k=0; k<n; k++)
+			y[k]=2.0/(1.0+exp(-2.0*x[k]))-1.0;
+		break;
+	    case NNC_ACT_RELU:
+		for(k=0; k<n; k++)
+			y[k]= x[k]<0 ? 0.0 : x[k];
+		break;
+	    case NNC_ACT_PRELU:
+		for(k=0; k<n; k++)
+			y[k]= x[k]<0 ? PRELU_A*x[k] : x[k];
+		break;
+	    default:
+		for(k=0; k<n; k++)
+			y[k]=transfunc(x[k], 0.0, NORMAL_FUNC);
+		break;
+	}
+}
+
+
+/*-------------------------------------------------------------------
+ * Note:
+ *	g[k]=derr[k]*f'(x[k]), k in [0 n).  f' takes x=u and y=f(u),
+ *	as transfunc(x,y,DERIVATIVE_FUNC). g may be the same as derr.
+ * Params:
+ *	@transfunc	A transfer function, NULL for f'(x)=1.
+ *	@x		Inputs of the forward, as dsums.
+ *	@y		Outputs of the forward, as douts.
+ *	@derr		dE/dy
+ *	@g		Output dE/dx
+ *	@n		Number of elements.
+---------------------------------------------------------------------*/
+void actfs_backward(nnc_transfunc_t transfunc, const nnc_real_t *x, const nnc_real_t *y,
+		    const nnc_real_t *derr, nnc_real_t *g, unsigned long n)
+{
+	unsigned long k;
+	int id=actfs_id(transfunc);
+
+	if(id<NNC_ACT_CUSTOM && actfs_simd_backward[id]) {
+		actfs_simd_backward[id](x, y, derr, g, n);
+		return;
+	}
+
+	switch(id) {
+	    case NNC_ACT_NONE:
+		if(g!=derr)
+			memcpy(g, derr, n*sizeof(nnc_real_t));
+		break;
+	    case NNC_ACT_STEP:
+		for(k=0; k<n; k++)
+			g[k]=derr[k]*0.0;
+		break;
+	    case NNC_ACT_SIGMOID:
+		for(k=0; k<n; k++)
+			g[k]=derr[k]*(y[k]*(1-y[k]));
+		break;
+	    case NNC_ACT_TANSIGMOID:
+		for(k=0; k<n; k++)
+			g[k]=derr[k]*(2.0*(1-y[k]*y[k])/2.0);
+		break;
+	    case NNC_ACT_RELU:
+		for(k=0; k<n; k++)
+			g[k]= x[k]<0 ? derr[k]*0.0 : derr[k];
+		break;
+	    case NNC_ACT_PRELU:
+		for(k=0; k<n; k++)
+			g[k]= x[k]<0 ? derr[k]*PRELU_A : derr[k];
+		break;
+	    default:
+		for(k=0; k<n; k++)
+			g[k]=derr[k]*transfunc(x[k], y[k], DERIVATIVE_FUNC);
+		break;
+	}
+}
+
+
+#ifdef ACTFS_X86_SIMD /* ----- AVX2/FMA kernels ----- */
+
+/* AVX2 lane type and intrinsics as per nnc_real_t, ACT_VLEN elements per lane */
+#ifdef NNC_FLOAT32
+#define ACT_VLEN		8
+#define act_vec_t		__m256
+#define act_vzero()		_mm256_setzero_ps()
+#define act_vset1(x)		_mm256_set1_ps(x)
+#define act_vload(p)		_mm256_loadu_ps(p)
+#define act_vstore(p,v)		_mm256_storeu_ps(p,v)
+#define act_vadd(a,b)		_mm256_add_ps(a,b)
+#define act_vsub(a,b)		_mm256_sub_ps(a,b)
+#define act_vmul(a,b)		_mm256_mul_ps(a,b)
+#define act_vdiv(a,b)		_mm256_div_ps(a,b)
+#define act_vmax(a,b)		_mm256_max_ps(a,b)
+#define act_vmin(a,b)		_mm256_min_ps(a,b)
+#define act_vfmadd(a,b,c)	_mm256_fmadd_ps(a,b,c)
+#define act_vfnmadd(a,b,c)	_mm256_fnmadd_ps(a,b,c)
+#define act_vltzero(a)		_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ)
+#define act_vblend(a,b,m)	_mm256_blendv_ps(a,b,m)
+#define act_vround(a)		_mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC)
+#define ACT_EXP_MAX		88.0
+#define ACT_EXP_MIN		(-87.0)
+#else
+#define ACT_VLEN		4
+#define act_vec_t		__m256d
+#define act_vzero()		_mm256_setzero_pd()
+#define act_vset1(x)		_mm256_set1_pd(x)
+#define act_vload(p)		_mm256_loadu_pd(p)
+#define act_vstore(p,v)		_mm256_storeu_pd(p,v)
+#define act_vadd(a,b)		_mm256_add_pd(a,b)
+#define act_vsub(a,b)		_mm256_sub_pd(a,b)
+#define act_vmul(a,b)		_mm256_mul_pd(a,b)
+#define act_vdiv(a,b)		_mm256_div_pd(a,b)
+#define act_vmax(a,b)		_mm256_max_pd(a,b)
+#define act_vmin(a,b)		_mm256_min_pd(a,b)
+#define act_vfmadd(a,b,c)	_mm256_fmadd_pd(a,b,c)
+#define act_vfnmadd(a,b,c)	_mm256_fnmadd_pd(a,b,c)
+#define act_vltzero(a)		_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_LT_OQ)
+#define act_vblend(a,b,m)	_mm256_blendv_pd(a,b,m)
+#define act_vround(a)		_mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC)
+#define ACT_EXP_MAX		708.0
+#define ACT_EXP_MIN		(-708.0)
+#endif
+
+/*-------------------------------------------------------------------
+ * Note:
+ *	Vectorized exp(x):
+ *	1. x=n*ln2+r, |r|<=ln2/2, ln2 is split into hi+lo so r is exact.
+ *	2. exp(r) by its Taylor polynomial(Horner), degree 12 for double
+ *	   and 6 for float, the truncation error is below 1ulp.
+ *	3. exp(x)=exp(r)*2^n, 2^n is built in exponent bits.
+ *	x is clamped to [ACT_EXP_MIN ACT_EXP_MAX], NO inf/denormal.
+---------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static inline act_vec_t act_vexp(act_vec_t x)
+{
+	act_vec_t n, r, p;
+
+	x=act_vmin(act_vmax(x, act_vset1(ACT_EXP_MIN)), act_vset1(ACT_EXP_MAX));
+	n=act_vround(act_vmul(x, act_vset1(1.4426950408889634)));	/* x/ln2 */
+	r=act_vfnmadd(n, act_vset1(6.93145751953125E-1), x);		/* ln2 hi */
+	r=act_vfnmadd(n, act_vset1(1.42860682030941723212E-6), r);	/* ln2 lo */
+
+#ifdef NNC_FLOAT32
+	p=act_vset1(1.0/720);
+	p=act_vfmadd(p, r, act_vset1(1.0/120));
+	p=act_vfmadd(p, r, act_vset1(1.0/24));
+	p=act_vfmadd(p, r, act_vset1(1.0/6));
+	p=act_vfmadd(p, r, act_vset1(1.0/2));
+	p=act_vfmadd(p, r, act_vset1(1.0));
+	p=act_vfmadd(p, r, act_vset1(1.0));
+
+	/* 2^n: n+127 into exponent bits */
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(
+			_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)));
+#else
+	p=act_vset1(1.0/479001600);
+	p=act_vfmadd(p, r, act_vset1(1.0/39916800));
+	p=act_vfmadd(p, r, act_vset1(1.0/3628800));
+	p=act_vfmadd(p, r, act_vset1(1.0/362880));
+	p=act_vfmadd(p, r, act_vset1(1.0/40320));
+	p=act_vfmadd(p, r, act_vset1(1.0/5040));
+	p=act_vfmadd(p, r, act_vset1(1.0/720));
+	p=act_vfmadd(p, r, act_vset1(1.0/120));
+	p=act_vfmadd(p, r, act_vset1(1.0/24));
+	p=act_vfmadd(p, r, act_vset1(1.0/6));
+	p=act_vfmadd(p, r, act_vset1(1.0/2));
+	p=act_vfmadd(p, r, act_vset1(1.0));
+	p=act_vfmadd(p, r, act_vset1(1.0));
+
+	/* 2^n: n+1023 into exponent bits, n is an integer in the low bits of n+1.5*2^52 */
+	return _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(
+			_mm256_add_epi64(_mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(6755399441055744.0))),
+					 _mm256_set1_epi64x(1023-0x0018000000000000LL)), 52)));
+#endif
+}
+
+/* Forward kernels, the tail by scalar loops as actfs_forward() */
+__attribute__((target("avx2,fma")))
+static void act_avx2_sigmoid(const nnc_real_t *x, nnc_real_t *y, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t one=act_vset1(1.0);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN)
+		act_vstore(y+k, act_vdiv(one, act_vadd(one, act_vexp(act_vsub(act_vzero(), act_vload(x+k))))));
+	for(; k<n; k++)
+		y[k]=1.0/(1.0+exp(-x[k]));
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_tansigmoid(const nnc_real_t *x, nnc_real_t *y, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t one=act_vset1(1.0), two=act_vset1(2.0);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN)
+		act_vstore(y+k, act_vsub(act_vdiv(two, act_vadd(one, act_vexp(act_vmul(act_vset1(-2.0), act_vload(x+k))))), one));
+	for(; k<n; k++)
+		y[k]=2.0/(1.0+exp(-2.0*x[k]))-1.0;
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_relu(const nnc_real_t *x, nnc_real_t *y, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t v;
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN) {
+		v=act_vload(x+k);
+		act_vstore(y+k, act_vblend(v, act_vzero(), act_vltzero(v)));
+	}
+	for(; k<n; k++)
+		y[k]= x[k]<0 ? 0.0 : x[k];
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_prelu(const nnc_real_t *x, nnc_real_t *y, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t v, a=act_vset1(PRELU_A);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN) {
+		v=act_vload(x+k);
+		act_vstore(y+k, act_vblend(v, act_vmul(a, v), act_vltzero(v)));
+	}
+	for(; k<n; k++)
+		y[k]= x[k]<0 ? PRELU_A*x[k] : x[k];
+}
+
+/* Backward kernels, the tail by scalar loops as actfs_backward() */
+__attribute__((target("avx2,fma")))
+static void act_avx2_dsigmoid(const nnc_real_t *x, const nnc_real_t *y, const nnc_real_t *derr, nnc_real_t *g, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t f, one=act_vset1(1.0);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN) {
+		f=act_vload(y+k);
+		act_vstore(g+k, act_vmul(act_vload(derr+k), act_vmul(f, act_vsub(one, f))));
+	}
+	for(; k<n; k++)
+		g[k]=derr[k]*(y[k]*(1-y[k]));
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_dtansigmoid(const nnc_real_t *x, const nnc_real_t *y, const nnc_real_t *derr, nnc_real_t *g, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t f, one=act_vset1(1.0);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN) {
+		f=act_vload(y+k);
+		act_vstore(g+k, act_vmul(act_vload(derr+k), act_vsub(one, act_vmul(f, f))));
+	}
+	for(; k<n; k++)
+		g[k]=derr[k]*(2.0*(1-y[k]*y[k])/2.0);
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_drelu(const nnc_real_t *x, const nnc_real_t *y, const nnc_real_t *derr, nnc_real_t *g, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t one=act_vset1(1.0);
+
+	/* derr*0.0 as scalar loops, NOT 0.0 */
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN)
+		act_vstore(g+k, act_vmul(act_vload(derr+k), act_vblend(one, act_vzero(), act_vltzero(act_vload(x+k)))));
+	for(; k<n; k++)
+		g[k]= x[k]<0 ? derr[k]*0.0 : derr[k];
+}
+
+__attribute__((target("avx2,fma")))
+static void act_avx2_dprelu(const nnc_real_t *x, const nnc_real_t *y, const nnc_real_t *derr, nnc_real_t *g, unsigned long n)
+{
+	unsigned long k;
+	act_vec_t e, a=act_vset1(PRELU_A);
+
+	for(k=0; k+ACT_VLEN-1<n; k+=ACT_VLEN) {
+		e=act_vload(derr+k);
+		act_vstore(g+k, act_vblend(e, act_vmul(e, a), act_vltzero(act_vload(x+k))));
+	}
+	for(; k<n; k++)
+		g[k]= x[k]<0 ? derr[k]*PRELU_A : derr[k];
+}
+
+#endif /* ----- END: AVX2/FMA kernels ----- */
+
+
+/*----------------------------------------------------------------
+ * Note:
+ *	Select SIMD kernels as per CPUID, it runs once at startup.
+ *	If the CPU has no AVX2/FMA, or actfs_set_simd(false), the
+ *	scalar loops are used.
+-----------------------------------------------------------------*/
+#ifdef ACTFS_X86_SIMD
+__attribute__((constructor))
+#endif
+static void actfs_cpu_dispatch(void)
+{
+	memset(actfs_simd_forward, 0, sizeof(actfs_simd_forward));
+	memset(actfs_simd_backward, 0, sizeof(actfs_simd_backward));
+
+	if(!actfs_simd_allowed)
+		return;
+
+#ifdef ACTFS_X86_SIMD
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+		actfs_simd_forward[NNC_ACT_SIGMOID]=act_avx2_sigmoid;
+		actfs_simd_forward[NNC_ACT_TANSIGMOID]=act_avx2_tansigmoid;
+		actfs_simd_forward[NNC_ACT_RELU]=act_avx2_relu;
+		actfs_simd_forward[NNC_ACT_PRELU]=act_avx2_prelu;
+		actfs_simd_backward[NNC_ACT_SIGMOID]=act_avx2_dsigmoid;
+		actfs_simd_backward[NNC_ACT_TANSIGMOID]=act_avx2_dtansigmoid;
+		actfs_simd_backward[NNC_ACT_RELU]=act_avx2_drelu;
+		actfs_simd_backward[NNC_ACT_PRELU]=act_avx2_dprelu;
+	}
+#endif
+}
+
+/*---------------------------------------------
+ * Enable/disable SIMD kernels of actfs_forward()
+ * and actfs_backward(). Also see nnc_set_simd().
+@enable:	true to use the best kernels for the CPU
+Return:
+	true	SIMD kernels are in use
+	false	Scalar loops are in use
+---------------------------------------------*/
+bool actfs_set_simd(bool enable)
+{
+	actfs_simd_allowed=enable;
+	actfs_cpu_dispatch();
+
+	return actfs_simd_forward[NNC_ACT_RELU]!=NULL;
+}
@@ -13,14 +13,52 @@ Midas Zhou
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
+#include <stdbool.h>
+#include <float.h>
+
+/* Scalar type of all params and data, build with -DNNC_FLOAT32 for float32 */
+#ifdef NNC_FLOAT32
+typedef float	nnc_real_t;
+#define NNC_REAL_MIN	FLT_MIN	/* Min. normalized positive value */
+#define NNC_REAL_EPSILON	FLT_EPSILON
+#else
+typedef double	nnc_real_t;
+#define NNC_REAL_MIN	DBL_MIN
+#define NNC_REAL_EPSILON	DBL_EPSILON
+#endif
 
 #define DERIVATIVE_FUNC	1  /* to switch to derivative calculation in a function */
 #define NORMAL_FUNC	0
 
-double func_step(double x, double f, int token);
-double func_sigmoid(double x, double f, int token);
-double func_TanSigmoid(double x, double f, int token);
-double func_ReLU(double x, double f, int token);
-double func_PReLU(double x, double f, int token);
+nnc_real_t func_step(nnc_real_t x, nnc_real_t f, int token);
+nnc_real_t func_sigmoid(nnc_real_t x, nnc_real_t f, int token);
+nnc_real_t func_TanSigmoid(nnc_real_t x, nnc_real_t f, int token);
+nnc_real_t func_ReLU(nnc_real_t x, nnc_real_t f, int token);
+nnc_real_t func_PReLU(nnc_real_t x, nnc_real_t f, int token);
+
+/*-------------------------------------------------------
+Activation identifiers of the transfer functions above,
+for whole-array kernels actfs_forward()/actfs_backward().
+A transfunc pointer is mapped to its id ONCE per array,
+then the kernel runs without per-element calls.
+*------------------------------------------------------*/
+enum nnc_act_id {
+	NNC_ACT_NONE = 0,	/* transfunc is NULL: f(x)=x */
+	NNC_ACT_STEP,		/* func_step */
+	NNC_ACT_SIGMOID,	/* func_sigmoid */
+	NNC_ACT_TANSIGMOID,	/* func_TanSigmoid, as tanh */
+	NNC_ACT_RELU,		/* func_ReLU */
+	NNC_ACT_PRELU,		/* func_PReLU */
+	NNC_ACT_CUSTOM,		/* Any other transfunc, called per element */
+};
+
+typedef nnc_real_t (*nnc_transfunc_t)(nnc_real_t, nnc_real_t, int);
+
+int actfs_id(nnc_transfunc_t transfunc);
+nnc_transfunc_t actfs_func(int id);
+void actfs_forward(nnc_transfunc_t transfunc, const nnc_real_t *x, nnc_real_t *y, unsigned long n);
+void actfs_backward(nnc_transfunc_t transfunc, const nnc_real_t *x, const nnc_real_t *y,
+		    const nnc_real_t *derr, nnc_real_t *g, unsigned long n);
+bool actfs_set_simd(bool enable);
 
 #endif
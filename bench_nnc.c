@@ -0,0 +1,456 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Microbenchmarks of nnc kernels with synthetic data, NO dataset is needed.
+
+Usage:
+   make bench [FLOAT32=1]
+   ./bench_nnc [-t threads] [-s] [-m ms]
+	-t threads	Threads of the nnc pool, see nnc_set_threads(). Default 0.
+	-s		Scalar loops ONLY, see nnc_set_simd().
+	-m ms		Min. time to run each op, default 200ms.
+
+Report:
+   ns/op     Mean time of one call, after a warm-up call.
+   GFLOP/s   A multiply-add counts 2 flops; 2x2 pooling counts 3 compares
+	     per output, '-' if NO arithmetic.
+   KB/op     Bytes moved, as an estimate of the minimum memory traffic:
+	     each input read once, each output written once.
+   GB/s      KB/op over ns/op.
+
+Journal:
+2026-10-17: Create the file.
+2026-10-18: Add CONVKXK shapes.
+            Check fused conv3x3+maxpool2x2 by conv3x3_check_fusion() before timing it.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "nnc.h"
+#include "actfs.h"
+
+#define BENCH_MIN_MS	200	/* Default min. time to run each op */
+#ifdef NNC_FLOAT32
+#define FUSION_TOL	1.0e-5	/* Max. abs diff of fused v.s. layer by layer, see conv3x3_check_fusion() */
+#else
+#define FUSION_TOL	1.0e-12
+#endif
+
+/* Shapes of CONV3X3: nf, nchan, imw(=imh) */
+static const int conv_shapes[][3] = {
+	{ 8,  1, 28 },	/* As layer 1 of test_nnc4 */
+	{ 32, 8, 13 },	/* As layer 3 of test_nnc4 */
+	{ 16, 16, 32 },
+	{ 64, 32, 16 },
+	{ 64, 64, 8 },
+};
+
+/* Shapes of CONVKXK: nf, nchan, imw(=imh), ks, stride, pad */
+static const int kxk_shapes[][6] = {
+	{ 8,  1, 28, 3, 2, 1 },	/* Stride-2 downsampling, as layer 1 of test_nnc4 */
+	{ 32, 8, 14, 3, 2, 1 },
+	{ 64, 32, 16, 3, 2, 1 },
+	{ 16, 3, 32, 5, 1, 2 },
+};
+
+/* Shapes of NVCELLs layers: nin, nc */
+static const int dense_shapes[][2] = {
+	{ 800,  10 },	/* As the output layer of test_nnc4 */
+	{ 784,  128 },
+	{ 1024, 1024 },
+	{ 4096, 256 },
+};
+
+static const char *engine_names[] = { "direct", "im2col", "winograd", "nchwc" };
+
+static double min_ms=BENCH_MIN_MS;
+static int null_fd=-1, stdout_fd=-1;
+
+/* Time in ns */
+static double tm_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1.0e9+ts.tv_nsec;
+}
+
+/* Mute/unmute stdout, to hide messages of new_xxx() */
+static void mute_stdout(bool mute)
+{
+	fflush(stdout);
+	if(mute) {
+		if(null_fd<0)
+			null_fd=open("/dev/null", O_WRONLY);
+		if(stdout_fd<0)
+			stdout_fd=dup(STDOUT_FILENO);
+		if(null_fd>=0 && stdout_fd>=0)
+			dup2(null_fd, STDOUT_FILENO);
+	}
+	else if(stdout_fd>=0) {
+		dup2(stdout_fd, STDOUT_FILENO);
+	}
+}
+
+/* An op to time */
+typedef int (*bench_op_t)(void *arg);
+
+/*----------------------------------------------------
+ * Time an op, and print a line of the report.
+ * The number of calls doubles until they take min_ms.
+ * @name, @shape:  Printed as they are.
+ * @flops:	   Flops per call, 0 if NO arithmetic.
+ * @bytes:	   Bytes moved per call.
+----------------------------------------------------*/
+static void bench_run(const char *name, const char *shape, bench_op_t op, void *arg, double flops, double bytes)
+{
+	long k, n;
+	double t0, ns;
+	char gflops[16];
+
+	/* Warm-up, and check the op */
+	if(op(arg)!=0) {
+		printf("%-26s %-22s failed!\n", name, shape);
+		return;
+	}
+
+	for(n=1; ; n*=2) {
+		t0=tm_ns();
+		for(k=0; k<n; k++)
+			op(arg);
+		ns=tm_ns()-t0;
+		if(ns >= min_ms*1.0e6 || n >= (1L<<30))
+			break;
+	}
+	ns /= n;
+
+	if(flops > 0)
+		snprintf(gflops, sizeof(gflops), "%.2f", flops/ns);
+	else
+		snprintf(gflops, sizeof(gflops), "-");
+	printf("%-26s %-22s %12.0f %9s %10.1f %8.2f\n", name, shape, ns, gflops, bytes/1024.0, bytes/ns);
+}
+
+
+/* Ops */
+static int op_conv3x3_forward(void *arg)
+{
+	return conv3x3_feed_forward(arg);
+}
+
+static int op_conv3x3_backward(void *arg)
+{
+	return conv3x3_feed_backward(arg);
+}
+
+static int op_conv3x3_maxpool2x2_forward(void *arg)
+{
+	MAXPOOL2X2 *maxpool=arg;
+
+	return conv3x3_maxpool2x2_feed_forward(maxpool->inconv3x3, maxpool);
+}
+
+static int op_convkxk_forward(void *arg)
+{
+	return convkxk_feed_forward(arg);
+}
+
+static int op_convkxk_backward(void *arg)
+{
+	return convkxk_feed_backward(arg);
+}
+
+static int op_maxpool2x2_forward(void *arg)
+{
+	return maxpool2x2_feed_forward(arg);
+}
+
+static int op_maxpool2x2_backward(void *arg)
+{
+	return maxpool2x2_feed_backward(arg);
+}
+
+static int op_nvlayer_forward(void *arg)
+{
+	return nvlayer_feed_forward(arg);
+}
+
+static int op_nvnet_update(void *arg)
+{
+	/* A tiny rate, to keep params in range for long runs */
+	return nvnet_update_params(arg, 1.0e-12);
+}
+
+
+/* Fill data with values in [-0.5 0.5] */
+static void fill_data(nnc_real_t *data, unsigned long n)
+{
+	unsigned long k;
+
+	for(k=0; k<n; k++)
+		data[k]=random_btwone()-0.5;
+}
+
+
+/*----------------------------------------------------
+ * Bench CONV3X3/MAXPOOL2X2 of a shape, as a middle
+ * layer: with prederr, ReLU and bias.
+----------------------------------------------------*/
+static void bench_conv(int nf, int nchan, int imw)
+{
+	int k, engine;
+	int ow, oh, pw, ph;
+	char shape[32], name[32];
+	double sz=sizeof(nnc_real_t);
+	double insize, fsize, osize, psize, flops;
+	nnc_real_t *din, *perr, **prederr;
+	CONV3X3 *conv3;
+	MAXPOOL2X2 *maxpool;
+
+	/* 1. Create CONV3X3 and MAXPOOL2X2 */
+	din=malloc(nchan*imw*imw*sizeof(nnc_real_t));
+	perr=malloc(nchan*imw*imw*sizeof(nnc_real_t));
+	prederr=malloc(nchan*sizeof(nnc_real_t *));
+	if(din==NULL || perr==NULL || prederr==NULL) {
+		printf("%s: Fail to malloc data.\n", __func__);
+		exit(1);
+	}
+	for(k=0; k<nchan; k++)
+		prederr[k]=perr+k*imw*imw;
+	fill_data(din, nchan*imw*imw);
+
+	mute_stdout(true);
+	conv3=new_conv3x3(nf, nchan, imw, imw, din, true);
+	maxpool= conv3 ? new_maxpool2x2(conv3, 0, 0, 0, NULL) : NULL;
+	mute_stdout(false);
+	if(conv3==NULL || maxpool==NULL) {
+		printf("%s: Fail to create conv3x3/maxpool2x2.\n", __func__);
+		exit(1);
+	}
+	conv3->transfunc=func_ReLU;
+	conv3->prederr=prederr;
+	conv3x3_rand_params(conv3);
+	fill_data(conv3->derr[0], nf*conv3->ow*conv3->oh);
+	fill_data(maxpool->derr[0], nf*maxpool->ow*maxpool->oh);
+
+	ow=conv3->ow; oh=conv3->oh;
+	pw=maxpool->ow; ph=maxpool->oh;
+	insize=nchan*imw*imw;
+	fsize=nf*(nchan*9+1);
+	osize=nf*ow*oh;
+	psize=nf*pw*ph;
+	flops=2.0*nf*nchan*9*ow*oh;
+	snprintf(shape, sizeof(shape), "%dx%dx%d->%dx%dx%d", nchan, imw, imw, nf, ow, oh);
+
+	/* 2. CONV3X3 feed forward: read din/fparams, write dsums/douts */
+	for(engine=CONV3X3_ENGINE_DIRECT; engine<=CONV3X3_ENGINE_NCHWC; engine++) {
+		if(conv3x3_set_engine(conv3, engine)!=0)
+			continue;
+		snprintf(name, sizeof(name), "conv3x3_fwd/%s", engine_names[engine]);
+		bench_run(name, shape, op_conv3x3_forward, conv3, flops, (insize+fsize+2*osize)*sz);
+	}
+
+	/* 3. CONV3X3 feed backward: read din/fparams/dsums/douts/derr, write dFP/prederr
+	 *    W*derr and din*derr: 2x flops of feed forward. Winograd is for feed forward ONLY.
+	 */
+	for(engine=CONV3X3_ENGINE_DIRECT; engine<=CONV3X3_ENGINE_NCHWC; engine++) {
+		if(engine==CONV3X3_ENGINE_WINOGRAD)
+			continue;
+		conv3x3_set_engine(conv3, engine);
+		conv3x3_feed_forward(conv3);
+		snprintf(name, sizeof(name), "conv3x3_bwd/%s", engine_names[engine]);
+		bench_run(name, shape, op_conv3x3_backward, conv3, 2*flops, (2*insize+2*fsize+3*osize)*sz);
+	}
+
+	/* 4. Fused CONV3X3+MAXPOOL2X2 feed forward, training: dsums/douts are written as well.
+	 *    Check it against layer by layer first.
+	 */
+	conv3x3_set_engine(conv3, CONV3X3_ENGINE_DIRECT);
+	if( conv3x3_check_fusion(conv3, maxpool, FUSION_TOL)!=0 )
+		exit(1);
+	bench_run("conv3x3_maxpool2x2_fwd", shape, op_conv3x3_maxpool2x2_forward, maxpool,
+			flops+3.0*psize, (insize+fsize+2*osize+psize)*sz+psize);
+
+	/* 5. MAXPOOL2X2: read conv douts, write douts/argmax, and the reverse */
+	snprintf(shape, sizeof(shape), "%dx%dx%d->%dx%dx%d", nf, ow, oh, nf, pw, ph);
+	conv3x3_feed_forward(conv3);
+	bench_run("maxpool2x2_fwd", shape, op_maxpool2x2_forward, maxpool, 3.0*psize, (osize+psize)*sz+psize);
+	bench_run("maxpool2x2_bwd", shape, op_maxpool2x2_backward, maxpool, 0, (osize+psize)*sz+psize);
+
+	conv3->prederr=NULL;
+	free_maxpool2x2(maxpool);
+	free_conv3x3(conv3);
+	free(prederr);
+	free(perr);
+	free(din);
+}
+
+
+/*----------------------------------------------------
+ * Bench CONVKXK of a shape, as a middle layer: with
+ * prederr, ReLU and bias.
+----------------------------------------------------*/
+static void bench_convkxk(int nf, int nchan, int imw, int ks, int stride, int pad)
+{
+	int k;
+	char shape[32];
+	double sz=sizeof(nnc_real_t);
+	double insize, fsize, osize, csize, flops;
+	nnc_real_t *din, *perr, **prederr;
+	CONVKXK *convk;
+
+	/* 1. Create CONVKXK */
+	din=malloc(nchan*imw*imw*sizeof(nnc_real_t));
+	perr=malloc(nchan*imw*imw*sizeof(nnc_real_t));
+	prederr=malloc(nchan*sizeof(nnc_real_t *));
+	if(din==NULL || perr==NULL || prederr==NULL) {
+		printf("%s: Fail to malloc data.\n", __func__);
+		exit(1);
+	}
+	for(k=0; k<nchan; k++)
+		prederr[k]=perr+k*imw*imw;
+	fill_data(din, nchan*imw*imw);
+
+	mute_stdout(true);
+	convk=new_convkxk(nf, nchan, imw, imw, ks, stride, pad, din, true);
+	mute_stdout(false);
+	if(convk==NULL) {
+		printf("%s: Fail to create convkxk.\n", __func__);
+		exit(1);
+	}
+	convk->transfunc=func_ReLU;
+	convk->prederr=prederr;
+	convkxk_rand_params(convk);
+	fill_data(convk->derr[0], nf*convk->ow*convk->oh);
+
+	insize=nchan*imw*imw;
+	fsize=nf*(nchan*ks*ks+1);
+	osize=nf*convk->ow*convk->oh;
+	csize=nchan*ks*ks*convk->ow*convk->oh;
+	flops=2.0*nf*nchan*ks*ks*convk->ow*convk->oh;
+	snprintf(shape, sizeof(shape), "%dx%dx%d->%dx%dx%d/k%ds%dp%d", nchan, imw, imw, nf, convk->ow, convk->oh,
+			ks, stride, pad);
+
+	/* 2. Feed forward: read din/fparams, write cols and dsums/douts */
+	bench_run("convkxk_fwd", shape, op_convkxk_forward, convk, flops, (insize+fsize+csize+2*osize)*sz);
+
+	/* 3. Feed backward: read cols/fparams/dsums/douts/derr, write dFP/prederr. 2x flops of feed forward */
+	convkxk_feed_forward(convk);
+	bench_run("convkxk_bwd", shape, op_convkxk_backward, convk, 2*flops, (2*csize+2*fsize+3*osize+insize)*sz);
+
+	convk->prederr=NULL;
+	free_convkxk(convk);
+	free(prederr);
+	free(perr);
+	free(din);
+}
+
+
+/*----------------------------------------------------
+ * Bench a NVCELLs layer of a shape, in a NVNET of
+ * the ONLY layer.
+----------------------------------------------------*/
+static void bench_dense(int nin, int nc)
+{
+	int j;
+	char shape[32];
+	double sz=sizeof(nnc_real_t);
+	double npa=(nin+1.0)*nc;
+	nnc_real_t *din;
+	NVCELL *tcell;
+	NVLAYER *layer;
+	NVNET *nnet;
+
+	/* 1. Create the NVNET */
+	din=malloc(nin*sizeof(nnc_real_t));
+	if(din==NULL) {
+		printf("%s: Fail to malloc din.\n", __func__);
+		exit(1);
+	}
+	fill_data(din, nin);
+
+	mute_stdout(true);
+	tcell=new_nvcell(nin, NULL, din, NULL, 0, func_ReLU);
+	layer= tcell ? new_nvlayer(nc, tcell, false) : NULL;
+	nnet=new_nvnet(1);
+	mute_stdout(false);
+	if(layer==NULL || nnet==NULL) {
+		printf("%s: Fail to create the nvnet.\n", __func__);
+		exit(1);
+	}
+	nnet->nvlayers[0]=layer;
+	if(nvnet_init_params(nnet)!=0) {
+		printf("%s: Fail to init params.\n", __func__);
+		exit(1);
+	}
+	for(j=0; j<nc; j++)
+		layer->nvcells[j]->derr=random_btwone()-0.5;
+
+	snprintf(shape, sizeof(shape), "%d->%d", nin, nc);
+
+	/* 2. Feed forward: read din/dw/dv, write douts */
+	bench_run("nvlayer_fwd", shape, op_nvlayer_forward, layer, 2.0*nin*nc, (nin+npa+nc)*sz);
+
+	/* 3. Update params: read din/derr, read and write dw/dv */
+	bench_run("nvnet_update_params", shape, op_nvnet_update, nnet, 2.0*npa, (nin+nc+2*npa)*sz);
+
+	free_nvcell(tcell);
+	free_nvnet(nnet);
+	free(din);
+}
+
+
+int main(int argc, char **argv)
+{
+	int i, opt;
+	int nth=0;
+	bool simd=true;
+
+	while( (opt=getopt(argc, argv, "t:sm:")) != -1 ) {
+		switch(opt) {
+		case 't':
+			nth=atoi(optarg);
+			break;
+		case 's':
+			simd=false;
+			break;
+		case 'm':
+			min_ms=atof(optarg);
+			break;
+		default:
+			printf("Usage: %s [-t threads] [-s] [-m ms]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	nnc_set_seed(2026);
+	nnc_set_simd(simd);
+	if(nnc_set_threads(nth)<0)
+		exit(1);
+
+	printf("nnc_real_t: %s, SIMD: %s, threads: %d, min. %.0fms per op\n\n",
+		sizeof(nnc_real_t)==sizeof(float) ? "float32" : "double", simd ? "auto" : "off", nth, min_ms);
+	printf("%-26s %-22s %12s %9s %10s %8s\n", "op", "shape", "ns/op", "GFLOP/s", "KB/op", "GB/s");
+
+	for(i=0; i< (int)(sizeof(conv_shapes)/sizeof(conv_shapes[0])); i++)
+		bench_conv(conv_shapes[i][0], conv_shapes[i][1], conv_shapes[i][2]);
+
+	for(i=0; i< (int)(sizeof(kxk_shapes)/sizeof(kxk_shapes[0])); i++)
+		bench_convkxk(kxk_shapes[i][0], kxk_shapes[i][1], kxk_shapes[i][2],
+			      kxk_shapes[i][3], kxk_shapes[i][4], kxk_shapes[i][5]);
+
+	for(i=0; i< (int)(sizeof(dense_shapes)/sizeof(dense_shapes[0])); i++)
+		bench_dense(dense_shapes[i][0], dense_shapes[i][1]);
+
+	nnc_set_threads(0);
+	return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Compare float32 and double training curves of a test app, as mean_err of the first N epochs.
+# Usage: ./cmpreal.sh [TEST_NAME] [N] [RTOL] [ATOL]
+#	 Default: test_nnc4, 3 epochs, relative tolerance 0.05, absolute tolerance 1e-5
+#	 An epoch fails if |double-float| > ATOL+RTOL*|double|, ATOL for mean_err near 0.
+
+TEST_NAME=${1:-test_nnc4}
+NEPOCH=${2:-3}
+RTOL=${3:-0.05}
+ATOL=${4:-1e-5}
+
+# Build each variant in its own temp copy of the sources, the objects and binaries of this tree are kept.
+# Curves are saved there as well.
+BUILD_DIR=$(mktemp -d /tmp/cmpreal.XXXXXX) || exit 1
+trap 'rm -rf $BUILD_DIR' EXIT
+for REAL in double float; do
+	mkdir -p $BUILD_DIR/$REAL
+	cp *.c *.h Makefile $BUILD_DIR/$REAL/
+	if [ $REAL = float ]; then FLAGS="FLOAT32=1"; else FLAGS=""; fi
+	make -C $BUILD_DIR/$REAL test TEST_NAME=$TEST_NAME $FLAGS >/dev/null || exit 1
+	# Run in the current directory, for data files of the test app.
+	$BUILD_DIR/$REAL/$TEST_NAME | grep "^Epoch" | head -n $NEPOCH > $BUILD_DIR/$REAL.txt
+done
+
+paste -d' ' $BUILD_DIR/double.txt $BUILD_DIR/float.txt | \
+awk -v rtol=$RTOL -v atol=$ATOL '
+{
+	for(i=1; i<=NF; i++) if($i ~ /^mean_err=/) { split($i, a, "="); v[++n]=a[2]; }
+	d=v[1]-v[2]; if(d<0) d=-d;
+	m=v[1]; if(m<0) m=-m;
+	printf("Epoch %d: double=%s, float=%s, abs_diff=%e\n", NR, v[1], v[2], d);
+	if(d > atol+rtol*m) fail=1;
+	n=0;
+}
+END {
+	if(NR==0) { print "No epoch output!"; exit 1; }
+	if(fail) { print "FAIL: float and double curves differ beyond atol " atol " + rtol " rtol; exit 1; }
+	print "OK: float and double curves within atol " atol " + rtol " rtol;
+}'
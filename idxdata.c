@@ -0,0 +1,399 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Read IDX data files(MNIST database), see idxdata.h for the file format.
+
+Note:
+1. The file is mmaped, items are accessed in place as uint8 data.
+   Feed them to a nvnet by nvnet_set_input_u8(), and the first
+   layer normalizes them, NO copy of each sample into a real buffer.
+2. For training, an IDXFEEDER prefetches normalized batches in a
+   producer thread, then the consumer points the first layer to
+   a sample by nvnet_set_input(), NOT by copy.
+
+Journal:
+2026-10-17:
+   1. Create new_idxdata(), free_idxdata(), idxdata_item(), idxdata_item_real().
+   2. Add IDXFEEDER: new_idxfeeder(), free_idxfeeder(), idxfeeder_next().
+   3. new_idxfeeder(): Add param 'sampler' to shuffle items for each epoch.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include "idxdata.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <endian.h>
+
+
+/*-----------------------------------------------------------------
+ * Open and mmap an IDX data file, then check its header.
+ * Params:
+ *	@fpath	Path of the IDX file.
+ * Return:
+ *	Pointer to IDXDATA	OK
+ *	NULL			Fails
+-----------------------------------------------------------------*/
+IDXDATA *new_idxdata(const char *fpath)
+{
+	int i;
+	IDXDATA *idx;
+	struct stat sb;
+	const uint8_t *hdr;
+	unsigned long hsize, dsize;
+
+	if(fpath==NULL)
+		return NULL;
+
+	idx=calloc(1, sizeof(IDXDATA));
+	if(idx==NULL)
+		return NULL;
+	idx->addr=MAP_FAILED;
+
+	/* 1. Open and mmap the file */
+	idx->fd=open(fpath, O_RDONLY);
+	if(idx->fd<0) {
+		printf("%s: Fail to open '%s'!\n", __func__, fpath);
+		goto FAIL;
+	}
+	if( fstat(idx->fd, &sb)<0 || sb.st_size<4 ) {
+		printf("%s: Invalid file '%s'!\n", __func__, fpath);
+		goto FAIL;
+	}
+	idx->mapsize=sb.st_size;
+	idx->addr=mmap(NULL, idx->mapsize, PROT_READ, MAP_PRIVATE, idx->fd, 0);
+	if(idx->addr==MAP_FAILED) {
+		printf("%s: Fail to mmap '%s'!\n", __func__, fpath);
+		perror("mmap");
+		goto FAIL;
+	}
+	hdr=idx->addr;
+
+	/* 2. Check magic number */
+	if(hdr[0]!=0 || hdr[1]!=0) {
+		printf("%s: '%s' is NOT an IDX file!\n", __func__, fpath);
+		goto FAIL;
+	}
+	if(hdr[2]!=IDX_TYPE_UBYTE) {
+		printf("%s: '%s' data type 0x%02x is NOT supported, ONLY unsigned byte!\n", __func__, fpath, hdr[2]);
+		goto FAIL;
+	}
+	idx->ndims=hdr[3];
+	if(idx->ndims==0 || idx->ndims>IDX_MAXDIMS) {
+		printf("%s: '%s' ndims=%d is NOT supported!\n", __func__, fpath, idx->ndims);
+		goto FAIL;
+	}
+	hsize=4+4*idx->ndims;
+	if(idx->mapsize < hsize) {
+		printf("%s: '%s' is too short!\n", __func__, fpath);
+		goto FAIL;
+	}
+
+	/* 3. Dimensions, in big endian */
+	idx->itemsize=1;
+	for(i=0; i< idx->ndims; i++) {
+		idx->dims[i]=be32toh( *(const uint32_t *)(hdr+4+4*i) );
+		if(i>0)
+			idx->itemsize *= idx->dims[i];
+	}
+	idx->count=idx->dims[0];
+
+	/* 4. Check size of data */
+	dsize=(unsigned long)idx->count*idx->itemsize;
+	if(idx->itemsize==0 || idx->mapsize-hsize < dsize) {
+		printf("%s: '%s' has %lu bytes of data, but needs %u*%u bytes!\n",
+				__func__, fpath, idx->mapsize-hsize, idx->count, idx->itemsize);
+		goto FAIL;
+	}
+	idx->data=hdr+hsize;
+
+	return idx;
+
+FAIL:
+	free_idxdata(idx);
+	return NULL;
+}
+
+
+/*-------------------------------------------------
+	Unmap and close an IDX data file.
+--------------------------------------------------*/
+void free_idxdata(IDXDATA *idx)
+{
+	if(idx==NULL)
+		return;
+
+	if(idx->addr!=MAP_FAILED && idx->addr!=NULL)
+		munmap(idx->addr, idx->mapsize);
+	if(idx->fd>=0)
+		close(idx->fd);
+
+	free(idx);
+}
+
+
+/*-------------------------------------------------
+ * Get item k of IDX data, in place.
+ * Return:
+ *	Pointer to itemsize uint8 data	OK
+ *	NULL				k out of range
+--------------------------------------------------*/
+const uint8_t *idxdata_item(const IDXDATA *idx, unsigned int k)
+{
+	if(idx==NULL || k >= idx->count)
+		return NULL;
+
+	return idx->data+(unsigned long)k*idx->itemsize;
+}
+
+
+/*-------------------------------------------------
+ * Copy item k of IDX data to real data,
+ * normalized as dout[i]=item[i]*scale. For
+ * buffering data, or a nvnet_feed_forward_batch().
+ * Params:
+ *	@dout	To pass out data, size itemsize.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+--------------------------------------------------*/
+int idxdata_item_real(const IDXDATA *idx, unsigned int k, nnc_real_t scale, nnc_real_t *dout)
+{
+	unsigned int i;
+	const uint8_t *item;
+
+	item=idxdata_item(idx, k);
+	if(item==NULL || dout==NULL)
+		return -1;
+
+	for(i=0; i< idx->itemsize; i++)
+		dout[i]=item[i]*scale;
+
+	return 0;
+}
+
+
+/*-------------------------------------------------
+ * Fill a slot of the feeder with the next batch,
+ * a batch does NOT cross the end of an epoch.
+ * Called by the producer thread, out of the lock.
+--------------------------------------------------*/
+static void idxfeeder_fill(IDXFEEDER *feeder, int slot, unsigned int next, unsigned int n)
+{
+	unsigned int i, k;
+	unsigned int isize=feeder->images->itemsize;
+	nnc_real_t *din=feeder->din+(unsigned long)slot*feeder->nb*isize;
+	nnc_real_t *tv=feeder->tv+(unsigned long)slot*feeder->nb*feeder->nclass;
+	uint8_t label;
+
+	for(i=0; i<n; i++) {
+		k=feeder->first+ (feeder->order ? feeder->order[next+i] : next+i);
+		idxdata_item_real(feeder->images, k, feeder->scale, din+i*isize);
+		if(feeder->labels) {
+			memset(tv+i*feeder->nclass, 0, feeder->nclass*sizeof(nnc_real_t));
+			label=*idxdata_item(feeder->labels, k);
+			if(label < feeder->nclass)
+				tv[i*feeder->nclass+label]=1.0;
+		}
+	}
+}
+
+/*-------------------------------------------------
+	The producer thread of a feeder.
+--------------------------------------------------*/
+static void *idxfeeder_worker(void *arg)
+{
+	IDXFEEDER *feeder=arg;
+	int slot;
+	unsigned int next, n;
+
+	pthread_mutex_lock(&feeder->lock);
+	while(1) {
+		/* Wait for an empty slot, one is held by the consumer */
+		while( !feeder->quit && feeder->nfull+(feeder->held>=0) >= feeder->nslot )
+			pthread_cond_wait(&feeder->cond_empty, &feeder->lock);
+		if(feeder->quit)
+			break;
+
+		slot=feeder->head;
+		next=feeder->next;
+		n= feeder->count-next < feeder->nb ? feeder->count-next : feeder->nb;
+		pthread_mutex_unlock(&feeder->lock);
+
+		/* Shuffle for a new epoch, batches of the last epoch are all filled */
+		if(next==0 && feeder->sampler)
+			feeder->order=nvsampler_next_epoch(feeder->sampler);
+
+		idxfeeder_fill(feeder, slot, next, n);
+
+		pthread_mutex_lock(&feeder->lock);
+		feeder->ns[slot]=n;
+		feeder->head=(slot+1)%feeder->nslot;
+		feeder->next= next+n < feeder->count ? next+n : 0;
+		feeder->nfull++;
+		pthread_cond_signal(&feeder->cond_full);
+	}
+	pthread_mutex_unlock(&feeder->lock);
+
+	return NULL;
+}
+
+
+/*-----------------------------------------------------------------
+ * Create a feeder, and start its producer thread.
+ * Params:
+ *	@images	 IDX input data, as MNIST images.
+ *	@labels	 IDX labels for one-hot targets, NULL for NO targets.
+ *	@first	 Index of the first item.
+ *	@count	 Number of items in an epoch, from first.
+ *	@nb	 Max. number of samples in a batch.
+ *	@nclass	 Size of a one-hot target, labels MUST be less than it.
+ *	@scale	 To normalize items: din=item*scale.
+ *	@nslot	 Number of slots in the ring, 2 for double buffering.
+ *	@sampler To shuffle items for each epoch, its count MUST be the same as count.
+ *		 NULL for file order. It's used by the producer thread, free it after the feeder.
+ * Return:
+ *	Pointer to IDXFEEDER	OK
+ *	NULL			Fails
+-----------------------------------------------------------------*/
+IDXFEEDER *new_idxfeeder(const IDXDATA *images, const IDXDATA *labels, unsigned int first, unsigned int count,
+			 unsigned int nb, unsigned int nclass, nnc_real_t scale, int nslot, NVSAMPLER *sampler)
+{
+	IDXFEEDER *feeder;
+	unsigned long dsize, tsize;
+
+	if(images==NULL || count==0 || nb==0 || nslot<2)
+		return NULL;
+	if( (unsigned long)first+count > images->count || (labels && ((unsigned long)first+count > labels->count || nclass==0)) ) {
+		printf("%s: Items out of range!\n", __func__);
+		return NULL;
+	}
+	if(sampler && sampler->count!=count) {
+		printf("%s: Count of the sampler is NOT the same as count!\n", __func__);
+		return NULL;
+	}
+
+	feeder=calloc(1, sizeof(IDXFEEDER));
+	if(feeder==NULL)
+		return NULL;
+
+	feeder->images=images;
+	feeder->labels=labels;
+	feeder->first=first;
+	feeder->count=count;
+	feeder->nb=nb;
+	feeder->nclass= labels ? nclass : 0;
+	feeder->scale=scale;
+	feeder->nslot=nslot;
+	feeder->sampler=sampler;
+	feeder->held=-1;
+
+	/* Slots, locked in RAM so the consumer never waits for swapping. It's OK if NOT allowed. */
+	dsize=(unsigned long)nslot*nb*images->itemsize*sizeof(nnc_real_t);
+	tsize=(unsigned long)nslot*nb*feeder->nclass*sizeof(nnc_real_t);
+	if( posix_memalign((void **)&feeder->din, 64, dsize+tsize) !=0 ) {
+		feeder->din=NULL;
+		goto FAIL;
+	}
+	mlock(feeder->din, dsize+tsize);
+	feeder->tv=feeder->din+dsize/sizeof(nnc_real_t);
+	feeder->ns=calloc(nslot, sizeof(unsigned int));
+	if(feeder->ns==NULL)
+		goto FAIL;
+
+	pthread_mutex_init(&feeder->lock, NULL);
+	pthread_cond_init(&feeder->cond_full, NULL);
+	pthread_cond_init(&feeder->cond_empty, NULL);
+	if( pthread_create(&feeder->thread, NULL, idxfeeder_worker, feeder) !=0 ) {
+		printf("%s: Fail to create the producer thread!\n", __func__);
+		pthread_mutex_destroy(&feeder->lock);
+		pthread_cond_destroy(&feeder->cond_full);
+		pthread_cond_destroy(&feeder->cond_empty);
+		goto FAIL;
+	}
+
+	return feeder;
+
+FAIL:
+	free(feeder->ns);
+	free(feeder->din);
+	free(feeder);
+	return NULL;
+}
+
+
+/*-------------------------------------------------
+	Stop the producer thread and free a feeder.
+--------------------------------------------------*/
+void free_idxfeeder(IDXFEEDER *feeder)
+{
+	if(feeder==NULL)
+		return;
+
+	pthread_mutex_lock(&feeder->lock);
+	feeder->quit=true;
+	pthread_cond_broadcast(&feeder->cond_empty);
+	pthread_mutex_unlock(&feeder->lock);
+	pthread_join(feeder->thread, NULL);
+
+	pthread_mutex_destroy(&feeder->lock);
+	pthread_cond_destroy(&feeder->cond_full);
+	pthread_cond_destroy(&feeder->cond_empty);
+
+	munlock(feeder->din, (unsigned long)feeder->nslot*feeder->nb*(feeder->images->itemsize+feeder->nclass)*sizeof(nnc_real_t));
+	free(feeder->din);
+	free(feeder->ns);
+	free(feeder);
+}
+
+
+/*-----------------------------------------------------------------
+ * Get the next batch of a feeder, batches go in order of items(OR
+ * as shuffled by the sampler), and restart after an epoch.
+ * The slot of the last batch is released to the producer, so
+ * data of the last batch are NOT valid any more.
+ * Params:
+ *	@din	To pass out input data of the batch, din[n*itemsize].
+ *	@tv	To pass out one-hot targets, tv[n*nclass]. Or NULL.
+ * Return:
+ *	n>0	Number of samples in the batch.
+ *	0	Fails
+-----------------------------------------------------------------*/
+unsigned int idxfeeder_next(IDXFEEDER *feeder, const nnc_real_t **din, const nnc_real_t **tv)
+{
+	int slot;
+
+	if(feeder==NULL || din==NULL)
+		return 0;
+
+	pthread_mutex_lock(&feeder->lock);
+
+	/* Release the last slot */
+	if(feeder->held>=0) {
+		feeder->held=-1;
+		pthread_cond_signal(&feeder->cond_empty);
+	}
+
+	/* Wait for a filled slot */
+	while(feeder->nfull==0)
+		pthread_cond_wait(&feeder->cond_full, &feeder->lock);
+
+	slot=feeder->tail;
+	feeder->tail=(slot+1)%feeder->nslot;
+	feeder->nfull--;
+	feeder->held=slot;
+
+	pthread_mutex_unlock(&feeder->lock);
+
+	*din=feeder->din+(unsigned long)slot*feeder->nb*feeder->images->itemsize;
+	if(tv)
+		*tv=feeder->tv+(unsigned long)slot*feeder->nb*feeder->nclass;
+
+	return feeder->ns[slot];
+}
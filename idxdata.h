@@ -0,0 +1,99 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#ifndef __IDXDATA_H__
+#define __IDXDATA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "nnc.h"	/* nnc_real_t, NVSAMPLER */
+
+typedef struct idx_data IDXDATA;
+typedef struct idx_feeder IDXFEEDER;
+
+/*-------------------------------------------------------
+IDX file format, as MNIST database, in big endian:
+
+   [offset]   [type]          [description]
+   0000       uint8 0, 0      magic number, the first 2 bytes are 0
+   0002       uint8           data type, 0x08 for unsigned byte
+   0003       uint8           number of dimensions, ndims
+   0004       uint32[ndims]   size of each dimension, dims[0] is number of items
+   4+4*ndims  data            items, row-major
+
+Example:
+   train-images.idx3-ubyte:  magic 0x00000803, dims 60000x28x28
+   train-labels.idx1-ubyte:  magic 0x00000801, dims 60000
+*------------------------------------------------------*/
+#define IDX_TYPE_UBYTE		0x08	/* The ONLY data type supported */
+#define IDX_MAXDIMS		4
+
+struct idx_data
+{
+	int fd;				/* File descriptor */
+	void *addr;			/* mmap address of the whole file */
+	unsigned long mapsize;		/* Size of the file */
+
+	unsigned int ndims;		/* Number of dimensions */
+	unsigned int dims[IDX_MAXDIMS];	/* Size of each dimension */
+	unsigned int count;		/* Number of items, as dims[0] */
+	unsigned int itemsize;		/* Number of values in an item, as dims[1]*dims[2]*..., 1 for labels */
+
+	const uint8_t *data;		/* Items, item k at data+k*itemsize. In the mmaped file, read only */
+};
+
+/*-------------------------------------------------------
+A feeder prefetches batches of IDX items for training:
+a producer thread normalizes items(and makes one-hot
+targets from labels) into a ring of slots, while the
+consumer trains with the batch of the slot it holds.
+Items go in file order, OR in a shuffled order for each
+epoch by a NVSAMPLER.
+*------------------------------------------------------*/
+struct idx_feeder
+{
+	const IDXDATA *images;		/* Input data */
+	const IDXDATA *labels;		/* Labels for one-hot targets, NULL for NO targets */
+	unsigned int first, count;	/* Items [first, first+count) for an epoch */
+	unsigned int nb;		/* Max. number of samples in a batch */
+	unsigned int nclass;		/* Size of a one-hot target */
+	nnc_real_t scale;		/* din=item*scale */
+	NVSAMPLER *sampler;		/* Shuffles items for each epoch, NULL for file order. Used by the producer only */
+	const unsigned int *order;	/* Order of items of the current epoch, from the sampler */
+
+	int nslot;			/* Number of slots in the ring, >=2 */
+	nnc_real_t *din;		/* din[nslot][nb*images->itemsize], 64 bytes aligned, locked in RAM if allowed */
+	nnc_real_t *tv;			/* tv[nslot][nb*nclass] */
+	unsigned int *ns;		/* ns[nslot], number of samples in a slot */
+
+	/* Ring state, protected by lock */
+	int head;			/* Next slot to fill */
+	int tail;			/* Next slot to consume */
+	int nfull;			/* Number of filled slots, NOT including the one held by the consumer */
+	int held;			/* Slot held by the consumer, -1 if none */
+	unsigned int next;		/* Next item to fill, offset from first */
+	bool quit;
+
+	pthread_t thread;		/* Producer thread */
+	pthread_mutex_t lock;
+	pthread_cond_t cond_full;	/* Signaled when a slot is filled */
+	pthread_cond_t cond_empty;	/* Signaled when a slot is released */
+};
+
+IDXDATA *new_idxdata(const char *fpath);
+void free_idxdata(IDXDATA *idx);
+const uint8_t *idxdata_item(const IDXDATA *idx, unsigned int k);
+int idxdata_item_real(const IDXDATA *idx, unsigned int k, nnc_real_t scale, nnc_real_t *dout);
+
+IDXFEEDER *new_idxfeeder(const IDXDATA *images, const IDXDATA *labels, unsigned int first, unsigned int count,
+			 unsigned int nb, unsigned int nclass, nnc_real_t scale, int nslot, NVSAMPLER *sampler);
+void free_idxfeeder(IDXFEEDER *feeder);
+unsigned int idxfeeder_next(IDXFEEDER *feeder, const nnc_real_t **din, const nnc_real_t **tv);
+
+#endif
@@ -37,14 +37,19 @@ Stochastic Gradient Descent ( SGD, Online-learning )
   Advantage:     Each nvCell can freely wires/connects its pincell/pdin to any nvCells.
   Disadvantage:  Not suitable for parallel matrix/tensor operations/compuations.
 
+  Tensor mode:   A nvlayer created by new_nvlayer() with a template cell has all nvcells
+		 sharing the same incells/din, after nvnet_pack_params() their dw[]/dv are
+		 packed as W[nc][nin+1] and the layer runs as ONE GEMV. see nvlayer_check_dense().
+
 
 TODO:
-1. Store and deploy model.
+1. Store and deploy model.  ---OK, nvnet_save() and nvnet_load(), see nvmodel.c
 2. XXX For multiply output, change mean loss function !!  ---OK, Apply nvlayer->transfunc
 3. Batch training:
    In nvnet_accum_dparams(): accumulate all accdw[k] -= rate*xxx, accfparams[n][j*3+k] -= rate*xxx
   	aacdw[] coupling with preCell->dout AND thisCell->derr, so can NOT accumlate derr ONLY.
    In nvnet_update_params(): update all dw[k] += accdw[k], fparams[n][j*3+k] +=accfparams[n][j*3+k],....
+   ---OK, nvnet_accum_dparams() and nvnet_apply_dparams(), with NVNET_ARENA_ACCUM.
 4. Feed back from conv3x3/maxpool to NVCells layer, how to apply prederr?
 
 Note:
@@ -89,6 +94,17 @@ XXX 2. Sometimes the err increases monotonously and NERVER converge, it's
    It's necessary to adjust the resolution to certain level before training, after cutting redundant data it still
    retains needed features and helps to speed up training process.
 
+9. All trainable params of a NVNET are kept in ONE parameter arena, see nvnet_pack_params().
+   It's allocated in nvnet_init_params(), so create and link all nvlayers before calling it,
+   and do NOT replace nvlayers of the nvnet after that.
+
+10. Mini-batch training:
+	for each sample in the batch:
+		nvnet_feed_forward(); nvnet_feed_backward(); nvnet_accum_dparams();
+	nvnet_apply_dparams(nnet, rate);
+   Gradients are averaged over the batch, so rate may be bigger than that of per-sample updating.
+   With multiple cores, nvtrainer_train_batch() runs shards of the batch on replicas of the nvnet.
+
 
 
 Journal:
@@ -154,6 +170,66 @@ Journal:
    1. Add conv3x3 memeber 'dsums' and 'transfunc'
    2. Modify conv3x3 functions accordingly:
       new_conv3x3(), free_conv3x3(), conv3x3_feed_forward(), conv3x3_feed_backward()
+2026-10-17:
+   1. Add NVNET parameter arena 'parena', and nvnet_pack_params().
+      All NVCELL dw[]/dv and CONV3X3 fparams/dvs/dFP/dferr are sliced from it, nnet->mmts is also inside.
+   2. NVCELL 'dv' changed to a pointer, as &dw[nin].
+   3. new_conv3x3(): Allocate fparams, dFP and derr flatten-friendly.
+      new_maxpool2x2(): Allocate derr flatten-friendly.
+   4. nvnet_buff_params()/nvnet_restore_params(): memcpy params from/to the arena.
+   5. Add NVLAYER members 'dense' and 'dins' for tensor mode.
+   6. Add nvlayer_dense_feed_forward(), nvlayer_dense_feed_backward(), nvlayer_dense_update_params(),
+      nvlayer_feed_forward()/nvlayer_feed_backward()/nvnet_update_params() call them for tensor mode layers.
+   7. Add CONV3X3 members 'engine','cols','gout','dcols', and conv3x3_set_engine().
+   8. Add CONV3X3_ENGINE_IM2COL: conv3x3_im2col_feed_forward(), conv3x3_im2col_feed_backward().
+   9. Add AVX2/FMA kernels for CONV3X3 direct engine, selected at startup by nnc_cpu_dispatch().
+  10. Add nnc_set_simd().
+  11. Add CONV3X3_ENGINE_WINOGRAD: conv3x3_winograd_feed_forward(), and conv3x3_check_winograd().
+  12. Add NVNET_ARENA_ACCUM, nvnet_accum_dparams() and nvnet_apply_dparams() for mini-batch training.
+  13. Add nvnet_feed_forward_batch(), conv3x3_im2col_data() and batched kernels for CONV3X3/tensor mode nvlayer.
+  14. Add nvnet_new_replica(), and NVTRAINER for data-parallel training with a thread pool(thpool.c).
+  15. Add nnc_set_threads(), conv3x3_run_tasks(): CONV3X3 filters split across threads of nnc_pool.
+  16. Replace 'double' of all params and data with nnc_real_t, build with -DNNC_FLOAT32 for float32.
+      AVX2 kernels use NNC_VLEN lanes as per nnc_real_t.
+  17. Add nvnet_map_params(), and NVNET members 'pmap','mapsize' for mmaped model files(nvmodel.c).
+  18. Add nnc_set_inference(), 'infer_only' of NVNET/CONV3X3/MAXPOOL2X2, and nvnet_mem_footprint().
+  19. Export nvnet_input_size(), nvnet_set_input() and nvnet_batch_insize(), for nvnet_quantize()(nvquant.c).
+  20. Add nvnet_set_input_u8(), CONV3X3/NVLAYER members 'din8','din8_scale','din8buf', to feed uint8
+      data(idxdata.c) and normalize it in the first layer.
+  21. random_btwone() uses a seeded xoshiro256** RNG(NNC_RNG), NOT srand() by time for each call.
+      Add nnc_set_seed(), nnc_rng_seed(), nnc_rng_next(), nnc_rng_btwone().
+  22. Add NVSAMPLER: new_nvsampler(), free_nvsampler(), nvsampler_next_epoch() for shuffled epochs.
+  23. Add NVOPTIM(SGD/momentum/Nesterov/RMSProp/Adam) for all params in the arena: new_nvoptim(),
+      free_nvoptim(), nvoptim_reset(), nvoptim_step() with a fused sweep(AVX2 if available).
+      Add NVTRAINER member 'optim'.
+  24. CONV3X3 engines and nvnet_feed_forward_batch() apply transfunc to whole arrays by actfs_forward()/
+      actfs_backward()(actfs.c), NOT by a function call per element.
+  25. Add conv3x3_maxpool2x2_feed_forward() and nnc_set_fusion(), nvnet_feed_forward() fuses a CONV3X3 and
+      its MAXPOOL2X2. Add MAXPOOL2X2 member 'argmax', CONV3X3 member 'outpool'.
+      maxpool2x2_feed_forward(): Compare with nnc_real_t, NOT float.
+  26. maxpool2x2_feed_forward() saves maxpool->argmax, and maxpool2x2_feed_backward() scatters derr by it,
+      NOT by comparing inconv3x3->douts, so a tie gets ONE derr. nvnet_feed_backward() does NOT clear derr
+      of a CONV3X3 followed by its MAXPOOL2X2.
+  27. Add nvnet_get_profile(), nvnet_reset_profile() and nvnet_print_profile(), per-layer time/calls/flops
+      recorded ONLY if built with NNC_PROFILE. Add NVNET member 'profile'.
+      nvnet_update_params(): Update params layer by layer by nvlayer_update_params().
+  28. Add nvnet_check_gradient_sampled(), it checks sampled params of ALL layers(including CONV3X3) by
+      threads, with replicas of private params.
+      CONV3X3 feed_backward(all engines): dferr[] sums derr*f'(u), NOT derr.
+  29. Add CONVKXK layer with kernel size, stride and zero padding, by im2col+GEMM. Add NVLAYER member 'convkxk'.
+  30. Add CONV3X3_ENGINE_NCHWC: din/fparams packed channel-blocked(CONV3X3_CBLK channels per pixel) in the
+      layer, douts/derr/prederr stay planar. Add CONV3X3 members 'cbin','cbw','cberr', and AVX2/FMA kernels.
+2026-10-18:
+   1. nvlayer_mean_loss(): softMax+CrossEntropy loss in log space, by dsum of output nvcells.
+      func_lossCrossEntropy(): Return 0 for tv==0, and clamp out to NNC_REAL_MIN.
+      Either keeps the loss finite when softmax outputs underflow in float32.
+   2. conv3x3_run_tasks(): Add param 'backward', feed forward kernels run without private prederr.
+   3. Add conv3x3_check_fusion().
+   4. Record NVPROF_UPDATE in nvnet_accum_dparams(), nvnet_apply_dparams() and nvoptim_step() as well,
+      a sweep over the arena is split to layers as per their params. Add nvlayer_num_params().
+   5. Add nvnet_pack_mapped_params(), NO PARAMS region in the arena for params in a mmaped model file.
+   6. CONV3X3_ENGINE_NCHWC: Pack din by channel blocks in nnc_pool, and cbw ONLY if fparams changed,
+      as conv3x3_nchwc_pack_din() and conv3x3_nchwc_pack_filters(). Add CONV3X3 member 'cbw_valid'.
 
 Midas Zhou
 知之者不如好之者好之者不如乐之者
@@ -165,18 +241,111 @@ midaszhou@yahoo.com <---- Not in use.
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
+#include <string.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/* x86 SIMD kernels, selected at startup by CPUID, see nnc_cpu_dispatch() */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NNC_X86_SIMD	1
+#include <immintrin.h>
+#endif
+
+
+/* Column block size for tensor mode GEMV, to keep x[] block in L1 cache */
+#define NVLAYER_GEMV_CBLK	1024
+
+/* Column(output position) block size for CONV3X3 im2col GEMM */
+#define CONV3X3_GEMM_PBLK	256
 
+/* Max. size of CONV3X3 batched im2col matrix, in doubles, see nvnet_feed_forward_batch() */
+#define CONV3X3_BATCH_COLS	(1<<19)
 
 /* to define limit value for gradient checking */
+#ifdef NNC_FLOAT32
+#define GRADIENT_ABS_LIMIT	0.00001		/* float32: absolue small value limit */
+#define GRADIENT_COMP_LIMIT	0.01		/* float32: compared/percentage small value limit */
+#else
 #define GRADIENT_ABS_LIMIT	0.00000001	/* absolue small value limit */
 #define GRADIENT_COMP_LIMIT	0.0001		/* compared/percentage small value limit */
+#endif
 
 
 static double dlrate=20.0;       	/* default value, learning rate for all nvcells */
+#ifdef NNC_FLOAT32
+static double desp_params=0.001;	/* small change value for computing numerical gradients of params*/
+#else
 static double desp_params=0.00001;	/* small change value for computing numerical gradients of params*/
+#endif
 static double dmmt_fric=0.75;		/* friction rate for momentum updating algorithm */
 
+/* A CONV3X3 kernel for filters [f0,f1), feed backward adds to prederr[nchan][imw*imh], see conv3x3_run_tasks() */
+typedef void (*conv3x3_kernel_t)(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr);
+
+/* Row i of dsums of a CONV3X3 filter, see conv3x3_direct_row() */
+typedef void (*conv3x3_row_t)(const CONV3X3 *conv3, int findex, int i, nnc_real_t *dst);
+
+/* SIMD kernels for CONV3X3 direct engine, NULL to use scalar loops. see nnc_cpu_dispatch() */
+static conv3x3_kernel_t conv3x3_simd_feed_forward;
+static conv3x3_kernel_t conv3x3_simd_feed_backward;
+static conv3x3_row_t conv3x3_simd_row;
+
+/* SIMD kernels for CONV3X3_ENGINE_NCHWC, NULL to use scalar loops. see nnc_cpu_dispatch() */
+static conv3x3_kernel_t conv3x3_simd_nchwc_forward;
+static conv3x3_kernel_t conv3x3_simd_nchwc_dparams;
+static conv3x3_kernel_t conv3x3_simd_nchwc_prederr;
+static bool nnc_simd_allowed=true;
+
+/* Coefficients of a fused optimizer sweep, all optimizers are in the form of:
+ *	g=acc*gs,  m=b1*m+c1*g,  v=b2*v+c2*g*g,  p += (s1*m+s2*g)/(sqrt(v)+eps),  acc=0
+ * see nvoptim_step().
+ */
+struct nvoptim_coefs {
+	nnc_real_t gs;
+	nnc_real_t b1, c1;
+	nnc_real_t b2, c2;
+	nnc_real_t s1, s2;
+	nnc_real_t eps;
+};
+
+/* A fused optimizer sweep over n params, see nvoptim_sweep() */
+typedef void (*nvoptim_kernel_t)(nnc_real_t *p, nnc_real_t *acc, nnc_real_t *m, nnc_real_t *v,
+				 unsigned long n, const struct nvoptim_coefs *c);
+
+/* SIMD kernel for optimizer sweeps, NULL to use scalar loops. see nnc_cpu_dispatch() */
+static nvoptim_kernel_t nvoptim_simd_sweep;
+
+/* Thread pool for intra-layer parallelism, see nnc_set_threads() */
+static THPOOL *nnc_pool;
+
+/* Create NVNET/CONV3X3/MAXPOOL2X2 for inference only, see nnc_set_inference() */
+static bool nnc_inference;
+
+/* Fuse CONV3X3+MAXPOOL2X2 in nvnet_feed_forward(), see nnc_set_fusion() */
+static bool nnc_fusion=true;
+
+/* Per-layer profile, compiled out without NNC_PROFILE. see nvnet_get_profile()
+ * NVPROF_END records the time since NVPROF_BEGIN, and flops of layers [i, i+n), to layer i.
+ * NVPROF_END_SWEEP records an update sweep over the arena to all layers, see nvprof_record_sweep().
+ */
+#ifdef NNC_PROFILE
+static double nvprof_ns(void);
+static void nvprof_record(NVNET *nnet, int i, int n, int phase, double t0);
+static void nvprof_record_sweep(NVNET *nnet, double t0);
+#define NVPROF_BEGIN(t0)			double t0=nvprof_ns()
+#define NVPROF_END(nnet, i, n, phase, t0)	nvprof_record(nnet, i, n, phase, t0)
+#define NVPROF_END_SWEEP(nnet, t0)		nvprof_record_sweep(nnet, t0)
+#else
+#define NVPROF_BEGIN(t0)
+#define NVPROF_END(nnet, i, n, phase, t0)
+#define NVPROF_END_SWEEP(nnet, t0)
+#endif
+
+/* RNG for random_btwone(), seeded by nnc_set_seed(), OR by time at the first use */
+static NNC_RNG nnc_rng;
+static bool nnc_rng_seeded;
+
 
 /*---------------------------------------------
  * set parameters for NNC
@@ -199,6 +368,107 @@ void nnc_set_mfrict(double mfric)
 	dmmt_fric=mfric;
 }
 
+/*---------------------------------------------
+ * Enable/disable SIMD kernels, including
+ * activation kernels of actfs.c.
+ * If disabled, scalar loops are used, for
+ * comparing/debugging.
+@enable:	true to use the best kernels for the CPU
+Return:
+	true	SIMD kernels are in use
+	false	Scalar loops are in use
+---------------------------------------------*/
+bool nnc_set_simd(bool enable)
+{
+	nnc_simd_allowed=enable;
+	nnc_cpu_dispatch();
+	actfs_set_simd(enable);
+
+	return conv3x3_simd_feed_forward!=NULL;
+}
+
+/*---------------------------------------------
+ * Set number of threads for intra-layer
+ * parallelism, CONV3X3 filters are split
+ * across threads. A persistent thread pool
+ * is created.
+@nth:		number of threads, usually number
+		of cores. <=1 to run in caller thread.
+Return:
+	0	OK
+	<0	Fails
+---------------------------------------------*/
+int nnc_set_threads(int nth)
+{
+	thpool_destroy(nnc_pool);
+	nnc_pool=NULL;
+
+	if(nth<=1)
+		return 0;
+
+	/* Caller thread runs tasks too */
+	nnc_pool=thpool_create(nth-1);
+	if(nnc_pool==NULL)
+		return -1;
+
+	return 0;
+}
+
+
+/*---------------------------------------------
+ * Set inference only mode for creating nvnets.
+ * NVNET/CONV3X3/MAXPOOL2X2 created after it
+ * have NO backward state(dFP,dferr,derr,dsums,
+ * and GRADS/MMTS/ACCUM arena regions), and
+ * CONV3X3 transfunc is applied as outputs are
+ * written. They can NOT be trained.
+@enable:	true for inference only
+Return:
+	previous mode
+---------------------------------------------*/
+bool nnc_set_inference(bool enable)
+{
+	bool prev=nnc_inference;
+
+	nnc_inference=enable;
+
+	return prev;
+}
+
+
+/*---------------------------------------------
+ * Enable/disable fused CONV3X3+MAXPOOL2X2 feed
+ * forward in nvnet_feed_forward(), see
+ * conv3x3_maxpool2x2_feed_forward().
+ * Disable it to get full CONV3X3 outputs of an
+ * inference only nvnet, as for calibration.
+@enable:	true to fuse
+Return:
+	previous mode
+---------------------------------------------*/
+bool nnc_set_fusion(bool enable)
+{
+	bool prev=nnc_fusion;
+
+	nnc_fusion=enable;
+
+	return prev;
+}
+
+
+/*---------------------------------------------
+ * Seed the RNG of random_btwone(), so params
+ * from nvnet_init_params() are reproducible.
+ * Call it before nvnet_init_params(). If NOT
+ * called, it's seeded by time at the first use.
+@seed:		any value
+---------------------------------------------*/
+void nnc_set_seed(uint64_t seed)
+{
+	nnc_rng_seed(&nnc_rng, seed);
+	nnc_rng_seeded=true;
+}
+
 
 ///////////////////////////     Nerve Cell/Layer/Net Concept     ///////////////////////
 
@@ -210,7 +480,7 @@ void nnc_set_mfrict(double mfric)
  * 	@incells 	array of input cells,from which we get input data(din),
  *			if NULL use din as input data, which will be realized only in transfer calculation.
  *	@din	array of input data, if NOT null, use as input data.
- * 	@dw  	array of weights, double. if NULL, init with 0.
+ * 	@dw  	array of weights, nnc_real_t. if NULL, init with 0.
  * 	@bias 	dv value.
  * 	@transfer 	transfer function.
  * Return:
@@ -218,7 +488,7 @@ void nnc_set_mfrict(double mfric)
  *	NULL		   ...  fails
 -------------------------------------------------------------------------*/
 NVCELL * new_nvcell( unsigned int nin, NVCELL * const *incells,
-				double *din, double *dw, double bias, double (*transfer)(double, double,int ) )
+				nnc_real_t *din, nnc_real_t *dw, nnc_real_t bias, nnc_real_t (*transfer)(nnc_real_t, nnc_real_t,int ) )
 {
 	int i;
 
@@ -234,7 +504,7 @@ NVCELL * new_nvcell( unsigned int nin, NVCELL * const *incells,
 		printf("Init a new NCELL: fail to calloc ncell.\n");
 		return NULL;
 	}
-	ncell->dw=calloc(nin,sizeof(double));
+	ncell->dw=calloc(nin+1,sizeof(nnc_real_t)); /* dw[nin] for bias */
 	if(ncell->dw==NULL) {
 		printf("Init a new NCELL: fail to calloc dw.\n");
 		free(ncell);
@@ -255,7 +525,8 @@ NVCELL * new_nvcell( unsigned int nin, NVCELL * const *incells,
 	/* assign incells, valve and tranfer function */
 	ncell->nin=nin;
 	ncell->incells=incells;
-	ncell->dv=bias;
+	ncell->dv=ncell->dw+nin;
+	*ncell->dv=bias;
 	ncell->dsum=0.0;
 	ncell->transfunc=transfer;
 	ncell->dout=0.0;
@@ -271,7 +542,8 @@ void free_nvcell(NVCELL *ncell)
 {
 	if(ncell==NULL) return;
 
-	if(ncell->dw != NULL)
+	/* dw in NVNET parameter arena is freed by free_nvnet() */
+	if(ncell->dw != NULL && !ncell->in_arena)
 		free(ncell->dw);
 
 	/* Free pdin and pincells HK2023-07-08 */
@@ -303,7 +575,7 @@ int nvcell_rand_dwv(NVCELL *ncell)
 
 
 	/* random dv */
-	ncell->dv=random_btwone();
+	*ncell->dv=random_btwone();
 
 	return 0;
 }
@@ -329,7 +601,7 @@ int nvcell_rand_dwv(NVCELL *ncell)
  *	pointer to a CONV3X3 ...  OK
  *	NULL		   ...  fails
 -------------------------------------------------------------------------*/
-CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigned int imw, unsigned int imh,  double *din,  bool withBias)
+CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigned int imw, unsigned int imh,  nnc_real_t *din,  bool withBias)
 {
 	int k,j;
 	unsigned int blocksize;
@@ -366,16 +638,18 @@ CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigne
 			return NULL;
 		}
 	}
+	/* Allocate fparams flatten-friendly: Allocate a whole block mem for all numFilters*numChannels*9 */
+	conv3x3->fparams[0][0]=calloc(numFilters*numChannels*9, sizeof(typeof(***conv3x3->fparams)));
+	if(conv3x3->fparams[0][0]==NULL) {
+		printf("%s: Fail to calloc conv3x3->fparams[0][0] as whole.\n",__func__);
+		/* Free and return */
+		free_conv3x3(conv3x3);
+		return NULL;
+	}
+	/* Assign address to conv3x3->fparams[k][j] */
 	for(k=0; k<numFilters; k++) {
-	    for(j=0; j<numChannels; j++) {
-		conv3x3->fparams[k][j]=calloc(9, sizeof(typeof(***conv3x3->fparams)));
-		if(conv3x3->fparams[k][j]==NULL) {
-			printf("%s: Fail to calloc conv3x3->fparams[%d][%d].\n",__func__, k,j);
-			/* Free and return */
-			free_conv3x3(conv3x3);
-			return NULL;
-		}
-	    }
+	    for(j=0; j<numChannels; j++)
+		conv3x3->fparams[k][j]=conv3x3->fparams[0][0]+(k*numChannels+j)*9;
 	}
 
 	/* 3a. Calloc conv3x3->dvs and dferr.  HK2023-08-05 */
@@ -386,63 +660,71 @@ CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigne
 	                free(conv3x3);
         	        return NULL;
         	}
-		conv3x3->dferr = calloc(numFilters, sizeof(typeof(*conv3x3->dferr)));
-		if(conv3x3->dvs==NULL) {
+		if(!nnc_inference) {
+		    conv3x3->dferr = calloc(numFilters, sizeof(typeof(*conv3x3->dferr)));
+		    if(conv3x3->dferr==NULL) {
                 	printf("%s: Fail to calloc conv3x3->dferr.\n",__func__);
 	                free(conv3x3);
         	        return NULL;
-        	}
+        	    }
+		}
 	}
 
-	/* 4. Calloc conv3x3-> dFP and dFP[]  HK2023-07-11, HK2023-08-06 */
-	conv3x3->dFP = calloc(numFilters, sizeof(typeof(*conv3x3->dFP)));
-	if(conv3x3->dFP==NULL) {
-		printf("%s: Fail to calloc conv3x3->dFP.\n",__func__);
-		/* Free and return */
-		free_conv3x3(conv3x3);
-		return NULL;
-	}
-	for(k=0; k<numFilters; k++) {
-                conv3x3->dFP[k]=calloc(numChannels, sizeof(typeof(**conv3x3->dFP)));
-                if(conv3x3->dFP[k]==NULL) {
-                        printf("%s: Fail to calloc conv3x3->dFP[%d].\n",__func__, k);
+	/* Inference only, NO backward buffers dFP/dferr/derr, and dsums is douts. see nnc_set_inference() */
+	conv3x3->infer_only=nnc_inference;
+
+	if(!nnc_inference) {
+		/* 4. Calloc conv3x3-> dFP and dFP[]  HK2023-07-11, HK2023-08-06 */
+		conv3x3->dFP = calloc(numFilters, sizeof(typeof(*conv3x3->dFP)));
+		if(conv3x3->dFP==NULL) {
+			printf("%s: Fail to calloc conv3x3->dFP.\n",__func__);
 			/* Free and return */
 			free_conv3x3(conv3x3);
 			return NULL;
 		}
-	}
-	for(k=0; k<numFilters; k++) {
-	    for(j=0; j<numChannels; j++) {
-                conv3x3->dFP[k][j]=calloc(9, sizeof(typeof(***conv3x3->dFP)));
-                if(conv3x3->dFP[k][j]==NULL) {
-                        printf("%s: Fail to calloc conv3x3->dFP[%d][%d].\n",__func__, k,j);
+		for(k=0; k<numFilters; k++) {
+	                conv3x3->dFP[k]=calloc(numChannels, sizeof(typeof(**conv3x3->dFP)));
+	                if(conv3x3->dFP[k]==NULL) {
+	                        printf("%s: Fail to calloc conv3x3->dFP[%d].\n",__func__, k);
+				/* Free and return */
+				free_conv3x3(conv3x3);
+				return NULL;
+			}
+		}
+		/* Allocate dFP flatten-friendly, same as fparams */
+		conv3x3->dFP[0][0]=calloc(numFilters*numChannels*9, sizeof(typeof(***conv3x3->dFP)));
+		if(conv3x3->dFP[0][0]==NULL) {
+			printf("%s: Fail to calloc conv3x3->dFP[0][0] as whole.\n",__func__);
 			/* Free and return */
 			free_conv3x3(conv3x3);
 			return NULL;
 		}
-	    }
-	}
+		for(k=0; k<numFilters; k++) {
+		    for(j=0; j<numChannels; j++)
+			conv3x3->dFP[k][j]=conv3x3->dFP[0][0]+(k*numChannels+j)*9;
+		}
 
-	/* 4a. Calloc conv3x3-> dsums and dsums[nf] */
-	conv3x3->dsums = calloc(numFilters, sizeof(typeof(*conv3x3->dsums)));
-	if(conv3x3->dsums==NULL) {
-		printf("%s: Fail to calloc conv3x3->dsums.\n",__func__);
-		/* Free and return */
-		free_conv3x3(conv3x3);
-                return NULL;
-	}
-	/* Allocate dsums flatten-friendly: Allocate a whole block mem for all numFilters*(imw-2)*(imh-2) --- HK2023-07-24 */
-	conv3x3->dsums[0]=calloc(numFilters*(imw-2)*(imh-2), sizeof(typeof(**conv3x3->dsums)));
-	if(conv3x3->dsums[0]==NULL) {
-			printf("%s: Fail to calloc conv3x3->dsums[0] as whole.\n",__func__);
+		/* 4a. Calloc conv3x3-> dsums and dsums[nf] */
+		conv3x3->dsums = calloc(numFilters, sizeof(typeof(*conv3x3->dsums)));
+		if(conv3x3->dsums==NULL) {
+			printf("%s: Fail to calloc conv3x3->dsums.\n",__func__);
 			/* Free and return */
-                        free_conv3x3(conv3x3);
-                        return NULL;
+			free_conv3x3(conv3x3);
+	                return NULL;
+		}
+		/* Allocate dsums flatten-friendly: Allocate a whole block mem for all numFilters*(imw-2)*(imh-2) --- HK2023-07-24 */
+		conv3x3->dsums[0]=calloc(numFilters*(imw-2)*(imh-2), sizeof(typeof(**conv3x3->dsums)));
+		if(conv3x3->dsums[0]==NULL) {
+				printf("%s: Fail to calloc conv3x3->dsums[0] as whole.\n",__func__);
+				/* Free and return */
+	                        free_conv3x3(conv3x3);
+	                        return NULL;
+		}
+		/* Assign address to conv3x3->dsums[k] */
+		blocksize=(imw-2)*(imh-2);
+		for(k=1; k<numFilters; k++)
+			conv3x3->dsums[k]=conv3x3->dsums[0]+k*blocksize;
 	}
-	/* Assign address to conv3x3->dsums[k] */
-	blocksize=(imw-2)*(imh-2);
-	for(k=1; k<numFilters; k++)
-		conv3x3->dsums[k]=conv3x3->dsums[0]+k*blocksize;
 
 
 	/* 5. Calloc conv3x3-> douts and douts[nf] */
@@ -478,23 +760,30 @@ CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigne
 	for(k=1; k<numFilters; k++)
 		conv3x3->douts[k]=conv3x3->douts[0]+k*blocksize;
 
+	/* Inference only: sums are written to douts, and transfunc applied in place */
+	if(nnc_inference)
+		conv3x3->dsums=conv3x3->douts;
 
-	/* 6. Calloc conv3x3-> derr and derr[nf], and init all derr as 0.0f */
-	conv3x3->derr = calloc(numFilters, sizeof(typeof(*conv3x3->derr)));
-	if(conv3x3->derr==NULL) {
-		printf("%s: Fail to calloc conv3x3->derr.\n",__func__);
-		/* Free and return */
-		free_conv3x3(conv3x3);
-                return NULL;
-	}
-	for(k=0; k<numFilters; k++) {
-		conv3x3->derr[k] = calloc((imw-2)*(imh-2), sizeof(typeof(**conv3x3->derr)));
-		if(conv3x3->derr[k]==NULL) {
-			printf("%s: Fail to calloc conv3x3->derr[%d].\n",__func__, k);
+
+	if(!nnc_inference) {
+		/* 6. Calloc conv3x3-> derr and derr[nf], and init all derr as 0.0f */
+		conv3x3->derr = calloc(numFilters, sizeof(typeof(*conv3x3->derr)));
+		if(conv3x3->derr==NULL) {
+			printf("%s: Fail to calloc conv3x3->derr.\n",__func__);
+			/* Free and return */
+			free_conv3x3(conv3x3);
+	                return NULL;
+		}
+		/* Allocate derr flatten-friendly */
+		conv3x3->derr[0] = calloc(numFilters*(imw-2)*(imh-2), sizeof(typeof(**conv3x3->derr)));
+		if(conv3x3->derr[0]==NULL) {
+			printf("%s: Fail to calloc conv3x3->derr[0] as whole.\n",__func__);
 			/* Free and return */
 			free_conv3x3(conv3x3);
 			return NULL;
 		}
+		for(k=1; k<numFilters; k++)
+			conv3x3->derr[k]=conv3x3->derr[0]+k*blocksize;
 	}
 
 
@@ -507,9 +796,9 @@ CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigne
 	conv3x3->oh = imh-2;
 	conv3x3->din = din;
 
-printf("%s: Created a CONV3X3: nf=%d; nchan=%d; (imw,imh): %d,%d; (ow,oh): %d,%d; %s\n",
+printf("%s: Created a CONV3X3: nf=%d; nchan=%d; (imw,imh): %d,%d; (ow,oh): %d,%d; %s%s\n",
 			__func__, conv3x3->nf, conv3x3->nchan, conv3x3->imw, conv3x3->imh, conv3x3->ow, conv3x3->oh,
-			withBias?"with Bias":"without Bias");
+			withBias?"with Bias":"without Bias", nnc_inference?"; Inference only":"");
 
 	/* 8. Return */
 	return conv3x3;
@@ -521,7 +810,7 @@ printf("%s: Created a CONV3X3: nf=%d; nchan=%d; (imw,imh): %d,%d; (ow,oh): %d,%d
 --------------------------------------*/
 void free_conv3x3(CONV3X3 *conv3)
 {
-	int j,k;
+	int j;
 
         if(conv3==NULL)
 		return;
@@ -534,49 +823,62 @@ void free_conv3x3(CONV3X3 *conv3)
 	    free(conv3->douts);
 	}
 
-	/* Free dsums HK2023-08-08 */
-	if(conv3->dsums) {
+	/* Free dsums HK2023-08-08, unless it's douts for inference only */
+	if(conv3->dsums && conv3->dsums != conv3->douts) {
 	    free(conv3->dsums[0]);
 	    free(conv3->dsums);
 	}
 
+	/* Free derr */
+	if(conv3->derr) {
+	    free(conv3->derr[0]); /* as allocated flatten-friendly */
+	    free(conv3->derr);
+	}
+
 	/* Free fparams HK2023-08-06 */
 	if(conv3->fparams) {
-	    for(j=0; j < conv3->nf; j++) {
-		if(conv3->fparams[j]) {
-		    for(k=0; k < conv3->nchan; k++) {
-			if(conv3->fparams[j][k])
-			 	free(conv3->fparams[j][k]);
-		    }
-
-		    free(conv3->fparams[j]);
-		}
-	    }
+	    /* fparams[0][0] holds whole mem space, unless it's in NVNET parameter arena */
+	    if(conv3->fparams[0] && !conv3->in_arena)
+		free(conv3->fparams[0][0]);
+	    for(j=0; j < conv3->nf; j++)
+		free(conv3->fparams[j]);
 
 	    free(conv3->fparams);
 	}
 	/* Free dvs HK2023-08-05 */
-	if(conv3->dvs) {
+	if(conv3->dvs && !conv3->in_arena) {
 	    free(conv3->dvs);
-	    free(conv3->dferr);
+	    free(conv3->dferr);	/* NULL for inference only */
 	}
 
 	/* Free dFP HK2023-08-06 */
 	if(conv3->dFP) {
-	    for(j=0; j < conv3->nf; j++) {
-		if(conv3->dFP[j]) {
-		    for(k=0; k < conv3->nchan; k++) {
-			if(conv3->dFP[j][k])
-			 	free(conv3->dFP[j][k]);
-		    }
-
-		    free(conv3->dFP[j]);
-		}
-	    }
+	    if(conv3->dFP[0] && !conv3->in_arena)
+		free(conv3->dFP[0][0]);
+	    for(j=0; j < conv3->nf; j++)
+		free(conv3->dFP[j]);
 
 	    free(conv3->dFP);
 	}
 
+	/* Free private prederr of filter tasks */
+	free(conv3->tperr);
+	free(conv3->tperrp);
+
+	/* Free im2col and Winograd buffers */
+	free(conv3->wgU);
+	free(conv3->wgV);
+	free(conv3->cols);
+	free(conv3->gout);
+	free(conv3->dcols);
+
+	/* Free channel-blocked buffers */
+	free(conv3->cbin);
+	free(conv3->cbw);
+	free(conv3->cberr);
+
+	/* Free buffer for uint8 input data */
+	free(conv3->din8buf);
 
 	/* Free conv3 */
         free(conv3);
@@ -631,6 +933,289 @@ int conv3x3_rand_params(CONV3X3 *conv3)
 		conv3->dvs[i]=random_btwone();
 	    }
         }
+	conv3->wgU_valid=false;
+	conv3->cbw_valid=false;
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Select convolution engine for a CONV3X3.
+ *
+ * Params:
+ *	@conv3	Pointer to a CONV3X3
+ *	@engine	CONV3X3_ENGINE_DIRECT:  Direct loops.
+ *		CONV3X3_ENGINE_IM2COL:  Lower din to an im2col patch matrix,
+ *			then dsums=W*cols as a blocked GEMM, W=fparams[nf][nchan*9].
+ *			Extra mem: cols/dcols (nchan*9)*(ow*oh), gout nf*(ow*oh).
+ *		CONV3X3_ENGINE_WINOGRAD: Winograd F(2x2,3x3) for feed forward,
+ *			16 multiplies per 2x2 outputs instead of 36.
+ *			Feed backward uses the direct engine.
+ *			Extra mem: wgU nf*nchan*16, wgV nchan*16.
+ *		CONV3X3_ENGINE_NCHWC: Pack din/fparams channel-blocked,
+ *			CONV3X3_CBLK channels interleaved per pixel, so each
+ *			SIMD load fetches one pixel across channels. douts/derr
+ *			and prederr keep the planar layout. For nchan<CONV3X3_CBLK,
+ *			lanes are padded with 0, and it's slower than the direct engine.
+ *			Extra mem(ncb=ceil(nchan/CONV3X3_CBLK)): cbin ncb*CBLK*imw*imh,
+ *			cbw nf*ncb*CBLK*9, gout nf*(ow*oh), cberr as cbin if prederr.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+int conv3x3_set_engine(CONV3X3 *conv3, int engine)
+{
+	unsigned int K, P, ncb;
+
+	if(conv3==NULL)
+		return -1;
+
+	K=conv3->nchan*9;
+	P=conv3->ow*conv3->oh;
+
+	switch(engine) {
+	    case CONV3X3_ENGINE_DIRECT:
+		break;
+	    case CONV3X3_ENGINE_IM2COL:
+		if(conv3->cols==NULL)
+			conv3->cols=calloc(K*P, sizeof(typeof(*conv3->cols)));
+		if(conv3->infer_only) {	/* NO backward buffers */
+			if(conv3->cols==NULL) {
+				printf("%s: Fail to calloc im2col buffers.\n", __func__);
+				return -2;
+			}
+			break;
+		}
+		if(conv3->dcols==NULL)
+			conv3->dcols=calloc(K*P, sizeof(typeof(*conv3->dcols)));
+		if(conv3->gout==NULL)
+			conv3->gout=calloc(conv3->nf*P, sizeof(typeof(*conv3->gout)));
+		if(conv3->cols==NULL || conv3->dcols==NULL || conv3->gout==NULL) {
+			printf("%s: Fail to calloc im2col buffers.\n", __func__);
+			return -2;
+		}
+		break;
+	    case CONV3X3_ENGINE_WINOGRAD:
+		if(conv3->wgU==NULL)
+			conv3->wgU=calloc(conv3->nf*conv3->nchan*16, sizeof(typeof(*conv3->wgU)));
+		if(conv3->wgV==NULL)
+			conv3->wgV=calloc(conv3->nchan*16, sizeof(typeof(*conv3->wgV)));
+		if(conv3->wgU==NULL || conv3->wgV==NULL) {
+			printf("%s: Fail to calloc Winograd buffers.\n", __func__);
+			return -2;
+		}
+		conv3->wgU_valid=false;
+		break;
+	    case CONV3X3_ENGINE_NCHWC:
+		ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+		if(conv3->cbin==NULL)
+			conv3->cbin=calloc(ncb*CONV3X3_CBLK*conv3->imw*conv3->imh, sizeof(typeof(*conv3->cbin)));
+		if(conv3->cbw==NULL)
+			conv3->cbw=calloc(conv3->nf*ncb*CONV3X3_CBLK*9, sizeof(typeof(*conv3->cbw)));
+		if(conv3->gout==NULL && !conv3->infer_only)
+			conv3->gout=calloc(conv3->nf*P, sizeof(typeof(*conv3->gout)));
+		if(conv3->cbin==NULL || conv3->cbw==NULL || (conv3->gout==NULL && !conv3->infer_only)) {
+			printf("%s: Fail to calloc channel-blocked buffers.\n", __func__);
+			return -2;
+		}
+		conv3->cbw_valid=false;
+		break;
+	    default:
+		printf("%s: Unknown engine %d!\n", __func__, engine);
+		return -1;
+	}
+
+	conv3->engine=engine;
+
+	return 0;
+}
+
+
+/*-------------------------------------------------------
+ * Note:
+ *	Calloc planes[n], n planes of size each, planes[0]
+ *	holds whole mem space(flatten-friendly).
+ * Return:
+ *	Pointer to planes	OK
+ *	NULL			Fails
+--------------------------------------------------------*/
+static nnc_real_t **nnc_calloc_planes(unsigned int n, unsigned int size)
+{
+	int k;
+	nnc_real_t **planes;
+
+	planes=calloc(n, sizeof(nnc_real_t *));
+	if(planes==NULL)
+		return NULL;
+
+	planes[0]=calloc((unsigned long)n*size, sizeof(nnc_real_t));
+	if(planes[0]==NULL) {
+		free(planes);
+		return NULL;
+	}
+	for(k=1; k<n; k++)
+		planes[k]=planes[0]+k*size;
+
+	return planes;
+}
+
+/* Free planes by nnc_calloc_planes() */
+static void nnc_free_planes(nnc_real_t **planes)
+{
+	if(planes==NULL)
+		return;
+
+	free(planes[0]);
+	free(planes);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Create a convkxk with given paramters.
+ *
+ * Params:
+ * 	@numFilters 	number of filtesrs
+ *      @numChannels    number of channels for each filter.
+ *			MUST be same as input data channels.
+ *	@imw,imh	Width and Height of input image.
+ *	@ks		Kernel size, filter is ks*ks.
+ *	@stride		Stride, Example: 2 to downsample to a half.
+ *	@pad		Zero padding on each side, <ks.
+ *			Example: ks=3,stride=2,pad=1: 28x28 -> 14x14.
+ *	@din	Pointer to image data. MAY assign it later.
+ *               !!! ---- CAUTION ---- !!!
+ *       The Caller MUST ensure enough mem space in din!
+ *	@withBias	TRUE: Has bias(dvs[]) for filters.
+ *
+ * Return:
+ *	pointer to a CONVKXK ...  OK
+ *	NULL		   ...  fails
+-------------------------------------------------------------------------*/
+CONVKXK *new_convkxk(unsigned int numFilters, unsigned int numChannels, unsigned int imw, unsigned int imh,
+		     unsigned int ks, unsigned int stride, unsigned int pad, nnc_real_t *din, bool withBias)
+{
+	unsigned int K, P;
+	CONVKXK *convk;
+
+	/* 1. check input param */
+	if( numFilters<1 || numChannels<1 || ks<1 || stride<1 || pad>=ks || imw+2*pad<ks || imh+2*pad<ks ) {
+		printf("%s: Input parameter error!\n", __func__);
+		return NULL;
+	}
+
+	/* 2. Calloc convk */
+	convk=calloc(1, sizeof(CONVKXK));
+	if(convk==NULL) {
+		printf("%s: Fail to calloc convk.\n",__func__);
+		return NULL;
+	}
+	convk->nchan=numChannels;
+	convk->nf=numFilters;
+	convk->ks=ks;
+	convk->stride=stride;
+	convk->pad=pad;
+	convk->imw=imw;
+	convk->imh=imh;
+	convk->ow=(imw+2*pad-ks)/stride+1;
+	convk->oh=(imh+2*pad-ks)/stride+1;
+	convk->din=din;
+	convk->infer_only=nnc_inference;
+
+	K=numChannels*ks*ks;
+	P=convk->ow*convk->oh;
+
+	/* 3. fparams, dvs, and cols/douts for feed forward */
+	convk->fparams=calloc(numFilters*K, sizeof(typeof(*convk->fparams)));
+	if(withBias)
+		convk->dvs=calloc(numFilters, sizeof(typeof(*convk->dvs)));
+	convk->cols=calloc(K*P, sizeof(typeof(*convk->cols)));
+	convk->douts=nnc_calloc_planes(numFilters, P);
+	if( convk->fparams==NULL || (withBias && convk->dvs==NULL) || convk->cols==NULL || convk->douts==NULL ) {
+		printf("%s: Fail to calloc fparams/dvs/cols/douts.\n",__func__);
+		free_convkxk(convk);
+		return NULL;
+	}
+
+	/* Inference only: sums are written to douts, NO backward buffers */
+	if(nnc_inference) {
+		convk->dsums=convk->douts;
+	}
+	/* 4. dFP, dferr, dsums, derr and gout/dcols for feed backward */
+	else {
+		convk->dFP=calloc(numFilters*K, sizeof(typeof(*convk->dFP)));
+		if(withBias)
+			convk->dferr=calloc(numFilters, sizeof(typeof(*convk->dferr)));
+		convk->dsums=nnc_calloc_planes(numFilters, P);
+		convk->derr=nnc_calloc_planes(numFilters, P);
+		convk->gout=calloc(numFilters*P, sizeof(typeof(*convk->gout)));
+		convk->dcols=calloc(K*P, sizeof(typeof(*convk->dcols)));
+		if( convk->dFP==NULL || (withBias && convk->dferr==NULL) || convk->dsums==NULL || convk->derr==NULL
+		    || convk->gout==NULL || convk->dcols==NULL ) {
+			printf("%s: Fail to calloc dFP/dferr/dsums/derr/gout/dcols.\n",__func__);
+			free_convkxk(convk);
+			return NULL;
+		}
+	}
+
+printf("%s: Created a CONVKXK: nf=%d; nchan=%d; ks=%d; stride=%d; pad=%d; (imw,imh): %d,%d; (ow,oh): %d,%d; %s%s\n",
+			__func__, convk->nf, convk->nchan, convk->ks, convk->stride, convk->pad, convk->imw, convk->imh,
+			convk->ow, convk->oh, withBias?"with Bias":"without Bias", nnc_inference?"; Inference only":"");
+
+	return convk;
+}
+
+/*--------------------------------------
+ * Params:
+ *      @convk  pointer to a CONVKXK.
+--------------------------------------*/
+void free_convkxk(CONVKXK *convk)
+{
+	if(convk==NULL)
+		return;
+
+	/* fparams/dvs/dFP/dferr, unless they are in NVNET parameter arena */
+	if(!convk->in_arena) {
+		free(convk->fparams);
+		free(convk->dvs);
+		free(convk->dFP);
+		free(convk->dferr);
+	}
+
+	/* dsums is douts for inference only */
+	if(convk->dsums != convk->douts)
+		nnc_free_planes(convk->dsums);
+	nnc_free_planes(convk->douts);
+	nnc_free_planes(convk->derr);
+
+	free(convk->cols);
+	free(convk->gout);
+	free(convk->dcols);
+	free(convk->din8buf);
+
+	free(convk);
+}
+
+/*------------------------------------------
+ * Initialize filter parmaters for a CONVKXK
+ *
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------*/
+int convkxk_rand_params(CONVKXK *convk)
+{
+	unsigned int k;
+
+	if(convk==NULL || convk->fparams==NULL)
+		return -1;
+
+	for(k=0; k< convk->nf*convk->nchan*convk->ks*convk->ks; k++)
+		convk->fparams[k]=random_btwone();
+	if(convk->dvs) {
+		for(k=0; k< convk->nf; k++)
+			convk->dvs[k]=random_btwone();
+	}
 
 	return 0;
 }
@@ -652,7 +1237,7 @@ int conv3x3_rand_params(CONV3X3 *conv3)
  *	pointer to a CONV3X3 ...  OK
  *	NULL		   ...  fails
 -------------------------------------------------------------------------*/
-MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsigned int imw, unsigned int imh,  double **din)
+MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsigned int imw, unsigned int imh,  nnc_real_t **din)
 {
 	int j,k;
 	MAXPOOL2X2 *maxpool2x2=NULL;
@@ -739,17 +1324,28 @@ MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsig
 		maxpool2x2->douts[k]=maxpool2x2->douts[0]+k*blocksize;
 
 
-	/* 5. Calloc derr */
-	maxpool2x2->derr = calloc(numFilters, sizeof(typeof(*maxpool2x2->derr)));
-	if(maxpool2x2->derr==NULL) {
-		printf("%s: Fail to calloc maxpool2x2->derr.\n",__func__);
-		free_maxpool2x2(maxpool2x2);
-		return NULL;
-	}
-	for(k=0; k<numFilters; k++) {
-		maxpool2x2->derr[k] = calloc(blocksize, sizeof(typeof(**maxpool2x2->derr)));
-		if(maxpool2x2->derr[k]==NULL) {
-			printf("%s: Fail to calloc maxpool2x2->derr[%d].\n",__func__, k);
+	if(!nnc_inference) {
+		/* 5. Calloc derr, NOT for inference only */
+		maxpool2x2->derr = calloc(numFilters, sizeof(typeof(*maxpool2x2->derr)));
+		if(maxpool2x2->derr==NULL) {
+			printf("%s: Fail to calloc maxpool2x2->derr.\n",__func__);
+			free_maxpool2x2(maxpool2x2);
+			return NULL;
+		}
+		/* Allocate derr flatten-friendly */
+		maxpool2x2->derr[0] = calloc(numFilters*blocksize, sizeof(typeof(**maxpool2x2->derr)));
+		if(maxpool2x2->derr[0]==NULL) {
+			printf("%s: Fail to calloc maxpool2x2->derr[0] as whole.\n",__func__);
+			free_maxpool2x2(maxpool2x2);
+			return NULL;
+		}
+		for(k=1; k<numFilters; k++)
+			maxpool2x2->derr[k]=maxpool2x2->derr[0]+k*blocksize;
+
+		/* 5a. Calloc argmax, NOT for inference only */
+		maxpool2x2->argmax = calloc(numFilters*blocksize, sizeof(uint8_t));
+		if(maxpool2x2->argmax==NULL) {
+			printf("%s: Fail to calloc maxpool2x2->argmax.\n",__func__);
 			free_maxpool2x2(maxpool2x2);
 			return NULL;
 		}
@@ -763,9 +1359,11 @@ MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsig
 	maxpool2x2->ow = imw/2;
 	maxpool2x2->oh = imh/2;
 	maxpool2x2->din = din;
+	maxpool2x2->infer_only = nnc_inference;
 
-printf("%s: Created a MAXPOOL2X2: nf=%d; (imw,imh): %d,%d; (ow,oh): %d,%d\n",
-			__func__, maxpool2x2->nf, maxpool2x2->imw, maxpool2x2->imh, maxpool2x2->ow, maxpool2x2->oh);
+printf("%s: Created a MAXPOOL2X2: nf=%d; (imw,imh): %d,%d; (ow,oh): %d,%d%s\n",
+			__func__, maxpool2x2->nf, maxpool2x2->imw, maxpool2x2->imh, maxpool2x2->ow, maxpool2x2->oh,
+			nnc_inference?"; Inference only":"");
 
 	/* 6. Return */
 	return maxpool2x2;
@@ -778,8 +1376,6 @@ printf("%s: Created a MAXPOOL2X2: nf=%d; (imw,imh): %d,%d; (ow,oh): %d,%d\n",
 -----------------------------------------*/
 void free_maxpool2x2(MAXPOOL2X2 *maxpool)
 {
-	int j;
-
         if(maxpool==NULL)
 		return;
 
@@ -801,10 +1397,10 @@ void free_maxpool2x2(MAXPOOL2X2 *maxpool)
 
 	/* Free derr */
 	if(maxpool->derr) {
-	    for(j=0; j < maxpool->nf; j++)
-                free(maxpool->derr[j]);
+	    free(maxpool->derr[0]); /* Allocate flatten-friendly */
             free(maxpool->derr);
 	}
+	free(maxpool->argmax);
 
 
 	/* Free maxpool */
@@ -886,7 +1482,7 @@ NVLAYER *new_nvlayer(unsigned int nc, const NVCELL *template_cell, bool layerTra
 	/* 6. Create nvcells as per template_cell */
 	for(i=0;i<nc;i++) {
 		layer->nvcells[i]=new_nvcell( template_cell->nin, template_cell->incells,
-					      template_cell->din, template_cell->dw, template_cell->dv,
+					      template_cell->din, template_cell->dw, *template_cell->dv,
 					      template_cell->transfunc
 					);
 		/* if fail, release all */
@@ -927,7 +1523,7 @@ NVLAYER *new_nvlayer(unsigned int nc, const NVCELL *template_cell, bool layerTra
  *	pointer to NVLAYER	OK
  *	NULL			fails
 ------------------------------------------------------------------------*/
-NVLAYER *new_conv_nvlayer( NVCELL * const *incells, double *din,
+NVLAYER *new_conv_nvlayer( NVCELL * const *incells, nnc_real_t *din,
 			   unsigned int iw, unsigned ih, unsigned int nf, unsigned int fs)
 {
 	int k, i,j, ii,jj;
@@ -966,7 +1562,7 @@ NVLAYER *new_conv_nvlayer( NVCELL * const *incells, double *din,
 
 	/* Create layer's nvCells, one filter as one nvCell, each nvCell with fs*fs input nin. */
 	for(k=0; k< layer->nc; k++) {
-		/* unsigned int nin, NVCELL * const *incells,double *din, double *dw, double bias, double (*transfer)() */
+		/* unsigned int nin, NVCELL * const *incells,nnc_real_t *din, nnc_real_t *dw, nnc_real_t bias, nnc_real_t (*transfer)() */
 		layer->nvcells[k]=new_nvcell(fs*fs, NULL, NULL, NULL, 0.0f, NULL);  /* incells, din to assign later */
 		if(layer->nvcells[k]==NULL) {
 			printf("%s: Fail in create layer->nvcells[%d]!\n", __func__, k);
@@ -995,7 +1591,7 @@ NVLAYER *new_conv_nvlayer( NVCELL * const *incells, double *din,
 			}
 		}
 		else { /* pdin */
-			layer->nvcells[k]->pdin = calloc(layer->nc, sizeof(double *));
+			layer->nvcells[k]->pdin = calloc(layer->nc, sizeof(nnc_real_t *));
 			if(layer->nvcells[k]->pdin == NULL) {
 				free_nvlayer(layer);
                                 return NULL;
@@ -1059,6 +1655,10 @@ void free_nvlayer(NVLAYER *layer)
 	if(layer->conv3x3) {
 		free_conv3x3(layer->conv3x3);
 	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		free_convkxk(layer->convkxk);
+	}
 	/* Case_2: MAXPOOL2X2 Layer */
 	else if(layer->maxpool2x2) {
 		free_maxpool2x2(layer->maxpool2x2);
@@ -1087,6 +1687,13 @@ void free_nvlayer(NVLAYER *layer)
 	if(layer->douts)
 	    free(layer->douts); /* HK2023-06-30 */
 
+	/* Free layer->dins, for tensor mode */
+	if(layer->dins)
+	    free(layer->dins);
+
+	/* Free layer->din8buf, for uint8 input data */
+	free(layer->din8buf);
+
 	/* Free layer */
 	free(layer);
 
@@ -1124,6 +1731,18 @@ NVNET *new_nvnet(unsigned int nl)
 
 	/* assign nl */
 	nnet->nl=nl;
+	nnet->infer_only=nnc_inference;
+
+#ifdef NNC_PROFILE
+	/* calloc nnet->profile */
+	nnet->profile=calloc(nl, sizeof(NVPROFILE));
+	if(nnet->profile==NULL) {
+		free(nnet->nvlayers);
+		free(nnet);
+		printf("Init a new NVNET: fail to calloc nnet->profile!\n");
+		return NULL;
+	}
+#endif
 
 	return nnet;
 }
@@ -1152,18 +1771,27 @@ void free_nvnet(NVNET *nnet)
 		nnet->params=NULL;
 	}
 
-	/* free mmts buff */
-	if(nnet->mmts != NULL) {
-		free(nnet->mmts);
-		nnet->mmts=NULL;
-	}
-
 	/* free nvlayers inside */
 	for(i=0;i < nnet->nl; i++) {
 		if(nnet->nvlayers[i] != NULL)
 			free_nvlayer(nnet->nvlayers[i]);
 	}
 
+	/* free batch working buffer */
+	free(nnet->bbuf);
+
+	/* free parameter arena, nnet->mmts is also inside. */
+	if(nnet->parena != NULL) {
+		free(nnet->parena);
+		nnet->parena=NULL;
+		nnet->mmts=NULL;
+	}
+
+	/* unmap model file */
+	if(nnet->pmap != NULL)
+		munmap(nnet->pmap, nnet->mapsize);
+
+	free(nnet->profile);
 	free(nnet->nvlayers);
 	free(nnet);
 
@@ -1201,7 +1829,7 @@ int nvcell_feed_forward(NVCELL *nvcell)
 			nvcell->dsum += (nvcell->din[i]) * (nvcell->dw[i]);
 		}
 		/* applay dv */
-		nvcell->dsum -= nvcell->dv;
+		nvcell->dsum -= *nvcell->dv;
 	}
 	/* 2.2 OR, get data from ahead nvcells' output */
 	else if( nvcell->incells !=NULL ) {
@@ -1214,7 +1842,7 @@ int nvcell_feed_forward(NVCELL *nvcell)
 			nvcell->dsum += (nvcell->incells[i]->dout) * (nvcell->dw[i]);
 		}
 		/* applay dv */
-		nvcell->dsum -= nvcell->dv;
+		nvcell->dsum -= *nvcell->dv;
 	}
 	/* 2.3 OR, input data unavailable ! */
 	else {
@@ -1246,8 +1874,8 @@ int nvcell_feed_forward(NVCELL *nvcell)
  *
  * Return:	loss/err value of the last feed_forward calculation.
 --------------------------------------------------------------------*/
-double nvcell_calc_loss(NVCELL *outcells, const double *tv,
-			double (*loss)(double out, const double tv) )
+nnc_real_t nvcell_calc_loss(NVCELL *outcells, const nnc_real_t *tv,
+			nnc_real_t (*loss)(nnc_real_t out, const nnc_real_t tv) )
 {
 
 	/* check input param */
@@ -1359,883 +1987,5295 @@ int nvcell_feed_backward(NVCELL *nvcell)
 
 #if 0 /* move to nvnet_update_params() */
 	/* 4. update bias value by learning */
-	nvcell->dv += -dlrate*(-1.0)*(nvcell->derr); /* bias deemed as a special kind of weight, with din[x]=-1 */
+	*nvcell->dv += -dlrate*(-1.0)*(nvcell->derr); /* bias deemed as a special kind of weight, with din[x]=-1 */
 #endif
 
 	return 0;
 }
 
 
-/*------------------------------------------------
+#ifdef NNC_X86_SIMD /* ----- AVX2/FMA kernels ----- */
+
+/* AVX2 lane type and intrinsics as per nnc_real_t, NNC_VLEN elements per lane */
+#ifdef NNC_FLOAT32
+#define NNC_VLEN		8
+#define nnc_vec_t		__m256
+#define nnc_vzero()		_mm256_setzero_ps()
+#define nnc_vset1(x)		_mm256_set1_ps(x)
+#define nnc_vload(p)		_mm256_loadu_ps(p)
+#define nnc_vstore(p,v)		_mm256_storeu_ps(p,v)
+#define nnc_vsub(a,b)		_mm256_sub_ps(a,b)
+#define nnc_vadd(a,b)		_mm256_add_ps(a,b)
+#define nnc_vmul(a,b)		_mm256_mul_ps(a,b)
+#define nnc_vdiv(a,b)		_mm256_div_ps(a,b)
+#define nnc_vsqrt(a)		_mm256_sqrt_ps(a)
+#define nnc_vfmadd(a,b,c)	_mm256_fmadd_ps(a,b,c)
+#else
+#define NNC_VLEN		4
+#define nnc_vec_t		__m256d
+#define nnc_vzero()		_mm256_setzero_pd()
+#define nnc_vset1(x)		_mm256_set1_pd(x)
+#define nnc_vload(p)		_mm256_loadu_pd(p)
+#define nnc_vstore(p,v)		_mm256_storeu_pd(p,v)
+#define nnc_vsub(a,b)		_mm256_sub_pd(a,b)
+#define nnc_vadd(a,b)		_mm256_add_pd(a,b)
+#define nnc_vmul(a,b)		_mm256_mul_pd(a,b)
+#define nnc_vdiv(a,b)		_mm256_div_pd(a,b)
+#define nnc_vsqrt(a)		_mm256_sqrt_pd(a)
+#define nnc_vfmadd(a,b,c)	_mm256_fmadd_pd(a,b,c)
+#endif
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. AVX2/FMA: Row i of dsums of a filter into dst[ow], with bias.
+ *	2. NNC_VLEN output columns per lane, 2*NNC_VLEN columns per step,
+ *	   the rest columns as scalar.
+ *	3. Results differ from the scalar loops only in rounding, as FMA.
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_row(const CONV3X3 *conv3, int findex, int i, nnc_real_t *dst)
+{
+	int j, ii, jj, k, chindex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow;
+	const nnc_real_t *src, *fp;
+	nnc_real_t bias, sum;
+	nnc_vec_t acc0, acc1, w;
+
+	bias=conv3->dvs ? conv3->dvs[findex] : 0.0;
+
+	/* 2*NNC_VLEN columns per step */
+	for(j=0; j+2*NNC_VLEN-1<ow; j+=2*NNC_VLEN) {
+	    acc0=nnc_vzero();
+	    acc1=nnc_vzero();
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		src=conv3->din+chindex*imw*imh+i*imw+j;
+		fp=conv3->fparams[findex][chindex];
+		for(ii=0; ii<3; ii++) {
+		    for(jj=0; jj<3; jj++) {
+			w=nnc_vset1(fp[ii*3+jj]);
+			acc0=nnc_vfmadd(w, nnc_vload(src+ii*imw+jj), acc0);
+			acc1=nnc_vfmadd(w, nnc_vload(src+ii*imw+jj+NNC_VLEN), acc1);
+		    }
+		}
+	    }
+	    w=nnc_vset1(bias);
+	    nnc_vstore(dst+j, nnc_vsub(acc0, w));
+	    nnc_vstore(dst+j+NNC_VLEN, nnc_vsub(acc1, w));
+	}
+	/* NNC_VLEN columns */
+	for(; j+NNC_VLEN-1<ow; j+=NNC_VLEN) {
+	    acc0=nnc_vzero();
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		src=conv3->din+chindex*imw*imh+i*imw+j;
+		fp=conv3->fparams[findex][chindex];
+		for(k=0; k<9; k++)
+		    acc0=nnc_vfmadd(nnc_vset1(fp[k]), nnc_vload(src+(k/3)*imw+k%3), acc0);
+	    }
+	    nnc_vstore(dst+j, nnc_vsub(acc0, nnc_vset1(bias)));
+	}
+	/* Rest columns */
+	for(; j<ow; j++) {
+	    sum=0.0;
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		src=conv3->din+chindex*imw*imh+i*imw+j;
+		fp=conv3->fparams[findex][chindex];
+		for(k=0; k<9; k++)
+		    sum += fp[k]*src[(k/3)*imw+k%3];
+	    }
+	    dst[j]=sum-bias;
+	}
+}
+
+/*------------------------------------------------------------------
+ * Note:
+ *	AVX2/FMA feed forward for CONV3X3 direct engine, row by row.
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_feed_forward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, findex;
+	int ow=conv3->ow, oh=conv3->oh;
+	nnc_real_t *dsums, *douts;
+
+	for(findex=f0; findex < f1; findex++) {
+	    dsums=conv3->dsums[findex];
+	    douts=conv3->douts[findex];
+
+	    for(i=0; i<oh; i++) {
+		conv3x3_avx2_row(conv3, findex, i, dsums+i*ow);
+
+		/* Inference only: dsums is douts, apply transfunc to the row while it's in cache */
+		if(conv3->infer_only)
+		    actfs_forward(conv3->transfunc, douts+i*ow, douts+i*ow, ow);
+	    }
+
+	    /* douts=transfunc(dsums) */
+	    if(!conv3->infer_only)
+		actfs_forward(conv3->transfunc, dsums, douts, ow*oh);
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. AVX2/FMA feed backward for CONV3X3 direct engine.
+ *	2. G=derr*f'(u) of a filter is computed into conv3->gout first,
+ *	   then for each filter param:
+ *	      dFP = SUM{ G*din },  NNC_VLEN columns per lane.
+ *	      prederr += fparam*G, NNC_VLEN columns per lane.
+ *	3. conv3->gout MUST be allocated, see conv3x3_feed_backward().
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_feed_backward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i,j, ii, jj, k, findex, chindex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	const nnc_real_t *src, *derr, *dsums, *douts;
+	nnc_real_t *g, *dst;
+	nnc_real_t sum, fw;
+	nnc_vec_t acc, w;
+	nnc_real_t tmp[NNC_VLEN];
+
+	for(findex=f0; findex < f1; findex++) {
+	    g=conv3->gout+findex*ow*oh;
+	    derr=conv3->derr[findex];
+	    dsums=conv3->dsums[findex];
+	    douts=conv3->douts[findex];
+
+	    /* 1. G=derr*f'(u), and dferr=SUM(G) */
+	    actfs_backward(conv3->transfunc, dsums, douts, derr, g, ow*oh);
+	    if(conv3->dvs) {
+		sum=0.0;
+		for(k=0; k<ow*oh; k++)
+		    sum += g[k];
+		conv3->dferr[findex]=sum;
+	    }
+
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		for(ii=0; ii<3; ii++) {
+		    for(jj=0; jj<3; jj++) {
+			/* 2. dFP=SUM{G*din} */
+			acc=nnc_vzero();
+			sum=0.0;
+			for(i=0; i<oh; i++) {
+			    src=conv3->din+chindex*imw*imh+(i+ii)*imw+jj;
+			    for(j=0; j+NNC_VLEN-1<ow; j+=NNC_VLEN)
+				acc=nnc_vfmadd(nnc_vload(g+i*ow+j), nnc_vload(src+j), acc);
+			    for(; j<ow; j++)
+				sum += g[i*ow+j]*src[j];
+			}
+			nnc_vstore(tmp, acc);
+			for(k=0; k<NNC_VLEN; k+=2)
+			    sum += tmp[k]+tmp[k+1];
+			conv3->dFP[findex][chindex][ii*3+jj]=sum;
+
+			/* 3. prederr += fparam*G */
+			if(prederr) {
+			    fw=conv3->fparams[findex][chindex][ii*3+jj];
+			    w=nnc_vset1(fw);
+			    for(i=0; i<oh; i++) {
+				dst=prederr[chindex]+(i+ii)*imw+jj;
+				for(j=0; j+NNC_VLEN-1<ow; j+=NNC_VLEN)
+				    nnc_vstore(dst+j, nnc_vfmadd(w, nnc_vload(g+i*ow+j), nnc_vload(dst+j)));
+				for(; j<ow; j++)
+				    dst[j] += fw*g[i*ow+j];
+			    }
+			}
+		    }
+		}
+	    }
+	}
+}
+
+/*------------------------------------------------------------------
+ * Note:
+ *	AVX2/FMA fused optimizer sweep, as nvoptim_sweep().
+ *	NNC_VLEN params per lane, the tail by scalar loops.
+------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void nvoptim_avx2_sweep(nnc_real_t *p, nnc_real_t *acc, nnc_real_t *m, nnc_real_t *v,
+			       unsigned long n, const struct nvoptim_coefs *c)
+{
+	unsigned long k;
+	nnc_vec_t g, vm, vv;
+	nnc_vec_t gs=nnc_vset1(c->gs), b1=nnc_vset1(c->b1), c1=nnc_vset1(c->c1);
+	nnc_vec_t b2=nnc_vset1(c->b2), c2=nnc_vset1(c->c2);
+	nnc_vec_t s1=nnc_vset1(c->s1), s2=nnc_vset1(c->s2), eps=nnc_vset1(c->eps);
+	nnc_real_t gk;
+
+	for(k=0; k+NNC_VLEN-1<n; k+=NNC_VLEN) {
+		g=nnc_vmul(nnc_vload(acc+k), gs);
+		vm=nnc_vfmadd(c1, g, nnc_vmul(b1, nnc_vload(m+k)));
+		vv=nnc_vfmadd(nnc_vmul(c2, g), g, nnc_vmul(b2, nnc_vload(v+k)));
+		nnc_vstore(m+k, vm);
+		nnc_vstore(v+k, vv);
+		nnc_vstore(p+k, nnc_vadd(nnc_vload(p+k),
+			   nnc_vdiv(nnc_vfmadd(s1, vm, nnc_vmul(s2, g)), nnc_vadd(nnc_vsqrt(vv), eps))));
+		nnc_vstore(acc+k, nnc_vzero());
+	}
+	for(; k<n; k++) {
+		gk=acc[k]*c->gs;
+		m[k]=c->b1*m[k]+c->c1*gk;
+		v[k]=c->b2*v[k]+c->c2*gk*gk;
+		p[k] += (c->s1*m[k]+c->s2*gk)/(sqrt(v[k])+c->eps);
+		acc[k]=0.0;
+	}
+}
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. AVX2/FMA feed forward for CONV3X3_ENGINE_NCHWC, for filters
+ *	   [f0,f1), as conv3x3_nchwc_feed_forward().
+ *	2. 4 filters x 2 output columns per step, each lane loads one
+ *	   pixel of NNC_VLEN channels, lanes are added up at last.
+ *	   Tail filters/column are computed again as the last one, and
+ *	   NOT stored.
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_nchwc_feed_forward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, j, j1, ii, k, l, cb, fb, nfb, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *s0, *s1, *fw[4];
+	nnc_real_t *dsums;
+	nnc_vec_t x0, x1, w;
+	nnc_vec_t acc0[4], acc1[4];
+	nnc_real_t tmp[2][NNC_VLEN];
+	nnc_real_t sum0, sum1;
+
+	for(findex=f0; findex < f1; findex+=4) {
+	    nfb= f1-findex < 4 ? f1-findex : 4;
+	    for(fb=0; fb<4; fb++)
+		fw[fb]=conv3->cbw+(findex+(fb<nfb ? fb : nfb-1))*ncb*9*CONV3X3_CBLK;
+
+	    for(i=0; i<oh; i++) {
+		for(j=0; j<ow; j+=2) {
+		    j1= j+1<ow ? j+1 : j;
+		    for(fb=0; fb<4; fb++) {
+			acc0[fb]=nnc_vzero();
+			acc1[fb]=nnc_vzero();
+		    }
+		    for(cb=0; cb<ncb; cb++) {
+			for(ii=0; ii<3; ii++) {
+			    s0=conv3->cbin+((cb*imh+i+ii)*imw+j)*CONV3X3_CBLK;
+			    s1=conv3->cbin+((cb*imh+i+ii)*imw+j1)*CONV3X3_CBLK;
+			    l=(cb*9+ii*3)*CONV3X3_CBLK;
+			    for(k=0; k<3*CONV3X3_CBLK; k+=NNC_VLEN) {
+				x0=nnc_vload(s0+k);
+				x1=nnc_vload(s1+k);
+				for(fb=0; fb<4; fb++) {
+				    w=nnc_vload(fw[fb]+l+k);
+				    acc0[fb]=nnc_vfmadd(w, x0, acc0[fb]);
+				    acc1[fb]=nnc_vfmadd(w, x1, acc1[fb]);
+				}
+			    }
+			}
+		    }
+		    for(fb=0; fb<nfb; fb++) {
+			nnc_vstore(tmp[0], acc0[fb]);
+			nnc_vstore(tmp[1], acc1[fb]);
+			sum0=0.0;
+			sum1=0.0;
+			for(l=0; l<NNC_VLEN; l++) {
+			    sum0 += tmp[0][l];
+			    sum1 += tmp[1][l];
+			}
+			dsums=conv3->dsums[findex+fb];
+			dsums[i*ow+j]=sum0-(conv3->dvs ? conv3->dvs[findex+fb] : 0.0);
+			if(j1>j)
+			    dsums[i*ow+j1]=sum1-(conv3->dvs ? conv3->dvs[findex+fb] : 0.0);
+		    }
+		}
+	    }
+
+	    /* douts=transfunc(dsums), in place for inference only */
+	    for(fb=0; fb<nfb; fb++)
+		actfs_forward(conv3->transfunc, conv3->dsums[findex+fb], conv3->douts[findex+fb], ow*oh);
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. AVX2/FMA feed backward for CONV3X3_ENGINE_NCHWC, for filters
+ *	   [f0,f1), as conv3x3_nchwc_feed_dparams().
+ *	2. dFP of a row of 3 taps of a channel block, 3*CONV3X3_CBLK,
+ *	   is summed in lanes over all outputs, G broadcast.
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_nchwc_feed_dparams(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, j, ii, k, l, cb, chindex, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *src;
+	nnc_real_t *g;
+	nnc_vec_t gv, acc[3*CONV3X3_CBLK/NNC_VLEN];
+	nnc_real_t tmp[3*CONV3X3_CBLK];
+	nnc_real_t sum;
+
+	for(findex=f0; findex < f1; findex++) {
+	    g=conv3->gout+findex*ow*oh;
+
+	    /* 1. G=derr*f'(u), and dferr=SUM(G) */
+	    actfs_backward(conv3->transfunc, conv3->dsums[findex], conv3->douts[findex], conv3->derr[findex], g, ow*oh);
+	    if(conv3->dvs) {
+		sum=0.0;
+		for(k=0; k<ow*oh; k++)
+		    sum += g[k];
+		conv3->dferr[findex]=sum;
+	    }
+
+	    /* 2. dFP=SUM{G*din}, per row of taps of a channel block */
+	    for(cb=0; cb<ncb; cb++) {
+		for(ii=0; ii<3; ii++) {
+		    for(k=0; k<3*CONV3X3_CBLK/NNC_VLEN; k++)
+			acc[k]=nnc_vzero();
+		    for(i=0; i<oh; i++) {
+			src=conv3->cbin+((cb*imh+i+ii)*imw)*CONV3X3_CBLK;
+			for(j=0; j<ow; j++) {
+			    gv=nnc_vset1(g[i*ow+j]);
+			    for(k=0; k<3*CONV3X3_CBLK/NNC_VLEN; k++)
+				acc[k]=nnc_vfmadd(gv, nnc_vload(src+j*CONV3X3_CBLK+k*NNC_VLEN), acc[k]);
+			}
+		    }
+		    for(k=0; k<3*CONV3X3_CBLK/NNC_VLEN; k++)
+			nnc_vstore(tmp+k*NNC_VLEN, acc[k]);
+		    for(l=0; l<CONV3X3_CBLK && (chindex=cb*CONV3X3_CBLK+l) < conv3->nchan; l++) {
+			for(k=0; k<3; k++)
+			    conv3->dFP[findex][chindex][ii*3+k]=tmp[k*CONV3X3_CBLK+l];
+		    }
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. AVX2/FMA feed backward for CONV3X3_ENGINE_NCHWC, for channel
+ *	   blocks [cb0,cb1), as conv3x3_nchwc_feed_prederr().
+ *	2. Each pixel of cberr is summed in lanes over filters and the
+ *	   3x3 outputs it goes to, then stored once.
+-------------------------------------------------------------------*/
+__attribute__((target("avx2,fma")))
+static void conv3x3_avx2_nchwc_feed_prederr(CONV3X3 *conv3, int cb0, int cb1, nnc_real_t * const *prederr)
+{
+	int x, y, i, j, ii, jj, i0, i1, j0, j1, k, l, cb, chindex, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *w, *g;
+	nnc_real_t *perr;
+	nnc_vec_t gv, acc[CONV3X3_CBLK/NNC_VLEN];
+
+	for(cb=cb0; cb<cb1; cb++) {
+	    perr=conv3->cberr+cb*imh*imw*CONV3X3_CBLK;
+
+	    for(y=0; y<imh; y++) {
+		/* Outputs (i,j)=(y-ii,x-jj) in range */
+		i0= y-2>0 ? y-2 : 0;
+		i1= y<oh-1 ? y : oh-1;
+		for(x=0; x<imw; x++) {
+		    j0= x-2>0 ? x-2 : 0;
+		    j1= x<ow-1 ? x : ow-1;
+		    for(k=0; k<CONV3X3_CBLK/NNC_VLEN; k++)
+			acc[k]=nnc_vzero();
+		    for(findex=0; findex < conv3->nf; findex++) {
+			w=conv3->cbw+(findex*ncb+cb)*9*CONV3X3_CBLK;
+			g=conv3->gout+findex*ow*oh;
+			for(i=i0; i<=i1; i++) {
+			    ii=y-i;
+			    for(j=j0; j<=j1; j++) {
+				jj=x-j;
+				gv=nnc_vset1(g[i*ow+j]);
+				for(k=0; k<CONV3X3_CBLK/NNC_VLEN; k++)
+				    acc[k]=nnc_vfmadd(gv, nnc_vload(w+(ii*3+jj)*CONV3X3_CBLK+k*NNC_VLEN), acc[k]);
+			    }
+			}
+		    }
+		    for(k=0; k<CONV3X3_CBLK/NNC_VLEN; k++)
+			nnc_vstore(perr+(y*imw+x)*CONV3X3_CBLK+k*NNC_VLEN, acc[k]);
+		}
+	    }
+
+	    /* Unpack to prederr */
+	    for(l=0; l<CONV3X3_CBLK && (chindex=cb*CONV3X3_CBLK+l) < conv3->nchan; l++) {
+		for(k=0; k<imw*imh; k++)
+		    conv3->prederr[chindex][k] += perr[k*CONV3X3_CBLK+l];
+	    }
+	}
+}
+
+#endif /* ----- END: AVX2/FMA kernels ----- */
+
+
+/*----------------------------------------------------------------
+ * Note:
+ *	1. Select SIMD kernels as per CPUID, it runs once at startup,
+ *	   so one build runs the best kernels on different CPUs.
+ *	2. If the CPU has no AVX2/FMA, or nnc_set_simd(false), the
+ *	   scalar loops are used.
+-----------------------------------------------------------------*/
+#ifdef NNC_X86_SIMD
+__attribute__((constructor))
+#endif
+void nnc_cpu_dispatch(void)
+{
+	conv3x3_simd_feed_forward=NULL;
+	conv3x3_simd_feed_backward=NULL;
+	conv3x3_simd_row=NULL;
+	conv3x3_simd_nchwc_forward=NULL;
+	conv3x3_simd_nchwc_dparams=NULL;
+	conv3x3_simd_nchwc_prederr=NULL;
+	nvoptim_simd_sweep=NULL;
+
+	if(!nnc_simd_allowed)
+		return;
+
+#ifdef NNC_X86_SIMD
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+		conv3x3_simd_feed_forward=conv3x3_avx2_feed_forward;
+		conv3x3_simd_feed_backward=conv3x3_avx2_feed_backward;
+		conv3x3_simd_row=conv3x3_avx2_row;
+		conv3x3_simd_nchwc_forward=conv3x3_avx2_nchwc_feed_forward;
+		conv3x3_simd_nchwc_dparams=conv3x3_avx2_nchwc_feed_dparams;
+		conv3x3_simd_nchwc_prederr=conv3x3_avx2_nchwc_feed_prederr;
+		nvoptim_simd_sweep=nvoptim_avx2_sweep;
+	}
+#endif
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Lower din[nchan][imw*imh] to an im2col patch matrix with
+ *	   row stride ldc: cols[chan*9+ii*3+jj][i*ow+j], ldc>=ow*oh.
+ *	2. With ldc>ow*oh, samples of a batch are put side by side.
+-------------------------------------------------------------------*/
+static void conv3x3_im2col_data(const CONV3X3 *conv3, const nnc_real_t *din, nnc_real_t *cols, unsigned int ldc)
+{
+	int i, ii, jj, chindex;
+	unsigned int imw=conv3->imw, imh=conv3->imh;
+	unsigned int ow=conv3->ow, oh=conv3->oh;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	for(chindex=0; chindex < conv3->nchan; chindex++) {
+	    for(ii=0; ii<3; ii++) {
+		for(jj=0; jj<3; jj++) {
+		    dst=cols+(chindex*9+ii*3+jj)*ldc;
+		    src=din+chindex*imw*imh+ii*imw+jj;
+		    for(i=0; i<oh; i++)
+			memcpy(dst+i*ow, src+i*imw, ow*sizeof(nnc_real_t));
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Normalize uint8 data: dout[k]=din8[k]*scale, k=0~n-1.
+-------------------------------------------------------------------*/
+static void nnc_normalize_u8(const uint8_t *din8, nnc_real_t scale, nnc_real_t *dout, unsigned int n)
+{
+	unsigned int k;
+
+	for(k=0; k<n; k++)
+		dout[k]=din8[k]*scale;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Same as conv3x3_im2col_data(), with uint8 data din8[nchan][imw*imh],
+ *	   normalized as din8[k]*scale when lowered to cols.
+-------------------------------------------------------------------*/
+static void conv3x3_im2col_data_u8(const CONV3X3 *conv3, const uint8_t *din8, nnc_real_t scale,
+				   nnc_real_t *cols, unsigned int ldc)
+{
+	int i, ii, jj, chindex;
+	unsigned int imw=conv3->imw, imh=conv3->imh;
+	unsigned int ow=conv3->ow, oh=conv3->oh;
+	const uint8_t *src;
+	nnc_real_t *dst;
+
+	for(chindex=0; chindex < conv3->nchan; chindex++) {
+	    for(ii=0; ii<3; ii++) {
+		for(jj=0; jj<3; jj++) {
+		    dst=cols+(chindex*9+ii*3+jj)*ldc;
+		    src=din8+chindex*imw*imh+ii*imw+jj;
+		    for(i=0; i<oh; i++)
+			nnc_normalize_u8(src+i*imw, scale, dst+i*ow, ow);
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Lower conv3->din to the im2col patch matrix conv3->cols[K][P],
+ *	   K=nchan*9, P=ow*oh.
+ *	   cols[chan*9+ii*3+jj][i*ow+j] = din[chan*imw*imh+(i+ii)*imw+j+jj]
+ *	2. Each cols row is a shifted copy of din rows, so it's memcpy
+ *	   friendly.
+-------------------------------------------------------------------*/
+static void conv3x3_im2col(CONV3X3 *conv3)
+{
+	if(conv3->din8)
+		conv3x3_im2col_data_u8(conv3, conv3->din8, conv3->din8_scale, conv3->cols, conv3->ow*conv3->oh);
+	else
+		conv3x3_im2col_data(conv3, conv3->din, conv3->cols, conv3->ow*conv3->oh);
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Add up cols[K][P] to prederr[nchan][imw*imh], the reverse of
+ *	   conv3x3_im2col().
+ *	2. Here conv3->dcols as the source.
+-------------------------------------------------------------------*/
+static void conv3x3_col2im(CONV3X3 *conv3)
+{
+	int i, j, ii, jj, chindex;
+	unsigned int imw=conv3->imw;
+	unsigned int ow=conv3->ow, oh=conv3->oh;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	for(chindex=0; chindex < conv3->nchan; chindex++) {
+	    for(ii=0; ii<3; ii++) {
+		for(jj=0; jj<3; jj++) {
+		    src=conv3->dcols+(chindex*9+ii*3+jj)*ow*oh;
+		    dst=conv3->prederr[chindex]+ii*imw+jj;
+		    for(i=0; i<oh; i++)
+			for(j=0; j<ow; j++)
+			    dst[i*imw+j] += src[i*ow+j];
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. A cache-blocked GEMM: C[M][P] (+)= A[M][K]*B[K][P], all row-major.
+ *	2. C is cleared first if clear==true.
+ *	3. Columns of C/B are blocked by CONV3X3_GEMM_PBLK, and 4 rows of
+ *	   C are computed together to reuse each loaded B row.
+ *	   For each C element, A[m][k]*B[k][p] are summed in order of k.
+ *	4. If transA==true, A is taken as stored in A[K][M] (A^T).
+-------------------------------------------------------------------*/
+static void conv3x3_gemm(int M, int K, int P, const nnc_real_t *A, bool transA,
+			 const nnc_real_t *B, nnc_real_t *C, bool clear)
+{
+	int m, k, p, pb, pe;
+	nnc_real_t a0, a1, a2, a3;
+	const nnc_real_t *b;
+	nnc_real_t *c0, *c1, *c2, *c3;
+
+	/* A[m][k] as per transA */
+	#define GEMM_A(m,k)  (transA ? A[(k)*M+(m)] : A[(m)*K+(k)])
+
+	if(clear)
+		memset(C, 0, M*P*sizeof(nnc_real_t));
+
+	for(pb=0; pb<P; pb+=CONV3X3_GEMM_PBLK) {
+	    pe = pb+CONV3X3_GEMM_PBLK < P ? pb+CONV3X3_GEMM_PBLK : P;
+
+	    /* 4 rows a time */
+	    for(m=0; m+3<M; m+=4) {
+		c0=C+m*P; c1=c0+P; c2=c1+P; c3=c2+P;
+		for(k=0; k<K; k++) {
+		    a0=GEMM_A(m,k); a1=GEMM_A(m+1,k);
+		    a2=GEMM_A(m+2,k); a3=GEMM_A(m+3,k);
+		    b=B+k*P;
+		    for(p=pb; p<pe; p++) {
+			c0[p] += a0*b[p];
+			c1[p] += a1*b[p];
+			c2[p] += a2*b[p];
+			c3[p] += a3*b[p];
+		    }
+		}
+	    }
+	    /* Rest rows */
+	    for(; m<M; m++) {
+		c0=C+m*P;
+		for(k=0; k<K; k++) {
+		    a0=GEMM_A(m,k);
+		    b=B+k*P;
+		    for(p=pb; p<pe; p++)
+			c0[p] += a0*b[p];
+		}
+	    }
+	}
+
+	#undef GEMM_A
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. Kernel of CONV3X3_ENGINE_IM2COL feed forward, after
+ *	   im2col: dsums[f0:f1][P]=W[f0:f1][K]*cols[K][P]-dvs,
+ *	   then transfunc.
+-------------------------------------------------*/
+static void conv3x3_im2col_kernel(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int k, findex;
+	unsigned int P=conv3->ow*conv3->oh;
+	unsigned int K=conv3->nchan*9;
+	nnc_real_t *dsums, *douts;
+	nnc_real_t bias;
+
+	if(f1<=f0)
+		return;
+
+	/* dsums=W*cols */
+	conv3x3_gemm(f1-f0, K, P, conv3->fparams[0][0]+f0*K, false, conv3->cols, conv3->dsums[f0], true);
+
+	/* Apply bias and transfunc */
+	for(findex=f0; findex < f1; findex++) {
+	    dsums=conv3->dsums[findex];
+	    douts=conv3->douts[findex];
+
+	    /* Inference only: dsums is douts, bias and transfunc in one pass */
+	    if(conv3->infer_only) {
+		bias=conv3->dvs ? conv3->dvs[findex] : 0.0;
+		for(k=0; k<P; k++)
+		    douts[k] -= bias;
+		actfs_forward(conv3->transfunc, douts, douts, P);
+		continue;
+	    }
+
+	    if(conv3->dvs) {
+		for(k=0; k<P; k++)
+		    dsums[k] -= conv3->dvs[findex];
+	    }
+	    actfs_forward(conv3->transfunc, dsums, douts, P);
+	}
+}
+
+
+/* Context of CONV3X3 filter tasks, see conv3x3_run_tasks() */
+struct conv3x3_tasks {
+	CONV3X3 *conv3;
+	conv3x3_kernel_t kernel;
+	bool backward;
+	int ntask;
+};
+
+static void conv3x3_task(void *arg, int t)
+{
+	struct conv3x3_tasks *ctx=arg;
+	CONV3X3 *conv3=ctx->conv3;
+	int f0=t*conv3->nf/ctx->ntask;
+	int f1=(t+1)*conv3->nf/ctx->ntask;
+	nnc_real_t * const *prederr= ctx->backward ? conv3->prederr : NULL;
+
+	/* Private prederr for task t>0 */
+	if(t>0 && prederr) {
+		prederr=conv3->tperrp+(t-1)*conv3->nchan;
+		memset(prederr[0], 0, conv3->nchan*conv3->imw*conv3->imh*sizeof(nnc_real_t));
+	}
+
+	ctx->kernel(conv3, f0, f1, prederr);
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Run a CONV3X3 kernel with filters split into ntask tasks,
+ *	   in nnc_pool. ntask=min(nf, threads), or 1 if no pool or in
+ *	   a task of other pool(as NVTRAINER).
+ *	2. Feed backward: Task 0 adds to conv3->prederr directly, other
+ *	   tasks to their private buffers, which are then added to prederr
+ *	   in order of tasks. So results are deterministic for a given ntask.
+ *	   Feed forward: Kernels get prederr as NULL, NO private buffers
+ *	   are allocated or reduced.
+ *
+ * Params:
+ * 	@conv3		Pointer to a CONV3X3
+ *	@kernel		Kernel for filters [f0,f1)
+ *	@backward	true for a feed backward kernel, which adds to prederr.
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------------------------*/
+static int conv3x3_run_tasks(CONV3X3 *conv3, conv3x3_kernel_t kernel, bool backward)
+{
+	int t, c, k;
+	unsigned int size=conv3->imw*conv3->imh;
+	struct conv3x3_tasks ctx;
+
+	ctx.conv3=conv3;
+	ctx.kernel=kernel;
+	ctx.backward=backward;
+	ctx.ntask=1;
+	if(nnc_pool && !thpool_in_worker())
+		ctx.ntask= conv3->nf < nnc_pool->nth+1 ? conv3->nf : nnc_pool->nth+1;
+
+	if(ctx.ntask==1) {
+		kernel(conv3, 0, conv3->nf, backward ? conv3->prederr : NULL);
+		return 0;
+	}
+
+	/* Private prederr buffers for task 1 ~ ntask-1 */
+	if(backward && conv3->prederr && conv3->ntperr < ctx.ntask-1) {
+		free(conv3->tperr);
+		free(conv3->tperrp);
+		conv3->tperr=malloc((ctx.ntask-1)*conv3->nchan*size*sizeof(nnc_real_t));
+		conv3->tperrp=malloc((ctx.ntask-1)*conv3->nchan*sizeof(nnc_real_t *));
+		if(conv3->tperr==NULL || conv3->tperrp==NULL) {
+			printf("%s: Fail to malloc private prederr.\n", __func__);
+			conv3->ntperr=0;
+			return -2;
+		}
+		for(k=0; k < (ctx.ntask-1)*conv3->nchan; k++)
+			conv3->tperrp[k]=conv3->tperr+k*size;
+		conv3->ntperr=ctx.ntask-1;
+	}
+
+	thpool_run(nnc_pool, conv3x3_task, &ctx, ctx.ntask);
+
+	/* Reduce prederr in order of tasks */
+	if(backward && conv3->prederr) {
+		for(t=1; t< ctx.ntask; t++) {
+			for(c=0; c< conv3->nchan; c++) {
+				for(k=0; k<size; k++)
+					conv3->prederr[c][k] += conv3->tperrp[(t-1)*conv3->nchan+c][k];
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_IM2COL feed forward.
+ *	2. dsums[nf][P]=W[nf][K]*cols[K][P]-dvs, W as flattened fparams.
+ *	   Same results as the direct loops.
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------*/
+static int conv3x3_im2col_feed_forward(CONV3X3 *conv3)
+{
+	if(conv3->cols==NULL) {
+		printf("%s: conv3x3->cols is NULL, call conv3x3_set_engine() first!\n", __func__);
+		return -1;
+	}
+
+	/* 1. Lower din */
+	conv3x3_im2col(conv3);
+
+	/* 2. dsums=W*cols, bias and transfunc, filters split across threads */
+	return conv3x3_run_tasks(conv3, conv3x3_im2col_kernel, false);
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_IM2COL feed backward.
+ *	2. G[nf][P]=derr*f'(u),  then:
+ *	      dFP[nf][K] = G*cols^T
+ *	      dcols[K][P] = W^T*G,  then col2im to prederr.
+ *	3. cols MUST be from the last forward.
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------*/
+static int conv3x3_im2col_feed_backward(CONV3X3 *conv3)
+{
+	int k, p, findex;
+	unsigned int P=conv3->ow*conv3->oh;
+	unsigned int K=conv3->nchan*9;
+	nnc_real_t *g, *derr, *dsums, *douts, *dFP;
+	const nnc_real_t *cols;
+	nnc_real_t dsum;
+
+	if(conv3->cols==NULL || conv3->gout==NULL || conv3->dcols==NULL) {
+		printf("%s: im2col buffers are NULL, call conv3x3_set_engine() first!\n", __func__);
+		return -1;
+	}
+
+	/* 1. G=derr*f'(u), and dferr */
+	for(findex=0; findex < conv3->nf; findex++) {
+	    g=conv3->gout+findex*P;
+	    derr=conv3->derr[findex];
+	    dsums=conv3->dsums[findex];
+	    douts=conv3->douts[findex];
+
+	    actfs_backward(conv3->transfunc, dsums, douts, derr, g, P);
+
+	    if(conv3->dvs) {
+		conv3->dferr[findex]=0.0;
+		for(p=0; p<P; p++)
+		    conv3->dferr[findex] += g[p];
+	    }
+	}
+
+	/* 2. dFP=G*cols^T, each as a dot product of rows */
+	dFP=conv3->dFP[0][0];
+	for(findex=0; findex < conv3->nf; findex++) {
+	    g=conv3->gout+findex*P;
+	    for(k=0; k<K; k++) {
+		cols=conv3->cols+k*P;
+		dsum=0.0;
+		for(p=0; p<P; p++)
+		    dsum += g[p]*cols[p];
+		dFP[findex*K+k]=dsum;
+	    }
+	}
+
+	/* 3. prederr += col2im(W^T*G) */
+	if(conv3->prederr) {
+		conv3x3_gemm(K, conv3->nf, P, conv3->fparams[0][0], true, conv3->gout, conv3->dcols, true);
+		conv3x3_col2im(conv3);
+	}
+
+	return 0;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Winograd F(2x2,3x3) filter transform, U=G*g*G^T, for all
+ *	   filters and channels, U[f][chan][4x4].
+ *		G = | 1    0    0  |
+ *		    | 1/2  1/2  1/2|
+ *		    | 1/2 -1/2  1/2|
+ *		    | 0    0    1  |
+ *	2. U is cached in conv3->wgU until fparams change.
+-------------------------------------------------------------------*/
+static void conv3x3_winograd_filters(CONV3X3 *conv3)
+{
+	int k, r;
+	const nnc_real_t *g;
+	nnc_real_t *U;
+	nnc_real_t t[4][3];	/* G*g */
+
+	for(k=0; k < conv3->nf*conv3->nchan; k++) {
+		g=conv3->fparams[0][0]+k*9;
+		U=conv3->wgU+k*16;
+
+		/* t=G*g, per column */
+		for(r=0; r<3; r++) {
+			t[0][r]=g[r];
+			t[1][r]=0.5*(g[r]+g[3+r]+g[6+r]);
+			t[2][r]=0.5*(g[r]-g[3+r]+g[6+r]);
+			t[3][r]=g[6+r];
+		}
+		/* U=t*G^T, per row */
+		for(r=0; r<4; r++) {
+			U[r*4+0]=t[r][0];
+			U[r*4+1]=0.5*(t[r][0]+t[r][1]+t[r][2]);
+			U[r*4+2]=0.5*(t[r][0]-t[r][1]+t[r][2]);
+			U[r*4+3]=t[r][2];
+		}
+	}
+
+	conv3->wgU_valid=true;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Feed forward with Winograd F(2x2,3x3).
+ *	   For each 4x4 input tile d of a channel: V=B^T*d*B,
+ *	   M=SUM_chan{ U(.)V } (elementwise), 2x2 outputs Y=A^T*M*A.
+ *		B^T = | 1  0 -1  0 |	A^T = | 1  1  1  0 |
+ *		      | 0  1  1  0 |	      | 0  1 -1 -1 |
+ *		      | 0 -1  1  0 |
+ *		      | 0  1  0 -1 |
+ *	2. Tiles at the odd edge read 0 beyond din, and only the
+ *	   valid outputs are stored.
+ *	3. Results differ from the direct engine only in rounding.
+-------------------------------------------------------------------*/
+static int conv3x3_winograd_feed_forward(CONV3X3 *conv3)
+{
+	int i,j, ii, jj, k, r, findex, chindex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	const nnc_real_t *src, *U, *V;
+	nnc_real_t *dsums, *pv;
+	nnc_real_t d[4][4], t[4][4], M[16];
+	nnc_real_t y0, y1, m0, m1, m2, m3;
+	nnc_real_t bias;
+
+	if(!conv3->wgU_valid)
+		conv3x3_winograd_filters(conv3);
+
+	for(i=0; i<oh; i+=2) {
+	    for(j=0; j<ow; j+=2) {
+
+		/* 1. V[chan]=B^T*d*B */
+		for(chindex=0; chindex < conv3->nchan; chindex++) {
+		    src=conv3->din+chindex*imw*imh;
+		    for(ii=0; ii<4; ii++) {
+			for(jj=0; jj<4; jj++)
+			    d[ii][jj]=(i+ii<imh && j+jj<imw) ? src[(i+ii)*imw+j+jj] : 0.0;
+		    }
+		    /* t=B^T*d */
+		    for(jj=0; jj<4; jj++) {
+			t[0][jj]=d[0][jj]-d[2][jj];
+			t[1][jj]=d[1][jj]+d[2][jj];
+			t[2][jj]=d[2][jj]-d[1][jj];
+			t[3][jj]=d[1][jj]-d[3][jj];
+		    }
+		    /* V=t*B */
+		    pv=conv3->wgV+chindex*16;
+		    for(r=0; r<4; r++) {
+			pv[r*4+0]=t[r][0]-t[r][2];
+			pv[r*4+1]=t[r][1]+t[r][2];
+			pv[r*4+2]=t[r][2]-t[r][1];
+			pv[r*4+3]=t[r][1]-t[r][3];
+		    }
+		}
+
+		/* 2. M=SUM{U(.)V}, Y=A^T*M*A */
+		for(findex=0; findex < conv3->nf; findex++) {
+		    for(k=0; k<16; k++)
+			M[k]=0.0;
+		    for(chindex=0; chindex < conv3->nchan; chindex++) {
+			U=conv3->wgU+(findex*conv3->nchan+chindex)*16;
+			V=conv3->wgV+chindex*16;
+			for(k=0; k<16; k++)
+			    M[k] += U[k]*V[k];
+		    }
+
+		    dsums=conv3->dsums[findex];
+		    bias=conv3->dvs ? conv3->dvs[findex] : 0.0;
+		    for(r=0; r<2 && i+r<oh; r++) {
+			/* Row r of A^T*M */
+			m0 = r==0 ? M[0]+M[4]+M[8]  : M[4]-M[8]-M[12];
+			m1 = r==0 ? M[1]+M[5]+M[9]  : M[5]-M[9]-M[13];
+			m2 = r==0 ? M[2]+M[6]+M[10] : M[6]-M[10]-M[14];
+			m3 = r==0 ? M[3]+M[7]+M[11] : M[7]-M[11]-M[15];
+			y0=m0+m1+m2;
+			y1=m1-m2-m3;
+			dsums[(i+r)*ow+j]= y0-bias;
+			if(j+1<ow)
+			    dsums[(i+r)*ow+j+1]= y1-bias;
+		    }
+		}
+	    }
+
+	    /* Inference only: dsums is douts, apply transfunc to the 2 rows while they're in cache */
+	    if(conv3->infer_only) {
+		for(findex=0; findex < conv3->nf; findex++)
+		    actfs_forward(conv3->transfunc, conv3->dsums[findex]+i*ow, conv3->dsums[findex]+i*ow, (i+1<oh ? 2 : 1)*ow);
+	    }
+	}
+
+	/* 3. douts=transfunc(dsums), done in 2. for inference only */
+	for(findex=0; findex < conv3->nf && !conv3->infer_only; findex++)
+	    actfs_forward(conv3->transfunc, conv3->dsums[findex], conv3->douts[findex], ow*oh);
+
+	return 0;
+}
+
+
+/*-------------------------------------------------------------
+ * Check the Winograd engine of a CONV3X3 against the direct
+ * engine, with current conv3->din and fparams.
+ * conv3->dsums/douts are overwritten.
+ *
+ * Params:
+ *	@conv3	Pointer to a CONV3X3, with din assigned.
+ *	@tol	Tolerance of max. abs difference, relative to
+ *		max. abs value of direct results.
+ * Return:
+ *	0	OK, within tolerance.
+ *	<0	Fails, or out of tolerance.
+-------------------------------------------------------------*/
+int conv3x3_check_winograd(CONV3X3 *conv3, double tol)
+{
+	int k, n, engine;
+	nnc_real_t *ref;
+	nnc_real_t dmax=0.0, emax=0.0;
+	int ret=0;
+
+	if(conv3==NULL || conv3->din==NULL)
+		return -1;
+
+	n=conv3->nf*conv3->ow*conv3->oh;
+	ref=calloc(n, sizeof(nnc_real_t));
+	if(ref==NULL) {
+		printf("%s: Fail to calloc ref.\n", __func__);
+		return -2;
+	}
+
+	engine=conv3->engine;
+
+	/* Direct results as reference, dsums[0] is flatten-friendly */
+	conv3->engine=CONV3X3_ENGINE_DIRECT;
+	if(conv3x3_feed_forward(conv3)!=0) {
+		ret=-3;
+		goto END_FUNC;
+	}
+	memcpy(ref, conv3->dsums[0], n*sizeof(nnc_real_t));
+
+	if(conv3x3_set_engine(conv3, CONV3X3_ENGINE_WINOGRAD)!=0 || conv3x3_feed_forward(conv3)!=0) {
+		ret=-3;
+		goto END_FUNC;
+	}
+	for(k=0; k<n; k++) {
+		dmax=fmax(dmax, fabs(ref[k]));
+		emax=fmax(emax, fabs(conv3->dsums[0][k]-ref[k]));
+	}
+
+	printf("%s: max|direct|=%e, max|winograd-direct|=%e\n", __func__, dmax, emax);
+	if( emax > tol*fmax(dmax, 1.0) ) {
+		printf("%s: Out of tolerance %e!\n", __func__, tol);
+		ret=-4;
+	}
+
+END_FUNC:
+	conv3->engine=engine;
+	free(ref);
+
+	return ret;
+}
+
+
+/*-------------------------------------------------------------
+ * Check the fused feed forward conv3x3_maxpool2x2_feed_forward()
+ * against conv3x3_feed_forward() then maxpool2x2_feed_forward(),
+ * both with the direct engine and current conv3->din/fparams.
+ * Compared are conv3->douts, maxpool->douts, maxpool->argmax, and
+ * conv3->derr scattered by maxpool2x2_feed_backward().
+ * conv3->dsums/douts/derr and maxpool->douts/argmax/derr are
+ * overwritten.
+ *
+ * Params:
+ *	@conv3		Pointer to a CONV3X3, with din assigned.
+ *	@maxpool	Pointer to a MAXPOOL2X2, maxpool->inconv3x3==conv3
+ *	@tol		Tolerance of max. abs difference, relative to
+ *			max. abs value of unfused results.
+ * Return:
+ *	0	OK, within tolerance.
+ *	<0	Fails, or out of tolerance.
+-------------------------------------------------------------*/
+int conv3x3_check_fusion(CONV3X3 *conv3, MAXPOOL2X2 *maxpool, double tol)
+{
+	int k, n, m, engine;
+	int nargmax=0;
+	nnc_real_t *ref;	/* Unfused conv3->douts[n], maxpool->douts[m], conv3->derr[n] */
+	uint8_t *refarg;
+	nnc_real_t dmax=0.0, emax=0.0;
+	int ret=0;
+
+	if(conv3==NULL || conv3->din==NULL || maxpool==NULL || maxpool->inconv3x3!=conv3)
+		return -1;
+	if(conv3->infer_only || maxpool->infer_only) {
+		printf("%s: conv3x3 OR maxpool2x2 is inference only!\n", __func__);
+		return -1;
+	}
+
+	n=conv3->nf*conv3->ow*conv3->oh;
+	m=maxpool->nf*maxpool->ow*maxpool->oh;
+	ref=calloc(2*n+m, sizeof(nnc_real_t));
+	refarg=malloc(m);
+	if(ref==NULL || refarg==NULL) {
+		printf("%s: Fail to calloc ref.\n", __func__);
+		free(ref);
+		return -2;
+	}
+
+	engine=conv3->engine;
+	conv3->engine=CONV3X3_ENGINE_DIRECT;
+
+	/* derr of the pooled outputs, douts/derr[0] are flatten-friendly */
+	for(k=0; k<m; k++)
+		maxpool->derr[0][k]=(k%7)-3.0;
+
+	/* 1. Unfused results as reference */
+	if( conv3x3_feed_forward(conv3)!=0 || maxpool2x2_feed_forward(maxpool)!=0
+	    || maxpool2x2_feed_backward(maxpool)!=0 ) {
+		ret=-3;
+		goto END_FUNC;
+	}
+	memcpy(ref, conv3->douts[0], n*sizeof(nnc_real_t));
+	memcpy(ref+n, maxpool->douts[0], m*sizeof(nnc_real_t));
+	memcpy(ref+n+m, conv3->derr[0], n*sizeof(nnc_real_t));
+	memcpy(refarg, maxpool->argmax, m);
+
+	/* 2. Fused */
+	if( conv3x3_maxpool2x2_feed_forward(conv3, maxpool)!=0 || maxpool2x2_feed_backward(maxpool)!=0 ) {
+		ret=-3;
+		goto END_FUNC;
+	}
+	for(k=0; k<n; k++) {
+		dmax=fmax(dmax, fabs(ref[k]));
+		emax=fmax(emax, fabs(conv3->douts[0][k]-ref[k]));
+		emax=fmax(emax, fabs(conv3->derr[0][k]-ref[n+m+k]));
+	}
+	for(k=0; k<m; k++) {
+		emax=fmax(emax, fabs(maxpool->douts[0][k]-ref[n+k]));
+		if(maxpool->argmax[k]!=refarg[k])
+			nargmax++;
+	}
+
+	printf("%s: max|unfused|=%e, max|fused-unfused|=%e, argmax differs %d/%d\n", __func__, dmax, emax, nargmax, m);
+	if( emax > tol*fmax(dmax, 1.0) || nargmax ) {
+		printf("%s: Out of tolerance %e!\n", __func__, tol);
+		ret=-4;
+	}
+
+END_FUNC:
+	conv3->engine=engine;
+	free(refarg);
+	free(ref);
+
+	return ret;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Pack din[nchan][imh*imw] of a CONV3X3 to the channel-blocked
+ *	   layout, for channel blocks [cb0,cb1), CONV3X3_CBLK channels
+ *	   interleaved per pixel:
+ *		cbin[cb][y][x][l] = din[cb*CONV3X3_CBLK+l][y*imw+x]
+ *	   Channels >=nchan are left 0.
+ *	2. Each forward packs again, as din changes. prederr is NOT used.
+-------------------------------------------------------------------*/
+static void conv3x3_nchwc_pack_din(CONV3X3 *conv3, int cb0, int cb1, nnc_real_t * const *prederr)
+{
+	int k, l, cb, chindex;
+	int size=conv3->imw*conv3->imh;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	(void)prederr;
+	for(cb=cb0; cb<cb1; cb++) {
+	    for(l=0; l<CONV3X3_CBLK; l++) {
+		chindex=cb*CONV3X3_CBLK+l;
+		if(chindex >= conv3->nchan)
+			break;
+		src=conv3->din+chindex*size;
+		dst=conv3->cbin+cb*size*CONV3X3_CBLK+l;
+		for(k=0; k<size; k++)
+			dst[k*CONV3X3_CBLK]=src[k];
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Pack fparams[nf][nchan][9] of filters [f0,f1) to the
+ *	   channel-blocked layout:
+ *		cbw[f][cb][k][l]  = fparams[f][cb*CONV3X3_CBLK+l][k]
+ *	   Channels >=nchan are left 0.
+ *	2. Packed ONLY when cbw_valid is false, as fparams change.
+ *	   prederr is NOT used.
+-------------------------------------------------------------------*/
+static void conv3x3_nchwc_pack_filters(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int k, l, cb, chindex, findex;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	(void)prederr;
+	for(findex=f0; findex < f1; findex++) {
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		cb=chindex/CONV3X3_CBLK;
+		l=chindex%CONV3X3_CBLK;
+		src=conv3->fparams[findex][chindex];
+		dst=conv3->cbw+(findex*ncb+cb)*9*CONV3X3_CBLK+l;
+		for(k=0; k<9; k++)
+			dst[k*CONV3X3_CBLK]=src[k];
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_NCHWC feed forward, for filters [f0,f1).
+ *	2. For each output, CONV3X3_CBLK lanes are summed over channel
+ *	   blocks and 3x3 taps, then the lanes are added up. A row of 3
+ *	   taps is 3*CONV3X3_CBLK contiguous data in both cbin and cbw.
+ *	3. Results differ from the direct engine only in rounding.
+-------------------------------------------------------------------*/
+static void conv3x3_nchwc_feed_forward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, j, ii, k, l, cb, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *src, *w;
+	nnc_real_t *dsums;
+	nnc_real_t acc[CONV3X3_CBLK];
+	nnc_real_t sum, bias;
+
+	for(findex=f0; findex < f1; findex++) {
+	    dsums=conv3->dsums[findex];
+	    bias=conv3->dvs ? conv3->dvs[findex] : 0.0;
+
+	    for(i=0; i<oh; i++) {
+		for(j=0; j<ow; j++) {
+		    for(l=0; l<CONV3X3_CBLK; l++)
+			acc[l]=0.0;
+		    for(cb=0; cb<ncb; cb++) {
+			w=conv3->cbw+(findex*ncb+cb)*9*CONV3X3_CBLK;
+			for(ii=0; ii<3; ii++) {
+			    src=conv3->cbin+((cb*imh+i+ii)*imw+j)*CONV3X3_CBLK;
+			    for(k=0; k<3*CONV3X3_CBLK; k+=CONV3X3_CBLK) {
+				for(l=0; l<CONV3X3_CBLK; l++)
+				    acc[l] += w[ii*3*CONV3X3_CBLK+k+l]*src[k+l];
+			    }
+			}
+		    }
+		    sum=0.0;
+		    for(l=0; l<CONV3X3_CBLK; l++)
+			sum += acc[l];
+		    dsums[i*ow+j]=sum-bias;
+		}
+
+		/* Inference only: dsums is douts, apply transfunc to the row while it's in cache */
+		if(conv3->infer_only)
+		    actfs_forward(conv3->transfunc, dsums+i*ow, dsums+i*ow, ow);
+	    }
+
+	    /* douts=transfunc(dsums) */
+	    if(!conv3->infer_only)
+		actfs_forward(conv3->transfunc, dsums, conv3->douts[findex], ow*oh);
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_NCHWC feed backward, for filters [f0,f1):
+ *	   G=derr*f'(u) to conv3->gout, dferr=SUM(G), and
+ *	   dFP[f][chan][k]=SUM{ G*din }, CONV3X3_CBLK channels per lane
+ *	   from cbin packed in the last feed forward.
+ *	2. prederr is NOT updated here, see conv3x3_nchwc_feed_prederr().
+-------------------------------------------------------------------*/
+static void conv3x3_nchwc_feed_dparams(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, j, ii, k, l, cb, chindex, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *src;
+	nnc_real_t *g;
+	nnc_real_t acc[9*CONV3X3_CBLK];
+	nnc_real_t gv, sum;
+
+	for(findex=f0; findex < f1; findex++) {
+	    g=conv3->gout+findex*ow*oh;
+
+	    /* 1. G=derr*f'(u), and dferr=SUM(G) */
+	    actfs_backward(conv3->transfunc, conv3->dsums[findex], conv3->douts[findex], conv3->derr[findex], g, ow*oh);
+	    if(conv3->dvs) {
+		sum=0.0;
+		for(k=0; k<ow*oh; k++)
+		    sum += g[k];
+		conv3->dferr[findex]=sum;
+	    }
+
+	    /* 2. dFP=SUM{G*din}, per channel block */
+	    for(cb=0; cb<ncb; cb++) {
+		for(k=0; k<9*CONV3X3_CBLK; k++)
+		    acc[k]=0.0;
+		for(i=0; i<oh; i++) {
+		    for(j=0; j<ow; j++) {
+			gv=g[i*ow+j];
+			for(ii=0; ii<3; ii++) {
+			    src=conv3->cbin+((cb*imh+i+ii)*imw+j)*CONV3X3_CBLK;
+			    for(k=0; k<3*CONV3X3_CBLK; k++)
+				acc[ii*3*CONV3X3_CBLK+k] += gv*src[k];
+			}
+		    }
+		}
+		for(l=0; l<CONV3X3_CBLK && (chindex=cb*CONV3X3_CBLK+l) < conv3->nchan; l++) {
+		    for(k=0; k<9; k++)
+			conv3->dFP[findex][chindex][k]=acc[k*CONV3X3_CBLK+l];
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_NCHWC feed backward, for channel blocks
+ *	   [cb0,cb1), after conv3x3_nchwc_feed_dparams() of ALL filters:
+ *		cberr[cb] = SUM_f{ cbw[f][cb](x)G[f] }, CONV3X3_CBLK channels per lane
+ *	   then cberr is unpacked and added to prederr.
+ *	2. Each task owns its channel blocks of prederr, so NO private
+ *	   buffers are needed, and results do NOT depend on threads.
+-------------------------------------------------------------------*/
+static void conv3x3_nchwc_feed_prederr(CONV3X3 *conv3, int cb0, int cb1, nnc_real_t * const *prederr)
+{
+	int i, j, ii, k, l, cb, chindex, findex;
+	int imw=conv3->imw, imh=conv3->imh;
+	int ow=conv3->ow, oh=conv3->oh;
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+	const nnc_real_t *w, *g;
+	nnc_real_t *dst, *perr;
+	nnc_real_t gv;
+
+	for(cb=cb0; cb<cb1; cb++) {
+	    perr=conv3->cberr+cb*imh*imw*CONV3X3_CBLK;
+	    memset(perr, 0, imh*imw*CONV3X3_CBLK*sizeof(nnc_real_t));
+
+	    for(findex=0; findex < conv3->nf; findex++) {
+		w=conv3->cbw+(findex*ncb+cb)*9*CONV3X3_CBLK;
+		g=conv3->gout+findex*ow*oh;
+		for(i=0; i<oh; i++) {
+		    for(j=0; j<ow; j++) {
+			gv=g[i*ow+j];
+			for(ii=0; ii<3; ii++) {
+			    dst=perr+((i+ii)*imw+j)*CONV3X3_CBLK;
+			    for(k=0; k<3*CONV3X3_CBLK; k++)
+				dst[k] += gv*w[ii*3*CONV3X3_CBLK+k];
+			}
+		    }
+		}
+	    }
+
+	    /* Unpack to prederr */
+	    for(l=0; l<CONV3X3_CBLK && (chindex=cb*CONV3X3_CBLK+l) < conv3->nchan; l++) {
+		for(k=0; k<imw*imh; k++)
+		    conv3->prederr[chindex][k] += perr[k*CONV3X3_CBLK+l];
+	    }
+	}
+}
+
+
+/* Context of CONV3X3 range tasks, see conv3x3_run_ranges() */
+struct conv3x3_ranges {
+	CONV3X3 *conv3;
+	conv3x3_kernel_t kernel;
+	int n;
+	int ntask;
+};
+
+static void conv3x3_range_task(void *arg, int t)
+{
+	struct conv3x3_ranges *ctx=arg;
+
+	ctx->kernel(ctx->conv3, t*ctx->n/ctx->ntask, (t+1)*ctx->n/ctx->ntask, NULL);
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Run a CONV3X3 kernel over [0,n) split into ntask tasks, in
+ *	   nnc_pool, as conv3x3_run_tasks(). The kernel gets prederr
+ *	   as NULL, tasks MUST NOT write to the same data.
+ *	2. For CONV3X3_ENGINE_NCHWC, n is nf for filter kernels, or
+ *	   ncb for channel block kernels.
+-------------------------------------------------------------------*/
+static void conv3x3_run_ranges(CONV3X3 *conv3, conv3x3_kernel_t kernel, int n)
+{
+	struct conv3x3_ranges ctx;
+
+	ctx.conv3=conv3;
+	ctx.kernel=kernel;
+	ctx.n=n;
+	ctx.ntask=1;
+	if(nnc_pool && !thpool_in_worker())
+		ctx.ntask= n < nnc_pool->nth+1 ? n : nnc_pool->nth+1;
+
+	if(ctx.ntask==1)
+		kernel(conv3, 0, n, NULL);
+	else
+		thpool_run(nnc_pool, conv3x3_range_task, &ctx, ctx.ntask);
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_NCHWC feed forward.
+ *	2. din(din8 normalized) is packed channel-blocked
+ *	   with channel blocks split across threads, and
+ *	   fparams ONLY if cbw is NOT valid, then filters
+ *	   split across threads.
+-------------------------------------------------*/
+static int conv3x3_nchwc_run_forward(CONV3X3 *conv3)
+{
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+
+	if(conv3->cbin==NULL || conv3->cbw==NULL) {
+		printf("%s: Channel-blocked buffers are NULL, call conv3x3_set_engine() first!\n", __func__);
+		return -1;
+	}
+
+	conv3x3_run_ranges(conv3, conv3x3_nchwc_pack_din, ncb);
+	if(!conv3->cbw_valid) {
+		conv3x3_run_ranges(conv3, conv3x3_nchwc_pack_filters, conv3->nf);
+		conv3->cbw_valid=true;
+	}
+	conv3x3_run_ranges(conv3, conv3x3_simd_nchwc_forward ? conv3x3_simd_nchwc_forward
+							     : conv3x3_nchwc_feed_forward, conv3->nf);
+
+	return 0;
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. CONV3X3_ENGINE_NCHWC feed backward.
+ *	2. G/dferr/dFP with filters split across threads,
+ *	   then prederr with channel blocks split.
+-------------------------------------------------*/
+static int conv3x3_nchwc_run_backward(CONV3X3 *conv3)
+{
+	int ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+
+	if(conv3->cbin==NULL || conv3->cbw==NULL || conv3->gout==NULL) {
+		printf("%s: Channel-blocked buffers are NULL, call conv3x3_set_engine() first!\n", __func__);
+		return -1;
+	}
+
+	/* cberr for prederr */
+	if(conv3->prederr && conv3->cberr==NULL) {
+		conv3->cberr=calloc(ncb*CONV3X3_CBLK*conv3->imw*conv3->imh, sizeof(typeof(*conv3->cberr)));
+		if(conv3->cberr==NULL) {
+			printf("%s: Fail to calloc conv3->cberr.\n", __func__);
+			return -2;
+		}
+	}
+
+	conv3x3_run_ranges(conv3, conv3x3_simd_nchwc_dparams ? conv3x3_simd_nchwc_dparams
+							     : conv3x3_nchwc_feed_dparams, conv3->nf);
+	if(conv3->prederr)
+		conv3x3_run_ranges(conv3, conv3x3_simd_nchwc_prederr ? conv3x3_simd_nchwc_prederr
+								     : conv3x3_nchwc_feed_prederr, ncb);
+
+	return 0;
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	Scalar: Row i of dsums of a filter into dst[ow],
+ *	with bias. The same as conv3x3_direct_feed_forward().
+-------------------------------------------------*/
+static void conv3x3_direct_row(const CONV3X3 *conv3, int findex, int i, nnc_real_t *dst)
+{
+	int j, ii, jj, chindex;
+	int imw=conv3->imw, imh=conv3->imh;
+	nnc_real_t sum;
+
+	for(j=0; j< conv3->ow; j++) {
+	    sum=0.0;
+	    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		for(ii=0; ii<3; ii++) {
+		    for(jj=0; jj<3; jj++)
+			sum += conv3->fparams[findex][chindex][ii*3+jj] * conv3->din[chindex*imw*imh+(i+ii)*imw+j+jj];
+		}
+	    }
+	    if(conv3->dvs)
+		sum -= conv3->dvs[findex];
+	    dst[j]=sum;
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Kernel of conv3x3_maxpool2x2_feed_forward(), for filters
+ *	   [f0,f1) and maxpool=conv3->outpool.
+ *	2. For each output row of maxpool, 2 rows of dsums are computed
+ *	   and pooled while they're in cache:
+ *	   Training:  dsums/douts rows are kept for backward, douts are
+ *		      pooled as maxpool2x2_feed_forward(), with argmax.
+ *	   Inference: rows go to a stack buffer, NOT to conv3->douts.
+ *		      dsums are pooled, then transfunc is applied to the
+ *		      pooled outputs ONLY, as f(max(u))=max(f(u)) for a
+ *		      non-decreasing f.
+-------------------------------------------------------------------*/
+static void conv3x3_maxpool2x2_kernel(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i, j, k, findex;
+	int ow=conv3->ow, oh=conv3->oh;
+	MAXPOOL2X2 *maxpool=conv3->outpool;
+	int pw=maxpool->ow, ph=maxpool->oh;
+	conv3x3_row_t conv_row= conv3x3_simd_row ? conv3x3_simd_row : conv3x3_direct_row;
+	nnc_real_t rows[2*ow];
+	nnc_real_t *r0, *r1, *pout;
+	nnc_real_t fval;
+	uint8_t *amax;
+
+	for(findex=f0; findex < f1; findex++) {
+	    pout=maxpool->douts[findex];
+	    amax=maxpool->argmax ? maxpool->argmax+findex*pw*ph : NULL;
+
+	    for(i=0; i<ph; i++) {
+		/* 1. Rows 2*i and 2*i+1 */
+		if(conv3->infer_only)
+		    r0=rows;
+		else
+		    r0=conv3->dsums[findex]+2*i*ow;
+		r1=r0+ow;
+		conv_row(conv3, findex, 2*i, r0);
+		conv_row(conv3, findex, 2*i+1, r1);
+		if(!conv3->infer_only) {
+		    r0=conv3->douts[findex]+2*i*ow;
+		    r1=r0+ow;
+		    actfs_forward(conv3->transfunc, conv3->dsums[findex]+2*i*ow, r0, 2*ow);
+		}
+
+		/* 2. Max. of 2x2 blocks, the first one wins a tie */
+		for(j=0; j<pw; j++) {
+		    pout[i*pw+j]=r0[2*j];
+		    k=0;
+		    if( (fval=r0[2*j+1]) > pout[i*pw+j] ) { pout[i*pw+j]=fval; k=1; }
+		    if( (fval=r1[2*j]) > pout[i*pw+j] )   { pout[i*pw+j]=fval; k=2; }
+		    if( (fval=r1[2*j+1]) > pout[i*pw+j] ) { pout[i*pw+j]=fval; k=3; }
+		    if(amax)
+			amax[i*pw+j]=k;
+		}
+		if(conv3->infer_only)
+		    actfs_forward(conv3->transfunc, pout+i*pw, pout+i*pw, pw);
+	    }
+
+	    /* 3. Rest row(s) NOT pooled, for backward */
+	    if(!conv3->infer_only) {
+		for(i=2*ph; i<oh; i++) {
+		    conv_row(conv3, findex, i, conv3->dsums[findex]+i*ow);
+		    actfs_forward(conv3->transfunc, conv3->dsums[findex]+i*ow, conv3->douts[findex]+i*ow, ow);
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. Scalar feed forward for CONV3X3 direct engine,
+ *	   for filters [f0,f1).
+-------------------------------------------------*/
+static void conv3x3_direct_feed_forward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i,j, ii, jj;
+	int imw=conv3->imw;
+	int imh=conv3->imh;
+	int findex; /* filter index */
+	int chindex; /* filter channel index */
+	int offset;
+
+
+	/* 1. Clear dsums[]/douts[] */
+	for(i=0; i<imh-2; i++) {
+	   for(j=0; j<imw-2; j++) {
+		/* Traverse filters. each filter produces (imh-2)*(imw-2) results. */
+	        for(findex=f0; findex < f1; findex++) {
+
+		    /* Reset/clear dsums[i,j]/douts[i,j] */
+		    conv3->dsums[findex][i*(imw-2)+j]=0.0f;
+		    conv3->douts[findex][i*(imw-2)+j]=0.0f;
+		}
+	    }
+	}
+
+	/* 2. Traverse filter position of image w/h */
+	for(i=0; i<imh-2; i++) {
+	    for(j=0; j<imw-2; j++) {
+		/* Traverse filters. each filter produces (imh-2)*(imw-2) results. */
+	        for(findex=f0; findex < f1; findex++) {
+		    ////NOT HERE!! * Reset/clear dsums[i,j]/douts[i,j] */
+
+		    /* Traverse channels HK2023-08-06 */
+		    for(chindex=0; chindex < conv3->nchan; chindex++) {
+			/* offset of input channel image data */
+			offset = chindex*imw*imh;
+
+	       		/* Compute dsums[i,j] */
+			for(ii=0; ii<3; ii++) {  /* filter H */
+		       	   for(jj=0; jj<3; jj++) { /* filter W */
+				conv3->dsums[findex][i*(imw-2)+j] +=	\
+						conv3->fparams[findex][chindex][ii*3+jj] * conv3->din[offset + (i+ii)*imw+j+jj ];
+			   }
+		   	}
+		    }
+
+		    /* Apply bias HK2023-08-05 */
+		    if(conv3->dvs) {
+			conv3->dsums[findex][i*(imw-2)+j] -= conv3->dvs[findex];
+		    }
+	       }
+	    }
+
+	    /* Inference only: dsums is douts, apply transfunc to the row while it's in cache */
+	    if(conv3->infer_only) {
+		for(findex=f0; findex < f1; findex++)
+		    actfs_forward(conv3->transfunc, conv3->dsums[findex]+i*(imw-2), conv3->douts[findex]+i*(imw-2), imw-2);
+	    }
+	}
+	if(conv3->infer_only)
+		return;
+
+	/* 3. Compute douts[]=transfunc(dsums[],,)   2023-08-08 */
+	for(findex=f0; findex < f1; findex++)
+	    actfs_forward(conv3->transfunc, conv3->dsums[findex], conv3->douts[findex], (imh-2)*(imw-2));
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. Scalar feed backward for CONV3X3 direct engine,
+ *	   for filters [f0,f1), derr fed back to prederr.
+-------------------------------------------------*/
+static void conv3x3_direct_feed_backward(CONV3X3 *conv3, int f0, int f1, nnc_real_t * const *prederr)
+{
+	int i,j, ii, jj;
+	int imw=conv3->imw;
+	int imh=conv3->imh;
+	int findex; /* filter index */
+	int chindex; /* filter channel index */
+	int offset;
+	float fsum, fout, fd;
+
+	/* derr already updated by backfeeding from downstream layer */
+
+	/* 0. Clear dferr[] and dFP[] HK2023-08-05 */
+	for(findex=f0; findex < f1; findex++) {
+	    if(conv3->dvs)
+		conv3->dferr[findex]=0.0f; /* temp. var */
+
+#if 1 /* TEST: --------------- HK2023-08-07 */
+	    for(chindex=0; chindex < conv3->nchan; chindex++) { /* HK2023-08-06 */
+	        for(ii=0; ii<3; ii++) {  /* filter H */
+        	        for(jj=0; jj<3; jj++) { /* filter W */
+			      conv3->dFP[findex][chindex][ii*3+jj] = 0.0f;
+			}
+	     	}
+	    }
+#endif
+
+	}
+
+
+	/* 1. Update dFP and feed_back derr to prederr */
+	/* Traverse derr(of douts) */
+	for(i=0; i< conv3->oh; i++) {
+	   for(j=0; j< conv3->ow; j++) {
+
+		/* Traverse filters. */
+	        for(findex=f0; findex < f1; findex++) {
+
+		    /* fsum and fout  HK2023-08-08 */
+		    fsum = conv3->dsums[findex][i*conv3->ow+j];
+		    fout = conv3->douts[findex][i*conv3->ow+j];
+
+		    if(conv3->transfunc)
+			fd = conv3->transfunc(fsum,fout,DERIVATIVE_FUNC);
+		    else
+			fd = 1.0f;
+
+		    /* Compute dferr for dvs updating HK2023-08-05 */
+		    /* dvs, dE/db=dE/dh*dh/du*du/db=derr*f'(u) ---> dferr[f] = SUM{conv3->derr[findex][:]*f'(u)} */
+		    if(conv3->dvs)
+		         conv3->dferr[findex] += conv3->derr[findex][i*conv3->ow+j]*fd;
+
+		    /* Traverse channels HK2023-08-06 */
+		    for(chindex=0; chindex < conv3->nchan; chindex++) {
+		        /* offset of input channel image data */
+		        offset = chindex*imw*imh;
+
+
+		        /* Traverse filter parameters */
+		        for(ii=0; ii<3; ii++) {  /* filter H */
+		    	    for(jj=0; jj<3; jj++) { /* filter W */
+
+				/* As one dout backmap to 3x3 grids of din, which is flattened data.
+				   Just like u=w0*x0+w1*x1+...+w8*x8; then dE/dwi=dE/dh*dh/du*du/dwi=dE/dh*f'(u)*du/dwi=derr*f'(u)*xi; (here dh/du=1)
+				   then sum up all regions
+				 */
+				conv3->dFP[findex][chindex][ii*3+jj] += conv3->derr[findex][i*conv3->ow+j]	\
+							// * conv3->transfunc(fsum,fout,DERIVATIVE_FUNC)
+							* fd * conv3->din[offset + (i+ii)*conv3->imw+j+jj];
+
+				/* Feed back derr[][] to prederr[][] (for conv3x3->derr, mp2x2->derr etc.) HK2023-08-06 */
+				if( prederr ) {  /* Noticed: prederr is flattened, size imw*imh, as output size of pre-layer */
+					prederr[chindex][(i+ii)*conv3->imw+(j+jj)] +=  conv3->derr[findex][i*conv3->ow+j]	\
+										    // * conv3->transfunc(fsum,fout,DERIVATIVE_FUNC)
+										    * fd *conv3->fparams[findex][chindex][ii*3+jj];
+
+				}
+			    }
+		        }
+
+		    }/* for(chindex) */
+		} /* for(findex) */
+
+	    } /* for(j) */
+	} /* for(i) */
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	A feed forward function for a CONV3X3.
+ *      stride==1
+ *
+ * Params:
+ * 	@conv3	Pointer to a CONV3X3
+ *
+ *	       !!!--- CAVEAT ---!!!
+ *  conv3->din MUST hold >=nchan*imw*imh data in mem.
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------*/
+int conv3x3_feed_forward(CONV3X3 *conv3)
+{
+	/* Check input */
+	if(conv3==NULL || conv3->fparams==NULL || conv3->douts==NULL) {
+		printf("%s: Invalid conv3x3!\n", __func__);
+		return -1;
+	}
+	if(conv3->imw<3 || conv3->imh<3) {
+		printf("%s: conv3x3->imw(imh)<3!\n", __func__);
+		return -1;
+	}
+	if(conv3->din==NULL) {
+		printf("%s: conv3x3->din is NULL!\n", __func__);
+		return -1;
+	}
+
+	/* im2col + GEMM engine, din8 is normalized when lowered */
+	if(conv3->engine==CONV3X3_ENGINE_IM2COL)
+		return conv3x3_im2col_feed_forward(conv3);
+
+	/* Other engines read din many times, normalize din8 to din8buf(as din) once */
+	if(conv3->din8)
+		nnc_normalize_u8(conv3->din8, conv3->din8_scale, conv3->din8buf, conv3->nchan*conv3->imw*conv3->imh);
+
+	/* Winograd engine, feed backward goes with the direct engine */
+	if(conv3->engine==CONV3X3_ENGINE_WINOGRAD)
+		return conv3x3_winograd_feed_forward(conv3);
+
+	/* Channel-blocked engine */
+	if(conv3->engine==CONV3X3_ENGINE_NCHWC)
+		return conv3x3_nchwc_run_forward(conv3);
+
+	/* Direct engine, SIMD kernel as per CPU, filters split across threads */
+	return conv3x3_run_tasks(conv3, conv3x3_simd_feed_forward ? conv3x3_simd_feed_forward
+								  : conv3x3_direct_feed_forward, false);
+}
+
+
+/*----------------------------------------------------------------
+ * Note:
+ *	1. Fused feed forward of a CONV3X3 and the MAXPOOL2X2 pooling
+ *	   its outputs, in one pass, see conv3x3_maxpool2x2_kernel().
+ *	   Called by nvnet_feed_forward() if nnc_set_fusion(true).
+ *	2. Training: results are the same as conv3x3_feed_forward()
+ *	   then maxpool2x2_feed_forward() with the direct engine, and
+ *	   maxpool->argmax is recorded.
+ *	   Inference only: conv3->douts are NOT updated, maxpool->douts
+ *	   are the same(with ReLU, OR in rounding with other functions).
+ *	3. It's fused ONLY for the direct engine and a non-decreasing
+ *	   transfunc(NOT NNC_ACT_CUSTOM), otherwise the two layers feed
+ *	   forward one by one.
+ *
+ * Params:
+ * 	@conv3		Pointer to a CONV3X3
+ *	@maxpool	Pointer to a MAXPOOL2X2, maxpool->inconv3x3==conv3
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+int conv3x3_maxpool2x2_feed_forward(CONV3X3 *conv3, MAXPOOL2X2 *maxpool)
+{
+	int ret;
+
+	if(conv3==NULL || maxpool==NULL)
+		return -1;
+
+	/* Layer by layer */
+	if( maxpool->inconv3x3!=conv3 || conv3->engine!=CONV3X3_ENGINE_DIRECT
+	    || actfs_id(conv3->transfunc)==NNC_ACT_CUSTOM
+	    || maxpool->nf!=conv3->nf || maxpool->imw!=conv3->ow || maxpool->imh!=conv3->oh ) {
+		ret=conv3x3_feed_forward(conv3);
+		if(ret!=0)
+			return ret;
+		return maxpool2x2_feed_forward(maxpool);
+	}
+
+	/* Check input */
+	if(conv3->fparams==NULL || conv3->douts==NULL || maxpool->douts==NULL) {
+		printf("%s: Invalid conv3x3 or maxpool2x2!\n", __func__);
+		return -1;
+	}
+	if(conv3->din==NULL) {
+		printf("%s: conv3x3->din is NULL!\n", __func__);
+		return -1;
+	}
+	if(conv3->din8)
+		nnc_normalize_u8(conv3->din8, conv3->din8_scale, conv3->din8buf, conv3->nchan*conv3->imw*conv3->imh);
+
+	/* Filters split across threads */
+	conv3->outpool=maxpool;
+	ret=conv3x3_run_tasks(conv3, conv3x3_maxpool2x2_kernel, false);
+	conv3->outpool=NULL;
+
+	return ret;
+}
+
+
+/*----------------------------------------------
+ * Note:
+ *	A feed backward function for a CONV3X3.
+ *      Channels==1, stride==1
+ *
+ * Params:
+ * 	@conv3	Pointer to a CONV3X3
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------*/
+int conv3x3_feed_backward(CONV3X3 *conv3)
+{
+	/* Check input */
+	if(conv3==NULL || conv3->fparams==NULL || conv3->douts==NULL || conv3->dFP==NULL ) {
+		printf("%s: Invalid conv3x3!\n", __func__);
+		return -1;
+	}
+
+	if(conv3->din==NULL) {
+		printf("%s: conv3x3->din is NULL!\n", __func__);
+		return -1;
+	}
+
+	/* im2col + GEMM engine */
+	if(conv3->engine==CONV3X3_ENGINE_IM2COL)
+		return conv3x3_im2col_feed_backward(conv3);
+
+	/* Channel-blocked engine */
+	if(conv3->engine==CONV3X3_ENGINE_NCHWC)
+		return conv3x3_nchwc_run_backward(conv3);
+
+	/* G buffer for SIMD kernel */
+	if(conv3x3_simd_feed_backward && conv3->gout==NULL) {
+		conv3->gout=calloc(conv3->nf*conv3->ow*conv3->oh, sizeof(typeof(*conv3->gout)));
+		if(conv3->gout==NULL) {
+			printf("%s: Fail to calloc conv3->gout.\n", __func__);
+			return -1;
+		}
+	}
+
+	/* Direct engine, SIMD kernel as per CPU, filters split across threads */
+	return conv3x3_run_tasks(conv3, conv3x3_simd_feed_backward ? conv3x3_simd_feed_backward
+								   : conv3x3_direct_feed_backward, true);
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Lower din[nchan][imw*imh] of a CONVKXK to the im2col patch
+ *	   matrix cols[K][P], K=nchan*ks*ks, P=ow*oh:
+ *	   cols[(chan*ks+ii)*ks+jj][i*ow+j] = din[chan][y*imw+x],
+ *	   y=i*stride+ii-pad, x=j*stride+jj-pad, 0 if out of the image.
+-------------------------------------------------------------------*/
+static void convkxk_im2col_data(const CONVKXK *convk, const nnc_real_t *din, nnc_real_t *cols)
+{
+	int i, j, ii, jj, x, y, chindex;
+	int imw=convk->imw, imh=convk->imh;
+	int ow=convk->ow, oh=convk->oh;
+	int ks=convk->ks, stride=convk->stride, pad=convk->pad;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	for(chindex=0; chindex < convk->nchan; chindex++) {
+	    src=din+chindex*imw*imh;
+	    for(ii=0; ii<ks; ii++) {
+		for(jj=0; jj<ks; jj++) {
+		    dst=cols+((chindex*ks+ii)*ks+jj)*ow*oh;
+		    for(i=0; i<oh; i++) {
+			y=i*stride+ii-pad;
+			for(j=0; j<ow; j++) {
+			    x=j*stride+jj-pad;
+			    dst[i*ow+j]= (y>=0 && y<imh && x>=0 && x<imw) ? src[y*imw+x] : 0.0;
+			}
+		    }
+		}
+	    }
+	}
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Add up dcols[K][P] to prederr[nchan][imw*imh], the reverse
+ *	   of convkxk_im2col_data(), padding is dropped.
+-------------------------------------------------------------------*/
+static void convkxk_col2im(CONVKXK *convk)
+{
+	int i, j, ii, jj, x, y, chindex;
+	int imw=convk->imw, imh=convk->imh;
+	int ow=convk->ow, oh=convk->oh;
+	int ks=convk->ks, stride=convk->stride, pad=convk->pad;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+
+	for(chindex=0; chindex < convk->nchan; chindex++) {
+	    dst=convk->prederr[chindex];
+	    for(ii=0; ii<ks; ii++) {
+		for(jj=0; jj<ks; jj++) {
+		    src=convk->dcols+((chindex*ks+ii)*ks+jj)*ow*oh;
+		    for(i=0; i<oh; i++) {
+			y=i*stride+ii-pad;
+			if(y<0 || y>=imh)
+				continue;
+			for(j=0; j<ow; j++) {
+			    x=j*stride+jj-pad;
+			    if(x>=0 && x<imw)
+				dst[y*imw+x] += src[i*ow+j];
+			}
+		    }
+		}
+	    }
+	}
+}
+
+
+/* A CONVKXK kernel for filters [f0,f1), see convkxk_run_tasks() */
+typedef void (*convkxk_kernel_t)(CONVKXK *convk, int f0, int f1);
+
+/*------------------------------------------------
+ * Note:
+ *	1. Kernel of CONVKXK feed forward, after im2col:
+ *	   dsums[f0:f1][P]=W[f0:f1][K]*cols[K][P]-dvs,
+ *	   then transfunc.
+-------------------------------------------------*/
+static void convkxk_forward_kernel(CONVKXK *convk, int f0, int f1)
+{
+	int k, findex;
+	unsigned int P=convk->ow*convk->oh;
+	unsigned int K=convk->nchan*convk->ks*convk->ks;
+	nnc_real_t *dsums;
+
+	if(f1<=f0)
+		return;
+
+	/* dsums=W*cols */
+	conv3x3_gemm(f1-f0, K, P, convk->fparams+f0*K, false, convk->cols, convk->dsums[f0], true);
+
+	/* Apply bias and transfunc, inference only: dsums is douts */
+	for(findex=f0; findex < f1; findex++) {
+	    dsums=convk->dsums[findex];
+	    if(convk->dvs) {
+		for(k=0; k<P; k++)
+		    dsums[k] -= convk->dvs[findex];
+	    }
+	    actfs_forward(convk->transfunc, dsums, convk->douts[findex], P);
+	}
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	1. Kernel of CONVKXK feed backward, for filters [f0,f1):
+ *	      G=derr*f'(u),  dferr=SUM(G)
+ *	      dFP[f0:f1][K] = G*cols^T
+-------------------------------------------------*/
+static void convkxk_backward_kernel(CONVKXK *convk, int f0, int f1)
+{
+	int k, p, findex;
+	unsigned int P=convk->ow*convk->oh;
+	unsigned int K=convk->nchan*convk->ks*convk->ks;
+	const nnc_real_t *cols;
+	nnc_real_t *g;
+	nnc_real_t dsum;
+
+	for(findex=f0; findex < f1; findex++) {
+	    g=convk->gout+findex*P;
+	    actfs_backward(convk->transfunc, convk->dsums[findex], convk->douts[findex], convk->derr[findex], g, P);
+
+	    if(convk->dvs) {
+		dsum=0.0;
+		for(p=0; p<P; p++)
+		    dsum += g[p];
+		convk->dferr[findex]=dsum;
+	    }
+
+	    for(k=0; k<K; k++) {
+		cols=convk->cols+k*P;
+		dsum=0.0;
+		for(p=0; p<P; p++)
+		    dsum += g[p]*cols[p];
+		convk->dFP[findex*K+k]=dsum;
+	    }
+	}
+}
+
+
+/* Context of CONVKXK filter tasks, see convkxk_run_tasks() */
+struct convkxk_tasks {
+	CONVKXK *convk;
+	convkxk_kernel_t kernel;
+	int ntask;
+};
+
+static void convkxk_task(void *arg, int t)
+{
+	struct convkxk_tasks *ctx=arg;
+	CONVKXK *convk=ctx->convk;
+
+	ctx->kernel(convk, t*convk->nf/ctx->ntask, (t+1)*convk->nf/ctx->ntask);
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Run a CONVKXK kernel with filters split into ntask tasks,
+ *	   in nnc_pool, as conv3x3_run_tasks(). Filters are computed
+ *	   independently, so results are the same for any ntask.
+-------------------------------------------------------------------*/
+static void convkxk_run_tasks(CONVKXK *convk, convkxk_kernel_t kernel)
+{
+	struct convkxk_tasks ctx;
+
+	ctx.convk=convk;
+	ctx.kernel=kernel;
+	ctx.ntask=1;
+	if(nnc_pool && !thpool_in_worker())
+		ctx.ntask= convk->nf < nnc_pool->nth+1 ? convk->nf : nnc_pool->nth+1;
+
+	if(ctx.ntask==1)
+		kernel(convk, 0, convk->nf);
+	else
+		thpool_run(nnc_pool, convkxk_task, &ctx, ctx.ntask);
+}
+
+
+/*------------------------------------------------
+ * Note:
+ *	A feed forward function for a CONVKXK.
+ *	1. Lower din to cols[K][P], then
+ *	   dsums[nf][P]=W[nf][K]*cols[K][P]-dvs, W as fparams,
+ *	   douts=transfunc(dsums).
+ *	2. Filters split across threads, see nnc_set_threads().
+ *
+ * Params:
+ * 	@convk	Pointer to a CONVKXK
+ *
+ *	       !!!--- CAVEAT ---!!!
+ *  convk->din MUST hold >=nchan*imw*imh data in mem.
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------*/
+int convkxk_feed_forward(CONVKXK *convk)
+{
+	/* Check input */
+	if(convk==NULL || convk->fparams==NULL || convk->douts==NULL || convk->cols==NULL) {
+		printf("%s: Invalid convkxk!\n", __func__);
+		return -1;
+	}
+	if(convk->din==NULL) {
+		printf("%s: convkxk->din is NULL!\n", __func__);
+		return -1;
+	}
+
+	/* uint8 input data, normalize to din8buf(as din) */
+	if(convk->din8)
+		nnc_normalize_u8(convk->din8, convk->din8_scale, convk->din8buf, convk->nchan*convk->imw*convk->imh);
+
+	/* 1. Lower din */
+	convkxk_im2col_data(convk, convk->din, convk->cols);
+
+	/* 2. dsums=W*cols, bias and transfunc */
+	convkxk_run_tasks(convk, convkxk_forward_kernel);
+
+	return 0;
+}
+
+
+/*----------------------------------------------
+ * Note:
+ *	A feed backward function for a CONVKXK.
+ *	1. G[nf][P]=derr*f'(u),  then:
+ *	      dFP[nf][K] = G*cols^T,  dferr=SUM(G)
+ *	      dcols[K][P] = W^T*G,  then col2im to prederr.
+ *	2. cols MUST be from the last forward.
+ *
+ * Params:
+ * 	@convk	Pointer to a CONVKXK
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------*/
+int convkxk_feed_backward(CONVKXK *convk)
+{
+	unsigned int K;
+
+	/* Check input */
+	if(convk==NULL || convk->fparams==NULL || convk->dFP==NULL || convk->gout==NULL || convk->dcols==NULL) {
+		printf("%s: Invalid convkxk!\n", __func__);
+		return -1;
+	}
+
+	/* 1. G, dferr and dFP, filters split across threads */
+	convkxk_run_tasks(convk, convkxk_backward_kernel);
+
+	/* 2. prederr += col2im(W^T*G) */
+	if(convk->prederr) {
+		K=convk->nchan*convk->ks*convk->ks;
+		conv3x3_gemm(K, convk->nf, convk->ow*convk->oh, convk->fparams, true, convk->gout, convk->dcols, true);
+		convkxk_col2im(convk);
+	}
+
+	return 0;
+}
+
+
+/*----------------------------------------------
+ * Note:
+ *	1. A feed forward function for MAXPOOL2X2
+ *	2. Position of the max. in each 2x2 block is
+ *	   saved in maxpool->argmax(if NOT NULL), the
+ *	   first one wins a tie.
+ *
+ * Params:
+ * 	@maxpool   Pointer to a MAXPOOL2X2
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------*/
+int maxpool2x2_feed_forward(MAXPOOL2X2 *maxpool)
+{
+	int i,j, ii, jj, k;
+	nnc_real_t **din=NULL; /* prev-layer/upstream output data */
+	unsigned int pos;
+	int findex; /* filter index */
+	nnc_real_t fval;
+
+	/* 1. Check input */
+	if(maxpool==NULL || maxpool->douts==NULL) {   //maxpool->fparams --- NO NEED ---
+		printf("%s: Invalid maxpool2x2!\n", __func__);
+		return -1;
+	}
+	if(maxpool->ow<1 || maxpool->oh<1) {
+		printf("%s: maxpool->w/h <1!\n", __func__);
+		return -1;
+	}
+	if(maxpool->din==NULL && maxpool->inconv3x3==NULL ) {
+		printf("%s: maxpool->din AND maxpool->inconv3x3 is NULL!\n", __func__);
+		return -1;
+	}
+
+	/* 2. Source data from inconv3x3->douts */
+	if(maxpool->inconv3x3 && maxpool->inconv3x3->douts) {
+	    /* Check params */
+	    if(maxpool->nf != maxpool->inconv3x3->nf) {
+		printf("%s: CONV and POOL do NOT have same number of filters!\n", __func__);
+		return -1;
+	    }
+	    if(maxpool->imw != maxpool->inconv3x3->ow || maxpool->imh != maxpool->inconv3x3->oh) {
+		printf("%s: CONV and POOL do NOT have compatible, imw(%d)!=ow(%d) OR imh(%d)!=oh(%d) !\n",
+				 __func__, maxpool->imw,maxpool->inconv3x3->ow, maxpool->imh, maxpool->inconv3x3->oh );
+		return -1;
+	    }
+
+	    /* Assing din */
+	    din = maxpool->inconv3x3->douts;
+	}
+	/* 3. Source data from maxpool2x2->din */
+	else {
+            /* Assign din */
+            din = maxpool->din;
+	}
+
+	/* 4. Check din */
+	if( din==NULL || *din==NULL ) {
+		printf("%s: Source data din error!\n", __func__);
+		return -1;
+	}
+
+	/* 5. Traverse din data (hxw) to compute maxpool->douts[][] */
+	for(i=0; i< maxpool->oh; i++ ) {
+		for(j=0; j< maxpool->ow; j++ ) {
+
+		    /* Traverse filters. each filter produces ow*oh resutls */
+		    for(findex=0; findex < maxpool->nf; findex++) {
+
+			/* Init douts[findex][i*maxpool->ow+j] */
+			pos=i*maxpool->ow+j;
+
+		    	//maxpool->douts[findex][pos]=maxpool->inconv3x3->douts[findex][(2*i)*maxpool->inconv3x3->ow + (2*j) ];
+		    	maxpool->douts[findex][pos]=din[findex][(2*i)*maxpool->imw + (2*j) ];
+			k=0;
+
+		    	/* Traverse 2x2 filter */
+		    	for(ii=0; ii<2; ii++) {		/* Filter H */
+			    for(jj=0; jj<2; jj++) {	/* Filter W */
+
+				//fval=maxpool->inconv3x3->douts[findex][(2*i+ii)*maxpool->inconv3x3->ow + (2*j+jj)];
+				fval=din[findex][(2*i+ii)*maxpool->imw + (2*j+jj)];
+				if(fval > maxpool->douts[findex][pos]) {
+					maxpool->douts[findex][pos]=fval;
+					k=ii*2+jj;
+				}
+			    }
+		    	}
+
+			/* Save position of the max. for feed backward */
+			if(maxpool->argmax)
+				maxpool->argmax[findex*maxpool->ow*maxpool->oh+pos]=k;
+		    }
+		}
+	}
+
+
+	#if 0 /* 5. TODO: Traverse din data (hxw) to compute maxpool->douts[][] */
+	for(i=0; i< maxpool->imw; i++ ) {
+		for(j=0; j< maxpool->imh; j++ ) {
+
+		}
+	}
+	#endif
+
+	return 0;
+}
+
+/*-----------------------------------------------------
+ * Note:
+ *	1. A feed backward function for MAXPOOL2X2
+ *	2. maxpool->derr is scattered to inconv3x3->derr at
+ *	   maxpool->argmax saved by feed forward, and the other
+ *	   3 in each 2x2 block(and the rest row/column NOT
+ *	   pooled) are set to 0. So ALL inconv3x3->derr are
+ *	   overwritten, NO need to clear them before.
+ *
+ * Params:
+ * 	@maxpool   Pointer to a MAXPOOL2X2
+ * Return:
+ *		0	OK
+ *		<0	fails
+------------------------------------------------------*/
+int maxpool2x2_feed_backward(MAXPOOL2X2 *maxpool)
+{
+	int i,j;
+	int imw, imh, ow, oh;
+	unsigned int pos;
+	int findex; /* filter index */
+	const uint8_t *amax;
+	const nnc_real_t *derr;
+	nnc_real_t *perr;
+
+	/* 1. Check input */
+	if(maxpool==NULL || maxpool->douts==NULL) {   //maxpool->fparams --- NO NEED ---
+		printf("%s: Invalid maxpool2x2!\n", __func__);
+		return -1;
+	}
+	if(maxpool->ow<1 || maxpool->oh<1) {
+		printf("%s: maxpool->w/h <1!\n", __func__);
+		return -1;
+	}
+	if(maxpool->derr==NULL || maxpool->argmax==NULL) {
+		printf("%s: maxpool->derr OR argmax is NULL!\n", __func__);
+		return -1;
+	}
+	if(maxpool->inconv3x3==NULL || maxpool->inconv3x3->derr==NULL ) {
+		printf("%s: maxpool->inconv3x3 OR its derr is NULL!\n", __func__);
+		return -1;
+	}
+	if(maxpool->inconv3x3->ow != maxpool->imw || maxpool->inconv3x3->oh != maxpool->imh ) {
+		printf("%s: maxpool->inconv3x3 has incompatible ow or oh!\n", __func__);
+		return -1;
+	}
+	if(maxpool->inconv3x3->nf != maxpool->nf ) {
+		printf("%s: maxpool and inconv3x3 MUST have same number of filters!\n", __func__);
+		return -1;
+	}
+
+	imw=maxpool->imw; imh=maxpool->imh;
+	ow=maxpool->ow;   oh=maxpool->oh;
+
+	/* 2. Scatter maxpool->derr[nf][] to inconv3x3->derr[nf][] */
+	for(findex=0; findex < maxpool->nf; findex++) {
+	    derr=maxpool->derr[findex];
+	    amax=maxpool->argmax+findex*ow*oh;
+	    perr=maxpool->inconv3x3->derr[findex];
+
+	    for(i=0; i<oh; i++) {
+		for(j=0; j<ow; j++) {
+		    /* Top-left of the 2x2 block, notice: maxpool->imw == conv3x3->ow */
+		    pos=(2*i)*imw+2*j;
+		    perr[pos]=0.0; perr[pos+1]=0.0;
+		    perr[pos+imw]=0.0; perr[pos+imw+1]=0.0;
+		    perr[pos+(amax[i*ow+j]>>1)*imw+(amax[i*ow+j]&1)]=derr[i*ow+j];
+		}
+		/* The rest column NOT pooled */
+		for(j=2*ow; j<imw; j++) {
+		    perr[(2*i)*imw+j]=0.0;
+		    perr[(2*i+1)*imw+j]=0.0;
+		}
+	    }
+	    /* The rest row NOT pooled */
+	    for(i=2*oh*imw; i<imw*imh; i++)
+		perr[i]=0.0;
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------
+ * Load weights/bias value for each nvcell in the layer
+ *
+ *		       !!! ---- CAUTION ---- !!!
+ *        The caller MUST ensure enough data in weights/bias,
+ *	  to avoid mem access error!
+ ^
+ * Params:
+ * 	@layer:	   a nerve layer;
+ *	@weights:  array of weights values
+ *		   In order of nvcells:
+		   Wc1,1 Wc1,2 ... Wc1,nin  Wc2,1 Wc2,2 ... Wc2,nin Wc3,1 Wc3,2 ... (total nin*nc)
+ *      @bias:     array of bias values.
+ 		   bc1  bc2  bc3 ... (total nc)
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------*/
+int nvlayer_load_params(NVLAYER *layer, nnc_real_t *weights, nnc_real_t *bias)
+{
+	int i,j;
+	int cnt;
+
+	if(layer==NULL || layer->nvcells==NULL)
+		return -1;
+
+        if(weights) {
+	   cnt=0;
+	   for(i=0; i< layer->nc; i++) {
+		for(j=0; j< layer->nvcells[i]->nin; j++)
+			layer->nvcells[i]->dw[j]=weights[cnt++];
+	   }
+	}
+
+        if(bias) {
+	   cnt=0;
+	   for(i=0; i< layer->nc; i++) {
+		*layer->nvcells[i]->dv=bias[cnt++];
+	   }
+	}
+
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------
+ * Link data array to each nvcell.din in the layer.
+ *
+ *	          !!! ---- CAUTION ---- !!!
+ * The caller MUST ensure enough data to avoid mem access error!
+ *
+ * Params:
+ * 	@layer:	   a nerve layer;
+ *	@data:     Data array as input data for nvcell.din
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------*/
+int nvlayer_link_inputdata(NVLAYER *layer, nnc_real_t *data)
+{
+	int i;
+
+	if(layer==NULL || layer->nvcells==NULL)
+		return -1;
+
+        for(i=0; i< layer->nc; i++) {
+		/* Link data to each nvcell.din */
+		layer->nvcells[i]->din=data;
+        }
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Check if a NVCELLs layer can run in tensor mode, and set
+ *	   layer->dense accordingly.
+ *	2. Conditions: all nvcells have the same nin/incells/din/prederr,
+ *	   NOT convolution nvcells, and their dw[]/dv are packed as
+ *	   W[nc][nin+1] in the parameter arena.
+ *	   As a layer created by new_nvlayer() with a template cell.
+ *	3. Called by nvnet_pack_params().
+ *
+ * Params:
+ * 	@layer	a nerve layer;
+ * Return:
+ *	true	Tensor mode
+ *	false	Normal mode
+-----------------------------------------------------------------*/
+static bool nvlayer_check_dense(NVLAYER *layer)
+{
+	int j;
+	NVCELL *cell0, *cell;
+
+	layer->dense=false;
+	if(layer->nvcells==NULL || layer->nc==0)
+		return false;
+
+	cell0=layer->nvcells[0];
+	if(cell0==NULL || !cell0->in_arena)
+		return false;
+
+	for(j=0; j< layer->nc; j++) {
+		cell=layer->nvcells[j];
+		if( cell==NULL || cell->nin != cell0->nin || cell->incells != cell0->incells
+		    || cell->din != cell0->din || cell->prederr != cell0->prederr
+		    || cell->pincells || cell->pdin || !cell->in_arena
+		    || cell->dw != cell0->dw + j*(cell0->nin+1) )
+			return false;
+	}
+
+	/* Input vector to gather incells[]->dout */
+	if(cell0->incells) {
+		if(layer->dins==NULL)
+			layer->dins=calloc(cell0->nin, sizeof(typeof(*layer->dins)));
+		if(layer->dins==NULL) {
+			printf("%s: Fail to calloc layer->dins, use normal mode.\n", __func__);
+			return false;
+		}
+	}
+
+	layer->dense=true;
+
+	return true;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Get input vector x[nin] for a tensor mode nvlayer.
+ *	2. If nvcells share din, return din. Else gather incells[]->dout
+ *	   into layer->dins, so the inner loops are free of pointer chasing.
+ *
+ * Return:
+ *	Pointer to x[nin]	OK
+ *	NULL			fails
+-----------------------------------------------------------------*/
+static nnc_real_t *nvlayer_dense_input(NVLAYER *layer)
+{
+	int i;
+	NVCELL *cell0=layer->nvcells[0];
+
+	if(cell0->din)
+		return cell0->din;
+
+	if(cell0->incells==NULL || cell0->incells[0]==NULL || layer->dins==NULL) {
+		printf("%s: nvcell->incells[x] or din[x] invalid!\n",__func__);
+		return NULL;
+	}
+
+	for(i=0; i< cell0->nin; i++)
+		layer->dins[i]=cell0->incells[i]->dout;
+
+	return layer->dins;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Tensor mode feed forward for a fully-connected nvlayer.
+ *	2. Compute all dsum[nc] as one blocked GEMV:  u=W*x-b
+ *	   4 rows are processed together to reuse x[i], and columns are
+ *	   blocked by NVLAYER_GEMV_CBLK to keep the x[] block in L1 cache.
+ *	   Each row is summed in the same order as nvcell_feed_forward().
+ *	3. Then dout=transfunc(dsum) for each nvcell.
+ *
+ * Params:
+ * 	@layer	a tensor mode nerve layer;
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+static int nvlayer_dense_feed_forward(NVLAYER *layer)
+{
+	int i,j, ib, ie;
+	int nc=layer->nc;
+	int nin=layer->nvcells[0]->nin;
+	int ld=nin+1;		/* Leading dimension of W, bias in the last column */
+	nnc_real_t *W=layer->nvcells[0]->dw;
+	nnc_real_t *x;
+	const nnc_real_t *w0, *w1, *w2, *w3;
+	nnc_real_t s0, s1, s2, s3;
+	NVCELL *cell;
+
+	x=nvlayer_dense_input(layer);
+	if(x==NULL)
+		return -3;
+
+	/* 1. Reset dsum */
+	for(j=0; j<nc; j++)
+		layer->nvcells[j]->dsum=0.0;
+
+	/* 2. dsum=W*x, blocked by columns */
+	for(ib=0; ib<nin; ib+=NVLAYER_GEMV_CBLK) {
+	    ie = ib+NVLAYER_GEMV_CBLK < nin ? ib+NVLAYER_GEMV_CBLK : nin;
+
+	    /* 4 rows a time */
+	    for(j=0; j+3<nc; j+=4) {
+		w0=W+j*ld; w1=w0+ld; w2=w1+ld; w3=w2+ld;
+		s0=layer->nvcells[j]->dsum;
+		s1=layer->nvcells[j+1]->dsum;
+		s2=layer->nvcells[j+2]->dsum;
+		s3=layer->nvcells[j+3]->dsum;
+		for(i=ib; i<ie; i++) {
+			s0 += x[i]*w0[i];
+			s1 += x[i]*w1[i];
+			s2 += x[i]*w2[i];
+			s3 += x[i]*w3[i];
+		}
+		layer->nvcells[j]->dsum=s0;
+		layer->nvcells[j+1]->dsum=s1;
+		layer->nvcells[j+2]->dsum=s2;
+		layer->nvcells[j+3]->dsum=s3;
+	    }
+	    /* Rest rows */
+	    for(; j<nc; j++) {
+		w0=W+j*ld;
+		s0=layer->nvcells[j]->dsum;
+		for(i=ib; i<ie; i++)
+			s0 += x[i]*w0[i];
+		layer->nvcells[j]->dsum=s0;
+	    }
+	}
+
+	/* 3. Apply dv and transfer function */
+	for(j=0; j<nc; j++) {
+		cell=layer->nvcells[j];
+		cell->dsum -= *cell->dv;
+
+		if(cell->transfunc)
+			cell->dout=(*cell->transfunc)(cell->dsum, 0, NORMAL_FUNC);
+		else
+			cell->dout=cell->dsum;
+	}
+
+	return 0;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Tensor mode feed backward for a fully-connected nvlayer.
+ *	2. derr=derr*f'(u) for each nvcell, then feed back to the upstream
+ *	   as W^T*derr: row by row AXPY into incells[]->derr or prederr[],
+ *	   in the same order as nvcell_feed_backward().
+ *
+ * Params:
+ * 	@layer	a tensor mode nerve layer;
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+static int nvlayer_dense_feed_backward(NVLAYER *layer)
+{
+	int i,j;
+	int nc=layer->nc;
+	NVCELL *cell0=layer->nvcells[0];
+	NVCELL *cell;
+	int nin=cell0->nin;
+	int ld=nin+1;
+	nnc_real_t *W=cell0->dw;
+	nnc_real_t *perr=NULL;
+	const nnc_real_t *w;
+	nnc_real_t d;
+
+	/* 1. derr=dE/du=derr*f'(u) */
+	for(j=0; j<nc; j++) {
+		cell=layer->nvcells[j];
+		if(cell->transfunc)
+			cell->derr *= (*cell->transfunc)(cell->dsum, cell->dout, DERIVATIVE_FUNC);
+	}
+
+	/* 2. Feed back to upstream cells: incells[]->derr += W^T*derr */
+	if( cell0->incells !=NULL && cell0->incells[0] != NULL) {
+		perr=layer->dins;  /* Borrow dins, x[] will be gathered again in nvlayer_dense_update_params() */
+		for(i=0; i<nin; i++)
+			perr[i]=cell0->incells[i]->derr;
+
+		for(j=0; j<nc; j++) {
+			w=W+j*ld;
+			d=layer->nvcells[j]->derr;
+			for(i=0; i<nin; i++)
+				perr[i] += w[i]*d;
+		}
+
+		for(i=0; i<nin; i++)
+			cell0->incells[i]->derr=perr[i];
+	}
+
+	/* 3. Feed back to upstream MAXPOOL layer: prederr[] += W^T*derr */
+	if( cell0->prederr ) {
+		perr=cell0->prederr;
+		for(j=0; j<nc; j++) {
+			w=W+j*ld;
+			d=layer->nvcells[j]->derr;
+			for(i=0; i<nin; i++)
+				perr[i] += w[i]*d;
+		}
+	}
+
+	return 0;
+}
+
+
+/*------------------------------------------------------------------
+ * Note:
+ *	1. Tensor mode params update for a fully-connected nvlayer.
+ *	2. As a rank-1 update: W -= rate*derr*x^T, b += rate*derr
+ *	   W rows are swept sequentially in the parameter arena.
+ *
+ * Params:
+ * 	@layer	a tensor mode nerve layer;
+ *	@rate	learning rate
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+static int nvlayer_dense_update_params(NVLAYER *layer, double rate)
+{
+	int i,j;
+	int nc=layer->nc;
+	int nin=layer->nvcells[0]->nin;
+	int ld=nin+1;
+	nnc_real_t *W=layer->nvcells[0]->dw;
+	nnc_real_t *x;
+	nnc_real_t *w;
+	nnc_real_t d;
+
+	x=nvlayer_dense_input(layer);
+	if(x==NULL)
+		return -2;
+
+	for(j=0; j<nc; j++) {
+		w=W+j*ld;
+		d=layer->nvcells[j]->derr;
+		for(i=0; i<nin; i++)
+			w[i] -= rate*x[i]*d;
+
+		/* dv as special weight var with w=-1.0 */
+		w[nin] += rate*d;
+	}
+
+	return 0;
+}
+
+
+/*----------------------------------------------
+ * Note:
+ *	A feed forward function for a nerve layer.
+ * Params:
+ * 	@layer	a nerve layer;
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------*/
+int nvlayer_feed_forward(NVLAYER *layer)
+{
+	int i;
+	int ret=0;
+
+	/* check layer */
+	if(layer==NULL)  // || layer->nvcells==NULL)
+		return -1;
+
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		ret=conv3x3_feed_forward(layer->conv3x3);
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		ret=convkxk_feed_forward(layer->convkxk);
+	}
+	/* Case_2: MAXPOOL2X2 Layer */
+	else if(layer->maxpool2x2) {
+		ret=maxpool2x2_feed_forward(layer->maxpool2x2);
+	}
+	/* Case_3A: NVCELLs Layer, in tensor mode */
+	else if(layer->dense) {
+		if(layer->din8)
+			nnc_normalize_u8(layer->din8, layer->din8_scale, layer->din8buf, layer->nvcells[0]->nin);
+		ret=nvlayer_dense_feed_forward(layer);
+		if( ret !=0 ) return ret;
+	}
+	/* Case_3: NVCELLs Layer */
+	else if(layer->nvcells) {
+		if(layer->din8)
+			nnc_normalize_u8(layer->din8, layer->din8_scale, layer->din8buf, layer->nvcells[0]->nin);
+
+		/* Feed forward all nvcells in the layer */
+		for(i=0; i< layer->nc; i++) {
+			ret=nvcell_feed_forward(layer->nvcells[i]);
+			if( ret !=0 ) return ret;
+		}
+	}
+
+	/* Apply nvlayer transfer function for NVCELLs Layer.  Example: output layer softmax  HK2023-05-18 */
+	if(layer->nvcells && layer->nc>0) {
+		if( layer->transfunc !=NULL ) {
+			if(layer->nvcells[0]->transfunc !=NULL) {
+			   printf("%s: !!! CAUTION !!!  Layer->transfunc defined while layer->nvcells->transfunc ALSO defined~!\n", __func__);
+			}
+
+			ret=(*layer->transfunc)(layer, NORMAL_FUNC);
+			if( ret!=0 ) return ret;
+		}
+	}
+
+	return ret;
+}
+
+
+/*-----------------------------------------------------------------------------
+ *	WARN: The loss function MUST be a kind of MEAN loss type !!!!
+ * 	Example: (1/N)*SUM[(tv-yi)^2], (1/N)*SUM[ ] is calculated in this func.
+ *
+ * Note:
+ *  1.  Calculate MEAN loss value from output nerve cells. It calculates
+ *	each output nvcells with dout and tv, then use number of nvcells
+ *	to get a mean loss value.
+ *  2.  It alsao calculate derr=L'(h)*f'(u)
+ *  3.  This func MUST be called after each feed_forward calculaton.
+ *  4.  Make sure that size of array tv is outlayer->nc.
+ *
+ * Params:
+ * 	@outlayer	output nerve layer;
+ *	@tv		array of teacher's value.
+ *	@loss		MUST be a kind of MEAN loss function !!!
+ *
+ * Return:
+ *		0	OK
+ *		<0	fails
+------------------------------------------------------------------------------*/
+nnc_real_t nvlayer_mean_loss(NVLAYER *outlayer, const nnc_real_t *tv,
+			nnc_real_t (*loss_func)(nnc_real_t out, const nnc_real_t tv, int token) )
+{
+	int i;
+	//nnc_real_t err=0.0;
+	nnc_real_t loss=0.0;
+	nnc_real_t fmaxdsum, lse;
+//	nnc_real_t mean_loss=0.0;
+
+	/* check input param */
+	if(outlayer==NULL || outlayer->nvcells==NULL|| tv==NULL ) {
+		printf("%s: input params invalid! \n",__func__);
+		return 999999.9;
+	}
+	else if(loss_func==NULL) {
+		printf("%s: Loss function NOT defined! \n",__func__);
+		return 999999.9;
+	}
+
+	/* 1. For softMax+lossCrossEntropy: softMas as outlayer transfer func.  HK2023-06-19 */
+	if(loss_func==func_lossCrossEntropy ) {
+	    if(outlayer->transfunc == func_softmax) {
+		/* log(SUM{e^dsum[k]}) with the max. dsum shifted out, as func_softmax(). The loss is
+		 * -tv*(dsum-lse) in log space, it keeps finite when a softmax douts[i] underflows to 0. HK2026-10-18
+		 */
+		fmaxdsum=outlayer->nvcells[0]->dsum;
+		for(i=1; i< outlayer->nc; i++) {
+			if(outlayer->nvcells[i]->dsum > fmaxdsum)
+				fmaxdsum=outlayer->nvcells[i]->dsum;
+		}
+		lse=0.0;
+		for(i=0; i< outlayer->nc; i++)
+			lse += exp(outlayer->nvcells[i]->dsum -fmaxdsum);
+		lse=fmaxdsum+log(lse);
+
+           	/* for each output nvcell */
+           	for(i=0; i< outlayer->nc; i++) {
+			/* sum up each loss, Noticed: softMax()  results stored in outlayer->douts! */
+			//loss += loss_func(outlayer->douts[i], tv[i], NORMAL_FUNC);
+			if(tv[i]!=0.0)
+				loss += -tv[i]*(outlayer->nvcells[i]->dsum -lse);
+
+			/* Here we only calc L'(h), and put it in nvcell->derr,
+                 	 * later in nvcell_feed_backward() : derr=L'(h)*f'(u)=derr*f'(u) as dE/du.dE/dh*dh/du
+                 	 */
+			/* For combined function cf(ui)=softmax+crossEntropy: cf'(u)= y[i]-tv[i]  */
+			outlayer->nvcells[i]->derr = outlayer->douts[i]-tv[i]; /* Notice: not in nvcells[]->dout!!! */
+		}
+	    }
+	    else {
+			printf("%s: CrossEntropy MUST combine with sotfMax! \n",__func__);
+			return 999999.9;
+	    }
+	}
+	/* 2. Non_combine functions */
+	else {
+
+	   /* for each output nvcell */
+	   for(i=0; i< outlayer->nc; i++) {
+		/* sum up each loss */
+		loss += loss_func(outlayer->nvcells[i]->dout, tv[i], NORMAL_FUNC);
+
+		/* Here we only calc L'(h), and put it in nvcell->derr,
+                 * later in nvcell_feed_backward() : derr=L'(h)*f'(u)=derr*f'(u) as dE/du.dE/dh*dh/du
+                 */
+		outlayer->nvcells[i]->derr = loss_func(outlayer->nvcells[i]->dout, tv[i], DERIVATIVE_FUNC);
+	    }
+	}
+
+	/* get mean loss */
+//	printf("%s: loss=%f\n", __func__, loss);
+	return loss/(outlayer->nc);
+}
+
+
+/*----------------------------------------------
+ * Note:
+ *	A feed forward function for a nerve layer.
+ * Params:
+ * 	@layer	a nerve layer;
+ *	@tv		a teacher's value of output nvcells;
+ *			NULL for non_output nvcells
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------*/
+int nvlayer_feed_backward(NVLAYER *layer)
+{
+	int i;
+	int ret=0;
+
+	/* check layer */
+	if(layer==NULL)  // || layer->nvcells==NULL)
+		return -1;
+
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		ret=conv3x3_feed_backward(layer->conv3x3);
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		ret=convkxk_feed_backward(layer->convkxk);
+	}
+	/* Case_2: MAXPOOL2X2 Layer */
+	else if(layer->maxpool2x2) {
+		ret=maxpool2x2_feed_backward(layer->maxpool2x2);
+	}
+	/* Case_3A: NVCELLs Layer, in tensor mode */
+	else if(layer->dense) {
+		ret=nvlayer_dense_feed_backward(layer);
+	}
+	/* Case_3: NVCELLs Layer */
+	else if(layer->nvcells) {
+		/* feed backward all nvcells in the layer */
+		for(i=0; i< layer->nc; i++) {
+			ret=nvcell_feed_backward(layer->nvcells[i]);
+	    		if(ret !=0) return ret;
+		}
+	}
+
+	return ret;
+}
+
+
+/*-----------------------------------------------------------------
+ * Get number of params of a nvlayer, as its size in the arena.
+-----------------------------------------------------------------*/
+static unsigned long nvlayer_num_params(const NVLAYER *layer)
+{
+	int j;
+	unsigned long n=0;
+
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		n=layer->conv3x3->nf*layer->conv3x3->nchan*9;
+		if(layer->conv3x3->dvs)
+			n += layer->conv3x3->nf;
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		n=layer->convkxk->nf*layer->convkxk->nchan*layer->convkxk->ks*layer->convkxk->ks;
+		if(layer->convkxk->dvs)
+			n += layer->convkxk->nf;
+	}
+	/* Case_2: MAXPOOL2X2 Layer, NO params */
+	else if(layer->maxpool2x2) {
+	}
+	/* Case_3: NVCELLs Layer */
+	else {
+		for(j=0; j< layer->nc; j++)
+			n += layer->nvcells[j]->nin+1; /* dw[], dv */
+	}
+
+	return n;
+}
+
+
+/*-----------------------------------------------------------------
+ * Pack params for nvnet_pack_params() and nvnet_pack_mapped_params(),
+ * with the PARAMS region at pmapped[npa_mapped] if it's NOT NULL.
+-----------------------------------------------------------------*/
+static int nvnet_pack_arena(NVNET *nnet, nnc_real_t *pmapped, unsigned long npa_mapped)
+{
+	int i,j;
+	int r0;			/* First region in the arena, NVNET_ARENA_GRADS if pmapped */
+	bool copy;		/* To copy current params into the arena */
+	unsigned long npa, off, size;
+	NVLAYER *layer;
+	CONV3X3 *conv3;
+	CONVKXK *convk;
+	NVCELL *cell;
+	nnc_real_t *pdata;
+
+	if( nnet==NULL || nnet->nl==0)
+		return -1;
+
+	/* Already packed */
+	if(nnet->pparams)
+		return 0;
+
+	/* 1. Count params */
+	npa=0;
+	for(i=0; i< nnet->nl; i++) {
+	    layer=nnet->nvlayers[i];
+	    if(layer==NULL)
+		return -1;
+
+	    /* Training and inference only layers can NOT be mixed */
+	    if( (layer->conv3x3 && layer->conv3x3->infer_only != nnet->infer_only)
+		|| (layer->convkxk && layer->convkxk->infer_only != nnet->infer_only)
+		|| (layer->maxpool2x2 && layer->maxpool2x2->infer_only != nnet->infer_only) ) {
+		printf("%s: nvlayers[%d] and the nvnet are NOT both inference only!\n", __func__, i);
+		return -1;
+	    }
+
+	    npa += nvlayer_num_params(layer);
+	}
+	if(npa==0) {
+		printf("%s: No params in the nvnet!\n", __func__);
+		return -1;
+	}
+	if( pmapped && npa != npa_mapped ) {
+		printf("%s: The nvnet has %lu params, while %lu are mapped.\n", __func__, npa, npa_mapped);
+		return -1;
+	}
+
+	/* 2. Calloc the arena, ONLY the PARAMS region for inference only, and NO PARAMS region if mapped */
+	r0= pmapped ? NVNET_ARENA_PARAMS+1 : NVNET_ARENA_PARAMS;
+	copy= (pmapped==NULL);
+	nnet->narena=((nnet->infer_only ? NVNET_ARENA_PARAMS+1 : NVNET_ARENA_REGIONS)-r0)*npa;
+	if(nnet->narena) {
+		nnet->parena=calloc(nnet->narena, sizeof(nnc_real_t));
+		if(nnet->parena==NULL) {
+			printf("%s: Fail to calloc nnet->parena.\n", __func__);
+			nnet->narena=0;
+			return -2;
+		}
+	}
+	nnet->npa=npa;
+	nnet->pparams= pmapped ? pmapped : nnet->parena+(NVNET_ARENA_PARAMS-r0)*npa;
+	if(!nnet->infer_only) {
+		nnet->pgrads=nnet->parena+(NVNET_ARENA_GRADS-r0)*npa;
+		nnet->mmts=nnet->parena+(NVNET_ARENA_MMTS-r0)*npa;
+		nnet->paccum=nnet->parena+(NVNET_ARENA_ACCUM-r0)*npa;
+		nnet->nmp=npa;
+	}
+	nnet->nacc=0;
+
+	/* 3. Move params into the arena */
+	off=0;
+	for(i=0; i< nnet->nl; i++) {
+	    layer=nnet->nvlayers[i];
+
+	    /* Case_1: CONV3X3 Layer */
+	    if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		size=conv3->nf*conv3->nchan*9;
+
+		/* fparams and dFP, both flatten-friendly, NO dFP/dferr for inference only */
+		pdata=conv3->fparams[0][0];
+		if(copy)
+			memcpy(nnet->pparams+off, pdata, size*sizeof(nnc_real_t));
+		if(!conv3->in_arena) free(pdata);
+		if(conv3->dFP) {
+			pdata=conv3->dFP[0][0];
+			memcpy(nnet->pgrads+off, pdata, size*sizeof(nnc_real_t));
+			if(!conv3->in_arena) free(pdata);
+		}
+		for(j=0; j< conv3->nf*conv3->nchan; j++) {
+			conv3->fparams[j/conv3->nchan][j%conv3->nchan]=nnet->pparams+off+j*9;
+			if(conv3->dFP)
+				conv3->dFP[j/conv3->nchan][j%conv3->nchan]=nnet->pgrads+off+j*9;
+		}
+		off += size;
+
+		/* dvs and dferr */
+		if(conv3->dvs) {
+			if(copy)
+				memcpy(nnet->pparams+off, conv3->dvs, conv3->nf*sizeof(nnc_real_t));
+			if(conv3->dferr)
+				memcpy(nnet->pgrads+off, conv3->dferr, conv3->nf*sizeof(nnc_real_t));
+			if(!conv3->in_arena) {
+				free(conv3->dvs);
+				free(conv3->dferr);
+			}
+			conv3->dvs=nnet->pparams+off;
+			if(conv3->dferr)
+				conv3->dferr=nnet->pgrads+off;
+			off += conv3->nf;
+		}
+
+		conv3->in_arena=true;
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(layer->convkxk) {
+		convk=layer->convkxk;
+		size=convk->nf*convk->nchan*convk->ks*convk->ks;
+
+		/* fparams and dFP, NO dFP/dferr for inference only */
+		if(copy)
+			memcpy(nnet->pparams+off, convk->fparams, size*sizeof(nnc_real_t));
+		if(convk->dFP)
+			memcpy(nnet->pgrads+off, convk->dFP, size*sizeof(nnc_real_t));
+		if(!convk->in_arena) {
+			free(convk->fparams);
+			free(convk->dFP);
+		}
+		convk->fparams=nnet->pparams+off;
+		if(convk->dFP)
+			convk->dFP=nnet->pgrads+off;
+		off += size;
+
+		/* dvs and dferr */
+		if(convk->dvs) {
+			if(copy)
+				memcpy(nnet->pparams+off, convk->dvs, convk->nf*sizeof(nnc_real_t));
+			if(convk->dferr)
+				memcpy(nnet->pgrads+off, convk->dferr, convk->nf*sizeof(nnc_real_t));
+			if(!convk->in_arena) {
+				free(convk->dvs);
+				free(convk->dferr);
+			}
+			convk->dvs=nnet->pparams+off;
+			if(convk->dferr)
+				convk->dferr=nnet->pgrads+off;
+			off += convk->nf;
+		}
+
+		convk->in_arena=true;
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer */
+	    else if(layer->maxpool2x2) {
+		/* NO params */
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else {
+		for(j=0; j< layer->nc; j++) {
+			cell=layer->nvcells[j];
+			if(copy)
+				memcpy(nnet->pparams+off, cell->dw, (cell->nin+1)*sizeof(nnc_real_t)); /* dw[], dv */
+			if(!cell->in_arena) free(cell->dw);
+			cell->dw=nnet->pparams+off;
+			cell->dv=cell->dw+cell->nin;
+			cell->in_arena=true;
+			off += cell->nin+1;
+		}
+
+		/* Check if it can run in tensor mode */
+		nvlayer_check_dense(layer);
+	    }
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Allocate the parameter arena for a nerve NET, and move all
+ *	   params of its nvlayers into the arena, in order of layers:
+ *	     CONV3X3:  fparams[nf][nchan][9], dvs[nf]
+ *	     CONVKXK:  fparams[nf][nchan*ks*ks], dvs[nf]
+ *	     NVCELL:   dw[0]...dw[nin-1], dv
+ *	   CONV3X3/CONVKXK dFP/dferr go to the GRADS region at the same offsets.
+ *	   nnet->mmts is the MMTS region.
+ *	2. Current param values are kept, and the original mem space
+ *	   of dw/fparams/dvs/dFP/dferr are freed.
+ *	3. It's called by nvnet_init_params(), nvnet_mmtupdate_params()
+ *	   and nvnet_buff_params() if the arena is NOT allocated yet.
+ *	   Call it only after all nvlayers are created and linked.
+ *
+ * Params:
+ * 	@nnet		nerve net
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+int nvnet_pack_params(NVNET *nnet)
+{
+	return nvnet_pack_arena(nnet, NULL, 0);
+}
+
+
+/*-----------------------------------------------------------------
+ * Pack params of a nvnet as nvnet_pack_params(), but its PARAMS
+ * region is pparams given by the caller, as params in a mmaped
+ * model file, see nvnet_load().
+ *
+ * Note:
+ *	1. Values in pparams are kept, current params of nvlayers are
+ *	   NOT copied and are freed.
+ *	2. The arena has NO PARAMS region, and NO arena at all for
+ *	   inference only.
+ *	3. pparams MUST keep valid until nnet is freed.
+ *
+ * Params:
+ * 	@nnet		nerve net, NOT packed yet.
+ *	@pparams	params in the layout of nvnet_pack_params()
+ *	@npa		number of params in pparams, MUST be the same as
+ *			that of the nvnet.
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+int nvnet_pack_mapped_params(NVNET *nnet, nnc_real_t *pparams, unsigned long npa)
+{
+	if( nnet==NULL || nnet->pparams || pparams==NULL )
+		return -1;
+
+	return nvnet_pack_arena(nnet, pparams, npa);
+}
+
+
+/*-----------------------------------------------------------------
+ * Point all params of a packed nvnet to pparams, which has the same
+ * layout as nnet->pparams. Values are NOT copied, and the PARAMS
+ * region of nnet->parena is left unused.
+ *
+ * Note:
+ *	1. For nvnet_new_replica() to share params of another nvnet,
+ *	   and nvnet_load() to use params in a mmaped model file.
+ *	2. pparams MUST hold nnet->npa values, and keep valid until
+ *	   nnet is freed.
+ *
+ * Params:
+ * 	@nnet		nerve net, with params packed.
+ *	@pparams	params in the layout of nvnet_pack_params()
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------------------------------*/
+int nvnet_map_params(NVNET *nnet, nnc_real_t *pparams)
+{
+	int i,k;
+	unsigned long off;
+	NVLAYER *layer;
+	CONV3X3 *conv3;
+	nnc_real_t *pold;
+
+	if( nnet==NULL || nnet->pparams==NULL || pparams==NULL )
+		return -1;
+
+	pold=nnet->pparams;
+	for(k=0; k< nnet->nl; k++) {
+	    layer=nnet->nvlayers[k];
+	    /* Case_1: CONV3X3 Layer */
+	    if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		off=conv3->fparams[0][0]-pold;
+		for(i=0; i< conv3->nf*conv3->nchan; i++)
+			conv3->fparams[i/conv3->nchan][i%conv3->nchan]=pparams+off+i*9;
+		if(conv3->dvs)
+			conv3->dvs=pparams+(conv3->dvs-pold);
+		conv3->wgU_valid=false;
+		conv3->cbw_valid=false;
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(layer->convkxk) {
+		layer->convkxk->fparams=pparams+(layer->convkxk->fparams-pold);
+		if(layer->convkxk->dvs)
+			layer->convkxk->dvs=pparams+(layer->convkxk->dvs-pold);
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer, NO params */
+	    else if(layer->maxpool2x2) {
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else {
+		for(i=0; i< layer->nc; i++) {
+			layer->nvcells[i]->dw=pparams+(layer->nvcells[i]->dw-pold);
+			layer->nvcells[i]->dv=layer->nvcells[i]->dw+layer->nvcells[i]->nin;
+		}
+	    }
+	}
+	nnet->pparams=pparams;
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Get memory footprint of a nvnet, as bytes allocated for it,
+ * its nvlayers, nvcells, CONV3X3/MAXPOOL2X2 and their buffers.
+ *
+ * Note:
+ *	1. A mmaped model file(nnet->pmap) is NOT counted, as its
+ *	   pages are shared by processes, see nvnet_load().
+ *	2. Input data of the first layer is NOT counted.
+ *
+ * Params:
+ * 	@nnet		nerve net
+ * Return:
+ *	Bytes of memory
+-----------------------------------------------------------------*/
+unsigned long nvnet_mem_footprint(const NVNET *nnet)
+{
+	int i,j;
+	unsigned long nr=0;	/* in nnc_real_t */
+	unsigned long np=0;	/* in pointers */
+	unsigned long bytes;
+	const NVLAYER *layer;
+	const CONV3X3 *conv3;
+	const CONVKXK *convk;
+	const MAXPOOL2X2 *maxpool;
+	unsigned long osize, K, ncb;
+
+	if(nnet==NULL)
+		return 0;
+
+	bytes=sizeof(NVNET);
+	np += nnet->nl;
+	if(nnet->profile)
+		bytes += nnet->nl*sizeof(NVPROFILE);
+
+	/* Parameter arena, params buffer and batch working buffer */
+	nr += nnet->narena;
+	if(nnet->params)
+		nr += nnet->np;
+	nr += nnet->nbsize;
+
+	for(i=0; i< nnet->nl; i++) {
+	    layer=nnet->nvlayers[i];
+	    if(layer==NULL)
+		continue;
+	    bytes += sizeof(NVLAYER);
+
+	    /* Case_1: CONV3X3 Layer */
+	    if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		osize=conv3->nf*conv3->ow*conv3->oh;
+		bytes += sizeof(CONV3X3);
+		np += conv3->nf+conv3->nf*conv3->nchan;		/* fparams[][] */
+		if(!conv3->in_arena) {
+			nr += conv3->nf*conv3->nchan*9;
+			if(conv3->dvs) nr += conv3->nf;
+			if(conv3->dferr) nr += conv3->nf;
+			if(conv3->dFP) nr += conv3->nf*conv3->nchan*9;
+		}
+		if(conv3->dFP)
+			np += conv3->nf+conv3->nf*conv3->nchan;
+		if(conv3->dsums && conv3->dsums != conv3->douts) {
+			np += conv3->nf;
+			nr += osize;
+		}
+		np += conv3->nf;
+		nr += osize;					/* douts */
+		if(conv3->derr) {
+			np += conv3->nf;
+			nr += osize;
+		}
+		if(conv3->cols) nr += conv3->nchan*9*conv3->ow*conv3->oh;
+		if(conv3->dcols) nr += conv3->nchan*9*conv3->ow*conv3->oh;
+		if(conv3->gout) nr += osize;
+		if(conv3->wgU) nr += conv3->nf*conv3->nchan*16;
+		if(conv3->wgV) nr += conv3->nchan*16;
+		ncb=(conv3->nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK;
+		if(conv3->cbin) nr += ncb*CONV3X3_CBLK*conv3->imw*conv3->imh;
+		if(conv3->cbw) nr += conv3->nf*ncb*CONV3X3_CBLK*9;
+		if(conv3->cberr) nr += ncb*CONV3X3_CBLK*conv3->imw*conv3->imh;
+		if(conv3->din8buf) nr += conv3->nchan*conv3->imw*conv3->imh;
+		nr += conv3->ntperr*conv3->nchan*conv3->imw*conv3->imh;
+		np += conv3->ntperr*conv3->nchan;
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(layer->convkxk) {
+		convk=layer->convkxk;
+		osize=convk->nf*convk->ow*convk->oh;
+		K=convk->nchan*convk->ks*convk->ks;
+		bytes += sizeof(CONVKXK);
+		if(!convk->in_arena) {
+			nr += convk->nf*K;
+			if(convk->dvs) nr += convk->nf;
+			if(convk->dferr) nr += convk->nf;
+			if(convk->dFP) nr += convk->nf*K;
+		}
+		if(convk->dsums != convk->douts) {
+			np += convk->nf;
+			nr += osize;
+		}
+		np += convk->nf;
+		nr += osize;					/* douts */
+		if(convk->derr) {
+			np += convk->nf;
+			nr += osize;
+		}
+		nr += K*convk->ow*convk->oh;			/* cols */
+		if(convk->dcols) nr += K*convk->ow*convk->oh;
+		if(convk->gout) nr += osize;
+		if(convk->din8buf) nr += convk->nchan*convk->imw*convk->imh;
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer */
+	    else if(layer->maxpool2x2) {
+		maxpool=layer->maxpool2x2;
+		osize=maxpool->nf*maxpool->ow*maxpool->oh;
+		bytes += sizeof(MAXPOOL2X2);
+		np += maxpool->nf;
+		nr += osize;
+		if(maxpool->derr) {
+			np += maxpool->nf;
+			nr += osize;
+		}
+		if(maxpool->argmax)
+			bytes += osize;
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else {
+		np += layer->nc;
+		bytes += layer->nc*sizeof(NVCELL);
+		for(j=0; j< layer->nc; j++) {
+			if(!layer->nvcells[j]->in_arena)
+				nr += layer->nvcells[j]->nin+1;
+		}
+		if(layer->douts)
+			nr += layer->nc;
+		if(layer->dins)
+			nr += layer->nvcells[0]->nin;
+		if(layer->din8buf)
+			nr += layer->nvcells[0]->nin;
+	    }
+	}
+
+	return bytes+nr*sizeof(nnc_real_t)+np*sizeof(void *);
+}
+
+
+#ifdef NNC_PROFILE
+/* Time in ns, for profiling */
+static double nvprof_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1.0e9+ts.tv_nsec;
+}
+
+
+/*--------------------------------------------------
+ * Flops of a phase of a nvlayer, a multiply-add
+ * counts 2, and a compare of MAXPOOL2X2 counts 1.
+ * Params:
+ *	@layer		a nerve layer
+ *	@phase		enum nvprof_phase
+ * Return:
+ *	Flops
+---------------------------------------------------*/
+static double nvlayer_flops(const NVLAYER *layer, int phase)
+{
+	double f;
+	const CONV3X3 *conv3;
+	const CONVKXK *convk;
+	const MAXPOOL2X2 *maxpool;
+
+	/* Case_1: CONV3X3 Layer, backward: dFP, and prederr if any */
+	if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		f=2.0*conv3->nf*conv3->nchan*9*conv3->ow*conv3->oh;
+		if(phase==NVPROF_FORWARD)
+			return f;
+		else if(phase==NVPROF_BACKWARD)
+			return conv3->prederr ? 2*f : f;
+		else
+			return 2.0*conv3->nf*conv3->nchan*9 + (conv3->dvs ? 2.0*conv3->nf : 0);
+	}
+	/* Case_1A: CONVKXK Layer, as CONV3X3 */
+	else if(layer->convkxk) {
+		convk=layer->convkxk;
+		f=2.0*convk->nf*convk->nchan*convk->ks*convk->ks*convk->ow*convk->oh;
+		if(phase==NVPROF_FORWARD)
+			return f;
+		else if(phase==NVPROF_BACKWARD)
+			return convk->prederr ? 2*f : f;
+		else
+			return 2.0*convk->nf*convk->nchan*convk->ks*convk->ks + (convk->dvs ? 2.0*convk->nf : 0);
+	}
+	/* Case_2: MAXPOOL2X2 Layer, 3 compares for each output */
+	else if(layer->maxpool2x2) {
+		maxpool=layer->maxpool2x2;
+		return phase==NVPROF_FORWARD ? 3.0*maxpool->nf*maxpool->ow*maxpool->oh : 0;
+	}
+	/* Case_3: NVCELLs Layer, backward: W^T*derr, if fed back to incells/prederr */
+	else if(layer->nc > 0 && layer->nvcells) {
+		f=2.0*layer->nc*layer->nvcells[0]->nin;
+		if(phase==NVPROF_FORWARD)
+			return f;
+		else if(phase==NVPROF_BACKWARD)
+			return (layer->nvcells[0]->prederr || layer->nvcells[0]->incells) ? f : 0;
+		else
+			return f+2.0*layer->nc;
+	}
+
+	return 0;
+}
+
+
+/*--------------------------------------------------
+ * Record a call of a phase to nnet->profile[i]:
+ * time since t0, and flops of layers [i, i+n).
+---------------------------------------------------*/
+static void nvprof_record(NVNET *nnet, int i, int n, int phase, double t0)
+{
+	int k;
+	NVPROFILE *prof=nnet->profile+i;
+
+	prof->ns[phase] += nvprof_ns()-t0;
+	prof->calls[phase]++;
+	for(k=i; k<i+n; k++)
+		prof->flops[phase] += nvlayer_flops(nnet->nvlayers[k], phase);
+}
+
+
+/*--------------------------------------------------
+ * Record an update sweep over the arena since t0,
+ * by nvoptim_step() or nvnet_apply_dparams(), to
+ * NVPROF_UPDATE of each layer with params. Time is
+ * split as per number of params of layers, as the
+ * sweep costs the same for each param.
+---------------------------------------------------*/
+static void nvprof_record_sweep(NVNET *nnet, double t0)
+{
+	int i;
+	unsigned long n;
+	double ns=nvprof_ns()-t0;
+	NVPROFILE *prof;
+
+	for(i=0; i< nnet->nl; i++) {
+		n=nvlayer_num_params(nnet->nvlayers[i]);
+		if(n==0)
+			continue;
+		prof=nnet->profile+i;
+		prof->ns[NVPROF_UPDATE] += ns*n/nnet->npa;
+		prof->calls[NVPROF_UPDATE]++;
+		prof->flops[NVPROF_UPDATE] += nvlayer_flops(nnet->nvlayers[i], NVPROF_UPDATE);
+	}
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+ * Get the per-layer profile of a nvnet, profile[nl] as nnet->nl
+ * layers, recorded in nvnet_feed_forward(), nvnet_feed_backward()
+ * and nvnet_update_params(). For mini-batch training, the update
+ * phase is recorded in nvnet_accum_dparams() for each sample, and
+ * in nvoptim_step()/nvnet_apply_dparams() for each batch.
+ *
+ * Note:
+ *	1. ONLY recorded if built with NNC_PROFILE(make ... PROFILE=1),
+ *	   otherwise it costs nothing and returns NULL.
+ *	2. Records are added up until nvnet_reset_profile(), call it
+ *	   at the start of each epoch for per-epoch results.
+ *	3. A MAXPOOL2X2 fused in its CONV3X3 is recorded to the CONV3X3,
+ *	   see conv3x3_maxpool2x2_feed_forward().
+ *	4. For a NVTRAINER, records of its replicas are added to its
+ *	   nvnet after each batch, so times are summed over threads.
+ *
+ * Params:
+ * 	@nnet		nerve net
+ * Return:
+ *	profile[nl]	OK
+ *	NULL		NOT built with NNC_PROFILE
+-----------------------------------------------------------------*/
+const NVPROFILE *nvnet_get_profile(const NVNET *nnet)
+{
+	if(nnet==NULL)
+		return NULL;
+
+	return nnet->profile;
+}
+
+
+/*-------------------------------------------
+ * Clear the per-layer profile of a nvnet,
+ * see nvnet_get_profile().
+ * Params:
+ * 	@nnet		nerve net
+--------------------------------------------*/
+void nvnet_reset_profile(NVNET *nnet)
+{
+	if(nnet==NULL || nnet->profile==NULL)
+		return;
+
+	memset(nnet->profile, 0, nnet->nl*sizeof(NVPROFILE));
+}
+
+
+/*--------------------------------------------------
+ * Print the per-layer profile of a nvnet, a line
+ * for each phase of each layer called.
+ * Params:
+ * 	@nnet		nerve net
+---------------------------------------------------*/
+void nvnet_print_profile(const NVNET *nnet)
+{
+	int i,k;
+	double total=0.0;
+	const NVPROFILE *prof;
+	const NVLAYER *layer;
+	const char *phase_names[NVPROF_PHASES]={ "forward", "backward", "update" };
+	const char *type;
+
+	prof=nvnet_get_profile(nnet);
+	if(prof==NULL) {
+		printf("%s: NO profile, build with NNC_PROFILE.\n", __func__);
+		return;
+	}
+
+	for(i=0; i< nnet->nl; i++)
+		for(k=0; k<NVPROF_PHASES; k++)
+			total += prof[i].ns[k];
+
+	printf("layer  type        phase        calls       total_ms   us/call  GFLOP/s  time%%\n");
+	for(i=0; i< nnet->nl; i++) {
+	    layer=nnet->nvlayers[i];
+	    if(layer->conv3x3)
+		type="CONV3X3";
+	    else if(layer->convkxk)
+		type="CONVKXK";
+	    else if(layer->maxpool2x2)
+		type="MAXPOOL2X2";
+	    else
+		type= layer->dense ? "DENSE" : "NVCELLs";
+
+	    for(k=0; k<NVPROF_PHASES; k++) {
+		if(prof[i].calls[k]==0)
+			continue;
+		printf("%-6d %-11s %-9s %10lu %14.3f %9.3f %8.3f %6.2f\n", i, type, phase_names[k], prof[i].calls[k],
+			prof[i].ns[k]/1.0e6, prof[i].ns[k]/1.0e3/prof[i].calls[k],
+			prof[i].ns[k]>0 ? prof[i].flops[k]/prof[i].ns[k] : 0.0,
+			total>0 ? 100.0*prof[i].ns[k]/total : 0.0);
+	    }
+	}
+}
+
+
+/*-----------------------------------------
+ * A feed forward function for a nerve NET.
+ * Params:
+ * 	@nnet		nerve net
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------*/
+int nvnet_init_params(NVNET *nnet)
+{
+	int i,j;
+	NVCELL *cell;
+
+	if( nnet==NULL || nnet->nl==0)
+		return -1;
+
+	/* Move params into the parameter arena */
+	if( nvnet_pack_params(nnet) <0 )
+		return -1;
+
+	/* rand dw[] and dv */
+	for(i=0; i< nnet->nl; i++) {
+	    /* Case_1: CONV3X3 Layer */
+	    if(nnet->nvlayers[i]->conv3x3) {
+		conv3x3_rand_params(nnet->nvlayers[i]->conv3x3);
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(nnet->nvlayers[i]->convkxk) {
+		convkxk_rand_params(nnet->nvlayers[i]->convkxk);
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer */
+	    else if(nnet->nvlayers[i]->maxpool2x2) {
+		/* NO params */
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else {
+		for(j=0; j< nnet->nvlayers[i]->nc; j++) {
+			cell=nnet->nvlayers[i]->nvcells[j];
+			if( nvcell_rand_dwv(cell) <0 ) /* rand dw dv */
+				return -2;
+			cell->dsum=0.0;
+			cell->dout=0.0;
+			cell->derr=0.0;
+		}
+	    }
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------
+ * A feed forward function for a nerve NET.
+ * Params:
+ * 	@nnet		nerve net
+ *	@tv		array of teach value
+ *	@loss_func	loss function
+ *
+ * Return:
+ *		others 	OK
+ *		a big value	fails
+-----------------------------------------*/
+nnc_real_t nvnet_feed_forward(NVNET *nnet, const nnc_real_t *tv,
+			nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int) )
+{
+	int i;
+
+	if( nnet==NULL || nnet->nl==0)
+		return 999999.9;
+
+	for(i=0; i< nnet->nl; i++) {
+//		printf("%s: nvlayers[%d] feed forward...\n",__func__, i);
+		NVPROF_BEGIN(t0);
+		/* A CONV3X3 and the MAXPOOL2X2 pooling it, in one pass */
+		if( nnc_fusion && i+1 < nnet->nl && nnet->nvlayers[i]->conv3x3 && nnet->nvlayers[i+1]->maxpool2x2
+		    && nnet->nvlayers[i+1]->maxpool2x2->inconv3x3==nnet->nvlayers[i]->conv3x3 ) {
+			conv3x3_maxpool2x2_feed_forward(nnet->nvlayers[i]->conv3x3, nnet->nvlayers[i+1]->maxpool2x2);
+			NVPROF_END(nnet, i, 2, NVPROF_FORWARD, t0);
+			i++;
+			continue;
+		}
+		nvlayer_feed_forward(nnet->nvlayers[i]);
+		NVPROF_END(nnet, i, 1, NVPROF_FORWARD, t0);
+	}
+
+        /* Get final err */
+	if(tv) {
+         	return  nvlayer_mean_loss( nnet->nvlayers[nnet->nl-1], tv, loss_func );
+	}
+	else /* HK2023-05-17 */
+		return 0.0f;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Pool din[nf][imw*imh] into dout[nf][ow*oh], the same as
+ *	   maxpool2x2_feed_forward(), for nvnet_feed_forward_batch().
+-----------------------------------------------------------------*/
+static void maxpool2x2_pool_data(const MAXPOOL2X2 *maxpool, const nnc_real_t *din, nnc_real_t *dout)
+{
+	int i,j, ii, jj, findex;
+	unsigned int pos;
+	const nnc_real_t *src;
+	nnc_real_t fval;
+
+	for(findex=0; findex < maxpool->nf; findex++) {
+	    src=din+findex*maxpool->imw*maxpool->imh;
+	    for(i=0; i< maxpool->oh; i++ ) {
+		for(j=0; j< maxpool->ow; j++ ) {
+		    pos=findex*maxpool->ow*maxpool->oh+i*maxpool->ow+j;
+		    dout[pos]=src[(2*i)*maxpool->imw + (2*j)];
+		    for(ii=0; ii<2; ii++) {
+			for(jj=0; jj<2; jj++) {
+			    fval=src[(2*i+ii)*maxpool->imw + (2*j+jj)];
+			    if(fval > dout[pos])
+				dout[pos]=fval;
+			}
+		    }
+		}
+	    }
+	}
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Size of output data of a nvlayer, for one sample.
+-----------------------------------------------------------------*/
+static unsigned int nvlayer_out_size(const NVLAYER *layer)
+{
+	if(layer->conv3x3)
+		return layer->conv3x3->nf*layer->conv3x3->ow*layer->conv3x3->oh;
+	else if(layer->convkxk)
+		return layer->convkxk->nf*layer->convkxk->ow*layer->convkxk->oh;
+	else if(layer->maxpool2x2)
+		return layer->maxpool2x2->nf*layer->maxpool2x2->ow*layer->maxpool2x2->oh;
+	else
+		return layer->nc;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Flat output data of a nvlayer, as input of the next layer.
+ *	NULL if the layer has no flat output, as non_dense nvcells.
+-----------------------------------------------------------------*/
+static const nnc_real_t *nvlayer_flat_outs(const NVLAYER *layer)
+{
+	if(layer->conv3x3)
+		return layer->conv3x3->douts[0];
+	else if(layer->convkxk)
+		return layer->convkxk->douts[0];
+	else if(layer->maxpool2x2)
+		return layer->maxpool2x2->douts[0];
+	else
+		return NULL;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Size of input data of a nvnet for one sample, as the first
+ *	layer is a CONV3X3/CONVKXK or nvcells with din.
+ * Return:
+ *	>0	OK
+ *	0	The first layer has no input data.
+-----------------------------------------------------------------*/
+unsigned int nvnet_input_size(const NVNET *nnet)
+{
+	const NVLAYER *layer=nnet->nvlayers[0];
+
+	if(layer->conv3x3)
+		return layer->conv3x3->nchan*layer->conv3x3->imw*layer->conv3x3->imh;
+	else if(layer->convkxk)
+		return layer->convkxk->nchan*layer->convkxk->imw*layer->convkxk->imh;
+	else if(layer->maxpool2x2==NULL && layer->nc>0 && layer->nvcells[0]->din)
+		return layer->nvcells[0]->nin;
+	else
+		return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Point input data of the first layer of a nvnet to din.
+-----------------------------------------------------------------*/
+void nvnet_set_input(NVNET *nnet, const nnc_real_t *din)
+{
+	int i;
+	NVLAYER *layer=nnet->nvlayers[0];
+
+	if(layer->conv3x3) {
+		layer->conv3x3->din=(nnc_real_t *)din;
+		layer->conv3x3->din8=NULL;
+	}
+	else if(layer->convkxk) {
+		layer->convkxk->din=(nnc_real_t *)din;
+		layer->convkxk->din8=NULL;
+	}
+	else {
+		for(i=0; i< layer->nc; i++)
+			layer->nvcells[i]->din=(nnc_real_t *)din;
+		layer->din8=NULL;
+	}
+}
+
+
+/*-----------------------------------------------------------------
  * Note:
- *	A feed forward function for a CONV3X3.
- *      stride==1
- *
+ *	1. Point input data of the first layer of a nvnet to uint8 data
+ *	   din8, as mmaped MNIST images, see idxdata.c.
+ *	2. din8 is normalized as din8[k]*scale in feed forward, so the
+ *	   caller need NOT copy it to a real buffer for each sample.
+ *	3. Call nvnet_set_input() to use real input data again.
  * Params:
- * 	@conv3	Pointer to a CONV3X3
- *
- *	       !!!--- CAVEAT ---!!!
- *  conv3->din MUST hold >=nchan*imw*imh data in mem.
- *
+ *	@nnet	A nvnet, the first layer is a CONV3X3/CONVKXK or nvcells with din.
+ *	@din8	uint8 input data, size as nvnet_input_size().
+ *	@scale	Scale to normalize din8, Example: 1.0/255 for [0 1.0]
  * Return:
- *		0	OK
- *		<0	fails
--------------------------------------------------*/
-int conv3x3_feed_forward(CONV3X3 *conv3)
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+int nvnet_set_input_u8(NVNET *nnet, const uint8_t *din8, nnc_real_t scale)
 {
-	int i,j, ii, jj;
+	int i;
+	NVLAYER *layer;
+	CONV3X3 *conv3;
+	CONVKXK *convk;
 
-	/* Check input */
-	if(conv3==NULL || conv3->fparams==NULL || conv3->douts==NULL) {
-		printf("%s: Invalid conv3x3!\n", __func__);
-		return -1;
-	}
-	if(conv3->imw<3 || conv3->imh<3) {
-		printf("%s: conv3x3->imw(imh)<3!\n", __func__);
+	if(nnet==NULL || nnet->nl==0 || din8==NULL || nvnet_input_size(nnet)==0)
 		return -1;
+
+	layer=nnet->nvlayers[0];
+
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		if(conv3->din8buf==NULL) {
+			conv3->din8buf=calloc(conv3->nchan*conv3->imw*conv3->imh, sizeof(typeof(*conv3->din8buf)));
+			if(conv3->din8buf==NULL)
+				return -2;
+		}
+		conv3->din8=din8;
+		conv3->din8_scale=scale;
+		conv3->din=conv3->din8buf;
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		convk=layer->convkxk;
+		if(convk->din8buf==NULL) {
+			convk->din8buf=calloc(convk->nchan*convk->imw*convk->imh, sizeof(typeof(*convk->din8buf)));
+			if(convk->din8buf==NULL)
+				return -2;
+		}
+		convk->din8=din8;
+		convk->din8_scale=scale;
+		convk->din=convk->din8buf;
 	}
-	if(conv3->din==NULL) {
-		printf("%s: conv3x3->din is NULL!\n", __func__);
-		return -1;
+	/* Case_2: NVCELLs Layer */
+	else {
+		if(layer->din8buf==NULL) {
+			layer->din8buf=calloc(layer->nvcells[0]->nin, sizeof(typeof(*layer->din8buf)));
+			if(layer->din8buf==NULL)
+				return -2;
+		}
+		layer->din8=din8;
+		layer->din8_scale=scale;
+		for(i=0; i< layer->nc; i++)
+			layer->nvcells[i]->din=layer->din8buf;
 	}
 
-	int imw=conv3->imw;
-	int imh=conv3->imh;
-	int findex; /* filter index */
-	int chindex; /* filter channel index */
-	int impos;
-	int offset;
+	return 0;
+}
 
 
-	/* 1. Clear dsums[]/douts[] */
-	for(i=0; i<imh-2; i++) {
-	   for(j=0; j<imw-2; j++) {
-		/* Traverse filters. each filter produces (imh-2)*(imw-2) results. */
-	        for(findex=0; findex < conv3->nf; findex++) {
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Check if nvlayer[k] of a nvnet reads its input ONLY from
+ *	   output of nvlayer[k-1] (or from the batch input if k==0),
+ *	   so nvnet_feed_forward_batch() can run it batch by batch.
+ *	2. NVCELLs layers MUST be in tensor mode.
+ * Return:
+ *	Size of input data for one sample	OK
+ *	0					Not batchable
+-----------------------------------------------------------------*/
+unsigned int nvnet_batch_insize(const NVNET *nnet, int k)
+{
+	int i;
+	const NVLAYER *layer=nnet->nvlayers[k];
+	const NVLAYER *prev= k>0 ? nnet->nvlayers[k-1] : NULL;
+	const NVCELL *cell0;
 
-		    /* Reset/clear dsums[i,j]/douts[i,j] */
-		    conv3->dsums[findex][i*(imw-2)+j]=0.0f;
-		    conv3->douts[findex][i*(imw-2)+j]=0.0f;
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		if(prev && layer->conv3x3->din != nvlayer_flat_outs(prev))
+			return 0;
+		return layer->conv3x3->nchan*layer->conv3x3->imw*layer->conv3x3->imh;
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		if(prev && layer->convkxk->din != nvlayer_flat_outs(prev))
+			return 0;
+		return layer->convkxk->nchan*layer->convkxk->imw*layer->convkxk->imh;
+	}
+	/* Case_2: MAXPOOL2X2 Layer */
+	else if(layer->maxpool2x2) {
+		if(prev==NULL || prev->conv3x3==NULL || layer->maxpool2x2->inconv3x3 != prev->conv3x3)
+			return 0;
+		return layer->maxpool2x2->imw*layer->maxpool2x2->imh*layer->maxpool2x2->nf;
+	}
+	/* Case_3: NVCELLs Layer */
+	else {
+		if(!layer->dense)
+			return 0;
+		cell0=layer->nvcells[0];
+		if(prev==NULL)
+			return cell0->din ? cell0->nin : 0;
+		if(cell0->din)
+			return cell0->din == nvlayer_flat_outs(prev) ? cell0->nin : 0;
+		/* incells[] MUST be nvcells of prev layer, in order */
+		if(prev->conv3x3 || prev->convkxk || prev->maxpool2x2 || prev->transfunc || cell0->nin != prev->nc)
+			return 0;
+		for(i=0; i< cell0->nin; i++) {
+			if(cell0->incells[i] != prev->nvcells[i])
+				return 0;
 		}
-	    }
+		return cell0->nin;
 	}
+}
 
-	/* 2. Traverse filter position of image w/h */
-	for(i=0; i<imh-2; i++) {
-	    for(j=0; j<imw-2; j++) {
-		/* Traverse filters. each filter produces (imh-2)*(imw-2) results. */
-	        for(findex=0; findex < conv3->nf; findex++) {
-		    ////NOT HERE!! * Reset/clear dsums[i,j]/douts[i,j] */
 
-		    /* Traverse channels HK2023-08-06 */
-		    for(chindex=0; chindex < conv3->nchan; chindex++) {
-			/* offset of input channel image data */
-			offset = chindex*imw*imh;
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Batched feed forward of a CONV3X3: for each chunk of samples,
+ *	   im2col all samples side by side into cols[K][nb*P], then
+ *	   ONE GEMM sums[nf][nb*P]=W[nf][K]*cols, at last scatter to
+ *	   dout[nb][nf][P] with bias and transfunc applied.
+ *	2. @work holds cols and sums, see nvnet_feed_forward_batch().
+-----------------------------------------------------------------*/
+static void conv3x3_feed_forward_batch(CONV3X3 *conv3, const nnc_real_t *din, unsigned int nb, nnc_real_t *dout,
+					 nnc_real_t *work, unsigned int nbc)
+{
+	unsigned int b, bc, n, k, findex;
+	unsigned int K=conv3->nchan*9, P=conv3->ow*conv3->oh;
+	unsigned int insize=conv3->nchan*conv3->imw*conv3->imh;
+	nnc_real_t *cols=work, *sums=work+K*nbc*P;
+	const nnc_real_t *src;
+	nnc_real_t *dst;
+	nnc_real_t bias;
 
-	       		/* Compute dsums[i,j] */
-			for(ii=0; ii<3; ii++) {  /* filter H */
-		       	   for(jj=0; jj<3; jj++) { /* filter W */
-				conv3->dsums[findex][i*(imw-2)+j] +=	\
-						conv3->fparams[findex][chindex][ii*3+jj] * conv3->din[offset + (i+ii)*imw+j+jj ];
-			   }
-		   	}
-		    }
+	for(b=0; b<nb; b+=nbc) {
+	    bc = b+nbc < nb ? nbc : nb-b;
 
-		    /* Apply bias HK2023-08-05 */
-		    if(conv3->dvs) {
-			conv3->dsums[findex][i*(imw-2)+j] -= conv3->dvs[findex];
-		    }
-	       }
+	    /* 1. cols[K][bc*P] */
+	    for(n=0; n<bc; n++)
+		conv3x3_im2col_data(conv3, din+(b+n)*insize, cols+n*P, bc*P);
+
+	    /* 2. sums[nf][bc*P]=W*cols */
+	    conv3x3_gemm(conv3->nf, K, bc*P, conv3->fparams[0][0], false, cols, sums, true);
+
+	    /* 3. dout[b+n][findex][P] */
+	    for(findex=0; findex < conv3->nf; findex++) {
+		bias=conv3->dvs ? conv3->dvs[findex] : 0.0;
+		for(n=0; n<bc; n++) {
+		    src=sums+findex*bc*P+n*P;
+		    dst=dout+(b+n)*conv3->nf*P+findex*P;
+		    for(k=0; k<P; k++)
+			dst[k]=src[k]-bias;
+		    actfs_forward(conv3->transfunc, dst, dst, P);
+		}
 	    }
 	}
+}
 
-	/* 3. Compute douts[]=transfunc(dsums[],,)   2023-08-08 */
-	double ftmp;
-	if(conv3->transfunc) {
-	    for(findex=0; findex < conv3->nf; findex++) {
-		for(i=0; i<imh-2; i++) {
-		    for(j=0; j<imw-2; j++) {
-			ftmp=conv3->dsums[findex][i*(imw-2)+j];
-			conv3->douts[findex][i*(imw-2)+j] = conv3->transfunc(ftmp, 0.0, NORMAL_FUNC); /* irrelevant with f */
-		    }
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Batched feed forward of a CONVKXK, sample by sample:
+ *	   im2col to convk->cols, then dout[b][nf][P]=W*cols, with
+ *	   bias and transfunc applied.
+-----------------------------------------------------------------*/
+static void convkxk_feed_forward_batch(CONVKXK *convk, const nnc_real_t *din, unsigned int nb, nnc_real_t *dout)
+{
+	unsigned int b, k, findex;
+	unsigned int K=convk->nchan*convk->ks*convk->ks, P=convk->ow*convk->oh;
+	unsigned int insize=convk->nchan*convk->imw*convk->imh;
+	nnc_real_t *dst;
+
+	for(b=0; b<nb; b++) {
+	    convkxk_im2col_data(convk, din+(unsigned long)b*insize, convk->cols);
+	    dst=dout+(unsigned long)b*convk->nf*P;
+	    conv3x3_gemm(convk->nf, K, P, convk->fparams, false, convk->cols, dst, true);
+	    for(findex=0; findex < convk->nf; findex++) {
+		if(convk->dvs) {
+		    for(k=0; k<P; k++)
+			dst[findex*P+k] -= convk->dvs[findex];
 		}
+		actfs_forward(convk->transfunc, dst+findex*P, dst+findex*P, P);
 	    }
 	}
-	/* doust[] = dsums[] */
-	else {
-	    for(findex=0; findex < conv3->nf; findex++) {
-		for(i=0; i<imh-2; i++) {
-		    for(j=0; j<imw-2; j++) {
-			conv3->douts[findex][i*(imw-2)+j] = conv3->dsums[findex][i*(imw-2)+j];
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	1. Batched feed forward of a tensor mode nvlayer:
+ *	   dout[nb][nc]=X[nb][nin]*W^T, 4 samples a time, so each row
+ *	   of W is loaded once for 4 samples. Blocked by columns, and in
+ *	   the same order as nvlayer_dense_feed_forward().
+ *	2. Cell transfunc and layer transfunc are applied sample by sample.
+-----------------------------------------------------------------*/
+static void nvlayer_dense_feed_forward_batch(NVLAYER *layer, const nnc_real_t *din, unsigned int nb, nnc_real_t *dout)
+{
+	unsigned int b, i, j, ib, ie;
+	unsigned int nc=layer->nc;
+	unsigned int nin=layer->nvcells[0]->nin;
+	unsigned int ld=nin+1;
+	const nnc_real_t *W=layer->nvcells[0]->dw;
+	const nnc_real_t *w, *x0, *x1, *x2, *x3;
+	nnc_real_t s0, s1, s2, s3;
+	nnc_real_t *y;
+	NVCELL *cell;
+
+	memset(dout, 0, nb*nc*sizeof(nnc_real_t));
+
+	/* 1. Y=X*W^T, blocked by columns */
+	for(ib=0; ib<nin; ib+=NVLAYER_GEMV_CBLK) {
+	    ie = ib+NVLAYER_GEMV_CBLK < nin ? ib+NVLAYER_GEMV_CBLK : nin;
+
+	    /* 4 samples a time */
+	    for(b=0; b+3<nb; b+=4) {
+		x0=din+b*nin; x1=x0+nin; x2=x1+nin; x3=x2+nin;
+		y=dout+b*nc;
+		for(j=0; j<nc; j++) {
+		    w=W+j*ld;
+		    s0=y[j]; s1=y[nc+j]; s2=y[2*nc+j]; s3=y[3*nc+j];
+		    for(i=ib; i<ie; i++) {
+			s0 += x0[i]*w[i];
+			s1 += x1[i]*w[i];
+			s2 += x2[i]*w[i];
+			s3 += x3[i]*w[i];
 		    }
+		    y[j]=s0; y[nc+j]=s1; y[2*nc+j]=s2; y[3*nc+j]=s3;
+		}
+	    }
+	    /* Rest samples */
+	    for(; b<nb; b++) {
+		x0=din+b*nin;
+		y=dout+b*nc;
+		for(j=0; j<nc; j++) {
+		    w=W+j*ld;
+		    s0=y[j];
+		    for(i=ib; i<ie; i++)
+			s0 += x0[i]*w[i];
+		    y[j]=s0;
 		}
 	    }
 	}
 
-
-	return 0;
+	/* 2. Apply dv and transfer functions */
+	for(b=0; b<nb; b++) {
+	    y=dout+b*nc;
+	    for(j=0; j<nc; j++) {
+		cell=layer->nvcells[j];
+		cell->dsum=y[j]-*cell->dv;
+		if(cell->transfunc)
+			cell->dout=(*cell->transfunc)(cell->dsum, 0, NORMAL_FUNC);
+		else
+			cell->dout=cell->dsum;
+		y[j]=cell->dout;
+	    }
+	    if(layer->transfunc) {
+		(*layer->transfunc)(layer, NORMAL_FUNC);
+		memcpy(y, layer->douts, nc*sizeof(nnc_real_t));
+	    }
+	}
 }
 
 
-/*----------------------------------------------
+/*-----------------------------------------------------------------------
+ * Feed forward nb samples through a nerve NET at once, for inference.
+ * CONV3X3 layers run as ONE GEMM over a chunk of samples, and tensor
+ * mode nvlayers as GEMM instead of GEMV.
+ *
  * Note:
- *	A feed backward function for a CONV3X3.
- *      Channels==1, stride==1
+ *	1. Each layer MUST read ONLY from its previous layer, the first layer
+ *	   is a CONV3X3/CONVKXK or a tensor mode nvlayer with nvcells' din.
+ *	   Otherwise samples are fed one by one with nvnet_feed_forward().
+ *	2. Per-sample states(douts,dsum,dout...) are NOT kept for all samples,
+ *	   so do NOT call nvnet_feed_backward() after it.
  *
  * Params:
- * 	@conv3	Pointer to a CONV3X3
+ * 	@nnet		nerve net, with params initialized.
+ *	@din		Input data of nb samples, each has the size of
+ *			the first layer input, as conv3x3->din or nvcells[0]->din.
+ *	@nb		Number of samples
+ *	@dout		To store outputs of the last layer, nb*(output size).
+ *			For the output layer with transfunc, as layer->douts.
  * Return:
  *		0	OK
  *		<0	fails
------------------------------------------------*/
-int conv3x3_feed_backward(CONV3X3 *conv3)
+-----------------------------------------------------------------------*/
+int nvnet_feed_forward_batch(NVNET *nnet, const nnc_real_t *din, unsigned int nb, nnc_real_t *dout)
 {
-	int i,j, ii, jj;
-
-	/* Check input */
-	if(conv3==NULL || conv3->fparams==NULL || conv3->douts==NULL || conv3->dFP==NULL ) {
-		printf("%s: Invalid conv3x3!\n", __func__);
+	int i, k;
+	bool batchable=true;
+	unsigned int insize, outsize, maxsize, nbc=0;
+	unsigned long size, wsize=0;
+	NVLAYER *layer, *last;
+	const nnc_real_t *src;
+	nnc_real_t *dst, *bouts[2];
+	nnc_real_t *pdin;
+
+	if( nnet==NULL || nnet->nl==0 || din==NULL || dout==NULL || nb==0 )
 		return -1;
-	}
 
-	if(conv3->din==NULL) {
-		printf("%s: conv3x3->din is NULL!\n", __func__);
+	/* Dense layers are set in nvnet_pack_params() */
+	if( nvnet_pack_params(nnet) <0 )
+		return -2;
+
+	layer=nnet->nvlayers[0];
+	last=nnet->nvlayers[nnet->nl-1];
+	if( nvnet_input_size(nnet)==0 ) {
+		printf("%s: The first layer MUST be CONV3X3/CONVKXK or nvcells with din!\n", __func__);
 		return -1;
 	}
 
-	int imw=conv3->imw;
-	int imh=conv3->imh;
-	int findex; /* filter index */
-	int chindex; /* filter channel index */
-	int offset;
-	float fsum, fout, fd;
-
-	/* derr already updated by backfeeding from downstream layer */
-
-	/* 0. Clear dferr[] and dFP[] HK2023-08-05 */
-	for(findex=0; findex < conv3->nf; findex++) {
-	    if(conv3->dvs)
-		conv3->dferr[findex]=0.0f; /* temp. var */
+	/* 1. Check layers and size of working buffer */
+	maxsize=0;
+	for(k=0; k< nnet->nl; k++) {
+		layer=nnet->nvlayers[k];
+		if( nvnet_batch_insize(nnet, k)==0 ) {
+			batchable=false;
+			break;
+		}
+		outsize=nvlayer_out_size(layer);
+		if(outsize>maxsize)
+			maxsize=outsize;
+
+		/* cols[K][nbc*P] and sums[nf][nbc*P] */
+		if(layer->conv3x3) {
+			size=layer->conv3x3->nchan*9*layer->conv3x3->ow*layer->conv3x3->oh;
+			nbc = size<CONV3X3_BATCH_COLS ? CONV3X3_BATCH_COLS/size : 1;
+			if(nbc>nb) nbc=nb;
+			size=(size+layer->conv3x3->nf*layer->conv3x3->ow*layer->conv3x3->oh)*nbc;
+			if(size>wsize)
+				wsize=size;
+		}
+	}
 
-#if 1 /* TEST: --------------- HK2023-08-07 */
-	    for(chindex=0; chindex < conv3->nchan; chindex++) { /* HK2023-08-06 */
-	        for(ii=0; ii<3; ii++) {  /* filter H */
-        	        for(jj=0; jj<3; jj++) { /* filter W */
-			      conv3->dFP[findex][chindex][ii*3+jj] = 0.0f;
+	/* 2. NOT batchable, feed samples one by one */
+	if(!batchable) {
+		layer=nnet->nvlayers[0];
+		insize=nvnet_input_size(nnet);
+		outsize=nvlayer_out_size(last);
+		pdin= layer->conv3x3 ? layer->conv3x3->din : layer->convkxk ? layer->convkxk->din : layer->nvcells[0]->din;
+		for(k=0; k<nb; k++) {
+			nvnet_set_input(nnet, din+k*insize);
+			nvnet_feed_forward(nnet, NULL, NULL);
+
+			dst=dout+k*outsize;
+			if(last->conv3x3 || last->convkxk || last->maxpool2x2)
+				memcpy(dst, nvlayer_flat_outs(last), outsize*sizeof(nnc_real_t));
+			else {
+				for(i=0; i< last->nc; i++)
+					dst[i]= last->transfunc ? last->douts[i] : last->nvcells[i]->dout;
 			}
-	     	}
-	    }
-#endif
+		}
+		/* Restore input pointer */
+		nvnet_set_input(nnet, pdin);
+		return 0;
+	}
+
+	/* 3. Working buffer */
+	size=2*(unsigned long)nb*maxsize+wsize;
+	if(size > nnet->nbsize) {
+		free(nnet->bbuf);
+		nnet->bbuf=malloc(size*sizeof(nnc_real_t));
+		if(nnet->bbuf==NULL) {
+			printf("%s: Fail to malloc nnet->bbuf.\n", __func__);
+			nnet->nbsize=0;
+			return -2;
+		}
+		nnet->nbsize=size;
+	}
+	bouts[0]=nnet->bbuf;
+	bouts[1]=nnet->bbuf+(unsigned long)nb*maxsize;
+
+	/* 4. Feed forward layer by layer, ping-pong bouts[] */
+	src=din;
+	for(k=0; k< nnet->nl; k++) {
+		layer=nnet->nvlayers[k];
+		dst= k==nnet->nl-1 ? dout : bouts[k%2];
+
+		/* Case_1: CONV3X3 Layer */
+		if(layer->conv3x3) {
+			size=layer->conv3x3->nchan*9*layer->conv3x3->ow*layer->conv3x3->oh;
+			nbc = size<CONV3X3_BATCH_COLS ? CONV3X3_BATCH_COLS/size : 1;
+			if(nbc>nb) nbc=nb;
+			conv3x3_feed_forward_batch(layer->conv3x3, src, nb, dst, bouts[1]+(unsigned long)nb*maxsize, nbc);
+		}
+		/* Case_1A: CONVKXK Layer */
+		else if(layer->convkxk) {
+			convkxk_feed_forward_batch(layer->convkxk, src, nb, dst);
+		}
+		/* Case_2: MAXPOOL2X2 Layer */
+		else if(layer->maxpool2x2) {
+			insize=nvnet_batch_insize(nnet, k);
+			outsize=nvlayer_out_size(layer);
+			for(i=0; i<nb; i++)
+				maxpool2x2_pool_data(layer->maxpool2x2, src+(unsigned long)i*insize, dst+(unsigned long)i*outsize);
+		}
+		/* Case_3A: NVCELLs Layer, in tensor mode */
+		else {
+			nvlayer_dense_feed_forward_batch(layer, src, nb, dst);
+		}
 
+		src=dst;
 	}
 
+	return 0;
+}
 
-	/* 1. Update dFP and feed_back derr to prederr */
-	/* Traverse derr(of douts) */
-	for(i=0; i< conv3->oh; i++) {
-	   for(j=0; j< conv3->ow; j++) {
-
-		/* Traverse filters. */
-	        for(findex=0; findex < conv3->nf; findex++) {
-
-		    /* Compute dferr for dvs updating HK2023-08-05 */
-		    /* dvs, dE/db=dE/du*du/db=dE/du=derr ---> dferr[f] = SUM{conv3->derr[findex][:]} */
-		    if(conv3->dvs)
-		         conv3->dferr[findex] += conv3->derr[findex][i*conv3->ow+j];
-
-		    /* fsum and fout  HK2023-08-08 */
-		    fsum = conv3->dsums[findex][i*conv3->ow+j];
-		    fout = conv3->douts[findex][i*conv3->ow+j];
 
-		    if(conv3->transfunc)
-			fd = conv3->transfunc(fsum,fout,DERIVATIVE_FUNC);
-		    else
-			fd = 1.0f;
+/*-----------------------------------------
+ * A feed backward function for a nerve NET.
+ * Params:
+ * 	@nnet		nerve net
+ * Return:
+ *		0	OK
+ *		<0	fails
+-----------------------------------------*/
+int nvnet_feed_backward(NVNET *nnet)
+{
+	int i,j,k,n;
 
-		    /* Traverse channels HK2023-08-06 */
-		    for(chindex=0; chindex < conv3->nchan; chindex++) {
-		        /* offset of input channel image data */
-		        offset = chindex*imw*imh;
+	if( nnet==NULL || nnet->nl==0)
+		return -1;
 
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return -1;
+	}
 
-		        /* Traverse filter parameters */
-		        for(ii=0; ii<3; ii++) {  /* filter H */
-		    	    for(jj=0; jj<3; jj++) { /* filter W */
 
-				/* As one dout backmap to 3x3 grids of din, which is flattened data.
-				   Just like u=w0*x0+w1*x1+...+w8*x8; then dE/dwi=dE/dh*dh/du*du/dwi=dE/dh*f'(u)*du/dwi=derr*f'(u)*xi; (here dh/du=1)
-				   then sum up all regions
-				 */
-				conv3->dFP[findex][chindex][ii*3+jj] += conv3->derr[findex][i*conv3->ow+j]	\
-							// * conv3->transfunc(fsum,fout,DERIVATIVE_FUNC)
-							* fd * conv3->din[offset + (i+ii)*conv3->imw+j+jj];
+	/* 1. Clear derr in all cell derr, except the output cells */
+	for(i=0; i< nnet->nl-1; i++) {  /*  ----- CAUTION ----  <nl-1, NOT for the ouput cells */
+	    /* Case_1: CONV3X3 Layer  HK2023-07-11 */
+	    if( nnet->nvlayers[i]->conv3x3 !=NULL ) {
+		/* derr is overwritten by maxpool2x2_feed_backward() of the MAXPOOL2X2 pooling it */
+		if( nnet->nvlayers[i+1]->maxpool2x2 && nnet->nvlayers[i+1]->maxpool2x2->inconv3x3==nnet->nvlayers[i]->conv3x3 )
+			continue;
 
-				/* Feed back derr[][] to prederr[][] (for conv3x3->derr, mp2x2->derr etc.) HK2023-08-06 */
-				if( conv3->prederr ) {  /* Noticed: prederr is flattened, size imw*imh, as output size of pre-layer */
-					conv3->prederr[chindex][(i+ii)*conv3->imw+(j+jj)] +=  conv3->derr[findex][i*conv3->ow+j]	\
-										    // * conv3->transfunc(fsum,fout,DERIVATIVE_FUNC)
-										    * fd *conv3->fparams[findex][chindex][ii*3+jj];
+		for(n=0; n< nnet->nvlayers[i]->conv3x3->nf; n++)
+		   for(j=0; j< nnet->nvlayers[i]->conv3x3->oh; j++)
+			for(k=0; k< nnet->nvlayers[i]->conv3x3->ow; k++)
+				nnet->nvlayers[i]->conv3x3->derr[n][j*nnet->nvlayers[i]->conv3x3->ow+k] = 0.0f;
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(nnet->nvlayers[i]->convkxk!=NULL) {
+		memset(nnet->nvlayers[i]->convkxk->derr[0], 0,
+			nnet->nvlayers[i]->convkxk->nf*nnet->nvlayers[i]->convkxk->ow*nnet->nvlayers[i]->convkxk->oh*sizeof(nnc_real_t));
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer HK2023-07-11 */
+	    else if(nnet->nvlayers[i]->maxpool2x2!=NULL) {
+		for(n=0; n< nnet->nvlayers[i]->maxpool2x2->nf; n++)
+		   for(j=0; j< nnet->nvlayers[i]->maxpool2x2->oh; j++)
+			for(k=0; k< nnet->nvlayers[i]->maxpool2x2->ow; k++)
+				nnet->nvlayers[i]->maxpool2x2->derr[n][j*nnet->nvlayers[i]->maxpool2x2->ow+k] = 0.0f;
+            }
+	    /* Case_3: NVCELL Layer */
+	    else {
 
-				}
-			    }
-		        }
+		/* but leave the output layer, as we already put derr=L'(h) there !!! */
+		for(j=0; j< nnet->nvlayers[i]->nc; j++) {
+			nnet->nvlayers[i]->nvcells[j]->derr=0.0;
+		}
+	    }
 
-		    }/* for(chindex) */
-		} /* for(findex) */
+	}
 
-	    } /* for(j) */
-	} /* for(i) */
+	/* 2. Feed backward from output layer to input layer */
+	for(i=nnet->nl-1; i>=0; i--) {
 
+//		printf("%s: nvlayers[%d] feed_backward...\n", __func__, i);
+		NVPROF_BEGIN(t0);
+		if(nvlayer_feed_backward(nnet->nvlayers[i]) !=0 ) {
+			printf("%s: nvlayer[%d] feed backward fails!\n",__func__,i);
+			return -2;
+		}
+		NVPROF_END(nnet, i, 1, NVPROF_BACKWARD, t0);
+	}
 
 	return 0;
 }
 
 
-/*----------------------------------------------
- * Note:
- *	A feed forward function for MAXPOOL2X2
- *
+
+/*---------------------------------------------------
+ * Update params of a nvlayer by simple gradient descent,
+ * see nvnet_update_params().
  * Params:
- * 	@maxpool   Pointer to a MAXPOOL2X2
+ * 	@layer		a nerve layer
+ *	@rate		learning rate
  * Return:
  *		0	OK
  *		<0	fails
------------------------------------------------*/
-int maxpool2x2_feed_forward(MAXPOOL2X2 *maxpool)
+----------------------------------------------------*/
+static int nvlayer_update_params(NVLAYER *layer, double rate)
 {
-	int i,j, ii, jj;
-	double **din=NULL; /* prev-layer/upstream output data */
-	unsigned int pos;
-	int findex; /* filter index */
-	float fval;
+	int j,k,n,m;
+	NVCELL *cell;
+	nnc_real_t *fparams, *dFP;
 
-	/* 1. Check input */
-	if(maxpool==NULL || maxpool->douts==NULL) {   //maxpool->fparams --- NO NEED ---
-		printf("%s: Invalid maxpool2x2!\n", __func__);
-		return -1;
-	}
-	if(maxpool->ow<1 || maxpool->oh<1) {
-		printf("%s: maxpool->w/h <1!\n", __func__);
-		return -1;
-	}
-	if(maxpool->din==NULL && maxpool->inconv3x3==NULL ) {
-		printf("%s: maxpool->din AND maxpool->inconv3x3 is NULL!\n", __func__);
-		return -1;
-	}
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		/* Update fparams, fparams[0][0] and dFP[0][0] are flatten-friendly */
+		fparams=layer->conv3x3->fparams[0][0];
+		dFP=layer->conv3x3->dFP[0][0];
+		m=layer->conv3x3->nf*layer->conv3x3->nchan*9;
+		for(k=0; k<m; k++)
+			fparams[k] -= rate*dFP[k];
+		layer->conv3x3->wgU_valid=false;  /* Winograd filter transforms */
+		layer->conv3x3->cbw_valid=false;  /* Channel-blocked fparams */
 
-	/* 2. Source data from inconv3x3->douts */
-	if(maxpool->inconv3x3 && maxpool->inconv3x3->douts) {
-	    /* Check params */
-	    if(maxpool->nf != maxpool->inconv3x3->nf) {
-		printf("%s: CONV and POOL do NOT have same number of filters!\n", __func__);
-		return -1;
-	    }
-	    if(maxpool->imw != maxpool->inconv3x3->ow || maxpool->imh != maxpool->inconv3x3->oh) {
-		printf("%s: CONV and POOL do NOT have compatible, imw(%d)!=ow(%d) OR imh(%d)!=oh(%d) !\n",
-				 __func__, maxpool->imw,maxpool->inconv3x3->ow, maxpool->imh, maxpool->inconv3x3->oh );
-		return -1;
-	    }
+		/* Update dvs HK2023-08-05 */
+		if(layer->conv3x3->dvs) {
+		   for(n=0; n< layer->conv3x3->nf; n++)
+			/* -rate*(-1.0)*(cell->derr), dv as special weight var with w=-1.0 */
+		   	layer->conv3x3->dvs[n] += rate*layer->conv3x3->dferr[n];
 
-	    /* Assing din */
-	    din = maxpool->inconv3x3->douts;
-	}
-	/* 3. Source data from maxpool2x2->din */
-	else {
-            /* Assign din */
-            din = maxpool->din;
-	}
+		}
 
-	/* 4. Check din */
-	if( din==NULL || *din==NULL ) {
-		printf("%s: Source data din error!\n", __func__);
-		return -1;
+		return 0;
 	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		m=layer->convkxk->nf*layer->convkxk->nchan*layer->convkxk->ks*layer->convkxk->ks;
+		for(k=0; k<m; k++)
+			layer->convkxk->fparams[k] -= rate*layer->convkxk->dFP[k];
+		if(layer->convkxk->dvs) {
+		   for(n=0; n< layer->convkxk->nf; n++)
+		   	layer->convkxk->dvs[n] += rate*layer->convkxk->dferr[n];
+		}
 
-	/* 5. Traverse din data (hxw) to compute maxpool->douts[][] */
-	for(i=0; i< maxpool->oh; i++ ) {
-		for(j=0; j< maxpool->ow; j++ ) {
+		return 0;
+	}
+	/* Case_2: MAXPOOL2X2 Layer */
+	else if(layer->maxpool2x2) {
+		/* No parameters need to be updated */
 
-		    /* Traverse filters. each filter produces ow*oh resutls */
-		    for(findex=0; findex < maxpool->nf; findex++) {
+		return 0;
+	}
 
-			/* Init douts[findex][i*maxpool->ow+j] */
-			pos=i*maxpool->ow+j;
+	/* Case_3A:  NVCELLs Layer, in tensor mode */
+	else if(layer->dense) {
+		return nvlayer_dense_update_params(layer, rate);
+	}
 
-		    	//maxpool->douts[findex][pos]=maxpool->inconv3x3->douts[findex][(2*i)*maxpool->inconv3x3->ow + (2*j) ];
-		    	maxpool->douts[findex][pos]=din[findex][(2*i)*maxpool->inconv3x3->ow + (2*j) ];
+	/* Case_3:  NVCELLs Layer */
+	for(j=0; j< layer->nc; j++) {	/* traverse nvcells */
+	      cell=layer->nvcells[j];
 
-		    	/* Traverse 2x2 filter */
-		    	for(ii=0; ii<2; ii++) {		/* Filter H */
-			    for(jj=0; jj<2; jj++) {	/* Filter W */
+	      /* 1. update dw[] += -LEARN_RATE*h[L-1]*derr */
+	      for(k=0; k< cell->nin; k++)  {		/* traverse params */
 
-				//fval=maxpool->inconv3x3->douts[findex][(2*i+ii)*maxpool->inconv3x3->ow + (2*j+jj)];
-				fval=din[findex][(2*i+ii)*maxpool->inconv3x3->ow + (2*j+jj)];
-				if(fval > maxpool->douts[findex][pos])
-					maxpool->douts[findex][pos]=fval;
-			    }
-		    	}
-		    }
-		}
-	}
+		 if( cell->incells !=NULL && cell->incells[0] != NULL) {
+			//cell->dw[k] += -rate*(cell->incells[k]->dout)*(cell->derr);
+			cell->dw[k] -= rate*(cell->incells[k]->dout)*(cell->derr);
+		 }
+		 else if( cell->din !=NULL ) {
+			//cell->dw[k] += -rate*(cell->din[k])*(cell->derr);
+			cell->dw[k] -= rate*(cell->din[k])*(cell->derr);
+		 }
+	 	 else {
+			printf("%s: nvcell->incells[x] or din[x] invalid!\n",__func__);
+			return -2;
+		 }
 
+	      }
 
-	#if 0 /* 5. TODO: Traverse din data (hxw) to compute maxpool->douts[][] */
-	for(i=0; i< maxpool->imw; i++ ) {
-		for(j=0; j< maxpool->imh; j++ ) {
+	      /* 2. bias deemed as a special kind of weight, dv += -LEARN_RATE*dE/db,
+	       *	dE/db=-f'(u)
+               */
+	      *cell->dv += rate*(cell->derr); /* -rate*(-1.0)*(cell->derr), dv as special weight var with w=-1.0 */
 
-		}
 	}
-	#endif
 
 	return 0;
 }
 
-/*----------------------------------------------
- * Note:
- *	A feed backward function for MAXPOOL2X2
+
+/*------------------------------------------------------------------------------
+ *  Update all cells' params of a nvnet by simple gradient descent algorithm.
+ *  For output cells:      dw += -rate*L'(h)*f'(u)*h[L-1],
+ *       assume derr=L'(h)*f'(u) already computed by nvnet_feed_backward().
+ *  For non_output cells:  dw += -rate*dE/du*h[L-1],
+ *       assume derr=dE/du=f'(h)*SUM(dE/du*w)[L-1] already computed by nvnet_feed_backward().
+ *
+ *  Note:
+ *	1. This function SHOULD be executed right after feed_backward operation,
+ *	   so that all temp. values(like dout,din, derr..)have just been updated
+ *	   and relevant.
  *
  * Params:
- * 	@maxpool   Pointer to a MAXPOOL2X2
+ * 	@nnet		nerve net
+ *	@rate		learning rate
  * Return:
  *		0	OK
  *		<0	fails
------------------------------------------------*/
-int maxpool2x2_feed_backward(MAXPOOL2X2 *maxpool)
+---------------------------------------------------------------------------*/
+int nvnet_update_params(NVNET *nnet, double rate)
 {
-	int i,j, ii, jj;
-//	double **din=NULL; /* prev-layer/upstream output data */
-	unsigned int pos;
-	int findex; /* filter index */
+	int i;
 
-	/* 1. Check input */
-	if(maxpool==NULL || maxpool->douts==NULL) {   //maxpool->fparams --- NO NEED ---
-		printf("%s: Invalid maxpool2x2!\n", __func__);
-		return -1;
-	}
-	if(maxpool->ow<1 || maxpool->oh<1) {
-		printf("%s: maxpool->w/h <1!\n", __func__);
+	if( nnet==NULL || nnet->nl==0)
 		return -1;
-	}
-	if(maxpool->inconv3x3==NULL || maxpool->inconv3x3->derr==NULL ) {
-		printf("%s: maxpool->inconv3x3 OR its derr is NULL!\n", __func__);
+
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
 		return -1;
 	}
-	if(maxpool->inconv3x3->ow != maxpool->imw || maxpool->inconv3x3->oh != maxpool->imh ) {
-		printf("%s: maxpool->inconv3x3 has incompatible ow or oh!\n", __func__);
-	}
-	if(maxpool->inconv3x3->nf != maxpool->nf ) {
-		printf("%s: maxpool and inconv3x3 MUST have same number of filters!\n", __func__);
-	}
 
-	/* 2. Assign prev-derr.   */
-//	din = maxpool->inconv3x3->douts;  /* douts dimension: maxpool->imw*maxpool->imh*NumFilters */
-
-	/* 3. Feed back maxpool->derr[nf][] to inconv3x3->derr[nf][] */
-	for(i=0; i< maxpool->oh; i++ ) {
-	    for(j=0; j< maxpool->ow; j++ ) {
-
-	        /* Traverse filters. */
-		for(findex=0; findex < maxpool->nf; findex++) {
-
-		    /* Travser 2x2 grid in conv3x3->douts */
-		    for(ii=0; ii<2; ii++) {   /* H */
-		    	for(jj=0; jj<2; jj++) {  /* W */
-			     /* Position of conv3x3->douts, as maxpool->douts maps to conv3x3->douts */
-			     pos = (2*i+ii)*maxpool->imw + 2*j+jj;  /* notice: maxpool->imw == conv3x3->ow, maxpool->imh==cov3x3->oh */
-			     /* Find the Max. value in 2x2 grid, and copy(feed back)  derr to corresponding inconv3x3->derr[][]   */
-			     if( maxpool->inconv3x3->douts[findex][pos] == maxpool->douts[findex][i*maxpool->ow+j] ) {
-				/* Copy(feed back) derr(dE/du) to inconv3x3->derr */
-				maxpool->inconv3x3->derr[findex][pos] = maxpool->derr[findex][i*maxpool->ow+j];
-			     }
-		        }
-		    }
-	        }
-	    }
+	/* Traverse nvlayers to update parameters */
+	for(i=0; i< nnet->nl; i++) {
+		NVPROF_BEGIN(t0);
+		if( nvlayer_update_params(nnet->nvlayers[i], rate) !=0 )
+			return -2;
+		NVPROF_END(nnet, i, 1, NVPROF_UPDATE, t0);
 	}
 
 	return 0;
 }
 
 
-/*-----------------------------------------------------
- * Load weights/bias value for each nvcell in the layer
+
+/*---------------------------------------------------------------------------
+ * Accumulate gradients dE/dparam of current sample into nnet->paccum[],
+ * for mini-batch training. paccum[k] is for pparams[k].
+ *	CONV3X3/CONVKXK:	dE/dfparams=dFP, dE/ddvs=-dferr
+ *	NVCELL:		dE/ddw[k]=h[L-1]*derr, dE/ddv=-derr
  *
- *		       !!! ---- CAUTION ---- !!!
- *        The caller MUST ensure enough data in weights/bias,
- *	  to avoid mem access error!
- ^
- * Params:
- * 	@layer:	   a nerve layer;
- *	@weights:  array of weights values
- *		   In order of nvcells:
-		   Wc1,1 Wc1,2 ... Wc1,nin  Wc2,1 Wc2,2 ... Wc2,nin Wc3,1 Wc3,2 ... (total nin*nc)
- *      @bias:     array of bias values.
- 		   bc1  bc2  bc3 ... (total nc)
+ *  Note:
+ *	1. Call it right after nvnet_feed_backward(), as nvnet_update_params().
+ *	2. Call nvnet_apply_dparams() after all samples of the batch are accumulated.
  *
+ * Params:
+ * 	@nnet		nerve net
  * Return:
  *		0	OK
  *		<0	fails
------------------------------------------------------*/
-int nvlayer_load_params(NVLAYER *layer, double *weights, double *bias)
+---------------------------------------------------------------------------*/
+int nvnet_accum_dparams(NVNET *nnet)
 {
-	int i,j;
-	int cnt;
+	int i,j,k,m;
+	NVLAYER *layer;
+	CONV3X3 *conv3;
+	CONVKXK *convk;
+	NVCELL *cell;
+	nnc_real_t *acc, *x;
 
-	if(layer==NULL || layer->nvcells==NULL)
+	if( nnet==NULL || nnet->nl==0)
 		return -1;
 
-        if(weights) {
-	   cnt=0;
-	   for(i=0; i< layer->nc; i++) {
-		for(j=0; j< layer->nvcells[i]->nin; j++)
-			layer->nvcells[i]->dw[j]=weights[cnt++];
-	   }
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return -1;
 	}
 
-        if(bias) {
-	   cnt=0;
-	   for(i=0; i< layer->nc; i++) {
-		layer->nvcells[i]->dv=bias[cnt++];
+	/* nnet->paccum is in the parameter arena */
+	if( nvnet_pack_params(nnet) <0 ) {
+		printf("%s: fail to pack params.\n",__func__);
+		return -2;
+	}
+
+	for(i=0; i< nnet->nl; i++) {
+	   NVPROF_BEGIN(t0);
+	   layer=nnet->nvlayers[i];
+
+	   /* Case_1: CONV3X3 Layer */
+	   if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		acc=nnet->paccum+(conv3->fparams[0][0]-nnet->pparams);
+		m=conv3->nf*conv3->nchan*9;
+		for(k=0; k<m; k++)
+			acc[k] += conv3->dFP[0][0][k];
+
+		if(conv3->dvs) {
+		   acc=nnet->paccum+(conv3->dvs-nnet->pparams);
+		   for(k=0; k< conv3->nf; k++)
+			acc[k] -= conv3->dferr[k];
+		}
+	   }
+	   /* Case_1A: CONVKXK Layer */
+	   else if(layer->convkxk) {
+		convk=layer->convkxk;
+		acc=nnet->paccum+(convk->fparams-nnet->pparams);
+		m=convk->nf*convk->nchan*convk->ks*convk->ks;
+		for(k=0; k<m; k++)
+			acc[k] += convk->dFP[k];
+
+		if(convk->dvs) {
+		   acc=nnet->paccum+(convk->dvs-nnet->pparams);
+		   for(k=0; k< convk->nf; k++)
+			acc[k] -= convk->dferr[k];
+		}
+	   }
+	   /* Case_2: MAXPOOL2X2 Layer, NO params */
+	   else if(layer->maxpool2x2) {
+	   }
+	   /* Case_3A: NVCELLs Layer, in tensor mode */
+	   else if(layer->dense) {
+		x=nvlayer_dense_input(layer);
+		if(x==NULL)
+			return -2;
+		for(j=0; j< layer->nc; j++) {
+		   cell=layer->nvcells[j];
+		   acc=nnet->paccum+(cell->dw-nnet->pparams);
+		   for(k=0; k< cell->nin; k++)
+			acc[k] += x[k]*cell->derr;
+		   acc[cell->nin] -= cell->derr;	/* dv */
+		}
+	   }
+	   /* Case_3: NVCELLs Layer */
+	   else {
+		for(j=0; j< layer->nc; j++) {
+		   cell=layer->nvcells[j];
+		   acc=nnet->paccum+(cell->dw-nnet->pparams);
+		   for(k=0; k< cell->nin; k++) {
+			if( cell->incells !=NULL && cell->incells[0] != NULL)
+				acc[k] += cell->incells[k]->dout*cell->derr;
+			else if( cell->din !=NULL )
+				acc[k] += cell->din[k]*cell->derr;
+			else {
+				printf("%s: nvcell->incells[x] or din[x] invalid!\n",__func__);
+				return -2;
+			}
+		   }
+		   acc[cell->nin] -= cell->derr;	/* dv */
+		}
 	   }
+	   NVPROF_END(nnet, i, 1, NVPROF_UPDATE, t0);
 	}
 
+	nnet->nacc++;
 
 	return 0;
 }
 
 
-/*-----------------------------------------------------
- * Link data array to each nvcell.din in the layer.
- *
- *	          !!! ---- CAUTION ---- !!!
- * The caller MUST ensure enough data to avoid mem access error!
+/*---------------------------------------------------------------------------
+ * Update all params of a nvnet with averaged gradients accumulated by
+ * nvnet_accum_dparams(), then clear the accumulation.
+ *	pparams[k] -= rate*paccum[k]/nacc
  *
  * Params:
- * 	@layer:	   a nerve layer;
- *	@data:     Data array as input data for nvcell.din
- *
+ * 	@nnet		nerve net
+ *	@rate		learning rate
  * Return:
  *		0	OK
  *		<0	fails
------------------------------------------------------*/
-int nvlayer_link_inputdata(NVLAYER *layer, double *data)
+---------------------------------------------------------------------------*/
+int nvnet_apply_dparams(NVNET *nnet, double rate)
 {
 	int i;
+	unsigned long k;
+	double r;
 
-	if(layer==NULL || layer->nvcells==NULL)
+	if( nnet==NULL || nnet->paccum==NULL )
 		return -1;
 
-        for(i=0; i< layer->nc; i++) {
-		/* Link data to each nvcell.din */
-		layer->nvcells[i]->din=data;
-        }
+	/* Nothing accumulated */
+	if(nnet->nacc==0)
+		return 0;
+
+	/* One sweep over the arena */
+	NVPROF_BEGIN(t0);
+	r=rate/nnet->nacc;
+	for(k=0; k< nnet->npa; k++)
+		nnet->pparams[k] -= r*nnet->paccum[k];
+
+	memset(nnet->paccum, 0, nnet->npa*sizeof(nnc_real_t));
+	NVPROF_END_SWEEP(nnet, t0);
+	nnet->nacc=0;
+
+	/* Winograd filter transforms and channel-blocked fparams */
+	for(i=0; i< nnet->nl; i++) {
+		if(nnet->nvlayers[i]->conv3x3) {
+			nnet->nvlayers[i]->conv3x3->wgU_valid=false;
+			nnet->nvlayers[i]->conv3x3->cbw_valid=false;
+		}
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Map a pointer into activation/derr buffers of layers of nnet
+ *	to the same position in rep, for nvnet_new_replica().
+ *	Only layers [0, nl) are searched, pointers out of them (as
+ *	external input data) are returned as they are.
+-----------------------------------------------------------------*/
+static nnc_real_t *nvnet_map_buffer(const NVNET *nnet, const NVNET *rep, int nl, const nnc_real_t *p)
+{
+	int k;
+	unsigned long size;
+	const NVLAYER *layer;
+	const NVLAYER *rlayer;
+
+	if(p==NULL)
+		return NULL;
+
+	for(k=0; k<nl; k++) {
+		layer=nnet->nvlayers[k];
+		rlayer=rep->nvlayers[k];
+		size=nvlayer_out_size(layer);
+
+		if(layer->conv3x3) {
+			if(p >= layer->conv3x3->douts[0] && p < layer->conv3x3->douts[0]+size)
+				return rlayer->conv3x3->douts[0]+(p-layer->conv3x3->douts[0]);
+			if(p >= layer->conv3x3->derr[0] && p < layer->conv3x3->derr[0]+size)
+				return rlayer->conv3x3->derr[0]+(p-layer->conv3x3->derr[0]);
+		}
+		else if(layer->convkxk) {
+			if(p >= layer->convkxk->douts[0] && p < layer->convkxk->douts[0]+size)
+				return rlayer->convkxk->douts[0]+(p-layer->convkxk->douts[0]);
+			if(p >= layer->convkxk->derr[0] && p < layer->convkxk->derr[0]+size)
+				return rlayer->convkxk->derr[0]+(p-layer->convkxk->derr[0]);
+		}
+		else if(layer->maxpool2x2) {
+			if(p >= layer->maxpool2x2->douts[0] && p < layer->maxpool2x2->douts[0]+size)
+				return rlayer->maxpool2x2->douts[0]+(p-layer->maxpool2x2->douts[0]);
+			if(p >= layer->maxpool2x2->derr[0] && p < layer->maxpool2x2->derr[0]+size)
+				return rlayer->maxpool2x2->derr[0]+(p-layer->maxpool2x2->derr[0]);
+		}
+	}
+
+	return (nnc_real_t *)p;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Map prederr of nvlayers[k] of nnet, as derr of a layer before,
+ *	to derr of the same layer in rep, for nvnet_new_replica().
+ *	NULL if it's NOT derr of a layer before.
+-----------------------------------------------------------------*/
+static nnc_real_t **nvnet_map_prederr(const NVNET *nnet, const NVNET *rep, int k, nnc_real_t **prederr)
+{
+	int j;
+
+	for(j=0; j<k; j++) {
+		if(nnet->nvlayers[j]->maxpool2x2 && prederr==nnet->nvlayers[j]->maxpool2x2->derr)
+			return rep->nvlayers[j]->maxpool2x2->derr;
+		else if(nnet->nvlayers[j]->conv3x3 && prederr==nnet->nvlayers[j]->conv3x3->derr)
+			return rep->nvlayers[j]->conv3x3->derr;
+		else if(nnet->nvlayers[j]->convkxk && prederr==nnet->nvlayers[j]->convkxk->derr)
+			return rep->nvlayers[j]->convkxk->derr;
+	}
 
-	return 0;
+	return NULL;
 }
 
-/*----------------------------------------------
+
+/*-----------------------------------------------------------------------
+ * Create a replica of a nvnet for data-parallel training.
+ * The replica has the same layers, sharing params(pparams) of nnet, but
+ * owns all activation/derr buffers (dsums,douts,derr, cell dsum/dout/derr)
+ * and gradient/accumulation regions of its own parameter arena.
+ *
  * Note:
- *	A feed forward function for a nerve layer.
+ *	1. All layers MUST read from layers before them or from input data,
+ *	   convolution nvcells(pincells/pdin) are NOT supported.
+ *	2. Input data of the replica's first layer is the same as nnet's,
+ *	   reassign it for each sample.
+ *	3. Free it with free_nvnet(), params of nnet are NOT freed.
+ *	   Free all replicas before nnet.
+ *
  * Params:
- * 	@layer	a nerve layer;
+ *	@nnet	Nerve net with params initialized.
  * Return:
- *		0	OK
- *		<0	fails
------------------------------------------------*/
-int nvlayer_feed_forward(NVLAYER *layer)
+ *	Pointer to a NVNET	OK
+ *	NULL			Fails
+-----------------------------------------------------------------------*/
+NVNET *nvnet_new_replica(NVNET *nnet)
 {
-	int i;
-	int ret=0;
+	int i,j,k;
+	NVNET *rep;
+	NVLAYER *layer, *rlayer;
+	CONV3X3 *conv3, *rconv3;
+	CONVKXK *convk;
+	MAXPOOL2X2 *maxpool;
+	NVCELL *cell0;
+	NVCELL tcell;
+	NVCELL * const *incells;
 
-	/* check layer */
-	if(layer==NULL)  // || layer->nvcells==NULL)
-		return -1;
+	if( nnet==NULL || nnet->nl==0 )
+		return NULL;
 
-	/* Case_1: CONV3X3 Layer */
-	if(layer->conv3x3) {
-		ret=conv3x3_feed_forward(layer->conv3x3);
-	}
-	/* Case_2: MAXPOOL2X2 Layer */
-	else if(layer->maxpool2x2) {
-		ret=maxpool2x2_feed_forward(layer->maxpool2x2);
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return NULL;
 	}
-	/* Case_3: NVCELLs Layer */
-	else if(layer->nvcells) {
-		/* Feed forward all nvcells in the layer */
-		for(i=0; i< layer->nc; i++) {
-			ret=nvcell_feed_forward(layer->nvcells[i]);
-			if( ret !=0 ) return ret;
+
+	if( nvnet_pack_params(nnet) <0 )
+		return NULL;
+
+	rep=new_nvnet(nnet->nl);
+	if(rep==NULL)
+		return NULL;
+
+	/* 1. Create layers */
+	for(k=0; k< nnet->nl; k++) {
+	    layer=nnet->nvlayers[k];
+	    rlayer=new_nvlayer(0, NULL, false);
+	    if(rlayer==NULL)
+		goto FAIL;
+	    rep->nvlayers[k]=rlayer;
+
+	    /* Case_1: CONV3X3 Layer */
+	    if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		rconv3=new_conv3x3(conv3->nf, conv3->nchan, conv3->imw, conv3->imh,
+				    nvnet_map_buffer(nnet, rep, k, conv3->din), conv3->dvs!=NULL);
+		if(rconv3==NULL)
+			goto FAIL;
+		rlayer->conv3x3=rconv3;
+		rconv3->transfunc=conv3->transfunc;
+
+		/* prederr as derr of a layer before */
+		if(conv3->prederr) {
+		    rconv3->prederr=nvnet_map_prederr(nnet, rep, k, conv3->prederr);
+		    if(rconv3->prederr==NULL) {
+			printf("%s: nvlayers[%d] conv3x3->prederr is NOT derr of a layer before!\n", __func__, k);
+			goto FAIL;
+		    }
 		}
 
-		/* Apply nvlayer transfer function.  Example: output layer softmax  HK2023-05-18 */
-		if( layer->transfunc !=NULL ) {
-			if(layer->nvcells[0]->transfunc !=NULL) {
-			   printf("%s: !!! CAUTION !!!  Layer->transfunc defined while layer->nvcells->transfunc ALSO defined~!\n", __func__);
-			}
+		if( conv3x3_set_engine(rconv3, conv3->engine) !=0 )
+			goto FAIL;
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(layer->convkxk) {
+		convk=layer->convkxk;
+		rlayer->convkxk=new_convkxk(convk->nf, convk->nchan, convk->imw, convk->imh, convk->ks, convk->stride,
+					    convk->pad, nvnet_map_buffer(nnet, rep, k, convk->din), convk->dvs!=NULL);
+		if(rlayer->convkxk==NULL)
+			goto FAIL;
+		rlayer->convkxk->transfunc=convk->transfunc;
+
+		if(convk->prederr) {
+		    rlayer->convkxk->prederr=nvnet_map_prederr(nnet, rep, k, convk->prederr);
+		    if(rlayer->convkxk->prederr==NULL) {
+			printf("%s: nvlayers[%d] convkxk->prederr is NOT derr of a layer before!\n", __func__, k);
+			goto FAIL;
+		    }
+		}
+	    }
+	    /* Case_2: MAXPOOL2X2 Layer */
+	    else if(layer->maxpool2x2) {
+		maxpool=layer->maxpool2x2;
+		if(k==0 || nnet->nvlayers[k-1]->conv3x3==NULL || maxpool->inconv3x3 != nnet->nvlayers[k-1]->conv3x3) {
+			printf("%s: nvlayers[%d] maxpool2x2 MUST follow its inconv3x3!\n", __func__, k);
+			goto FAIL;
+		}
+		rlayer->maxpool2x2=new_maxpool2x2(rep->nvlayers[k-1]->conv3x3, 0, 0, 0, NULL);
+		if(rlayer->maxpool2x2==NULL)
+			goto FAIL;
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else if(layer->nc>0) {
+		cell0=layer->nvcells[0];
+
+		/* Template cell, with din/incells mapped */
+		tcell=*cell0;
+		tcell.din=nvnet_map_buffer(nnet, rep, k, cell0->din);
+		tcell.incells=NULL;
+		free_nvlayer(rlayer);
+		rlayer=new_nvlayer(layer->nc, &tcell, layer->douts!=NULL);
+		rep->nvlayers[k]=rlayer;
+		if(rlayer==NULL)
+			goto FAIL;
+		rlayer->transfunc=layer->transfunc;
 
-			ret=(*layer->transfunc)(layer, NORMAL_FUNC);
-			if( ret!=0 ) return ret;
+		for(i=0; i< layer->nc; i++) {
+		    if( layer->nvcells[i]->pincells || layer->nvcells[i]->pdin ) {
+			printf("%s: Convolution nvcells are NOT supported!\n", __func__);
+			goto FAIL;
+		    }
+		    rlayer->nvcells[i]->transfunc=layer->nvcells[i]->transfunc;
+		    rlayer->nvcells[i]->din=nvnet_map_buffer(nnet, rep, k, layer->nvcells[i]->din);
+		    rlayer->nvcells[i]->prederr=nvnet_map_buffer(nnet, rep, k, layer->nvcells[i]->prederr);
+
+		    /* incells as nvcells[] of a layer before */
+		    incells=layer->nvcells[i]->incells;
+		    if(incells) {
+			for(j=0; j<k; j++) {
+			    if(incells==nnet->nvlayers[j]->nvcells)
+				rlayer->nvcells[i]->incells=rep->nvlayers[j]->nvcells;
+			}
+			if(rlayer->nvcells[i]->incells==NULL) {
+			    printf("%s: nvlayers[%d] incells are NOT nvcells of a layer before!\n", __func__, k);
+			    goto FAIL;
+			}
+		    }
 		}
+	    }
 	}
 
-	return ret;
+	/* 2. Arena of the replica, in the same layout as nnet */
+	if( nvnet_pack_params(rep) <0 || rep->npa != nnet->npa )
+		goto FAIL;
+
+	/* 3. Share params of nnet, its own PARAMS region is left unused */
+	if( nvnet_map_params(rep, nnet->pparams) <0 )
+		goto FAIL;
+
+	return rep;
+
+FAIL:
+	printf("%s: Fail to create a replica!\n", __func__);
+	free_nvnet(rep);
+	return NULL;
 }
 
 
-/*-----------------------------------------------------------------------------
- *	WARN: The loss function MUST be a kind of MEAN loss type !!!!
- * 	Example: (1/N)*SUM[(tv-yi)^2], (1/N)*SUM[ ] is calculated in this func.
- *
- * Note:
- *  1.  Calculate MEAN loss value from output nerve cells. It calculates
- *	each output nvcells with dout and tv, then use number of nvcells
- *	to get a mean loss value.
- *  2.  It alsao calculate derr=L'(h)*f'(u)
- *  3.  This func MUST be called after each feed_forward calculaton.
- *  4.  Make sure that size of array tv is outlayer->nc.
+/*-----------------------------------------------------------------------
+ * Create a trainer to train a nvnet by mini-batch with nt threads.
+ * Each thread runs feed forward/backward on its own replica of the nvnet,
+ * for a shard of the batch, see nvtrainer_train_batch().
  *
  * Params:
- * 	@outlayer	output nerve layer;
- *	@tv		array of teacher's value.
- *	@loss		MUST be a kind of MEAN loss function !!!
- *
+ *	@nnet	Nerve net with params initialized.
+ *	@nt	Number of threads, usually number of cores.
  * Return:
- *		0	OK
- *		<0	fails
-------------------------------------------------------------------------------*/
-double nvlayer_mean_loss(NVLAYER *outlayer, const double *tv,
-			double (*loss_func)(double out, const double tv, int token) )
+ *	Pointer to a NVTRAINER	OK
+ *	NULL			Fails
+-----------------------------------------------------------------------*/
+NVTRAINER *new_nvtrainer(NVNET *nnet, int nt)
 {
 	int i;
-	//double err=0.0;
-	double loss=0.0;
-//	double mean_loss=0.0;
+	NVTRAINER *trainer;
 
-	/* check input param */
-	if(outlayer==NULL || outlayer->nvcells==NULL|| tv==NULL ) {
-		printf("%s: input params invalid! \n",__func__);
-		return 999999.9;
+	if(nnet==NULL || nt<1)
+		return NULL;
+
+	if( nvnet_input_size(nnet)==0 ) {
+		printf("%s: The first layer MUST be CONV3X3 or nvcells with din!\n", __func__);
+		return NULL;
 	}
-	else if(loss_func==NULL) {
-		printf("%s: Loss function NOT defined! \n",__func__);
-		return 999999.9;
+
+	trainer=calloc(1, sizeof(NVTRAINER));
+	if(trainer==NULL) {
+		printf("%s: Fail to calloc trainer.\n", __func__);
+		return NULL;
 	}
+	trainer->nnet=nnet;
+	trainer->nt=nt;
 
-	/* 1. For softMax+lossCrossEntropy: softMas as outlayer transfer func.  HK2023-06-19 */
-	if(loss_func==func_lossCrossEntropy ) {
-	    if(outlayer->transfunc == func_softmax) {
-           	/* for each output nvcell */
-           	for(i=0; i< outlayer->nc; i++) {
-			/* sum up each loss, Noticed: softMax()  results stored in outlayer->douts! */
-			//loss += loss_func(outlayer->nvcells[i]->dout, tv[i], NORMAL_FUNC);
-			loss += loss_func(outlayer->douts[i], tv[i], NORMAL_FUNC);
+	trainer->replicas=calloc(nt, sizeof(NVNET *));
+	trainer->errs=calloc(nt, sizeof(nnc_real_t));
+	if(trainer->replicas==NULL || trainer->errs==NULL) {
+		printf("%s: Fail to calloc replicas/errs.\n", __func__);
+		goto FAIL;
+	}
 
-			/* Here we only calc L'(h), and put it in nvcell->derr,
-                 	 * later in nvcell_feed_backward() : derr=L'(h)*f'(u)=derr*f'(u) as dE/du.dE/dh*dh/du
-                 	 */
-			/* For combined function cf(ui)=softmax+crossEntropy: cf'(u)= y[i]-tv[i]  */
-			outlayer->nvcells[i]->derr = outlayer->douts[i]-tv[i]; /* Notice: not in nvcells[]->dout!!! */
-		}
-	    }
-	    else {
-			printf("%s: CrossEntropy MUST combine with sotfMax! \n",__func__);
-			return 999999.9;
-	    }
+	for(i=0; i<nt; i++) {
+		trainer->replicas[i]=nvnet_new_replica(nnet);
+		if(trainer->replicas[i]==NULL)
+			goto FAIL;
 	}
-	/* 2. Non_combine functions */
-	else {
 
-	   /* for each output nvcell */
-	   for(i=0; i< outlayer->nc; i++) {
-		/* sum up each loss */
-		loss += loss_func(outlayer->nvcells[i]->dout, tv[i], NORMAL_FUNC);
+	/* The caller thread works as the last one */
+	trainer->pool=thpool_create(nt-1);
+	if(trainer->pool==NULL)
+		goto FAIL;
 
-		/* Here we only calc L'(h), and put it in nvcell->derr,
-                 * later in nvcell_feed_backward() : derr=L'(h)*f'(u)=derr*f'(u) as dE/du.dE/dh*dh/du
-                 */
-		outlayer->nvcells[i]->derr = loss_func(outlayer->nvcells[i]->dout, tv[i], DERIVATIVE_FUNC);
-	    }
-	}
+	return trainer;
 
-	/* get mean loss */
-//	printf("%s: loss=%f\n", __func__, loss);
-	return loss/(outlayer->nc);
+FAIL:
+	free_nvtrainer(trainer);
+	return NULL;
 }
 
 
-/*----------------------------------------------
- * Note:
- *	A feed forward function for a nerve layer.
- * Params:
- * 	@layer	a nerve layer;
- *	@tv		a teacher's value of output nvcells;
- *			NULL for non_output nvcells
- * Return:
- *		0	OK
- *		<0	fails
------------------------------------------------*/
-int nvlayer_feed_backward(NVLAYER *layer)
+/*-----------------------------------------------------------------
+ * Free a NVTRAINER, the nvnet is NOT freed.
+-----------------------------------------------------------------*/
+void free_nvtrainer(NVTRAINER *trainer)
 {
 	int i;
-	int ret=0;
 
-	/* check layer */
-	if(layer==NULL)  // || layer->nvcells==NULL)
-		return -1;
+	if(trainer==NULL)
+		return;
 
-	/* Case_1: CONV3X3 Layer */
-	if(layer->conv3x3) {
-		ret=conv3x3_feed_backward(layer->conv3x3);
-	}
-	/* Case_2: MAXPOOL2X2 Layer */
-	else if(layer->maxpool2x2) {
-		ret=maxpool2x2_feed_backward(layer->maxpool2x2);
+	thpool_destroy(trainer->pool);
+	if(trainer->replicas) {
+		for(i=0; i< trainer->nt; i++)
+			free_nvnet(trainer->replicas[i]);
+		free(trainer->replicas);
 	}
-	/* Case_3: NVCELLs Layer */
-	else if(layer->nvcells) {
-		/* feed backward all nvcells in the layer */
-		for(i=0; i< layer->nc; i++) {
-			ret=nvcell_feed_backward(layer->nvcells[i]);
-	    		if(ret !=0) return ret;
-		}
+	free(trainer->errs);
+	free(trainer);
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Task of nvtrainer_train_batch(), replica t runs samples
+ *	[t*nb/nt, (t+1)*nb/nt) and accumulates their gradients.
+-----------------------------------------------------------------*/
+static void nvtrainer_task(void *arg, int t)
+{
+	unsigned int k, kb, ke;
+	NVTRAINER *trainer=arg;
+	NVNET *rep=trainer->replicas[t];
+	nnc_real_t err=0.0;
+
+	kb=(unsigned long)t*trainer->nb/trainer->nt;
+	ke=(unsigned long)(t+1)*trainer->nb/trainer->nt;
+
+	for(k=kb; k<ke; k++) {
+		nvnet_set_input(rep, trainer->din+(unsigned long)k*trainer->insize);
+		err += nvnet_feed_forward(rep, trainer->tv+(unsigned long)k*trainer->tvsize, trainer->loss_func);
+		nvnet_feed_backward(rep);
+		nvnet_accum_dparams(rep);
 	}
 
-	return ret;
+	trainer->errs[t]=err;
 }
 
 
-/*-----------------------------------------
- * A feed forward function for a nerve NET.
+/*-----------------------------------------------------------------------
+ * Train a nvnet with a mini-batch, by threads of the trainer.
+ * Samples are split into nt shards, each thread feeds forward/backward
+ * a shard on its replica. Then gradients of all replicas are added up
+ * in order of replicas(so results are deterministic for a given nt),
+ * and params are updated ONCE with the averaged gradients.
+ *
  * Params:
- * 	@nnet		nerve net
+ *	@trainer	Pointer to a NVTRAINER
+ *	@din		Input data of nb samples, each has the size of
+ *			the first layer input, as conv3x3->din or nvcells[0]->din.
+ *	@tv		Teacher values of nb samples, each has nc(of the output layer) values.
+ *	@nb		Number of samples in the batch
+ *	@loss_func	Loss function
+ *	@rate		Learning rate
  * Return:
- *		0	OK
- *		<0	fails
------------------------------------------*/
-int nvnet_init_params(NVNET *nnet)
+ *	Sum of loss of all samples	OK
+ *	a big value			Fails
+-----------------------------------------------------------------------*/
+nnc_real_t nvtrainer_train_batch(NVTRAINER *trainer, const nnc_real_t *din, const nnc_real_t *tv, unsigned int nb,
+			     nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int), double rate)
 {
-	int i,j;
-	NVCELL *cell;
+	int i, t;
+	unsigned long k;
+	NVNET *nnet, *rep;
+	nnc_real_t err=0.0;
 
-	if( nnet==NULL || nnet->nl==0)
-		return -1;
+	if(trainer==NULL || din==NULL || tv==NULL || nb==0)
+		return 999999.9;
 
-	/* rand dw[] and dv */
-	for(i=0; i< nnet->nl; i++) {
-	    /* Case_1: CONV3X3 Layer */
-	    if(nnet->nvlayers[i]->conv3x3) {
-		conv3x3_rand_params(nnet->nvlayers[i]->conv3x3);
-	    }
-	    /* Case_2: MAXPOOL2X2 Layer */
-	    else if(nnet->nvlayers[i]->maxpool2x2) {
-		/* NO params */
-	    }
-	    /* Case_3: NVCELLs Layer */
-	    else {
-		for(j=0; j< nnet->nvlayers[i]->nc; j++) {
-			cell=nnet->nvlayers[i]->nvcells[j];
-			if( nvcell_rand_dwv(cell) <0 ) /* rand dw dv */
-				return -2;
-			cell->dsum=0.0;
-			cell->dout=0.0;
-			cell->derr=0.0;
+	nnet=trainer->nnet;
+	trainer->din=din;
+	trainer->tv=tv;
+	trainer->nb=nb;
+	trainer->insize=nvnet_input_size(nnet);
+	trainer->tvsize=nnet->nvlayers[nnet->nl-1]->nc;
+	trainer->loss_func=loss_func;
+
+	/* 1. Params changed since last batch */
+	for(t=0; t< trainer->nt; t++) {
+		rep=trainer->replicas[t];
+		for(i=0; i< rep->nl; i++) {
+			if(rep->nvlayers[i]->conv3x3) {
+				rep->nvlayers[i]->conv3x3->wgU_valid=false;
+				rep->nvlayers[i]->conv3x3->cbw_valid=false;
+			}
 		}
-	    }
 	}
 
-	return 0;
+	/* 2. Feed forward/backward shards in parallel */
+	thpool_run(trainer->pool, nvtrainer_task, trainer, trainer->nt);
+
+	/* 3. Reduce gradients in order */
+	for(t=0; t< trainer->nt; t++) {
+		rep=trainer->replicas[t];
+		for(k=0; k< nnet->npa; k++)
+			nnet->paccum[k] += rep->paccum[k];
+		nnet->nacc += rep->nacc;
+		memset(rep->paccum, 0, rep->npa*sizeof(nnc_real_t));
+		rep->nacc=0;
+		err += trainer->errs[t];
+
+#ifdef NNC_PROFILE
+		/* Add up profiles of replicas, times are summed over threads */
+		for(i=0; i< nnet->nl; i++) {
+			for(k=0; k<NVPROF_PHASES; k++) {
+				nnet->profile[i].calls[k] += rep->profile[i].calls[k];
+				nnet->profile[i].ns[k] += rep->profile[i].ns[k];
+				nnet->profile[i].flops[k] += rep->profile[i].flops[k];
+			}
+		}
+		memset(rep->profile, 0, rep->nl*sizeof(NVPROFILE));
+#endif
+	}
+
+	/* 4. Update params */
+	if(trainer->optim) {
+		if( nvoptim_step(trainer->optim, rate) !=0 )
+			return 999999.9;
+	}
+	else if( nvnet_apply_dparams(nnet, rate) !=0 )
+		return 999999.9;
+
+	return err;
 }
 
 
-/*-----------------------------------------
- * A feed forward function for a nerve NET.
+/*-----------------------------------------------------------------
+ * Create an epoch sampler, it gives a shuffled order of samples
+ * for each epoch, see nvsampler_next_epoch().
+ * With the same seed, orders of all epochs are the same.
  * Params:
- * 	@nnet		nerve net
- *	@tv		array of teach value
- *	@loss_func	loss function
- *
+ *	@count	Number of samples in an epoch.
+ *	@seed	Seed of its RNG.
  * Return:
- *		others 	OK
- *		a big value	fails
------------------------------------------*/
-double nvnet_feed_forward(NVNET *nnet, const double *tv,
-			double (*loss_func)(double, const double, int) )
+ *	Pointer to NVSAMPLER	OK
+ *	NULL			Fails
+-----------------------------------------------------------------*/
+NVSAMPLER *new_nvsampler(unsigned int count, uint64_t seed)
 {
-	int i;
+	NVSAMPLER *sampler;
+	unsigned int i;
 
-	if( nnet==NULL || nnet->nl==0)
-		return 999999.9;
+	if(count==0)
+		return NULL;
 
-	for(i=0; i< nnet->nl; i++) {
-//		printf("%s: nvlayers[%d] feed forward...\n",__func__, i);
-		nvlayer_feed_forward(nnet->nvlayers[i]);
+	sampler=calloc(1, sizeof(NVSAMPLER));
+	if(sampler==NULL)
+		return NULL;
+
+	sampler->order=malloc(count*sizeof(unsigned int));
+	if(sampler->order==NULL) {
+		free(sampler);
+		return NULL;
 	}
 
-        /* Get final err */
-	if(tv) {
-         	return  nvlayer_mean_loss( nnet->nvlayers[nnet->nl-1], tv, loss_func );
+	sampler->count=count;
+	for(i=0; i<count; i++)
+		sampler->order[i]=i;
+	nnc_rng_seed(&sampler->rng, seed);
+
+	return sampler;
+}
+
+void free_nvsampler(NVSAMPLER *sampler)
+{
+	if(sampler==NULL)
+		return;
+
+	free(sampler->order);
+	free(sampler);
+}
+
+
+/*-----------------------------------------------------------------
+ * Shuffle the order for the next epoch(Fisher-Yates).
+ * Params:
+ *	@sampler	Pointer to a NVSAMPLER
+ * Return:
+ *	order[count]	Sample indexes of the epoch, valid until the next call.
+ *	NULL		Fails
+-----------------------------------------------------------------*/
+const unsigned int *nvsampler_next_epoch(NVSAMPLER *sampler)
+{
+	unsigned int i, k, tmp;
+
+	if(sampler==NULL)
+		return NULL;
+
+	for(i=sampler->count-1; i>0; i--) {
+		/* k in [0 i], the bias of modulo is negligible as count << 2^64 */
+		k=nnc_rng_next(&sampler->rng)%(i+1);
+		tmp=sampler->order[i];
+		sampler->order[i]=sampler->order[k];
+		sampler->order[k]=tmp;
 	}
-	else /* HK2023-05-17 */
-		return 0.0f;
+	sampler->epoch++;
+
+	return sampler->order;
 }
 
 
-/*-----------------------------------------
- * A feed backward function for a nerve NET.
+/*-----------------------------------------------------------------
+ * Create an optimizer for a nvnet, it covers all params in the
+ * parameter arena: NVCELL dw[]/dv and CONV3X3 fparams/dvs.
+ * Hyper params are set to defaults, change them before the first
+ * nvoptim_step() if necessary.
+ *
+ * Usage:
+ *	Accumulate gradients by nvnet_accum_dparams()(or by a NVTRAINER
+ *	with trainer->optim set), then call nvoptim_step() in place of
+ *	nvnet_apply_dparams().
+ *
  * Params:
- * 	@nnet		nerve net
+ *	@nnet	A nvnet for training.
+ *	@type	enum nvoptim_type
  * Return:
- *		0	OK
- *		<0	fails
------------------------------------------*/
-int nvnet_feed_backward(NVNET *nnet)
+ *	Pointer to NVOPTIM	OK
+ *	NULL			Fails
+-----------------------------------------------------------------*/
+NVOPTIM *new_nvoptim(NVNET *nnet, int type)
 {
-	int i,j,k,n;
+	NVOPTIM *optim;
 
-	if( nnet==NULL || nnet->nl==0)
-		return -1;
+	if(nnet==NULL || type<NVOPTIM_SGD || type>NVOPTIM_ADAM)
+		return NULL;
 
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return NULL;
+	}
 
-	/* 1. Clear derr in all cell derr, except the output cells */
-	for(i=0; i< nnet->nl-1; i++) {  /*  ----- CAUTION ----  <nl-1, NOT for the ouput cells */
-	    /* Case_1: CONV3X3 Layer  HK2023-07-11 */
-	    if( nnet->nvlayers[i]->conv3x3 !=NULL ) {
-		for(n=0; n< nnet->nvlayers[i]->conv3x3->nf; n++)
-		   for(j=0; j< nnet->nvlayers[i]->conv3x3->oh; j++)
-			for(k=0; k< nnet->nvlayers[i]->conv3x3->ow; k++)
-				nnet->nvlayers[i]->conv3x3->derr[n][j*nnet->nvlayers[i]->conv3x3->ow+k] = 0.0f;
-	    }
-	    /* Case_2: MAXPOOL2X2 Layer HK2023-07-11 */
-	    else if(nnet->nvlayers[i]->maxpool2x2!=NULL) {
-		for(n=0; n< nnet->nvlayers[i]->maxpool2x2->nf; n++)
-		   for(j=0; j< nnet->nvlayers[i]->maxpool2x2->oh; j++)
-			for(k=0; k< nnet->nvlayers[i]->maxpool2x2->ow; k++)
-				nnet->nvlayers[i]->maxpool2x2->derr[n][j*nnet->nvlayers[i]->maxpool2x2->ow+k] = 0.0f;
-            }
-	    /* Case_3: NVCELL Layer */
-	    else {
+	/* Params and gradients are in the arena */
+	if( nvnet_pack_params(nnet) <0 ) {
+		printf("%s: fail to pack params.\n",__func__);
+		return NULL;
+	}
 
-		/* but leave the output layer, as we already put derr=L'(h) there !!! */
-		for(j=0; j< nnet->nvlayers[i]->nc; j++) {
-			nnet->nvlayers[i]->nvcells[j]->derr=0.0;
-		}
-	    }
+	optim=calloc(1, sizeof(NVOPTIM));
+	if(optim==NULL)
+		return NULL;
 
+	if( posix_memalign((void **)&optim->state, 64, 2*nnet->npa*sizeof(nnc_real_t)) !=0 ) {
+		printf("%s: Fail to alloc optim->state.\n", __func__);
+		free(optim);
+		return NULL;
 	}
 
-	/* 2. Feed backward from output layer to input layer */
-	for(i=nnet->nl-1; i>=0; i--) {
+	optim->nnet=nnet;
+	optim->type=type;
+	optim->mu=0.9;
+	optim->beta1=0.9;
+	optim->beta2= type==NVOPTIM_RMSPROP ? 0.9 : 0.999;
+	optim->eps=1.0e-8;
+	optim->npa=nnet->npa;
+	optim->m=optim->state;
+	optim->v=optim->state+nnet->npa;
+	nvoptim_reset(optim);
 
-//		printf("%s: nvlayers[%d] feed_backward...\n", __func__, i);
-		if(nvlayer_feed_backward(nnet->nvlayers[i]) !=0 ) {
-			printf("%s: nvlayer[%d] feed backward fails!\n",__func__,i);
-			return -2;
-		}
-	}
+	return optim;
+}
 
-	return 0;
+void free_nvoptim(NVOPTIM *optim)
+{
+	if(optim==NULL)
+		return;
+
+	free(optim->state);
+	free(optim);
+}
+
+/*---------------------------------------------
+ * Clear moments and steps of an optimizer, as
+ * a new one.
+---------------------------------------------*/
+void nvoptim_reset(NVOPTIM *optim)
+{
+	if(optim==NULL)
+		return;
+
+	memset(optim->state, 0, 2*optim->npa*sizeof(nnc_real_t));
+	optim->step=0;
 }
 
 
+/*---------------------------------------------------------------------------
+ * Scalar fused optimizer sweep, see struct nvoptim_coefs.
+ * Params, gradients and moments are read and written ONCE in one sweep.
+---------------------------------------------------------------------------*/
+static void nvoptim_sweep(nnc_real_t *p, nnc_real_t *acc, nnc_real_t *m, nnc_real_t *v,
+			  unsigned long n, const struct nvoptim_coefs *c)
+{
+	unsigned long k;
+	nnc_real_t g;
 
-/*------------------------------------------------------------------------------
- *  Update all cells' params of a nvnet by simple gradient descent algorithm.
- *  For output cells:      dw += -rate*L'(h)*f'(u)*h[L-1],
- *       assume derr=L'(h)*f'(u) already computed by nvnet_feed_backward().
- *  For non_output cells:  dw += -rate*dE/du*h[L-1],
- *       assume derr=dE/du=f'(h)*SUM(dE/du*w)[L-1] already computed by nvnet_feed_backward().
- *
- *  Note:
- *	1. This function SHOULD be executed right after feed_backward operation,
- *	   so that all temp. values(like dout,din, derr..)have just been updated
- *	   and relevant.
+	for(k=0; k<n; k++) {
+		g=acc[k]*c->gs;
+		m[k]=c->b1*m[k]+c->c1*g;
+		v[k]=c->b2*v[k]+c->c2*g*g;
+		p[k] += (c->s1*m[k]+c->s2*g)/(sqrt(v[k])+c->eps);
+		acc[k]=0.0;
+	}
+}
+
+
+/*---------------------------------------------------------------------------
+ * Update all params of the nvnet with averaged gradients accumulated by
+ * nvnet_accum_dparams(), g=paccum[k]/nacc, then clear the accumulation.
+ * Update rules are listed in enum nvoptim_type, they are all done by ONE
+ * fused sweep over the arena(AVX2 if available).
  *
  * Params:
- * 	@nnet		nerve net
+ *	@optim		Pointer to a NVOPTIM
  *	@rate		learning rate
  * Return:
  *		0	OK
  *		<0	fails
 ---------------------------------------------------------------------------*/
-int nvnet_update_params(NVNET *nnet, double rate)
+int nvoptim_step(NVOPTIM *optim, double rate)
 {
-	int i,j,k,n,m;
-	NVCELL *cell;
+	int i;
+	NVNET *nnet;
+	struct nvoptim_coefs c;
+	double bc1, bc2;
 
-	if( nnet==NULL || nnet->nl==0)
+	if( optim==NULL || optim->nnet==NULL || optim->nnet->paccum==NULL )
 		return -1;
 
-	/* Traverse nvlayers to update parameters */
-	for(i=0; i< nnet->nl; i++) {
-	   /* Case_1: CONV3X3 Layer */
-	   if(nnet->nvlayers[i]->conv3x3) {
-		/* Update fparams */
-		for(n=0; n< nnet->nvlayers[i]->conv3x3->nf; n++) {
-		    for(m=0; m< nnet->nvlayers[i]->conv3x3->nchan;m++) {
-		   	for(j=0; j<3; j++)
-			    for(k=0; k<3; k++)
-				 nnet->nvlayers[i]->conv3x3->fparams[n][m][j*3+k] -= rate*nnet->nvlayers[i]->conv3x3->dFP[n][m][j*3+k];
-		    }
-		}
+	nnet=optim->nnet;
+	if(nnet->npa != optim->npa) {
+		printf("%s: Params of the nvnet changed!\n", __func__);
+		return -1;
+	}
 
-		/* Update dvs HK2023-08-05 */
-		if(nnet->nvlayers[i]->conv3x3->dvs) {
-		   for(n=0; n< nnet->nvlayers[i]->conv3x3->nf; n++)
-			/* -rate*(-1.0)*(cell->derr), dv as special weight var with w=-1.0 */
-		   	nnet->nvlayers[i]->conv3x3->dvs[n] += rate*nnet->nvlayers[i]->conv3x3->dferr[n];
+	/* Nothing accumulated */
+	if(nnet->nacc==0)
+		return 0;
+
+	optim->step++;
+
+	/* Default as SGD, v is NOT used: sqrt(0)+1 */
+	c.gs=1.0/nnet->nacc;
+	c.b1=0.0; c.c1=0.0;
+	c.b2=0.0; c.c2=0.0;
+	c.s1=0.0; c.s2=-rate;
+	c.eps=1.0;
+
+	switch(optim->type) {
+	    case NVOPTIM_MOMENTUM:
+		c.b1=optim->mu; c.c1=-rate;
+		c.s1=1.0; c.s2=0.0;
+		break;
+	    case NVOPTIM_NESTEROV:
+		c.b1=optim->mu; c.c1=-rate;
+		c.s1=optim->mu; c.s2=-rate;
+		break;
+	    case NVOPTIM_RMSPROP:
+		c.b2=optim->beta2; c.c2=1.0-optim->beta2;
+		c.eps=optim->eps;
+		break;
+	    case NVOPTIM_ADAM:
+		/* Bias corrections are folded into rate and eps */
+		bc1=1.0-pow(optim->beta1, optim->step);
+		bc2=sqrt(1.0-pow(optim->beta2, optim->step));
+		c.b1=optim->beta1; c.c1=1.0-optim->beta1;
+		c.b2=optim->beta2; c.c2=1.0-optim->beta2;
+		c.s1=-rate*bc2/bc1; c.s2=0.0;
+		c.eps=optim->eps*bc2;
+		break;
+	    default:
+		break;
+	}
+
+	NVPROF_BEGIN(t0);
+	if(nvoptim_simd_sweep)
+		nvoptim_simd_sweep(nnet->pparams, nnet->paccum, optim->m, optim->v, nnet->npa, &c);
+	else
+		nvoptim_sweep(nnet->pparams, nnet->paccum, optim->m, optim->v, nnet->npa, &c);
+	NVPROF_END_SWEEP(nnet, t0);
+	nnet->nacc=0;
 
+	/* Winograd filter transforms and channel-blocked fparams */
+	for(i=0; i< nnet->nl; i++) {
+		if(nnet->nvlayers[i]->conv3x3) {
+			nnet->nvlayers[i]->conv3x3->wgU_valid=false;
+			nnet->nvlayers[i]->conv3x3->cbw_valid=false;
 		}
-
-   /* <----------  continue for(i) */
-		continue;
-	   }
-	   /* Case_2: MAXPOOL2X2 Layer */
-	   else if(nnet->nvlayers[i]->maxpool2x2) {
-		/* No parameters need to be updated */
-
-   /* <----------  continue for(i) */
-		continue;
-	   }
-
-	   /* Case_3:  NVCELLs Layer */
-	   for(j=0; j< nnet->nvlayers[i]->nc; j++) {	/* traverse nvcells */
-	      cell=nnet->nvlayers[i]->nvcells[j];
-
-	      /* 1. update dw[] += -LEARN_RATE*h[L-1]*derr */
-	      for(k=0; k< cell->nin; k++)  {		/* traverse params */
-
-		 if( cell->incells !=NULL && cell->incells[0] != NULL) {
-			//cell->dw[k] += -rate*(cell->incells[k]->dout)*(cell->derr);
-			cell->dw[k] -= rate*(cell->incells[k]->dout)*(cell->derr);
-		 }
-		 else if( cell->din !=NULL ) {
-			//cell->dw[k] += -rate*(cell->din[k])*(cell->derr);
-			cell->dw[k] -= rate*(cell->din[k])*(cell->derr);
-		 }
-	 	 else {
-			printf("%s: nvcell->incells[x] or din[x] invalid!\n",__func__);
-			return -2;
-		 }
-
-	      }
-
-	      /* 2. bias deemed as a special kind of weight, dv += -LEARN_RATE*dE/db,
-	       *	dE/db=-f'(u)
-               */
-	      cell->dv += rate*(cell->derr); /* -rate*(-1.0)*(cell->derr), dv as special weight var with w=-1.0 */
-
-           }
 	}
 
-
-
-
-
 	return 0;
 }
 
 
-
 /*------------------------------------------------------------------------------
  *  Update all cells' params of a nvnet by momentum algorithm.
  *  For output cells:      dw += -rate*L'(h)*f'(u)*h[L-1],
@@ -2261,38 +7301,33 @@ int nvnet_update_params(NVNET *nnet, double rate)
 int nvnet_mmtupdate_params(NVNET *nnet, double rate, double mfrict)
 {
 	int i,j,k;
-	int nmp;
+	unsigned long nmp;
 	NVCELL *cell;
 
 	if( nnet==NULL || nnet->nl==0)
 		return -1;
 
-	/* init nnet->mmts if NULL */
-	if( nnet->mmts == NULL ) {
-		nmp=0;
-		/* get total number of mmts params */
-		for(i=0; i< nnet->nl; i++) {	/* layers in the nvnet */
-			for(j=0; j < nnet->nvlayers[i]->nc; j++) {	    /* cells in a layer */
-				nmp += (nnet->nvlayers[i]->nvcells[j]->nin)+1; /* dw[], dv */
-			}
-		}
-		/* allocate nnet->mmts and set all zero */
-		nnet->mmts = calloc(nmp, sizeof(double));
-		if(nnet->mmts==NULL) {
-			printf("%s: fail to calloc nnet->mmts.\n",__func__);
-			return -2;
-		}
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return -1;
+	}
 
-		nnet->nmp=nmp;
+	/* nnet->mmts is in the parameter arena */
+	if( nvnet_pack_params(nnet) <0 ) {
+		printf("%s: fail to pack params and mmts.\n",__func__);
+		return -2;
 	}
 
 	/* update params by momentum */
-	nmp=0;
 	for(i=0; i< nnet->nl; i++) {			/* traverse nvlayers */
 	   for(j=0; j< nnet->nvlayers[i]->nc; j++) {	/* traverse nvcells */
 	      /* For each neuron in the network */
 	      cell=nnet->nvlayers[i]->nvcells[j];
 
+	      /* mmts[] at the same offset as dw[] in the arena */
+	      nmp=cell->dw - nnet->pparams;
+
 	      /* 1. update dw[]  */
 	      for(k=0; k< cell->nin; k++)  {		/* traverse params */
 		if( cell->incells !=NULL && cell->incells[0] != NULL) {
@@ -2323,9 +7358,8 @@ int nvnet_mmtupdate_params(NVNET *nnet, double rate, double mfrict)
 		//nnet->mmts[nmp]= dmmt_fric*nnet->mmts[nmp]+rate*(cell->derr); /* -rate*(-1.0)*(cell->derr) */
 		nnet->mmts[nmp]= mfrict*nnet->mmts[nmp]+rate*(cell->derr); /* -rate*(-1.0)*(cell->derr) */
 		/* update dv, dv[i+1]=dv[i]+dv_mmt[i+i] */
-		cell->dv += nnet->mmts[nmp];
+		*cell->dv += nnet->mmts[nmp];
 
-		nmp++;
            }
 	}
 
@@ -2337,7 +7371,7 @@ int nvnet_mmtupdate_params(NVNET *nnet, double rate, double mfrict)
  * Buff current params into nvnet->params.
  * params are buffed in order: dw[],dv,dsum,dout,derr.
  *
- * the net. all to be double type.
+ * the net. all to be nnc_real_t type.
  *
  * Params:
  * 	@nnet		nerve net
@@ -2347,45 +7381,44 @@ int nvnet_mmtupdate_params(NVNET *nnet, double rate, double mfrict)
 -----------------------------------------------*/
 int nvnet_buff_params(NVNET *nnet)
 {
-	int i,j,k;
-	int np; /* total numbers of params */
+	int i,j;
+	unsigned long np; /* total numbers of params */
 	NVCELL *cell;
 
 	if( nnet==NULL || nnet->nl==0)
 		return -1;
 
+	/* All dw[], dv to be buffed from the parameter arena */
+	if( nvnet_pack_params(nnet) <0 )
+		return -1;
+
 	/* if NULL, allocate nnet->params */
 	if(nnet->params==NULL) {
-		np=0;
+		np=nnet->npa;
 		for(i=0; i< nnet->nl; i++) {	/* layers in the nvnet */
-			for(j=0; j < nnet->nvlayers[i]->nc; j++) {	  /* cells in a layer */
-				cell=nnet->nvlayers[i]->nvcells[j];
-				np += cell->nin + 4; /* dw[], dv, dsum, dout, derr */
-			}
+			np += 3*nnet->nvlayers[i]->nc; /* dsum, dout, derr */
 		}
 
-		nnet->params=calloc(np,sizeof(double));
+		nnet->params=calloc(np,sizeof(nnc_real_t));
 		if(nnet->params==NULL) {
 			printf("%s: fail to calloc nnet->params.\n",__func__);
 			return -1;
 		}
 
 		nnet->np=np;
-		printf("%s: space for %d double type params are allocated to nvnet->param.\n",__func__, np);
+		printf("%s: space for %lu nnc_real_t type params are allocated to nvnet->param.\n",__func__, np);
 	}
 
-	/* buff all params to nnet->params */
-	np=0;
+	/* buff all dw[],dv and fparams,dvs from the arena */
+	memcpy(nnet->params, nnet->pparams, nnet->npa*sizeof(nnc_real_t));
+
+	/* buff dsum, dout, derr of all cells */
+	np=nnet->npa;
 	for(i=0; i<nnet->nl; i++) {				  /* layers in the nvnet */
 		for(j=0; j < nnet->nvlayers[i]->nc; j++) {	  /* cells in a layer */
 
 			cell=nnet->nvlayers[i]->nvcells[j];
-			/* buff dw[] */
-			for(k=0; k< cell->nin; k++) {
-				nnet->params[np++]=cell->dw[k];
-			}
-			/* buff dv, dsum, dout, derr; beware of the their order */
-			nnet->params[np++]=cell->dv;
+			/* buff dsum, dout, derr; beware of the their order */
 			nnet->params[np++]=cell->dsum;
 			nnet->params[np++]=cell->dout;
 			nnet->params[np++]=cell->derr;
@@ -2400,7 +7433,7 @@ int nvnet_buff_params(NVNET *nnet)
 /*----------------------------------------------------
  * Restore params in nvnet->buff to its cells
  * params are buffed in order: dw[],dv,dsum,dout,derr.
- * the net. all to be double type.
+ * the net. all to be nnc_real_t type.
  *
  * Params:
  * 	@nnet		nerve net
@@ -2410,26 +7443,27 @@ int nvnet_buff_params(NVNET *nnet)
 -----------------------------------------------------*/
 int nvnet_restore_params(NVNET *nnet)
 {
-	int i,j,k;
-	int np; /* total numbers of params */
+	int i,j;
+	unsigned long np; /* total numbers of params */
 	NVCELL *cell;
 
-	if( nnet==NULL || nnet->params==NULL || nnet->nl==0 )
+	if( nnet==NULL || nnet->params==NULL || nnet->pparams==NULL || nnet->nl==0 )
 		return -1;
 
+	/* restore all dw[],dv and fparams,dvs into the arena */
+	memcpy(nnet->pparams, nnet->params, nnet->npa*sizeof(nnc_real_t));
 
-	/* put all params to nnet->params */
-	np=0;
+	/* restore dsum, dout, derr of all cells */
+	np=nnet->npa;
 	for(i=0; i< nnet->nl; i++) {				  /* layers in the nvnet */
+		if(nnet->nvlayers[i]->conv3x3) {
+			nnet->nvlayers[i]->conv3x3->wgU_valid=false;  /* fparams restored */
+			nnet->nvlayers[i]->conv3x3->cbw_valid=false;
+		}
 		for(j=0; j < nnet->nvlayers[i]->nc; j++) {	  /* cells in a layer */
 
 			cell=nnet->nvlayers[i]->nvcells[j];
-			/* restore dw[] */
-			for(k=0; k< cell->nin; k++) {
-				cell->dw[k]=nnet->params[np++];
-			}
-			/* buff dv, dsum, dout, derr; beware of the their order */
-			cell->dv=nnet->params[np++];
+			/* restore dsum, dout, derr; beware of the their order */
 			cell->dsum=nnet->params[np++];
 			cell->dout=nnet->params[np++];
 			cell->derr=nnet->params[np++];
@@ -2460,19 +7494,25 @@ int nvnet_restore_params(NVNET *nnet)
  *		0	OK
  *		<0	fails
 ---------------------------------------------------------*/
-int nvnet_check_gradient(NVNET *nnet, const double *tv,
-			double (*loss_func)(double, const double, int) )
+int nvnet_check_gradient(NVNET *nnet, const nnc_real_t *tv,
+			nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int) )
 {
 	int i,j,k;
 	NVCELL *cell;
-	double  dgrt_back; /* backpropagation gradient */
-	double  dgrt_num;  /* numerical gradient */
-	double  err_plus; /* err result for dw plus samll changes */
-	double  err_minus; /* err result for dw minus samll changes */
+	nnc_real_t  dgrt_back; /* backpropagation gradient */
+	nnc_real_t  dgrt_num;  /* numerical gradient */
+	nnc_real_t  err_plus; /* err result for dw plus samll changes */
+	nnc_real_t  err_minus; /* err result for dw minus samll changes */
 
 	if( nnet==NULL || nnet->nl==0 )
 		return -1;
 
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return -1;
+	}
+
 	/* buff all params */
 	nvnet_buff_params(nnet);
 
@@ -2526,12 +7566,12 @@ int nvnet_check_gradient(NVNET *nnet, const double *tv,
 		nvnet_restore_params(nnet);
 		dgrt_back=-1.0*cell->derr;
 
-		cell->dv += desp_params; /* plus a small change value */
+		*cell->dv += desp_params; /* plus a small change value */
 		err_plus= nvnet_feed_forward(nnet, tv, loss_func);
 
 		/* 2.2 restore params and compute error with minus param */
 		nvnet_restore_params(nnet);
-		cell->dv -= desp_params; /* minus a small change value */
+		*cell->dv -= desp_params; /* minus a small change value */
 		err_minus= nvnet_feed_forward(nnet, tv, loss_func);
 
 		/* 2.3 numerical gradient */
@@ -2560,6 +7600,293 @@ int nvnet_check_gradient(NVNET *nnet, const double *tv,
 
 
 
+/* Context of nvnet_check_gradient_sampled() tasks */
+struct nvnet_gcheck
+{
+	NVNET **reps;		/* reps[nt], replicas with private params */
+	int nt;
+	const nnc_real_t *tv;
+	nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int);
+	const unsigned long *probes;	/* Indices of params to probe, in nnet->pparams[] */
+	unsigned long nprobe;
+	nnc_real_t *dnum;		/* dnum[nprobe], numerical gradients */
+};
+
+
+/* Order of unsigned long, for qsort() */
+static int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long x=*(const unsigned long *)a, y=*(const unsigned long *)b;
+
+	return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+
+/*------------------------------------------------------
+ * Name of the param pparams[idx] of a packed nvnet,
+ * in the layout of nvnet_pack_params().
+-------------------------------------------------------*/
+static void nvnet_param_name(const NVNET *nnet, unsigned long idx, char *name, size_t size)
+{
+	int i,j;
+	unsigned long n, K;
+	const CONV3X3 *conv3;
+	const NVLAYER *layer;
+
+	for(i=0; i< nnet->nl; i++) {
+	    layer=nnet->nvlayers[i];
+	    /* Case_1: CONV3X3 Layer */
+	    if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		n=conv3->nf*conv3->nchan*9;
+		if(idx<n) {
+			snprintf(name, size, "nvlayers[%d] fparams[%lu][%lu][%lu]", i, idx/(conv3->nchan*9), idx/9%conv3->nchan, idx%9);
+			return;
+		}
+		idx -= n;
+		if(conv3->dvs) {
+			if(idx < conv3->nf) {
+				snprintf(name, size, "nvlayers[%d] dvs[%lu]", i, idx);
+				return;
+			}
+			idx -= conv3->nf;
+		}
+	    }
+	    /* Case_1A: CONVKXK Layer */
+	    else if(layer->convkxk) {
+		K=layer->convkxk->nchan*layer->convkxk->ks*layer->convkxk->ks;
+		n=layer->convkxk->nf*K;
+		if(idx<n) {
+			snprintf(name, size, "nvlayers[%d] fparams[%lu][%lu]", i, idx/K, idx%K);
+			return;
+		}
+		idx -= n;
+		if(layer->convkxk->dvs) {
+			if(idx < layer->convkxk->nf) {
+				snprintf(name, size, "nvlayers[%d] dvs[%lu]", i, idx);
+				return;
+			}
+			idx -= layer->convkxk->nf;
+		}
+	    }
+	    /* Case_3: NVCELLs Layer */
+	    else if(layer->maxpool2x2==NULL) {
+		for(j=0; j< layer->nc; j++) {
+			n=layer->nvcells[j]->nin;
+			if(idx<n) {
+				snprintf(name, size, "nvlayers[%d] nvcells[%d]->dw[%lu]", i, j, idx);
+				return;
+			}
+			else if(idx==n) {
+				snprintf(name, size, "nvlayers[%d] nvcells[%d]->dv", i, j);
+				return;
+			}
+			idx -= n+1;
+		}
+	    }
+	}
+
+	snprintf(name, size, "pparams[?]");
+}
+
+
+/*--------------------------------------------------------------
+ * Note:
+ *	Task of nvnet_check_gradient_sampled(), replica t probes
+ *	params probes[t], probes[t+nt], ...
+ *	Each param is changed in place, and ONLY it is restored.
+---------------------------------------------------------------*/
+static void nvnet_gcheck_task(void *arg, int t)
+{
+	int i;
+	unsigned long k;
+	struct nvnet_gcheck *ctx=arg;
+	NVNET *rep=ctx->reps[t];
+	nnc_real_t *param;
+	nnc_real_t pval;
+	nnc_real_t err_plus, err_minus;
+
+	for(k=t; k< ctx->nprobe; k+=ctx->nt) {
+		param=rep->pparams+ctx->probes[k];
+		pval=*param;
+
+		*param=pval+desp_params;
+		for(i=0; i< rep->nl; i++) {
+			if(rep->nvlayers[i]->conv3x3) {
+				rep->nvlayers[i]->conv3x3->wgU_valid=false;  /* Winograd filter transforms */
+				rep->nvlayers[i]->conv3x3->cbw_valid=false;
+			}
+		}
+		err_plus=nvnet_feed_forward(rep, ctx->tv, ctx->loss_func);
+
+		*param=pval-desp_params;
+		for(i=0; i< rep->nl; i++) {
+			if(rep->nvlayers[i]->conv3x3) {
+				rep->nvlayers[i]->conv3x3->wgU_valid=false;
+				rep->nvlayers[i]->conv3x3->cbw_valid=false;
+			}
+		}
+		err_minus=nvnet_feed_forward(rep, ctx->tv, ctx->loss_func);
+
+		*param=pval;
+		/* feed forward returns the mean loss of nc output cells, while derr is of the summed loss */
+		ctx->dnum[k]=rep->nvlayers[rep->nl-1]->nc*(err_plus-err_minus)/(2.0*desp_params);
+	}
+}
+
+
+/*-------------------------------------------------------------------------
+ * Check backpropagation gradients of ALL params of a nvnet, CONV3X3
+ * fparams/dvs and NVCELL dw/dv, with numerical gradients of a random
+ * subset of params.
+ *
+ * Note:
+ *	1. Input data of the first layer and tv are of ONE sample, the
+ *	   nvnet itself is NOT changed: nt replicas with private copies
+ *	   of params run the checking, see nvnet_new_replica().
+ *	2. Backpropagation gradients are from nvnet_accum_dparams().
+ *	   A probe changes ONE param in place by +/-desp_params, and
+ *	   restores ONLY it. Probes are split across nt threads.
+ *	   nvnet_feed_forward() returns the MEAN loss of the output cells,
+ *	   so numerical gradients are scaled by nc of the last layer.
+ *	3. A probe fails if both |dgrt_back-dgrt_num| > max(GRADIENT_ABS_LIMIT, noise)
+ *	   and > GRADIENT_COMP_LIMIT*max(|dgrt_back|,|dgrt_num|), noise is the rounding
+ *	   noise of numerical gradients as per the loss and NNC_REAL_EPSILON.
+ *	   A probe across a kink of ReLU or MAXPOOL2X2 may fail as well.
+ *	4. The same seed probes the same params, for any nt.
+ *
+ * Params:
+ * 	@nnet		nerve net, with params packed.
+ *	@tv		teacher values of the sample
+ *	@loss_func	loss function
+ *	@nprobe		number of params to probe, 0 for ALL params
+ *	@nt		number of threads
+ *	@seed		seed to sample params
+ * Return:
+ *		0	OK
+ *		<0	fails
+-------------------------------------------------------------------------*/
+int nvnet_check_gradient_sampled(NVNET *nnet, const nnc_real_t *tv,
+			nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int),
+			unsigned long nprobe, int nt, uint64_t seed)
+{
+	int t, ret=-1;
+	unsigned long k, r, tmp, npa, nfail=0;
+	unsigned long *probes=NULL;
+	nnc_real_t *pcopy;
+	nnc_real_t dgrt_back, dgrt_num, diff, scale;
+	nnc_real_t err, noise, abslimit;
+	double maxrel=0.0;
+	char name[64];
+	NNC_RNG rng;
+	THPOOL *pool=NULL;
+	struct nvnet_gcheck ctx;
+
+	if( nnet==NULL || nnet->nl==0 || tv==NULL || loss_func==NULL || nt<1 )
+		return -1;
+
+	/* NO gradient buffers */
+	if(nnet->infer_only) {
+		printf("%s: The nvnet is inference only!\n", __func__);
+		return -1;
+	}
+	if(nnet->pparams==NULL) {
+		printf("%s: Params of the nvnet are NOT packed!\n", __func__);
+		return -1;
+	}
+	npa=nnet->npa;
+	if(nprobe==0 || nprobe>npa)
+		nprobe=npa;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.nt=nt;
+	ctx.tv=tv;
+	ctx.loss_func=loss_func;
+	ctx.nprobe=nprobe;
+
+	/* 1. Sample params by partial Fisher-Yates shuffle, then in order of params */
+	probes=malloc(npa*sizeof(unsigned long));
+	ctx.dnum=malloc(nprobe*sizeof(nnc_real_t));
+	ctx.reps=calloc(nt, sizeof(NVNET *));
+	if(probes==NULL || ctx.dnum==NULL || ctx.reps==NULL) {
+		printf("%s: Fail to malloc probes.\n", __func__);
+		goto END_FUNC;
+	}
+	for(k=0; k<npa; k++)
+		probes[k]=k;
+	nnc_rng_seed(&rng, seed);
+	for(k=0; k<nprobe; k++) {
+		r=k+nnc_rng_next(&rng)%(npa-k);
+		tmp=probes[k]; probes[k]=probes[r]; probes[r]=tmp;
+	}
+	qsort(probes, nprobe, sizeof(unsigned long), cmp_ulong);
+	ctx.probes=probes;
+
+	/* 2. Replicas with private params, copied to their PARAMS region */
+	for(t=0; t<nt; t++) {
+		ctx.reps[t]=nvnet_new_replica(nnet);
+		if(ctx.reps[t]==NULL)
+			goto END_FUNC;
+		pcopy=ctx.reps[t]->parena+NVNET_ARENA_PARAMS*npa;
+		memcpy(pcopy, nnet->pparams, npa*sizeof(nnc_real_t));
+		if( nvnet_map_params(ctx.reps[t], pcopy) <0 )
+			goto END_FUNC;
+	}
+
+	/* 3. Backpropagation gradients, in reps[0]->paccum[] */
+	err=nvnet_feed_forward(ctx.reps[0], tv, loss_func);
+	/* Rounding noise of numerical gradients: 8 ulps of the summed loss, for rounding of
+	 * err_plus/err_minus and of the feed forward, see nvnet_gcheck_task(). It matters in float32 ONLY.
+	 */
+	noise=8.0*ctx.reps[0]->nvlayers[nnet->nl-1]->nc*fabs(err)*NNC_REAL_EPSILON/(2.0*desp_params);
+	abslimit=fmax(GRADIENT_ABS_LIMIT, noise);
+	if( nvnet_feed_backward(ctx.reps[0]) !=0 || nvnet_accum_dparams(ctx.reps[0]) !=0 ) {
+		printf("%s: Fail to get backpropagation gradients.\n", __func__);
+		goto END_FUNC;
+	}
+
+	/* 4. Numerical gradients, the caller thread works as the last one */
+	pool=thpool_create(nt-1);
+	if(pool==NULL)
+		goto END_FUNC;
+	thpool_run(pool, nvnet_gcheck_task, &ctx, nt);
+
+	/* 5. Compare */
+	for(k=0; k<nprobe; k++) {
+		dgrt_back=ctx.reps[0]->paccum[probes[k]];
+		dgrt_num=ctx.dnum[k];
+		diff=fabs(dgrt_back-dgrt_num);
+		scale=fmax(fabs(dgrt_back), fabs(dgrt_num));
+		if(scale > abslimit && diff/scale > maxrel)
+			maxrel=diff/scale;
+
+		if( diff > abslimit && diff > GRADIENT_COMP_LIMIT*scale ) {
+			if(nfail < 10) {
+				nvnet_param_name(nnet, probes[k], name, sizeof(name));
+				printf("%s: %s: dgrt_back=%1.10f, dgrt_num=%1.10f\n", __func__, name, dgrt_back, dgrt_num);
+			}
+			nfail++;
+		}
+	}
+
+	printf("%s: %lu of %lu params probed by %d threads, %lu failed, max. relative error %e, abs. limit %e\n",
+				__func__, nprobe, npa, nt, nfail, maxrel, abslimit);
+	ret= nfail ? -2 : 0;
+
+END_FUNC:
+	thpool_destroy(pool);
+	if(ctx.reps) {
+		for(t=0; t<nt; t++)
+			free_nvnet(ctx.reps[t]);
+	}
+	free(ctx.reps);
+	free(ctx.dnum);
+	free(probes);
+
+	return ret;
+}
+
+
 /*------------------------------------------------
  * Params:
  * 	@nnet	a well prepared/confiured nerve net;
@@ -2569,7 +7896,7 @@ int nvnet_check_gradient(NVNET *nnet, const double *tv,
  *		0	OK
  *		<0	fails
 ------------------------------------------------*/
-int nvcell_get_loss(NVNET *nnet, double tv)
+int nvcell_get_loss(NVNET *nnet, nnc_real_t tv)
 {
 
 	return 0;
@@ -2585,7 +7912,7 @@ int nvcell_get_loss(NVNET *nnet, double tv)
  *		0	OK
  *		<0	fails
 -------------------------------------------------------*/
-int  nvcell_input_data(NVCELL *cell, double *data)
+int  nvcell_input_data(NVCELL *cell, nnc_real_t *data)
 {
 	/* check input */
 	if( cell==NULL || data==NULL )
@@ -2605,21 +7932,72 @@ int  nvcell_input_data(NVCELL *cell, double *data)
 ///////////////////////////    Common Math     ///////////////////////
 
 /*----------------------------------------------------
- * Generate a random double between -1 to 1 for dw[]
+ * Generate a random nnc_real_t between -1 to 1 for dw[]
+ * With nnc_rng, see nnc_set_seed(). NOT thread safe.
 ----------------------------------------------------*/
 double random_btwone(void)
 {
-	double rnd;
         struct timeval tmval;
 
-	/* rand seeds */
-        gettimeofday(&tmval,NULL);
-        srand(tmval.tv_usec);
+	/* Seed by time if NOT seeded */
+	if(!nnc_rng_seeded) {
+	        gettimeofday(&tmval,NULL);
+		nnc_set_seed((uint64_t)tmval.tv_sec*1000000+tmval.tv_usec);
+	}
+
+	return nnc_rng_btwone(&nnc_rng);
+}
+
+
+/*----------------------------------------------------
+ * Seed a xoshiro256** RNG, its state is expanded from
+ * the seed by splitmix64, so it's never all 0.
+----------------------------------------------------*/
+void nnc_rng_seed(NNC_RNG *rng, uint64_t seed)
+{
+	int i;
+	uint64_t z;
+
+	for(i=0; i<4; i++) {
+		seed += 0x9e3779b97f4a7c15ULL;
+		z=seed;
+		z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+		z=(z^(z>>27))*0x94d049bb133111ebULL;
+		rng->s[i]=z^(z>>31);
+	}
+}
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+	return (x<<k)|(x>>(64-k));
+}
 
-	while( (rnd=(double)rand()/RAND_MAX) == 1.0 );
-	rnd=rnd*2-1.0;
+/*----------------------------------------------------
+ * Next 64bits random number of a xoshiro256** RNG
+----------------------------------------------------*/
+uint64_t nnc_rng_next(NNC_RNG *rng)
+{
+	uint64_t *s=rng->s;
+	uint64_t result=rotl64(s[1]*5, 7)*9;
+	uint64_t t=s[1]<<17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3]=rotl64(s[3], 45);
+
+	return result;
+}
 
-	return rnd;
+/*----------------------------------------------------
+ * Random number in [-1 1) of a RNG, the high 53bits
+ * of nnc_rng_next() make a double in [0 1).
+----------------------------------------------------*/
+double nnc_rng_btwone(NNC_RNG *rng)
+{
+	return (nnc_rng_next(rng)>>11)*(1.0/9007199254740992.0)*2.0-1.0;
 }
 
 
@@ -2643,7 +8021,7 @@ void nvcell_print_params(const NVCELL *nvcell)
 	for( i=0; i < nvcell->nin; i++ ) {
 		printf("  %f",nvcell->dw[i]);
 	}
-	printf("   dv: %f   \n",nvcell->dv);
+	printf("   dv: %f   \n",*nvcell->dv);
 
 }
 
@@ -2706,7 +8084,7 @@ void nvnet_print_params(const NVNET *nnet)
  *		0	OK
  *		<0	fails
 ------------------------------------------------------------------------------*/
-double func_lossMSE(double out, const double tv, int token)
+nnc_real_t func_lossMSE(nnc_real_t out, const nnc_real_t tv, int token)
 {
    /* Normal func */
    if(token==NORMAL_FUNC) {
@@ -2726,6 +8104,8 @@ double func_lossMSE(double out, const double tv, int token)
  * 		-1/N*SUM{ tv[i]*log(out[i]) }  to be applied by the caller!!
  * NOTE:
  *  1. For normal func: it returns: -tv[i]*log(out[i])
+ *     It returns 0 for tv[i]==0, and clamps out[i] to NNC_REAL_MIN, so an underflowed
+ *     softmax output(0 in float32) gives a finite loss, NOT 0*inf=nan.
  *  2. For derivative func: it returns:
  *
  *   		!!!--- CAUTION ---!!!
@@ -2739,12 +8119,14 @@ double func_lossMSE(double out, const double tv, int token)
  * Return:
  *	A very big value	fails
 ------------------------------------------------------------------------------*/
-double func_lossCrossEntropy(double out, double tv, int token)
+nnc_real_t func_lossCrossEntropy(nnc_real_t out, nnc_real_t tv, int token)
 {
    /* Normal func */
    if(token==NORMAL_FUNC) {
 //	if(out<0.0001) printf("%s: out=%f, log(out)=%f\n",__func__, out, log(out));
-	return  -tv*log(out);  /* log() is ln() */
+	if(tv==0.0)
+		return 0.0;
+	return  -tv*log(out > NNC_REAL_MIN ? out : NNC_REAL_MIN);  /* log() is ln() */
    }
    /* For Derivative: It MUST combine with softMax or logSoftMax etc.
 	1.  softMax + CorssEntropy:  dE/dh=dE/dz=yi-ti
@@ -2795,11 +8177,11 @@ float func_lossCrossEntropy(float *out, float *tv, int classes, int token)
  *	true	ok, two values are close enough.
  *	false	fails
 --------------------------------------------------------*/
-bool  gradient_isclose(double da, double db)
+bool  gradient_isclose(nnc_real_t da, nnc_real_t db)
 {
-	double a=da>0?da:-da;
-	double b=db>0?db:-db;
-	double dcomp;
+	nnc_real_t a=da>0?da:-da;
+	nnc_real_t b=db>0?db:-db;
+	nnc_real_t dcomp;
 
 	/* 1. check absoute limit and compute dcomp */
 	if(a > GRADIENT_ABS_LIMIT && b > 0 ) {
@@ -2846,7 +8228,7 @@ Return:
 int func_softmax(NVLAYER *layer, int token)
 {
 	int i;
-	double fsum=0.0f;
+	nnc_real_t fsum=0.0f;
 
         /* check layer */
         if(layer==NULL || layer->nvcells==NULL)
@@ -2892,7 +8274,7 @@ int func_softmax(NVLAYER *layer, int token)
 		    used in backpropagation, otherwise this method will fail!
 
 		*/
-		double fmaxdsum;
+		nnc_real_t fmaxdsum;
 
 		/* Init fdsum */
 		if(layer->nc>0)
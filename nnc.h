@@ -11,12 +11,20 @@ Midas Zhou
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "thpool.h"
+#include "actfs.h"	/* nnc_real_t */
 
 typedef struct nerve_cell  NVCELL; 	/* neuron, or nerve cell */
 typedef struct nerve_layer NVLAYER;
 typedef struct nerve_net   NVNET;
+typedef struct nvnet_trainer NVTRAINER;
+typedef struct nnc_rng     NNC_RNG;
+typedef struct nvnet_sampler NVSAMPLER;
+typedef struct nvnet_optim NVOPTIM;
+typedef struct nvlayer_profile NVPROFILE;
 
 typedef struct conv3x3	   CONV3X3;
+typedef struct convkxk	   CONVKXK;
 typedef struct maxpool2x2  MAXPOOL2X2;
 
 
@@ -36,11 +44,11 @@ struct nerve_cell
 					 * A list of NVELL*, map to connected/input nvcells
 					 * pincells[iw*ih]
 					 */
-	double **pdin;			/* This is for Convolution nvCell, allocated in new_conv_nvcell(). HK2023-07-08
-					 * A list of double *, map to receiving data.
+	nnc_real_t **pdin;			/* This is for Convolution nvCell, allocated in new_conv_nvcell(). HK2023-07-08
+					 * A list of nnc_real_t *, map to receiving data.
 					 * pdin[iw*ih]
 					 */
-	double *douts;			/* Output values, size (iw-fs+1)*)ih-fs+1)*/
+	nnc_real_t *douts;			/* Output values, size (iw-fs+1)*)ih-fs+1)*/
 
 
 
@@ -51,28 +59,33 @@ struct nerve_cell
 				  	   Only a reference pointer here.
 					 */
 
-	double *din; 			/* (data*nin)  (h^L-1) array of input data.
+	nnc_real_t *din; 			/* (data*nin)  (h^L-1) array of input data.
 					 * Only a reference pointer here. (mem space NOT to be allocated here.)
 					 *  If the cell is in the input layer, din points to input data.
 					 *  Else NO USE!  data fetch from incells[]->dout
 					 */
-	double *prederr;		/* as flattened prev. &MAXPOOL->derr[0][0] */
+	nnc_real_t *prederr;		/* as flattened prev. &MAXPOOL->derr[0][0] */
 
 
 
   /* ----- For Common NVCELLs ----- */
 
-	double *dw;  			/* (w*nin) array of weights, mem sapce allocated in new_nvcell().  */
+	nnc_real_t *dw;  			/* (w*nin) array of weights, mem sapce allocated in new_nvcell().
+					 * Allocated as dw[nin+1], dw[nin] holds the bias, see dv.
+					 * After nvnet_pack_params(), dw points into the NVNET parameter arena.
+					 */
 
 	bool   ignore_dv;		/* Ignore bias, For example: a convolution ncell. HK2023-07-08 */
-	double dv;			/* (b) bias value */
+	nnc_real_t *dv;			/* (b) Pointer to bias value, ALWAYS as &dw[nin] */
+
+	bool   in_arena;		/* dw[]/dv are slices of NVNET->parena, NOT to be freed by free_nvcell() */
 
 	/* Pooling operations: like Max(), Min(), or Average(). HK2023-07-08 */
-	double (*pool)(double*, int);
+	nnc_real_t (*pool)(nnc_real_t*, int);
 
-	double dsum;			/* (u) sum of x1*w1+x2*w2+x3*w3+....+xn*wn -dv */
+	nnc_real_t dsum;			/* (u) sum of x1*w1+x2*w2+x3*w3+....+xn*wn -dv */
 
-	double (*transfunc)(double, double, int); /* pointer to a NVCELL transfer function (also include derivative part)
+	nnc_real_t (*transfunc)(nnc_real_t, nnc_real_t, int); /* pointer to a NVCELL transfer function (also include derivative part)
 						   * If NULL, then f(x)=x! as nvcell->dout=nvcell->dsum <-------- NOTICED~!!!
 
 									!!!---- CAUTION ----!!!
@@ -82,11 +95,11 @@ struct nerve_cell
 						      learning process will fail (NOT converge)!
 						   */
 
-	double dout;			/* (h^L) dz, output value, dout=transfunc(dsum)
+	nnc_real_t dout;			/* (h^L) dz, output value, dout=transfunc(dsum)
 					 * If transfunc==NULL, then dout==dsum!!!   see in nvcell_feed_forward()
 					 */
 
-	double derr;			/* current nvcell's dE/du, updated in feedback process.
+	nnc_real_t derr;			/* current nvcell's dE/du, updated in feedback process.
 					  1. In backpropagation, it temporarily stores dE/dh(=next layer' dE/dxi). then dE/du=dE/dh*f'(u).
 			   		  2. For non_output layer, after feedback calculation:
 				derr=dE/du=f'(u)*SUM(dE/du*w), wereh SUM(dE/du*w)=backfeeded(back propagated) from the next layer cell
@@ -96,6 +109,17 @@ struct nerve_cell
 					*/
 };
 
+/* Convolution engines for CONV3X3, see conv3x3_set_engine() */
+enum conv3x3_engine {
+	CONV3X3_ENGINE_DIRECT = 0,	/* Direct loops, default */
+	CONV3X3_ENGINE_IM2COL,		/* im2col patch matrix + blocked GEMM */
+	CONV3X3_ENGINE_WINOGRAD,	/* Winograd F(2x2,3x3) feed forward */
+	CONV3X3_ENGINE_NCHWC,		/* Channel-blocked din/fparams, CONV3X3_CBLK channels per pixel */
+};
+
+/* Channels interleaved per pixel in the blocked layout of CONV3X3_ENGINE_NCHWC */
+#define CONV3X3_CBLK	8
+
 /*-------------------------------------------------------
 Note:
 
@@ -117,17 +141,19 @@ struct conv3x3
 	//unsigned int stride;  /* ALWAYS ==1, Stride */
 	//mode=valid_padding;
 
-	double*** fparams;	/* Array of all filter parameters/data, nf*nchan*9*sizeof(double), calloc in new_conv3x3()
+	nnc_real_t*** fparams;	/* Array of all filter parameters/data, nf*nchan*9*sizeof(nnc_real_t), calloc in new_conv3x3()
 				 * fparams[filter_index][chan_index][param_index(0 ~ 3*3-1)]
 				 * Data in row_major.
+				 * 		!!!--- IMPORTANT ---!!!
+				 * fparams[0][0] holds whole mem space! ---> Flattened fparams: (nnc_real_t *)(&fparams[0][0][0])
 				 * Also see conv3x3_rand_params()
 				 */
 
-	double *dvs;		/* Bias, dvs[filter_index]
+	nnc_real_t *dvs;		/* Bias, dvs[filter_index]
 				 * If NULL, to be ignored.
 				 * To allocate dferr TOGETHER.
 				 */
-	double *dferr;		/* ---- Combined with dvs[] ----
+	nnc_real_t *dferr;		/* ---- Combined with dvs[] ----
 				   Ref. to derr, this is temp. array, just to facilitate computing dvs[findex]=-rate*dferr[findex]
 				   dferr[filter_index] = SUM{ derr[filter_index][:] }
 				   see in conv3x3_feed_backward() and nvnet_update_params()
@@ -135,50 +161,142 @@ struct conv3x3
 				 */
 
 
-	double***dFP;		/* dE/dFP(Filter_Parameter),  dFP[filter_index][chan_index][param_index(0 ~ (3*3-1))]    HK2023-07-11
+	nnc_real_t***dFP;		/* dE/dFP(Filter_Parameter),  dFP[filter_index][chan_index][param_index(0 ~ (3*3-1))]    HK2023-07-11
 				 * This for updating fparams: fparams[nf][chan][x] += -learRate*dFP[nf][chan][x]
 				 * XXX It SHOULD be updated after each backfeed opeartion, before updating fparams.
 				 * To be cleared and updated at conv3x3_feed_backward().
+				 * dFP[0][0] holds whole mem space, same as fparams.
 				 */
 
+	bool in_arena;		/* fparams/dvs/dFP/dferr are slices of NVNET->parena, see nvnet_pack_params() */
+	bool infer_only;	/* Inference only: NO dFP/dferr/derr, dsums==douts, see nnc_set_inference() */
+
 	unsigned int imw,imh;	/* Original(Input) image(or other data) width/height */
 	//unsigned int fs==3;	/* Filter size, 3,5,7 etc. */
 
 	unsigned int ow,oh;	/* w,h for douts, w=imw-fs+1, h=imh-fs+1, (imw-2,imh-2) */
 
-	double *din;		/* Pointer to input image data, size imw*imh*nchan, row-major
+	nnc_real_t *din;		/* Pointer to input image data, size imw*imh*nchan, row-major
 				 * If connects to a MAXPOOL2x2 outputs, it should be flattened data (pointer).
 				 */
+	const uint8_t *din8;	/* If NOT NULL, uint8 input data for the first layer, normalized as din8[k]*din8_scale
+				 * on the fly. Then din points to din8buf, see nvnet_set_input_u8().
+				 */
+	nnc_real_t din8_scale;	/* Scale to normalize din8 */
+	nnc_real_t *din8buf;	/* din8 normalized, size nchan*imw*imh. Filled in feed forward by the direct/Winograd
+				 * engines, the im2col engine lowers din8 to cols directly.
+				 */
 
-	double **prederr;	/* For feeding back derr, Example: flattened prev. maxpool->derr.
+	nnc_real_t **prederr;	/* For feeding back derr, Example: flattened prev. maxpool->derr.
 				 * This is ONLY a ref. pointer.
 			         * Array size and channels MUST be same as din.
 				 * TODO: NOT applied yet!, and its corresponding **derr MUST BE allocated flatten-friendly?
 				 */
 
-	double **dsums;		/* Convolution sums,size= nf*(imw-2)*(imh-2)  HK2023-08-08
+	nnc_real_t **dsums;		/* Convolution sums,size= nf*(imw-2)*(imh-2)  HK2023-08-08
 				 * dsums[]/douts[] to be cleared and updated at conv3x3_feed_forward().
 				 */
-	double **douts;		/* Convolution output as results of transfunc(dsums,,), size= nf*(imw-2)*(imh-2)
+	nnc_real_t **douts;		/* Convolution output as results of transfunc(dsums,,), size= nf*(imw-2)*(imh-2)
 				 * Stored as results of the last forward operations, for next backprop operation.
 				 * douts[filter_index][0 ~ (imw-2)*(imh-2)-1], row-major
 
 				 * 		!!!--- IMPORTANT ---!!!
-				 * douts[0] holds whole mem space! -------> Flattened douts:  (double *)(&douts[0][0])
+				 * douts[0] holds whole mem space! -------> Flattened douts:  (nnc_real_t *)(&douts[0][0])
 				 * dsums[]/douts[] to be cleared and updated at conv3x3_feed_forward().
 				 */
 
 
-        double (*transfunc)(double, double, int); /* pointer to a transfer function (also include derivative part) */
+        nnc_real_t (*transfunc)(nnc_real_t, nnc_real_t, int); /* pointer to a transfer function (also include derivative part) */
 				/*   !!!--- CAUTION --- !!!
 				 * TODO: Here douts[](as x) also to store h=f(x)
   				 * so transfunc(x,f,DERIVATIVE) MUST be irrelevant with f! Example: func_ReLU
 				 *
 				 */
-	double **derr;		/* dE/du dLoss/dOut  derr[filter_index][0 ~ (imw-2)*(imh-2)-1]
+
+	int engine;		/* enum conv3x3_engine, set by conv3x3_set_engine() */
+	nnc_real_t *cols;		/* CONV3X3_ENGINE_IM2COL: im2col patch matrix cols[nchan*9][ow*oh]
+				 * cols[chan*9+ii*3+jj][i*ow+j] = din[chan*imw*imh+(i+ii)*imw+j+jj]
+				 * Updated in forward, and reused in backward for dFP.
+				 */
+	nnc_real_t *gout;		/* CONV3X3_ENGINE_IM2COL: G[nf][ow*oh]=derr*f'(u), in backward */
+	nnc_real_t *dcols;		/* CONV3X3_ENGINE_IM2COL: W^T*G [nchan*9][ow*oh], in backward, col2im to prederr */
+	nnc_real_t *wgU;		/* CONV3X3_ENGINE_WINOGRAD: filter transforms U[nf][nchan][4x4] */
+	nnc_real_t *wgV;		/* CONV3X3_ENGINE_WINOGRAD: input tile transforms V[nchan][4x4] */
+	bool wgU_valid;		/* wgU is up to date with fparams, reset when fparams change */
+	nnc_real_t *cbin;		/* CONV3X3_ENGINE_NCHWC: channel-blocked din, cbin[ncb][imh][imw][CONV3X3_CBLK],
+				 * ncb=(nchan+CONV3X3_CBLK-1)/CONV3X3_CBLK, channels >=nchan are 0.
+				 * Packed in forward, and reused in backward for dFP.
+				 */
+	nnc_real_t *cbw;		/* CONV3X3_ENGINE_NCHWC: channel-blocked fparams, cbw[nf][ncb][9][CONV3X3_CBLK] */
+	bool cbw_valid;		/* cbw is up to date with fparams, reset when fparams change, as wgU_valid */
+	nnc_real_t *cberr;		/* CONV3X3_ENGINE_NCHWC: channel-blocked prederr as cbin, in backward */
+	int ntperr;		/* Number of private prederr buffers, for filter tasks, see nnc_set_threads() */
+	nnc_real_t *tperr;		/* Private prederr buffers, ntperr*nchan*imw*imh */
+	nnc_real_t **tperrp;	/* tperrp[ntperr*nchan], pointers to channels of tperr */
+	MAXPOOL2X2 *outpool;	/* The MAXPOOL2X2 fused in, during conv3x3_maxpool2x2_feed_forward() ONLY */
+	nnc_real_t **derr;		/* dE/du dLoss/dOut  derr[filter_index][0 ~ (imw-2)*(imh-2)-1]
 				   1. In backpropagation, it temporarily stores dE/dh(=next layer' dE/dxi).
 				      dE/du=dE/dh*f'(u)=dE/dh, here f(u)=u, f'(u)=1.
 				   2. Reset/clear at nvnet_feed_backward(), before feeding backward.
+				   3. derr[0] holds whole mem space, flatten-friendly.
+				 */
+};
+
+
+/*-------------------------------------------------------
+Note:
+1. A convolution layer with kernel size ks, stride and zero
+   padding pad, valid for the padded image:
+   OW=(W+2*pad-ks)/stride+1; OH=(H+2*pad-ks)/stride+1
+
+2. A stride-2 CONVKXK downsamples as CONV3X3+MAXPOOL2X2, at
+   a quarter of convolution compute.
+
+3. Computed as im2col+GEMM, see convkxk_feed_forward().
+*------------------------------------------------------*/
+struct convkxk
+{
+	unsigned int nchan;	/* >0,  Number of filter/input channels */
+	unsigned int nf;	/* >0, Number of filters */
+	unsigned int ks;	/* >0, Kernel size, filter ks*ks */
+	unsigned int stride;	/* >0, Stride */
+	unsigned int pad;	/* Zero padding on each side, <ks */
+
+	nnc_real_t *fparams;	/* All filter parameters, fparams[nf][nchan*ks*ks], flattened, calloc in new_convkxk()
+				 * fparams[findex*K+chan*ks*ks+ii*ks+jj], K=nchan*ks*ks, as W of the GEMM.
+				 */
+	nnc_real_t *dvs;		/* Bias, dvs[filter_index], If NULL, to be ignored. To allocate dferr TOGETHER. */
+	nnc_real_t *dferr;		/* dferr[filter_index] = SUM{ derr*f'(u) }, see convkxk_feed_backward() */
+	nnc_real_t *dFP;		/* dE/dfparams, dFP[nf][nchan*ks*ks], cleared and updated in convkxk_feed_backward() */
+
+	bool in_arena;		/* fparams/dvs/dFP/dferr are slices of NVNET->parena, see nvnet_pack_params() */
+	bool infer_only;	/* Inference only: NO dFP/dferr/derr/gout/dcols, dsums==douts, see nnc_set_inference() */
+
+	unsigned int imw,imh;	/* Input image width/height, NOT padded */
+	unsigned int ow,oh;	/* w,h for douts, ow=(imw+2*pad-ks)/stride+1, oh=(imh+2*pad-ks)/stride+1 */
+
+	nnc_real_t *din;		/* Pointer to input data, size nchan*imw*imh, row-major */
+	const uint8_t *din8;	/* If NOT NULL, uint8 input data for the first layer, see nvnet_set_input_u8() */
+	nnc_real_t din8_scale;	/* Scale to normalize din8 */
+	nnc_real_t *din8buf;	/* din8 normalized, size nchan*imw*imh, din points to it */
+
+	nnc_real_t **prederr;	/* For feeding back derr, Example: derr of the previous layer.
+				 * This is ONLY a ref. pointer, size nchan*imw*imh.
+				 */
+
+	nnc_real_t **dsums;		/* Convolution sums, dsums[nf][ow*oh], dsums[0] holds whole mem space */
+	nnc_real_t **douts;		/* Outputs transfunc(dsums), douts[nf][ow*oh], douts[0] holds whole mem space */
+
+        nnc_real_t (*transfunc)(nnc_real_t, nnc_real_t, int); /* pointer to a transfer function, as CONV3X3 */
+
+	nnc_real_t *cols;		/* im2col patch matrix cols[K][ow*oh], zeros for padding.
+				 * Updated in forward, and reused in backward for dFP.
+				 */
+	nnc_real_t *gout;		/* G[nf][ow*oh]=derr*f'(u), in backward */
+	nnc_real_t *dcols;		/* W^T*G [K][ow*oh], in backward, col2im to prederr */
+
+	nnc_real_t **derr;		/* dE/dh, derr[nf][ow*oh], derr[0] holds whole mem space.
+				 * Reset/clear at nvnet_feed_backward(), before feeding backward.
 				 */
 };
 
@@ -199,23 +317,30 @@ struct maxpool2x2
 	unsigned int imw, imh;	/* Input data size width/height */
 	unsigned int ow, oh;	/* data width/height, w=inw//2, h=inh//2, or  w(h)=(inconv3x3->imw(imh)-2)//2 */
 
-	double **din;		/* Pointer to input data, size nf*inw*inh,  USUALLY as conv3x3->douts[][] */
-//	double *prederr;	/* For feeding back derr, Example: flattened prev. conv3x3->derr */
+	nnc_real_t **din;		/* Pointer to input data, size nf*inw*inh,  USUALLY as conv3x3->douts[][] */
+//	nnc_real_t *prederr;	/* For feeding back derr, Example: flattened prev. conv3x3->derr */
 			        /* Array size MUST be same as din
 				 * TODO: NOT applied yet!, and its corresponding **derr MUST BE allocated flatten-friendly.
 				 */
 
-	double **douts;		/* maxpool2x2 output, size= w * h *nf, in row-major
+	nnc_real_t **douts;		/* maxpool2x2 output, size= w * h *nf, in row-major
 				 * Stored as results of the last forward operations, for next backprop operation.
 				 * douts[filter_index][data_index(0 ~ w*h-1)]
 				 * 		!!!--- IMPORTANT ---!!!
-				 * douts[0] holds whole mem space! -------> Flattened douts:  (double *)(&douts[0][0])
+				 * douts[0] holds whole mem space! -------> Flattened douts:  (nnc_real_t *)(&douts[0][0])
 				 */
 
-	double **derr;		/* dE/du  dLoss/dOut derr[filter_index][0 ~ ow*oh-1]
+	bool infer_only;	/* Inference only: NO derr, see nnc_set_inference() */
+
+	uint8_t *argmax;	/* Position of the max. in each 2x2 block, argmax[nf*ow*oh]=ii*2+jj.
+				 * NULL for inference only. See conv3x3_maxpool2x2_feed_forward().
+				 */
+
+	nnc_real_t **derr;		/* dE/du  dLoss/dOut derr[filter_index][0 ~ ow*oh-1]
 				   1. In backpropagation, it temporarily stores dE/dh(=next layer' dE/dxi).
 				      dE/du=dE/dh*f'(u)=dE/dh, here f(u)=u; f'(u)=1.
 				   2. Reset/clear at nvnet_feed_backward(), before feeding backward.
+				   3. derr[0] holds whole mem space, flatten-friendly.
 				 */
 };
 
@@ -226,6 +351,7 @@ struct nerve_layer
 
 	/* ------- For Convolution Layer --------- */
 	CONV3X3	*conv3x3;	 /* Pointer to a 3x3 convolution layer */
+	CONVKXK *convkxk;	 /* Pointer to a kxk convolution layer, with stride and padding */
 	MAXPOOL2X2 *maxpool2x2;	 /* Pointer to a 2x2 max pooling layer */
 
 
@@ -245,50 +371,197 @@ struct nerve_layer
 					      learning process will fail!
 
                                             */
-	double *douts;		/* For the output layer, to store transfunc results! HK2023-06-19
+	nnc_real_t *douts;		/* For the output layer, to store transfunc results! HK2023-06-19
 				 * In this case, nvcell->dout stores u value.
 				 * Calloc in new_nvlayer()
 				 */
+
+	/* ------- Tensor mode, for a fully-connected Neurion Layer ------- */
+	bool dense;		/* All nvcells share the same incells/din, and their dw[]/dv are packed row by row
+				 * in the NVNET parameter arena, as a row-major matrix W[nc][nin+1] (bias in the last column).
+				 * Then the layer is computed as ONE GEMV, see nvlayer_dense_feed_forward().
+				 * Set by nvnet_pack_params().
+				 */
+	nnc_real_t *dins;		/* Tensor mode: input vector x[nin], gathered from nvcells[0]->incells[]->dout.
+				 * If nvcells[0]->din is used, then NO need.
+				 */
+
+	/* ------- For the first Neurion Layer, with uint8 input data ------- */
+	const uint8_t *din8;	/* If NOT NULL, nvcells[]->din point to din8buf, and din8buf[k]=din8[k]*din8_scale
+				 * is updated in feed forward. See nvnet_set_input_u8().
+				 */
+	nnc_real_t din8_scale;	/* Scale to normalize din8 */
+	nnc_real_t *din8buf;	/* din8 normalized, din8buf[nvcells[0]->nin] */
 };
 
 
+/* Regions of the NVNET parameter arena, each region has npa doubles, see nvnet_pack_params() */
+enum nvnet_arena_region {
+	NVNET_ARENA_PARAMS = 0,		/* Weights and bias: CONV3X3/CONVKXK fparams/dvs, NVCELL dw[]/dv */
+	NVNET_ARENA_GRADS,		/* Gradients: CONV3X3/CONVKXK dFP/dferr, at the same offsets as their params */
+	NVNET_ARENA_MMTS,		/* Momentums, at the same offsets as their params */
+	NVNET_ARENA_ACCUM,		/* Accumulated dE/dparam for mini-batch, see nvnet_accum_dparams() */
+	NVNET_ARENA_REGIONS		/* Number of regions */
+};
+
 struct nerve_net
 {
 	unsigned int nl;			/* number of NVLAYER in the net */
+	bool infer_only;	/* Inference only: the arena has ONLY the PARAMS region, see nnc_set_inference() */
 	NVLAYER * *nvlayers;     /*  array of nervers for the net, calloc in new_nvnet(). */
 
+	unsigned long npa;	/* total number of trainable params in the net, as size of each arena region */
+	unsigned long narena;	/* size of parena, in doubles. NO PARAMS region if params are mapped, see nvnet_pack_mapped_params() */
+	nnc_real_t *parena;		/* Parameter arena, ONE block of NVNET_ARENA_REGIONS*npa doubles, calloc in nvnet_pack_params().
+				 * In order of layers, then cells:
+				 *   CONV3X3:  fparams[nf][nchan][9], dvs[nf]
+				 *   CONVKXK:  fparams[nf][nchan*ks*ks], dvs[nf]
+				 *   NVCELL:   dw[0]...dw[nin-1], dv
+				 * All NVCELL dw/dv and CONV3X3/CONVKXK fparams/dvs/dFP/dferr are sliced from it.
+				 */
+	nnc_real_t *pparams;	/* = parena+NVNET_ARENA_PARAMS*npa, or mapped params. NOT NULL once packed */
+	nnc_real_t *pgrads;		/* = parena+NVNET_ARENA_GRADS*npa */
+	nnc_real_t *paccum;		/* = parena+NVNET_ARENA_ACCUM*npa, paccum[k] is for pparams[k] */
+	unsigned int nacc;	/* number of samples accumulated in paccum[] */
+
 	unsigned long np;	/* total numbers of params in the net */
-	double *params;		/* for buffing params of all cells in the nvnet,
+	nnc_real_t *params;		/* for buffing params of all cells in the nvnet,
 				 * WARNING: write and read MUST follow the same sequence!!!
-				 * params are buffed cell by cell, in order of: dw[], dv, dsum, dout, derr
+				 * params are buffed as: pparams[npa], then cell by cell: dsum, dout, derr
 				*/
 	unsigned long nmp;	/* total nmbers of mmts of all params, dw[] and dv */
-	double *mmts; 		/* momentums of all corresponding params
-				 * WARNING: write and read MUST follow the same sequence!!!
+	nnc_real_t *mmts; 		/* momentums of all corresponding params, = parena+NVNET_ARENA_MMTS*npa
+				 * mmts[k] is for pparams[k].
+				 */
+
+	unsigned long nbsize;	/* size of bbuf, in doubles */
+	nnc_real_t *bbuf;		/* Working buffer for nvnet_feed_forward_batch(), realloc as needed:
+				 * bouts[2][nb*max_outsize] ping-pong layer outputs, then CONV3X3 cols/sums.
 				 */
+
+	void *pmap;		/* Mmaped model file, pparams points into it, see nvnet_load(). munmap in free_nvnet() */
+	unsigned long mapsize;	/* size of pmap, in bytes */
+
+	NVPROFILE *profile;	/* profile[nl], per-layer profile. Calloc in new_nvnet() ONLY if built with NNC_PROFILE,
+				 * see nvnet_get_profile().
+				 */
+};
+
+
+/* Phases of a nvlayer to profile */
+enum nvprof_phase {
+	NVPROF_FORWARD = 0,	/* In nvnet_feed_forward() */
+	NVPROF_BACKWARD,	/* In nvnet_feed_backward() */
+	NVPROF_UPDATE,		/* In nvnet_update_params(), OR nvnet_accum_dparams() and nvoptim_step()/nvnet_apply_dparams() */
+	NVPROF_PHASES		/* Number of phases */
+};
+
+/* Profile of a nvlayer, see nvnet_get_profile() */
+struct nvlayer_profile
+{
+	unsigned long calls[NVPROF_PHASES];	/* Number of calls */
+	double ns[NVPROF_PHASES];		/* Wall time in ns, by CLOCK_MONOTONIC */
+	double flops[NVPROF_PHASES];		/* Flops, a multiply-add counts 2 */
+};
+
+
+/* Data-parallel trainer, see new_nvtrainer() */
+struct nvnet_trainer
+{
+	NVNET *nnet;		/* The nvnet to train, params are updated here */
+	int nt;			/* Number of threads, each has a replica */
+	NVNET **replicas;	/* replicas[nt], sharing params of nnet, see nvnet_new_replica() */
+	nnc_real_t *errs;		/* errs[nt], sum of loss of each replica for the batch */
+	THPOOL *pool;		/* nt-1 threads, the caller thread runs as the last one */
+
+	/* Current batch, see nvtrainer_train_batch() */
+	const nnc_real_t *din;
+	const nnc_real_t *tv;
+	unsigned int nb;
+	unsigned int insize;	/* Input size of one sample */
+	unsigned int tvsize;	/* Size of teacher values of one sample */
+	nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int);
+
+	NVOPTIM *optim;		/* Optimizer of nnet to update params, NULL for SGD by nvnet_apply_dparams() */
+};
+
+
+/* xoshiro256** random number generator, see nnc_rng_seed() */
+struct nnc_rng
+{
+	uint64_t s[4];		/* State, NOT all 0 */
+};
+
+
+/* Epoch sampler, see new_nvsampler() */
+struct nvnet_sampler
+{
+	unsigned int count;	/* Number of samples in an epoch */
+	unsigned int *order;	/* order[count], a permutation of 0..count-1 for the current epoch */
+	unsigned int epoch;	/* Number of epochs shuffled */
+	NNC_RNG rng;
+};
+
+
+/* Optimizers, see new_nvoptim() */
+enum nvoptim_type {
+	NVOPTIM_SGD = 0,	/* p -= rate*g */
+	NVOPTIM_MOMENTUM,	/* m=mu*m-rate*g,  p += m */
+	NVOPTIM_NESTEROV,	/* m=mu*m-rate*g,  p += mu*m-rate*g */
+	NVOPTIM_RMSPROP,	/* v=rho*v+(1-rho)*g^2,  p -= rate*g/(sqrt(v)+eps) */
+	NVOPTIM_ADAM,		/* m=b1*m+(1-b1)*g, v=b2*v+(1-b2)*g^2,  p -= rate_t*m/(sqrt(v)+eps) */
+};
+
+/* Optimizer of a nvnet, it updates all params in the arena with gradients in nnet->paccum */
+struct nvnet_optim
+{
+	NVNET *nnet;
+	int type;		/* enum nvoptim_type */
+	double mu;		/* MOMENTUM/NESTEROV: momentum,  default 0.9 */
+	double beta1;		/* ADAM: decay of m, default 0.9 */
+	double beta2;		/* ADAM: decay of v, default 0.999. RMSPROP: rho, default 0.9 */
+	double eps;		/* RMSPROP/ADAM: default 1.0e-8 */
+	unsigned long step;	/* Number of updates, for bias correction of ADAM */
+
+	unsigned long npa;	/* As nnet->npa */
+	nnc_real_t *state;	/* ONE block of 2*npa, 64 bytes aligned, zeroed */
+	nnc_real_t *m;		/* = state, 1st moments(velocities), m[k] is for nnet->pparams[k] */
+	nnc_real_t *v;		/* = state+npa, 2nd moments */
 };
 
 
 /* Function declaration */
 /* nvcell */
 NVCELL *new_nvcell( unsigned int nin, NVCELL * const *incells,
-			double *din, double *dw, double bias, double (*transfer)(double, double, int ) );
+			nnc_real_t *din, nnc_real_t *dw, nnc_real_t bias, nnc_real_t (*transfer)(nnc_real_t, nnc_real_t, int ) );
 void free_nvcell(NVCELL *ncell);
 int nvcell_rand_dwv(NVCELL *ncell);
 int nvcell_feed_forward(NVCELL *nvcell);
 int nvcell_feed_backward(NVCELL *nvcell);
-int nvcell_input_data(NVCELL *cell, double *data);
+int nvcell_input_data(NVCELL *cell, nnc_real_t *data);
 
 /* conv3x3 */
-CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigned int w, unsigned int h, double *din, bool withBias);
+CONV3X3  *new_conv3x3(unsigned int numFilters, unsigned int numChannels, unsigned int w, unsigned int h, nnc_real_t *din, bool withBias);
 void free_conv3x3(CONV3X3 *conv3);
 void conv3x3_print_params(CONV3X3 *conv3);
 int conv3x3_rand_params(CONV3X3 *conv3);
+int conv3x3_set_engine(CONV3X3 *conv3, int engine);
+int conv3x3_check_winograd(CONV3X3 *conv3, double tol);
+int conv3x3_check_fusion(CONV3X3 *conv3, MAXPOOL2X2 *maxpool, double tol);
 int conv3x3_feed_forward(CONV3X3 *conv3);
 int conv3x3_feed_backward(CONV3X3 *conv3);
+int conv3x3_maxpool2x2_feed_forward(CONV3X3 *conv3, MAXPOOL2X2 *maxpool);
+
+/* convkxk */
+CONVKXK *new_convkxk(unsigned int numFilters, unsigned int numChannels, unsigned int imw, unsigned int imh,
+		     unsigned int ks, unsigned int stride, unsigned int pad, nnc_real_t *din, bool withBias);
+void free_convkxk(CONVKXK *convk);
+int convkxk_rand_params(CONVKXK *convk);
+int convkxk_feed_forward(CONVKXK *convk);
+int convkxk_feed_backward(CONVKXK *convk);
 
 /* maxpool2x2 */
-MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsigned int imw, unsigned int imh,  double **din);
+MAXPOOL2X2  *new_maxpool2x2( CONV3X3 *pinconv3x3, unsigned int numFilters, unsigned int imw, unsigned int imh,  nnc_real_t **din);
 void free_maxpool2x2(MAXPOOL2X2 *maxpool);
 //int maxpool2x2_rand_params(MAXPOOL2X2 *maxpool);
 int maxpool2x2_feed_forward(MAXPOOL2X2 *maxpool);
@@ -297,32 +570,67 @@ int maxpool2x2_feed_backward(MAXPOOL2X2 *maxpool);
 /* nvlayers */
 NVLAYER *new_nvlayer(unsigned int nc, const NVCELL *template_cell, bool layerTransfuncDefined);
 void free_nvlayer(NVLAYER *layer);
-NVLAYER *new_conv_nvlayer( NVCELL * const *incells, double *din, unsigned int iw, unsigned ih, unsigned int nf, unsigned int fs);
+NVLAYER *new_conv_nvlayer( NVCELL * const *incells, nnc_real_t *din, unsigned int iw, unsigned ih, unsigned int nf, unsigned int fs);
 
-int nvlayer_load_params(NVLAYER *layer, double *weights, double *bias);
-int nvlayer_link_inputdata(NVLAYER *layer, double *data);
+int nvlayer_load_params(NVLAYER *layer, nnc_real_t *weights, nnc_real_t *bias);
+int nvlayer_link_inputdata(NVLAYER *layer, nnc_real_t *data);
 int nvlayer_feed_forward(NVLAYER *layer);
-double nvlayer_mean_loss(NVLAYER *outlayer, const double *tv,
-                        double (*loss_func)(double out, const double tv, int token) );
+nnc_real_t nvlayer_mean_loss(NVLAYER *outlayer, const nnc_real_t *tv,
+                        nnc_real_t (*loss_func)(nnc_real_t out, const nnc_real_t tv, int token) );
 int nvlayer_feed_backward(NVLAYER *layer);
 
 
 /* nvnet */
 NVNET *new_nvnet(unsigned int nl);
 //int nvnet_feed_forward(NVNET *nnet);
+int nvnet_pack_params(NVNET *nnet);
+int nvnet_pack_mapped_params(NVNET *nnet, nnc_real_t *pparams, unsigned long npa);
+int nvnet_map_params(NVNET *nnet, nnc_real_t *pparams);
+unsigned long nvnet_mem_footprint(const NVNET *nnet);
+const NVPROFILE *nvnet_get_profile(const NVNET *nnet);
+void nvnet_reset_profile(NVNET *nnet);
+void nvnet_print_profile(const NVNET *nnet);
 int nvnet_init_params(NVNET *nnet);
-double nvnet_feed_forward(NVNET *nnet, const double *tv,
-                          double (*loss_func)(double, const double, int) );
+nnc_real_t nvnet_feed_forward(NVNET *nnet, const nnc_real_t *tv,
+                          nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int) );
+int nvnet_feed_forward_batch(NVNET *nnet, const nnc_real_t *din, unsigned int nb, nnc_real_t *dout);
+unsigned int nvnet_input_size(const NVNET *nnet);
+void nvnet_set_input(NVNET *nnet, const nnc_real_t *din);
+int nvnet_set_input_u8(NVNET *nnet, const uint8_t *din8, nnc_real_t scale);
+unsigned int nvnet_batch_insize(const NVNET *nnet, int k);
 int nvnet_feed_backward(NVNET *nnet);
 
 int nvnet_update_params(NVNET *nnet, double rate);
 //int nvnet_mmtupdate_params(NVNET *nnet, double rate);
 int nvnet_mmtupdate_params(NVNET *nnet, double rate, double mfrict);
+int nvnet_accum_dparams(NVNET *nnet);
+int nvnet_apply_dparams(NVNET *nnet, double rate);
+NVNET *nvnet_new_replica(NVNET *nnet);
+
+/* nvtrainer */
+NVTRAINER *new_nvtrainer(NVNET *nnet, int nt);
+void free_nvtrainer(NVTRAINER *trainer);
+nnc_real_t nvtrainer_train_batch(NVTRAINER *trainer, const nnc_real_t *din, const nnc_real_t *tv, unsigned int nb,
+			     nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int), double rate);
+
+/* nvsampler */
+NVSAMPLER *new_nvsampler(unsigned int count, uint64_t seed);
+void free_nvsampler(NVSAMPLER *sampler);
+const unsigned int *nvsampler_next_epoch(NVSAMPLER *sampler);
+
+/* nvoptim */
+NVOPTIM *new_nvoptim(NVNET *nnet, int type);
+void free_nvoptim(NVOPTIM *optim);
+void nvoptim_reset(NVOPTIM *optim);
+int nvoptim_step(NVOPTIM *optim, double rate);
 
 int nvnet_buff_params(NVNET *nnet);
 int nvnet_restore_params(NVNET *nnet);
-int nvnet_check_gradient(NVNET *nnet, const double *tv,
-                        double (*loss_func)(double, const double, int) );
+int nvnet_check_gradient(NVNET *nnet, const nnc_real_t *tv,
+                        nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int) );
+int nvnet_check_gradient_sampled(NVNET *nnet, const nnc_real_t *tv,
+			nnc_real_t (*loss_func)(nnc_real_t, const nnc_real_t, int),
+			unsigned long nprobe, int nt, uint64_t seed);
 void free_nvnet(NVNET *nnet);
 
 /* set param */
@@ -330,8 +638,19 @@ void free_nvnet(NVNET *nnet);
 void  nnc_set_param(double learn_rate, double dmfric);
 void nnc_set_learnrate(double learn_rate);
 void nnc_set_mfrict(double mfric);
+bool nnc_set_simd(bool enable);
+int nnc_set_threads(int nth);
+bool nnc_set_inference(bool enable);
+bool nnc_set_fusion(bool enable);
+void nnc_cpu_dispatch(void);
+void nnc_set_seed(uint64_t seed);
 double random_btwone(void);
 
+/* random numbers */
+void nnc_rng_seed(NNC_RNG *rng, uint64_t seed);
+uint64_t nnc_rng_next(NNC_RNG *rng);
+double nnc_rng_btwone(NNC_RNG *rng);
+
 /* print params */
 void nvcell_print_params(const NVCELL *nvcell);
 void nvlayer_print_params(const NVLAYER *layer);
@@ -339,12 +658,12 @@ void nvnet_print_params(const NVNET *nnet);
 
 
 /* loss func */
-double func_lossMSE(double out, const double tv, int token);
-double func_lossCrossEntropy(double out, double tv, int token);
-//double func_lossCrossEntropy(double *out, double *tv, int classes, int token);
+nnc_real_t func_lossMSE(nnc_real_t out, const nnc_real_t tv, int token);
+nnc_real_t func_lossCrossEntropy(nnc_real_t out, nnc_real_t tv, int token);
+//nnc_real_t func_lossCrossEntropy(nnc_real_t *out, nnc_real_t *tv, int classes, int token);
 
 /* others */
-bool  gradient_isclose(double da, double db);
+bool  gradient_isclose(nnc_real_t da, nnc_real_t db);
 
 /* NVLAYER transfer/activation functions */
 int func_softmax(NVLAYER *layer, int token);
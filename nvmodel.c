@@ -0,0 +1,682 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Store and deploy NVNET models, see nvmodel.h for the file format.
+
+Journal:
+2026-10-17:
+   1. Create nvnet_save(), nvnet_load().
+   2. Save/load CONVKXK layers, ks/stride/pad in the engine field.
+   3. NVMODEL_VERSION 2 for CONVKXK layers, nvnet_load() reads version 1 and 2.
+2026-10-18:
+   1. nvnet_load() checks input size of each layer against its src layer, and insize.
+   2. nvnet_load() with use_mmap packs params by nvnet_pack_mapped_params(), NO private copy.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include "nvmodel.h"
+#include "actfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* Transfer functions of CONV3X3/NVCELL, saved by name */
+static const struct {
+	const char *name;
+	nnc_real_t (*func)(nnc_real_t, nnc_real_t, int);
+} nvmodel_funcs[] = {
+	{ "step",	func_step },
+	{ "sigmoid",	func_sigmoid },
+	{ "TanSigmoid",	func_TanSigmoid },
+	{ "ReLU",	func_ReLU },
+	{ "PReLU",	func_PReLU },
+};
+
+/* Transfer functions of NVLAYER, saved by name */
+static const struct {
+	const char *name;
+	int (*func)(NVLAYER *, int);
+} nvmodel_lfuncs[] = {
+	{ "softmax",	func_softmax },
+};
+
+#define NVMODEL_NFUNCS	(sizeof(nvmodel_funcs)/sizeof(nvmodel_funcs[0]))
+#define NVMODEL_NLFUNCS	(sizeof(nvmodel_lfuncs)/sizeof(nvmodel_lfuncs[0]))
+
+
+/*-------------------------------------------------
+ * Get name of a transfer function.
+ * Return:
+ *	0	OK, name is "" for NULL.
+ *	<0	Unknown function.
+--------------------------------------------------*/
+static int nvmodel_func_name(nnc_real_t (*func)(nnc_real_t, nnc_real_t, int), char *name)
+{
+	int i;
+
+	memset(name, 0, NVMODEL_NAMESIZE);
+	if(func==NULL)
+		return 0;
+
+	for(i=0; i<NVMODEL_NFUNCS; i++) {
+		if(nvmodel_funcs[i].func==func) {
+			snprintf(name, NVMODEL_NAMESIZE, "%s", nvmodel_funcs[i].name);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+/*-------------------------------------------------
+ * Get a transfer function by name.
+ * Return:
+ *	0	OK, *func=NULL for "".
+ *	<0	Unknown name.
+--------------------------------------------------*/
+static int nvmodel_find_func(const char *name, nnc_real_t (**func)(nnc_real_t, nnc_real_t, int))
+{
+	int i;
+
+	*func=NULL;
+	if(name[0]=='\0')
+		return 0;
+
+	for(i=0; i<NVMODEL_NFUNCS; i++) {
+		if(strncmp(nvmodel_funcs[i].name, name, NVMODEL_NAMESIZE)==0) {
+			*func=nvmodel_funcs[i].func;
+			return 0;
+		}
+	}
+
+	printf("%s: Unknown transfunc '%.*s'.\n", __func__, NVMODEL_NAMESIZE, name);
+	return -1;
+}
+
+
+/*-----------------------------------------------------------------
+ * Get flattened outputs of a CONV3X3/CONVKXK/MAXPOOL2X2 layer, as
+ * din of the next layer. NULL for a NVCELLs layer.
+-----------------------------------------------------------------*/
+static nnc_real_t *nvmodel_layer_outs(const NVLAYER *layer)
+{
+	if(layer->conv3x3)
+		return layer->conv3x3->douts[0];
+	else if(layer->convkxk)
+		return layer->convkxk->douts[0];
+	else if(layer->maxpool2x2)
+		return layer->maxpool2x2->douts[0];
+	else
+		return NULL;
+}
+
+
+/*-----------------------------------------------------------------
+ * Get number of outputs of a layer, as input size of the next layer.
+-----------------------------------------------------------------*/
+static uint64_t nvmodel_layer_outsize(const NVLAYER *layer)
+{
+	if(layer->conv3x3)
+		return (uint64_t)layer->conv3x3->nf*layer->conv3x3->ow*layer->conv3x3->oh;
+	else if(layer->convkxk)
+		return (uint64_t)layer->convkxk->nf*layer->convkxk->ow*layer->convkxk->oh;
+	else if(layer->maxpool2x2)
+		return (uint64_t)layer->maxpool2x2->nf*layer->maxpool2x2->ow*layer->maxpool2x2->oh;
+	else
+		return layer->nc;
+}
+
+
+/*-----------------------------------------------------------------
+ * Get derr of a CONV3X3/CONVKXK/MAXPOOL2X2 layer, as prederr of
+ * the next layer. NULL for a NVCELLs layer.
+-----------------------------------------------------------------*/
+static nnc_real_t **nvmodel_layer_derr(const NVLAYER *layer)
+{
+	if(layer->conv3x3)
+		return layer->conv3x3->derr;
+	else if(layer->convkxk)
+		return layer->convkxk->derr;
+	else if(layer->maxpool2x2)
+		return layer->maxpool2x2->derr;
+	else
+		return NULL;
+}
+
+
+/*-----------------------------------------------------------------
+ * Fill in a layer descriptor for nvnet_save().
+ * Return:
+ *	0	OK
+ *	<0	Fails, the layer can NOT be saved.
+-----------------------------------------------------------------*/
+static int nvmodel_describe_layer(const NVNET *nnet, int k, struct nvmodel_layer *desc)
+{
+	int i,j;
+	const NVLAYER *layer=nnet->nvlayers[k];
+	const CONV3X3 *conv3;
+	const CONVKXK *convk;
+	const NVCELL *cell0, *cell;
+	nnc_real_t **derr;
+
+	memset(desc, 0, sizeof(*desc));
+	desc->src=-1;
+
+	/* Case_1: CONV3X3 Layer */
+	if(layer->conv3x3) {
+		conv3=layer->conv3x3;
+		desc->type=NVMODEL_LAYER_CONV3X3;
+		desc->nf=conv3->nf;
+		desc->nchan=conv3->nchan;
+		desc->imw=conv3->imw;
+		desc->imh=conv3->imh;
+		desc->engine=conv3->engine;
+		if(conv3->dvs)
+			desc->flags |= NVMODEL_FLAG_BIAS;
+
+		for(j=0; j<k; j++) {
+			if(conv3->din==nvmodel_layer_outs(nnet->nvlayers[j]))
+				desc->src=j;
+		}
+		if(conv3->prederr) {
+			if(desc->src<0 || conv3->prederr != nvmodel_layer_derr(nnet->nvlayers[desc->src])) {
+				printf("%s: nvlayers[%d] conv3x3->prederr is NOT derr of its input layer!\n", __func__, k);
+				return -1;
+			}
+			desc->flags |= NVMODEL_FLAG_PREDERR;
+		}
+
+		if( nvmodel_func_name(conv3->transfunc, desc->transfunc) <0 ) {
+			printf("%s: nvlayers[%d] conv3x3 has an unknown transfunc!\n", __func__, k);
+			return -1;
+		}
+	}
+	/* Case_1A: CONVKXK Layer */
+	else if(layer->convkxk) {
+		convk=layer->convkxk;
+		if(convk->ks>0xff || convk->stride>0xff || convk->pad>0xff) {
+			printf("%s: nvlayers[%d] convkxk ks/stride/pad >255!\n", __func__, k);
+			return -1;
+		}
+		desc->type=NVMODEL_LAYER_CONVKXK;
+		desc->nf=convk->nf;
+		desc->nchan=convk->nchan;
+		desc->imw=convk->imw;
+		desc->imh=convk->imh;
+		desc->engine=NVMODEL_KXK(convk->ks, convk->stride, convk->pad);
+		if(convk->dvs)
+			desc->flags |= NVMODEL_FLAG_BIAS;
+
+		for(j=0; j<k; j++) {
+			if(convk->din==nvmodel_layer_outs(nnet->nvlayers[j]))
+				desc->src=j;
+		}
+		if(convk->prederr) {
+			if(desc->src<0 || convk->prederr != nvmodel_layer_derr(nnet->nvlayers[desc->src])) {
+				printf("%s: nvlayers[%d] convkxk->prederr is NOT derr of its input layer!\n", __func__, k);
+				return -1;
+			}
+			desc->flags |= NVMODEL_FLAG_PREDERR;
+		}
+
+		if( nvmodel_func_name(convk->transfunc, desc->transfunc) <0 ) {
+			printf("%s: nvlayers[%d] convkxk has an unknown transfunc!\n", __func__, k);
+			return -1;
+		}
+	}
+	/* Case_2: MAXPOOL2X2 Layer */
+	else if(layer->maxpool2x2) {
+		desc->type=NVMODEL_LAYER_MAXPOOL2X2;
+		desc->nf=layer->maxpool2x2->nf;
+		desc->imw=layer->maxpool2x2->imw;
+		desc->imh=layer->maxpool2x2->imh;
+
+		for(j=0; j<k; j++) {
+			if(nnet->nvlayers[j]->conv3x3 && nnet->nvlayers[j]->conv3x3==layer->maxpool2x2->inconv3x3)
+				desc->src=j;
+		}
+		if(desc->src<0) {
+			printf("%s: nvlayers[%d] maxpool2x2->inconv3x3 is NOT a layer before!\n", __func__, k);
+			return -1;
+		}
+	}
+	/* Case_3: NVCELLs Layer */
+	else {
+		if(layer->nc==0 || layer->nvcells==NULL)
+			return -1;
+
+		cell0=layer->nvcells[0];
+		desc->type=NVMODEL_LAYER_NVCELLS;
+		desc->nc=layer->nc;
+		desc->nin=cell0->nin;
+		if(layer->douts)
+			desc->flags |= NVMODEL_FLAG_LDOUTS;
+
+		/* All nvcells MUST be as the same template cell */
+		for(i=0; i< layer->nc; i++) {
+			cell=layer->nvcells[i];
+			if( cell->nin != cell0->nin || cell->incells != cell0->incells || cell->din != cell0->din
+			    || cell->prederr != cell0->prederr || cell->transfunc != cell0->transfunc
+			    || cell->pincells || cell->pdin ) {
+				printf("%s: nvlayers[%d] nvcells are NOT of the same template!\n", __func__, k);
+				return -1;
+			}
+		}
+
+		for(j=0; j<k; j++) {
+			if(cell0->incells) {
+				if(cell0->incells==nnet->nvlayers[j]->nvcells)
+					desc->src=j;
+			}
+			else if(cell0->din==nvmodel_layer_outs(nnet->nvlayers[j]))
+				desc->src=j;
+		}
+		if(cell0->incells) {
+			if(desc->src<0) {
+				printf("%s: nvlayers[%d] incells are NOT nvcells of a layer before!\n", __func__, k);
+				return -1;
+			}
+			desc->flags |= NVMODEL_FLAG_INCELLS;
+		}
+		if(cell0->prederr) {
+			derr= desc->src<0 ? NULL : nvmodel_layer_derr(nnet->nvlayers[desc->src]);
+			if(derr==NULL || cell0->prederr != derr[0]) {
+				printf("%s: nvlayers[%d] nvcell->prederr is NOT derr of its input layer!\n", __func__, k);
+				return -1;
+			}
+			desc->flags |= NVMODEL_FLAG_PREDERR;
+		}
+
+		if( nvmodel_func_name(cell0->transfunc, desc->transfunc) <0 ) {
+			printf("%s: nvlayers[%d] nvcells have an unknown transfunc!\n", __func__, k);
+			return -1;
+		}
+		if(layer->transfunc) {
+			for(i=0; i<NVMODEL_NLFUNCS; i++) {
+				if(nvmodel_lfuncs[i].func==layer->transfunc)
+					snprintf(desc->ltransfunc, NVMODEL_LNAMESIZE, "%s", nvmodel_lfuncs[i].name);
+			}
+			if(desc->ltransfunc[0]=='\0') {
+				printf("%s: nvlayers[%d] has an unknown layer transfunc!\n", __func__, k);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Save a nvnet to a model file, with topology and all params.
+ *
+ * Note:
+ *	1. Layers MUST be linked as built in test_nnc3/test_nnc4.c:
+ *	   each layer reads din/incells of ONE layer before it or the
+ *	   input data, convolution nvcells(pincells/pdin) NOT supported.
+ *	2. Transfer functions are saved by name, ONLY functions in
+ *	   actfs.h and func_softmax() are supported.
+ *	3. The file is for builds with the same nnc_real_t and byte order.
+ *
+ * Params:
+ *	@nnet	Nerve net to save.
+ *	@fpath	Path of the model file.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------------*/
+int nvnet_save(NVNET *nnet, const char *fpath)
+{
+	int k;
+	int ret=0;
+	FILE *fp;
+	struct nvmodel_header hdr;
+	struct nvmodel_layer *descs;
+	static const char pad[NVMODEL_ALIGN];
+	unsigned long off;
+
+	if(nnet==NULL || nnet->nl==0 || fpath==NULL)
+		return -1;
+
+	if( nvnet_pack_params(nnet) <0 )
+		return -1;
+
+	/* 1. Layer descriptors */
+	descs=calloc(nnet->nl, sizeof(*descs));
+	if(descs==NULL)
+		return -2;
+	for(k=0; k< nnet->nl; k++) {
+		if( nvmodel_describe_layer(nnet, k, descs+k) <0 ) {
+			free(descs);
+			return -3;
+		}
+	}
+
+	/* 2. Header */
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NVMODEL_MAGIC, sizeof(NVMODEL_MAGIC));
+	hdr.version=NVMODEL_VERSION;
+	hdr.endian=NVMODEL_ENDIAN;
+	hdr.real_size=sizeof(nnc_real_t);
+	hdr.nl=nnet->nl;
+	hdr.npa=nnet->npa;
+	off=sizeof(hdr)+nnet->nl*sizeof(*descs);
+	hdr.param_off=(off+NVMODEL_ALIGN-1)/NVMODEL_ALIGN*NVMODEL_ALIGN;
+	hdr.file_size=hdr.param_off+nnet->npa*sizeof(nnc_real_t);
+
+	/* 3. Write to file */
+	fp=fopen(fpath, "wb");
+	if(fp==NULL) {
+		printf("%s: Fail to open '%s'.\n", __func__, fpath);
+		free(descs);
+		return -4;
+	}
+	if( fwrite(&hdr, sizeof(hdr), 1, fp) !=1
+	    || fwrite(descs, sizeof(*descs), nnet->nl, fp) != nnet->nl
+	    || fwrite(pad, 1, hdr.param_off-off, fp) != hdr.param_off-off
+	    || fwrite(nnet->pparams, sizeof(nnc_real_t), nnet->npa, fp) != nnet->npa ) {
+		printf("%s: Fail to write '%s'.\n", __func__, fpath);
+		ret=-5;
+	}
+	if( fclose(fp) !=0 )
+		ret=-5;
+
+	free(descs);
+	return ret;
+}
+
+
+/*-----------------------------------------------------------------
+ * Create a layer as per its descriptor, for nvnet_load().
+ * Note:
+ *	Input size of the layer MUST match outputs of its src layer,
+ *	or insize for din, else a corrupted file overruns buffers.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+static int nvmodel_create_layer(NVNET *nnet, int k, const struct nvmodel_layer *desc,
+				nnc_real_t *din, unsigned int insize)
+{
+	int i;
+	uint64_t have;		/* Outputs of the src layer, or insize */
+	NVLAYER *layer, *src;
+	CONV3X3 *conv3;
+	CONVKXK *convk;
+	NVCELL *tcell;
+	nnc_real_t (*func)(nnc_real_t, nnc_real_t, int);
+
+	if(desc->src >= k || desc->src < -1)
+		return -1;
+	src= desc->src<0 ? NULL : nnet->nvlayers[desc->src];
+	have= src ? nvmodel_layer_outsize(src) : insize;
+
+	if( nvmodel_find_func(desc->transfunc, &func) <0 )
+		return -1;
+
+	switch(desc->type) {
+	/* Case_1: CONV3X3 Layer */
+	case NVMODEL_LAYER_CONV3X3:
+		if(src)
+			din=nvmodel_layer_outs(src);
+		if(din==NULL)
+			return -1;
+		if( (uint64_t)desc->nchan*desc->imw*desc->imh != have ) {
+			printf("%s: nvlayers[%d] takes %ux%ux%u inputs, while its src has %llu.\n", __func__,
+					k, desc->nchan, desc->imw, desc->imh, (unsigned long long)have);
+			return -1;
+		}
+		conv3=new_conv3x3(desc->nf, desc->nchan, desc->imw, desc->imh, din, desc->flags & NVMODEL_FLAG_BIAS);
+		if(conv3==NULL)
+			return -2;
+		layer=new_nvlayer(0, NULL, false);
+		if(layer==NULL) {
+			free_conv3x3(conv3);
+			return -2;
+		}
+		layer->conv3x3=conv3;
+		nnet->nvlayers[k]=layer;
+
+		conv3->transfunc=func;
+		if( (desc->flags & NVMODEL_FLAG_PREDERR) && !nnet->infer_only ) {
+			if(src==NULL)
+				return -1;
+			conv3->prederr=nvmodel_layer_derr(src);
+		}
+		if( conv3x3_set_engine(conv3, desc->engine) !=0 )
+			return -1;
+		break;
+
+	/* Case_1A: CONVKXK Layer */
+	case NVMODEL_LAYER_CONVKXK:
+		if(src)
+			din=nvmodel_layer_outs(src);
+		if(din==NULL)
+			return -1;
+		if( (uint64_t)desc->nchan*desc->imw*desc->imh != have ) {
+			printf("%s: nvlayers[%d] takes %ux%ux%u inputs, while its src has %llu.\n", __func__,
+					k, desc->nchan, desc->imw, desc->imh, (unsigned long long)have);
+			return -1;
+		}
+		convk=new_convkxk(desc->nf, desc->nchan, desc->imw, desc->imh, NVMODEL_KXK_KS(desc->engine),
+				  NVMODEL_KXK_STRIDE(desc->engine), NVMODEL_KXK_PAD(desc->engine), din,
+				  desc->flags & NVMODEL_FLAG_BIAS);
+		if(convk==NULL)
+			return -2;
+		layer=new_nvlayer(0, NULL, false);
+		if(layer==NULL) {
+			free_convkxk(convk);
+			return -2;
+		}
+		layer->convkxk=convk;
+		nnet->nvlayers[k]=layer;
+
+		convk->transfunc=func;
+		if( (desc->flags & NVMODEL_FLAG_PREDERR) && !nnet->infer_only ) {
+			if(src==NULL)
+				return -1;
+			convk->prederr=nvmodel_layer_derr(src);
+		}
+		break;
+
+	/* Case_2: MAXPOOL2X2 Layer */
+	case NVMODEL_LAYER_MAXPOOL2X2:
+		if(src==NULL || src->conv3x3==NULL)
+			return -1;
+		if( desc->nf != src->conv3x3->nf || desc->imw != src->conv3x3->ow || desc->imh != src->conv3x3->oh ) {
+			printf("%s: nvlayers[%d] takes %ux%ux%u inputs, while its src has %ux%ux%u.\n", __func__,
+					k, desc->nf, desc->imw, desc->imh, src->conv3x3->nf, src->conv3x3->ow, src->conv3x3->oh);
+			return -1;
+		}
+		layer=new_nvlayer(0, NULL, false);
+		if(layer==NULL)
+			return -2;
+		nnet->nvlayers[k]=layer;
+		layer->maxpool2x2=new_maxpool2x2(src->conv3x3, 0, 0, 0, NULL);
+		if(layer->maxpool2x2==NULL)
+			return -2;
+		break;
+
+	/* Case_3: NVCELLs Layer */
+	case NVMODEL_LAYER_NVCELLS:
+		if(desc->flags & NVMODEL_FLAG_INCELLS) {
+			if(src==NULL || src->nvcells==NULL || src->nc != desc->nin)
+				return -1;
+			tcell=new_nvcell(desc->nin, src->nvcells, NULL, NULL, 0, func);
+		}
+		else {
+			if(src)
+				din=nvmodel_layer_outs(src);
+			if(din==NULL)
+				return -1;
+			if( desc->nin != have ) {
+				printf("%s: nvlayers[%d] takes %u inputs, while its src has %llu.\n", __func__,
+						k, desc->nin, (unsigned long long)have);
+				return -1;
+			}
+			tcell=new_nvcell(desc->nin, NULL, din, NULL, 0, func);
+		}
+		if(tcell==NULL)
+			return -2;
+		layer=new_nvlayer(desc->nc, tcell, desc->flags & NVMODEL_FLAG_LDOUTS);
+		free_nvcell(tcell);
+		if(layer==NULL)
+			return -2;
+		nnet->nvlayers[k]=layer;
+
+		/* NO derr for inference only */
+		if( (desc->flags & NVMODEL_FLAG_PREDERR) && !nnet->infer_only ) {
+			if(src==NULL || nvmodel_layer_derr(src)==NULL)
+				return -1;
+			for(i=0; i< layer->nc; i++)
+				layer->nvcells[i]->prederr=nvmodel_layer_derr(src)[0];
+		}
+
+		if(desc->ltransfunc[0]) {
+			for(i=0; i<NVMODEL_NLFUNCS; i++) {
+				if(strncmp(nvmodel_lfuncs[i].name, desc->ltransfunc, NVMODEL_LNAMESIZE)==0)
+					layer->transfunc=nvmodel_lfuncs[i].func;
+			}
+			if(layer->transfunc==NULL) {
+				printf("%s: Unknown layer transfunc '%.*s'.\n", __func__, NVMODEL_LNAMESIZE, desc->ltransfunc);
+				return -1;
+			}
+		}
+		break;
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Load a nvnet from a model file saved by nvnet_save().
+ *
+ * Note:
+ *	1. If use_mmap, the file is mmaped(MAP_PRIVATE) and all params
+ *	   point into it, with NO parsing or copying, and the arena has NO
+ *	   PARAMS region, see nvnet_pack_mapped_params(). Pages are shared
+ *	   by processes loading the same file, until params are updated
+ *	   (copy on write). The file is unmapped in free_nvnet().
+ *	2. Else params are read into the parameter arena.
+ *	3. Params are ready, do NOT call nvnet_init_params().
+ *	4. Call nnc_set_inference(true) before it to load for inference only.
+ *
+ * Params:
+ *	@fpath		Path of the model file.
+ *	@din		Input data of the first layer.
+ *	@insize		Size of din, checked against the first layer.
+ *	@use_mmap	To mmap the file.
+ * Return:
+ *	Pointer to a NVNET	OK
+ *	NULL			Fails
+-----------------------------------------------------------------------*/
+NVNET *nvnet_load(const char *fpath, nnc_real_t *din, unsigned int insize, bool use_mmap)
+{
+	int k;
+	int fd;
+	struct stat sb;
+	struct nvmodel_header hdr;
+	struct nvmodel_layer *descs=NULL;
+	NVNET *nnet=NULL;
+	void *pmap;
+
+	if(fpath==NULL)
+		return NULL;
+
+	fd=open(fpath, O_RDONLY);
+	if(fd<0) {
+		printf("%s: Fail to open '%s'.\n", __func__, fpath);
+		return NULL;
+	}
+
+	/* 1. Check header */
+	if( fstat(fd, &sb)<0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ) {
+		printf("%s: Fail to read '%s'.\n", __func__, fpath);
+		goto FAIL;
+	}
+	if( memcmp(hdr.magic, NVMODEL_MAGIC, sizeof(NVMODEL_MAGIC)) !=0 || hdr.endian != NVMODEL_ENDIAN ) {
+		printf("%s: '%s' is NOT a model file, or in other byte order.\n", __func__, fpath);
+		goto FAIL;
+	}
+	if( hdr.version < 1 || hdr.version > NVMODEL_VERSION ) {
+		printf("%s: Model file version %u is NOT supported.\n", __func__, hdr.version);
+		goto FAIL;
+	}
+	if( hdr.real_size != sizeof(nnc_real_t) ) {
+		printf("%s: Model file params are %u bytes, while nnc_real_t is %zu bytes.\n",
+								__func__, hdr.real_size, sizeof(nnc_real_t));
+		goto FAIL;
+	}
+	if( hdr.nl==0 || hdr.param_off%NVMODEL_ALIGN || hdr.param_off < sizeof(hdr)+hdr.nl*sizeof(*descs)
+	    || hdr.file_size != hdr.param_off+hdr.npa*sizeof(nnc_real_t) || hdr.file_size != sb.st_size ) {
+		printf("%s: '%s' is corrupted.\n", __func__, fpath);
+		goto FAIL;
+	}
+
+	/* 2. Create layers */
+	descs=calloc(hdr.nl, sizeof(*descs));
+	if(descs==NULL)
+		goto FAIL;
+	if( pread(fd, descs, hdr.nl*sizeof(*descs), sizeof(hdr)) != hdr.nl*sizeof(*descs) )
+		goto FAIL;
+
+	nnet=new_nvnet(hdr.nl);
+	if(nnet==NULL)
+		goto FAIL;
+	for(k=0; k< hdr.nl; k++) {
+		if( hdr.version < 2 && descs[k].type == NVMODEL_LAYER_CONVKXK ) {
+			printf("%s: nvlayers[%d] CONVKXK in a version %u model file.\n", __func__, k, hdr.version);
+			goto FAIL;
+		}
+		if( nvmodel_create_layer(nnet, k, descs+k, din, insize) <0 ) {
+			printf("%s: Fail to create nvlayers[%d].\n", __func__, k);
+			goto FAIL;
+		}
+	}
+
+	/* 3. Params, NO PARAMS region in the arena if mmaped */
+	if(use_mmap) {
+		pmap=mmap(NULL, hdr.file_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if(pmap==MAP_FAILED) {
+			printf("%s: Fail to mmap '%s'.\n", __func__, fpath);
+			goto FAIL;
+		}
+		nnet->pmap=pmap;
+		nnet->mapsize=hdr.file_size;
+		if( nvnet_pack_mapped_params(nnet, (nnc_real_t *)((char *)pmap+hdr.param_off), hdr.npa) <0 ) {
+			printf("%s: Params of '%s' do NOT match its layers.\n", __func__, fpath);
+			goto FAIL;
+		}
+	}
+	else {
+		if( nvnet_pack_params(nnet) <0 || nnet->npa != hdr.npa ) {
+			printf("%s: Params of '%s' do NOT match its layers.\n", __func__, fpath);
+			goto FAIL;
+		}
+		if( pread(fd, nnet->pparams, hdr.npa*sizeof(nnc_real_t), hdr.param_off) != hdr.npa*sizeof(nnc_real_t) ) {
+			printf("%s: Fail to read params of '%s'.\n", __func__, fpath);
+			goto FAIL;
+		}
+	}
+
+	free(descs);
+	close(fd);
+	return nnet;
+
+FAIL:
+	free(descs);
+	free_nvnet(nnet);
+	close(fd);
+	return NULL;
+}
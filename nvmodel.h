@@ -0,0 +1,89 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#ifndef __NVMODEL_H__
+#define __NVMODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nnc.h"
+
+/*-------------------------------------------------------
+Model file format, in host byte order:
+
+   struct nvmodel_header		64 bytes
+   struct nvmodel_layer[nl]		64 bytes each
+   padding to NVMODEL_ALIGN
+   params[npa]			nnc_real_t, at header.param_off
+				as NVNET pparams, see nvnet_pack_params()
+
+The params blob is NVMODEL_ALIGN aligned, so nvnet_load()
+can mmap the file and point weights into it directly.
+
+Versions:
+   1	CONV3X3, MAXPOOL2X2 and NVCELLs layers.
+   2	Add NVMODEL_LAYER_CONVKXK, whose engine field holds
+	NVMODEL_KXK(ks,stride,pad). Version 1 files are still loaded.
+*------------------------------------------------------*/
+#define NVMODEL_MAGIC		"NVMODEL"	/* with the ending '\0', 8 bytes */
+#define NVMODEL_VERSION		2
+#define NVMODEL_ALIGN		64
+#define NVMODEL_ENDIAN		0x01020304	/* to check byte order */
+#define NVMODEL_NAMESIZE	16	/* Size of a CONV3X3/NVCELL transfunc name */
+#define NVMODEL_LNAMESIZE	8	/* Size of a NVLAYER transfunc name */
+
+/* Layer types */
+enum nvmodel_layer_type {
+	NVMODEL_LAYER_CONV3X3 = 1,
+	NVMODEL_LAYER_MAXPOOL2X2,
+	NVMODEL_LAYER_NVCELLS,
+	NVMODEL_LAYER_CONVKXK,
+};
+
+/* Kernel size, stride and padding of a CONVKXK, in the engine field, each <256 */
+#define NVMODEL_KXK(ks,stride,pad)	((ks) | (stride)<<8 | (pad)<<16)
+#define NVMODEL_KXK_KS(v)		((v) & 0xff)
+#define NVMODEL_KXK_STRIDE(v)		((v)>>8 & 0xff)
+#define NVMODEL_KXK_PAD(v)		((v)>>16 & 0xff)
+
+/* Layer flags */
+#define NVMODEL_FLAG_BIAS	(1<<0)	/* CONV3X3/CONVKXK with dvs[] */
+#define NVMODEL_FLAG_PREDERR	(1<<1)	/* Feed back derr to the src layer */
+#define NVMODEL_FLAG_INCELLS	(1<<2)	/* NVCELLs take nvcells of the src layer as incells, else din */
+#define NVMODEL_FLAG_LDOUTS	(1<<3)	/* NVCELLs layer with layer->douts, as layerTransfuncDefined */
+
+struct nvmodel_header
+{
+	char	 magic[8];		/* NVMODEL_MAGIC */
+	uint32_t version;		/* NVMODEL_VERSION */
+	uint32_t endian;		/* NVMODEL_ENDIAN */
+	uint32_t real_size;		/* sizeof(nnc_real_t) */
+	uint32_t nl;			/* Number of layers */
+	uint64_t npa;			/* Number of params */
+	uint64_t param_off;		/* Offset of params in the file, NVMODEL_ALIGN aligned */
+	uint64_t file_size;		/* Total size of the file */
+	uint8_t	 reserved[16];
+};
+
+struct nvmodel_layer
+{
+	uint32_t type;			/* enum nvmodel_layer_type */
+	int32_t	 src;			/* Index of the input layer, -1 for input data */
+	uint32_t flags;			/* NVMODEL_FLAG_xxx */
+	uint32_t engine;		/* CONV3X3: enum conv3x3_engine. CONVKXK: NVMODEL_KXK(ks,stride,pad) */
+	uint32_t nf, nchan;		/* CONV3X3/CONVKXK/MAXPOOL2X2 */
+	uint32_t imw, imh;		/* CONV3X3/CONVKXK/MAXPOOL2X2 input size */
+	uint32_t nc, nin;		/* NVCELLs */
+	char	 transfunc[NVMODEL_NAMESIZE];	/* Name of CONV3X3/NVCELL transfunc, "" as NULL */
+	char	 ltransfunc[NVMODEL_LNAMESIZE];	/* Name of NVLAYER transfunc, "" as NULL */
+};
+
+int nvnet_save(NVNET *nnet, const char *fpath);
+NVNET *nvnet_load(const char *fpath, nnc_real_t *din, unsigned int insize, bool use_mmap);
+
+#endif
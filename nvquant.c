@@ -0,0 +1,818 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Post-training int8 quantization of a NVNET, see nvquant.h.
+
+Note:
+1. Only sequential nets are quantized: each layer reads its input
+   ONLY from the previous layer, and NVCELLs layers are in tensor mode.
+   As nvnet_feed_forward_batch(). CONVKXK layers are NOT supported.
+   All NVCELLs of a layer MUST share one transfunc.
+2. Scales of data are taken from max|x| of the calibration set,
+   so the calibration samples should be drawn from the training set.
+
+Journal:
+2026-10-17:
+   1. Create nvnet_quantize(), nvqnet_feed_forward(), and int8 dot
+      product kernels: scalar, AVX2, AVX-VNNI/AVX512-VNNI.
+   2. nvq_calibrate(): Disable CONV3X3+MAXPOOL2X2 fusion, for full CONV3X3 outputs.
+   3. nvq_check_nvnet(): CONVKXK layers are NOT supported yet.
+   4. nvq_check_nvnet(): Reject a layer whose NVCELLs have different transfuncs.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include "nvquant.h"
+#include "actfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* x86 SIMD kernels, selected at startup by CPUID, see nvq_cpu_dispatch() */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NVQ_X86_SIMD	1
+#include <immintrin.h>
+#endif
+
+#define NVQ_QMAX	127	/* int8 data and weights are in [-NVQ_QMAX NVQ_QMAX] */
+
+/* Int8 dot product of w[n] and x[n], n is multiple of NVQ_KALIGN, wsum=SUM(w[:]) */
+typedef int32_t (*nvq_dot_t)(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum);
+
+static int32_t nvq_dot_scalar(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum);
+static nvq_dot_t nvq_dot=nvq_dot_scalar;
+static int nvq_kernel=NVQ_KERNEL_SCALAR;
+
+
+/*-------------------------------------------------
+	Int8 dot product, scalar loops.
+--------------------------------------------------*/
+static int32_t nvq_dot_scalar(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum)
+{
+	unsigned int i;
+	int32_t sum=0;
+
+	for(i=0; i<n; i++)
+		sum += w[i]*x[i];
+
+	return sum;
+}
+
+#ifdef NVQ_X86_SIMD
+/*-------------------------------------------------
+	Horizontal sum of 8 int32 lanes.
+--------------------------------------------------*/
+__attribute__((target("avx2")))
+static inline int32_t nvq_hsum_avx2(__m256i v)
+{
+	__m128i s;
+
+	s=_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s=_mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1,0,3,2)));
+	s=_mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2,3,0,1)));
+
+	return _mm_cvtsi128_si32(s);
+}
+
+/*-------------------------------------------------
+ * Int8 dot product, AVX2.
+ * int8 are extended to int16, then madd to int32,
+ * |w*x|<=127*127, NO overflow for madd pairs.
+--------------------------------------------------*/
+__attribute__((target("avx2")))
+static int32_t nvq_dot_avx2(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum)
+{
+	unsigned int i;
+	__m256i acc0=_mm256_setzero_si256();
+	__m256i acc1=_mm256_setzero_si256();
+	__m256i vw, vx;
+
+	for(i=0; i<n; i+=32) {
+		vw=_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w+i)));
+		vx=_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(x+i)));
+		acc0=_mm256_add_epi32(acc0, _mm256_madd_epi16(vw, vx));
+		vw=_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(w+i+16)));
+		vx=_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(x+i+16)));
+		acc1=_mm256_add_epi32(acc1, _mm256_madd_epi16(vw, vx));
+	}
+
+	return nvq_hsum_avx2(_mm256_add_epi32(acc0, acc1));
+}
+
+/*-------------------------------------------------
+ * Int8 dot product, AVX-VNNI.
+ * dpbusd takes u8*s8, so x is offset by 128 as u8:
+ *	SUM((x+128)*w) = SUM(x*w) + 128*wsum
+--------------------------------------------------*/
+__attribute__((target("avxvnni")))
+static int32_t nvq_dot_avxvnni(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum)
+{
+	unsigned int i;
+	const __m256i flip=_mm256_set1_epi8((char)0x80);
+	__m256i acc=_mm256_setzero_si256();
+	__m256i vx;
+
+	for(i=0; i<n; i+=32) {
+		vx=_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x+i)), flip);
+		acc=_mm256_dpbusd_avx_epi32(acc, vx, _mm256_loadu_si256((const __m256i *)(w+i)));
+	}
+
+	return nvq_hsum_avx2(acc) - 128*wsum;
+}
+
+/*-------------------------------------------------
+ * Int8 dot product, AVX512-VNNI on 256bit vectors.
+ * The same as nvq_dot_avxvnni().
+--------------------------------------------------*/
+__attribute__((target("avx512vnni,avx512vl")))
+static int32_t nvq_dot_avx512vnni(const int8_t *w, const int8_t *x, unsigned int n, int32_t wsum)
+{
+	unsigned int i;
+	const __m256i flip=_mm256_set1_epi8((char)0x80);
+	__m256i acc=_mm256_setzero_si256();
+	__m256i vx;
+
+	for(i=0; i<n; i+=32) {
+		vx=_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x+i)), flip);
+		acc=_mm256_dpbusd_epi32(acc, vx, _mm256_loadu_si256((const __m256i *)(w+i)));
+	}
+
+	return nvq_hsum_avx2(acc) - 128*wsum;
+}
+#endif
+
+
+/*-------------------------------------------------
+ * Select an int8 dot product kernel, if the CPU
+ * supports it.
+ * Return:
+ *	true	OK
+ *	false	Not supported
+--------------------------------------------------*/
+static bool nvq_select_kernel(int kernel)
+{
+	nvq_dot_t dot=NULL;
+
+	switch(kernel) {
+	    case NVQ_KERNEL_SCALAR:
+		dot=nvq_dot_scalar;
+		break;
+#ifdef NVQ_X86_SIMD
+	    case NVQ_KERNEL_AVX2:
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("avx2") )
+			dot=nvq_dot_avx2;
+		break;
+	    case NVQ_KERNEL_VNNI:
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("avxvnni") )
+			dot=nvq_dot_avxvnni;
+		else if( __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl") )
+			dot=nvq_dot_avx512vnni;
+		break;
+#endif
+	    default:
+		break;
+	}
+
+	if(dot==NULL)
+		return false;
+
+	nvq_dot=dot;
+	nvq_kernel=kernel;
+	return true;
+}
+
+/*---------------------------------------------
+ * Set the int8 dot product kernel, for
+ * comparing/debugging. All kernels give the
+ * same int32 sums.
+@kernel:	enum nvq_kernel
+Return:
+	>=0	OK, the kernel in use
+	<0	The CPU does NOT support the kernel,
+		the kernel in use is NOT changed.
+---------------------------------------------*/
+int nvq_set_kernel(int kernel)
+{
+	if(!nvq_select_kernel(kernel)) {
+		printf("%s: Kernel %d is NOT supported!\n", __func__, kernel);
+		return -1;
+	}
+
+	return nvq_kernel;
+}
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Select the best int8 kernel as per CPUID, it runs once at startup.
+-----------------------------------------------------------------*/
+#ifdef NVQ_X86_SIMD
+__attribute__((constructor))
+#endif
+void nvq_cpu_dispatch(void)
+{
+	if( !nvq_select_kernel(NVQ_KERNEL_VNNI) && !nvq_select_kernel(NVQ_KERNEL_AVX2) )
+		nvq_select_kernel(NVQ_KERNEL_SCALAR);
+}
+
+
+/*-------------------------------------------------
+	Quantize v with scale 1/inv to int8.
+--------------------------------------------------*/
+static inline int8_t nvq_quantize_value(float v, float inv)
+{
+	long q=lrintf(v*inv);
+
+	if(q > NVQ_QMAX)
+		q=NVQ_QMAX;
+	else if(q < -NVQ_QMAX)
+		q=-NVQ_QMAX;
+
+	return (int8_t)q;
+}
+
+/*-------------------------------------------------
+	Scale for data/weights with max. abs value amax.
+--------------------------------------------------*/
+static inline float nvq_scale(double amax)
+{
+	return amax>0.0 ? amax/NVQ_QMAX : 1.0f;
+}
+
+/*-------------------------------------------------
+	Round up n to multiple of NVQ_KALIGN.
+--------------------------------------------------*/
+static inline unsigned int nvq_align(unsigned int n)
+{
+	return (n+NVQ_KALIGN-1)/NVQ_KALIGN*NVQ_KALIGN;
+}
+
+/*-------------------------------------------------
+	Max. abs value of data[n].
+--------------------------------------------------*/
+static double nvq_absmax(const nnc_real_t *data, unsigned int n, double amax)
+{
+	unsigned int i;
+
+	for(i=0; i<n; i++) {
+		if(fabs(data[i]) > amax)
+			amax=fabs(data[i]);
+	}
+
+	return amax;
+}
+
+
+/*-----------------------------------------------------------------
+ * Check if a NVNET can be quantized, see Note 1 in the file head.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+static int nvq_check_nvnet(NVNET *nnet)
+{
+	int k, j;
+	NVLAYER *layer;
+
+	if( nvnet_pack_params(nnet) <0 )
+		return -1;
+
+	for(k=0; k< nnet->nl; k++) {
+		layer=nnet->nvlayers[k];
+		if( nvnet_batch_insize(nnet, k)==0 ) {
+			printf("%s: nvlayers[%d] does NOT read input from the previous layer ONLY, or NOT in tensor mode!\n",
+					__func__, k);
+			return -2;
+		}
+		if(k==0 && layer->maxpool2x2) {
+			printf("%s: nvlayers[0] is a MAXPOOL2X2!\n", __func__);
+			return -2;
+		}
+		if(layer->convkxk) {
+			printf("%s: nvlayers[%d] CONVKXK is NOT supported!\n", __func__, k);
+			return -2;
+		}
+		/* A DENSE qlayer has ONE transfunc for all outputs, see nvq_create_layer() */
+		if(layer->nvcells) {
+			for(j=1; j< layer->nc; j++) {
+				if(layer->nvcells[j]->transfunc != layer->nvcells[0]->transfunc) {
+					printf("%s: nvlayers[%d] nvcells[%d] transfunc differs from nvcells[0]!\n", __func__, k, j);
+					return -3;
+				}
+			}
+		}
+		if( layer->transfunc && (k < nnet->nl-1 || layer->transfunc != func_softmax) ) {
+			printf("%s: nvlayers[%d] transfunc is NOT supported, ONLY softmax for the last layer!\n", __func__, k);
+			return -3;
+		}
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Feed forward the calibration set through a NVNET, and get
+ * max. abs value of data.
+ * Params:
+ *	@nnet	 A NVNET, checked by nvq_check_nvnet().
+ *	@calib	 Calibration samples, calib[ncalib*insize].
+ *	@ncalib  Number of calibration samples.
+ *	@amax	 amax[0] for input data, amax[k+1] for outputs of nvlayers[k].
+-----------------------------------------------------------------*/
+static void nvq_calibrate(NVNET *nnet, const nnc_real_t *calib, unsigned int ncalib, double *amax)
+{
+	int i,k;
+	unsigned int s, insize;
+	NVLAYER *layer;
+	CONV3X3 *conv3;
+	MAXPOOL2X2 *maxpool;
+	nnc_real_t *din0;
+	bool fused;
+
+	insize=nvnet_input_size(nnet);
+	layer=nnet->nvlayers[0];
+	din0= layer->conv3x3 ? layer->conv3x3->din : layer->nvcells[0]->din;
+
+	for(k=0; k<= nnet->nl; k++)
+		amax[k]=0.0;
+
+	/* Full CONV3X3 outputs are needed, NOT fused with MAXPOOL2X2 */
+	fused=nnc_set_fusion(false);
+
+	for(s=0; s<ncalib; s++) {
+		amax[0]=nvq_absmax(calib+(unsigned long)s*insize, insize, amax[0]);
+
+		nvnet_set_input(nnet, calib+(unsigned long)s*insize);
+		nvnet_feed_forward(nnet, NULL, NULL);
+
+		for(k=0; k< nnet->nl; k++) {
+			layer=nnet->nvlayers[k];
+			if(layer->conv3x3) {
+				conv3=layer->conv3x3;
+				amax[k+1]=nvq_absmax(conv3->douts[0], conv3->nf*conv3->ow*conv3->oh, amax[k+1]);
+			}
+			else if(layer->maxpool2x2) {
+				maxpool=layer->maxpool2x2;
+				amax[k+1]=nvq_absmax(maxpool->douts[0], maxpool->nf*maxpool->ow*maxpool->oh, amax[k+1]);
+			}
+			else {
+				for(i=0; i< layer->nc; i++) {
+					if(fabs(layer->nvcells[i]->dout) > amax[k+1])
+						amax[k+1]=fabs(layer->nvcells[i]->dout);
+				}
+			}
+		}
+	}
+	nnc_set_fusion(fused);
+
+	/* Restore input of the nvnet */
+	nvnet_set_input(nnet, din0);
+}
+
+
+/*-------------------------------------------------
+	Quantize weights of a CONV3X3/DENSE layer,
+	w[n] is at w0+n*ld.
+--------------------------------------------------*/
+static void nvq_quantize_weights(NVQLAYER *qlayer, const nnc_real_t *w0, unsigned int ld)
+{
+	int n;
+	unsigned int i;
+	const nnc_real_t *w;
+	float inv;
+
+	for(n=0; n< qlayer->nout; n++) {
+		w=w0+n*ld;
+		qlayer->wscale[n]=nvq_scale(nvq_absmax(w, qlayer->K, 0.0));
+		inv=1.0f/qlayer->wscale[n];
+		qlayer->wsum[n]=0;
+		for(i=0; i< qlayer->K; i++) {
+			qlayer->qw[n*qlayer->Kp+i]=nvq_quantize_value(w[i], inv);
+			qlayer->wsum[n] += qlayer->qw[n*qlayer->Kp+i];
+		}
+	}
+}
+
+
+/*-----------------------------------------------------------------
+ * Create a NVQLAYER for nvlayers[k] of a NVNET.
+ * Params:
+ *	@qlayer	 The NVQLAYER, zeroed.
+ *	@layer	 nvlayers[k]
+ *	@last	 TRUE if the layer is the last one, it outputs real values.
+ *	@xscale	 Scale of input data.
+ *	@yamax	 Max. abs value of output data.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+static int nvq_create_layer(NVQLAYER *qlayer, const NVLAYER *layer, bool last, float xscale, double yamax)
+{
+	int n;
+	CONV3X3 *conv3=layer->conv3x3;
+	MAXPOOL2X2 *maxpool=layer->maxpool2x2;
+	unsigned int osize;
+
+	qlayer->xscale=xscale;
+	qlayer->yscale=nvq_scale(yamax);
+
+	/* 1. Sizes */
+	if(conv3) {
+		qlayer->type=NVQ_LAYER_CONV3X3;
+		qlayer->nout=conv3->nf;
+		qlayer->nchan=conv3->nchan;
+		qlayer->imw=conv3->imw;	 qlayer->imh=conv3->imh;
+		qlayer->ow=conv3->ow;	 qlayer->oh=conv3->oh;
+		qlayer->K=conv3->nchan*9;
+		qlayer->transfunc=conv3->transfunc;
+	}
+	else if(maxpool) {
+		qlayer->type=NVQ_LAYER_MAXPOOL2X2;
+		qlayer->nout=maxpool->nf;
+		qlayer->imw=maxpool->imw; qlayer->imh=maxpool->imh;
+		qlayer->ow=maxpool->ow;	  qlayer->oh=maxpool->oh;
+		qlayer->yscale=qlayer->xscale;		/* Max. of int8 data */
+	}
+	else {
+		qlayer->type=NVQ_LAYER_DENSE;
+		qlayer->nout=layer->nc;
+		qlayer->ow=1;		qlayer->oh=1;
+		qlayer->K=layer->nvcells[0]->nin;
+		qlayer->transfunc=layer->nvcells[0]->transfunc;
+	}
+	qlayer->Kp=nvq_align(qlayer->K);
+	osize=qlayer->nout*qlayer->ow*qlayer->oh;
+
+	/* 2. Weights and bias */
+	if(qlayer->type != NVQ_LAYER_MAXPOOL2X2) {
+		qlayer->qw=calloc((unsigned long)qlayer->nout*qlayer->Kp, sizeof(int8_t));
+		qlayer->wscale=calloc(qlayer->nout, sizeof(float));
+		qlayer->wsum=calloc(qlayer->nout, sizeof(int32_t));
+		qlayer->bias=calloc(qlayer->nout, sizeof(float));
+		if(qlayer->qw==NULL || qlayer->wscale==NULL || qlayer->wsum==NULL || qlayer->bias==NULL)
+			return -1;
+
+		if(conv3) {
+			nvq_quantize_weights(qlayer, &conv3->fparams[0][0][0], qlayer->K);
+			for(n=0; conv3->dvs && n< qlayer->nout; n++)
+				qlayer->bias[n]=conv3->dvs[n];
+		}
+		else {
+			/* Tensor mode: W[nc][nin+1] */
+			nvq_quantize_weights(qlayer, layer->nvcells[0]->dw, qlayer->K+1);
+			for(n=0; n< qlayer->nout; n++)
+				qlayer->bias[n]=*layer->nvcells[n]->dv;
+		}
+	}
+
+	/* 3. Data buffers */
+	if(conv3) {
+		qlayer->cols=calloc((unsigned long)qlayer->ow*qlayer->Kp, sizeof(int8_t));
+		if(qlayer->cols==NULL)
+			return -1;
+	}
+	if(last) {
+		qlayer->dout=calloc(osize, sizeof(nnc_real_t));
+		if(qlayer->dout==NULL)
+			return -1;
+	}
+	if(!last || maxpool) {
+		qlayer->qout=calloc(nvq_align(osize), sizeof(int8_t));
+		if(qlayer->qout==NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------
+ * Quantize a trained NVNET to an int8 inference graph.
+ * Params:
+ *	@nnet	 A trained NVNET, training OR inference only.
+ *		 Its params are packed, see nvnet_pack_params().
+ *	@calib	 Calibration samples, calib[ncalib*insize], as input
+ *		 data of nvnet_feed_forward_batch().
+ *	@ncalib  Number of calibration samples.
+ * Return:
+ *	Pointer to NVQNET	OK
+ *	NULL			Fails
+-----------------------------------------------------------------*/
+NVQNET *nvnet_quantize(NVNET *nnet, const nnc_real_t *calib, unsigned int ncalib)
+{
+	int k;
+	NVQNET *qnet;
+	double *amax;
+	NVLAYER *last;
+
+	if(nnet==NULL || nnet->nl==0 || calib==NULL || ncalib==0)
+		return NULL;
+
+	if( nvq_check_nvnet(nnet) <0 )
+		return NULL;
+
+	/* 1. Calibrate */
+	amax=calloc(nnet->nl+1, sizeof(double));
+	if(amax==NULL)
+		return NULL;
+	nvq_calibrate(nnet, calib, ncalib, amax);
+
+	/* 2. Create NVQNET */
+	qnet=calloc(1, sizeof(NVQNET));
+	if(qnet==NULL) {
+		free(amax);
+		return NULL;
+	}
+	qnet->nl=nnet->nl;
+	qnet->insize=nvnet_input_size(nnet);
+	last=nnet->nvlayers[nnet->nl-1];
+	qnet->softmax= (last->transfunc==func_softmax);
+
+	qnet->layers=calloc(qnet->nl, sizeof(NVQLAYER));
+	qnet->qin=calloc(nvq_align(qnet->insize), sizeof(int8_t));
+	if(qnet->layers==NULL || qnet->qin==NULL) {
+		free(amax);
+		free_nvqnet(qnet);
+		return NULL;
+	}
+
+	/* 3. Quantize layers, xscale of a layer is yscale of the previous one */
+	for(k=0; k< qnet->nl; k++) {
+		if( nvq_create_layer(qnet->layers+k, nnet->nvlayers[k], k==qnet->nl-1,
+				     k>0 ? qnet->layers[k-1].yscale : nvq_scale(amax[0]), amax[k+1]) <0 ) {
+			printf("%s: Fail to create layers[%d]!\n", __func__, k);
+			free(amax);
+			free_nvqnet(qnet);
+			return NULL;
+		}
+	}
+
+	free(amax);
+	return qnet;
+}
+
+
+/*-------------------------------------------------
+	Free a NVQNET.
+--------------------------------------------------*/
+void free_nvqnet(NVQNET *qnet)
+{
+	int k;
+	NVQLAYER *qlayer;
+
+	if(qnet==NULL)
+		return;
+
+	for(k=0; qnet->layers && k< qnet->nl; k++) {
+		qlayer=qnet->layers+k;
+		free(qlayer->qw);
+		free(qlayer->wscale);
+		free(qlayer->wsum);
+		free(qlayer->bias);
+		free(qlayer->cols);
+		free(qlayer->qout);
+		free(qlayer->dout);
+	}
+	free(qnet->layers);
+	free(qnet->qin);
+	free(qnet);
+}
+
+
+/*-------------------------------------------------
+ * Apply bias/transfunc to a dot product, then
+ * store the result to qout(requantized) OR dout.
+--------------------------------------------------*/
+static inline void nvq_store_output(const NVQLAYER *qlayer, int n, unsigned int pos, int32_t acc, float inv)
+{
+	nnc_real_t u;
+
+	u=acc*qlayer->xscale*qlayer->wscale[n] - qlayer->bias[n];
+	if(qlayer->transfunc)
+		u=(*qlayer->transfunc)(u, 0, NORMAL_FUNC);
+
+	if(qlayer->dout)
+		qlayer->dout[pos]=u;
+	else
+		qlayer->qout[pos]=nvq_quantize_value(u, inv);
+}
+
+/*-------------------------------------------------
+ * CONV3X3: int8 im2col, then dot products.
+ * Patches are lowered row by row of outputs,
+ * so cols[] is ONLY ow*Kp bytes.
+--------------------------------------------------*/
+static void nvq_conv3x3_forward(NVQLAYER *qlayer, const int8_t *x)
+{
+	int n, chindex, ii, jj;
+	unsigned int i,j;
+	unsigned int np=qlayer->ow*qlayer->oh;
+	unsigned int Kp=qlayer->Kp;
+	int8_t *col;
+	const int8_t *src;
+	float inv=1.0f/qlayer->yscale;
+
+	for(i=0; i< qlayer->oh; i++) {
+	    /* 1. im2col of row i, zero padding of cols[j][K:Kp] is NOT touched */
+	    for(j=0; j< qlayer->ow; j++) {
+		col=qlayer->cols+j*Kp;
+		for(chindex=0; chindex< qlayer->nchan; chindex++) {
+		    src=x+chindex*qlayer->imw*qlayer->imh+i*qlayer->imw+j;
+		    for(ii=0; ii<3; ii++) {
+			for(jj=0; jj<3; jj++)
+			    *(col++)=src[ii*qlayer->imw+jj];
+		    }
+		}
+	    }
+
+	    /* 2. Each patch with all filters, the patch stays in L1 cache */
+	    for(j=0; j< qlayer->ow; j++) {
+		col=qlayer->cols+j*Kp;
+		for(n=0; n< qlayer->nout; n++)
+		    nvq_store_output(qlayer, n, n*np+i*qlayer->ow+j,
+				     nvq_dot(qlayer->qw+n*Kp, col, Kp, qlayer->wsum[n]), inv);
+	    }
+	}
+}
+
+/*-------------------------------------------------
+	MAXPOOL2X2 on int8 data.
+--------------------------------------------------*/
+static void nvq_maxpool2x2_forward(NVQLAYER *qlayer, const int8_t *x)
+{
+	int n, ii, jj;
+	unsigned int i,j, pos;
+	const int8_t *src;
+	int8_t *dst;
+
+	for(n=0; n< qlayer->nout; n++) {
+	    src=x+n*qlayer->imw*qlayer->imh;
+	    dst=qlayer->qout+n*qlayer->ow*qlayer->oh;
+	    for(i=0; i< qlayer->oh; i++) {
+		for(j=0; j< qlayer->ow; j++) {
+		    pos=i*qlayer->ow+j;
+		    dst[pos]=src[(2*i)*qlayer->imw+2*j];
+		    for(ii=0; ii<2; ii++) {
+			for(jj=0; jj<2; jj++) {
+			    if(src[(2*i+ii)*qlayer->imw+2*j+jj] > dst[pos])
+				dst[pos]=src[(2*i+ii)*qlayer->imw+2*j+jj];
+			}
+		    }
+		}
+	    }
+	}
+
+	/* The last layer */
+	if(qlayer->dout) {
+	    for(pos=0; pos< qlayer->nout*qlayer->ow*qlayer->oh; pos++)
+		qlayer->dout[pos]=qlayer->qout[pos]*qlayer->yscale;
+	}
+}
+
+/*-------------------------------------------------
+	DENSE: W*x, one dot product per row.
+--------------------------------------------------*/
+static void nvq_dense_forward(NVQLAYER *qlayer, const int8_t *x)
+{
+	int n;
+	float inv=1.0f/qlayer->yscale;
+
+	for(n=0; n< qlayer->nout; n++)
+		nvq_store_output(qlayer, n, n, nvq_dot(qlayer->qw+n*qlayer->Kp, x, qlayer->Kp, qlayer->wsum[n]), inv);
+}
+
+/*-------------------------------------------------
+	Softmax of dout[n], in place.
+--------------------------------------------------*/
+static void nvq_softmax(nnc_real_t *dout, unsigned int n)
+{
+	unsigned int i;
+	nnc_real_t dmax, sum;
+
+	dmax=dout[0];
+	for(i=1; i<n; i++) {
+		if(dout[i] > dmax)
+			dmax=dout[i];
+	}
+
+	sum=0.0;
+	for(i=0; i<n; i++) {
+		dout[i]=exp(dout[i]-dmax);
+		sum += dout[i];
+	}
+	for(i=0; i<n; i++)
+		dout[i] /= sum;
+}
+
+
+/*-----------------------------------------------------------------
+ * Feed forward one sample through a NVQNET.
+ * Params:
+ *	@qnet	 A NVQNET, by nvnet_quantize().
+ *	@din	 Input data din[insize], as the NVNET.
+ *	@dout	 To pass out results, dout[nvqnet_output_size()].
+ *		 If NULL, results are ONLY in dout of the last layer.
+ * Return:
+ *	0	OK
+ *	<0	Fails
+-----------------------------------------------------------------*/
+int nvqnet_feed_forward(NVQNET *qnet, const nnc_real_t *din, nnc_real_t *dout)
+{
+	int k;
+	unsigned int i;
+	NVQLAYER *qlayer;
+	const int8_t *x;
+	float inv;
+
+	if(qnet==NULL || din==NULL)
+		return -1;
+
+	/* 1. Quantize input data */
+	inv=1.0f/qnet->layers[0].xscale;
+	for(i=0; i< qnet->insize; i++)
+		qnet->qin[i]=nvq_quantize_value(din[i], inv);
+
+	/* 2. Layers */
+	x=qnet->qin;
+	for(k=0; k< qnet->nl; k++) {
+		qlayer=qnet->layers+k;
+		switch(qlayer->type) {
+		    case NVQ_LAYER_CONV3X3:
+			nvq_conv3x3_forward(qlayer, x);
+			break;
+		    case NVQ_LAYER_MAXPOOL2X2:
+			nvq_maxpool2x2_forward(qlayer, x);
+			break;
+		    case NVQ_LAYER_DENSE:
+			nvq_dense_forward(qlayer, x);
+			break;
+		}
+		x=qlayer->qout;
+	}
+
+	/* 3. Outputs */
+	qlayer=qnet->layers+qnet->nl-1;
+	if(qnet->softmax)
+		nvq_softmax(qlayer->dout, nvqnet_output_size(qnet));
+	if(dout)
+		memcpy(dout, qlayer->dout, nvqnet_output_size(qnet)*sizeof(nnc_real_t));
+
+	return 0;
+}
+
+
+/*-------------------------------------------------
+	Size of outputs of a NVQNET, for one sample.
+--------------------------------------------------*/
+unsigned int nvqnet_output_size(const NVQNET *qnet)
+{
+	const NVQLAYER *qlayer;
+
+	if(qnet==NULL)
+		return 0;
+
+	qlayer=qnet->layers+qnet->nl-1;
+	return qlayer->nout*qlayer->ow*qlayer->oh;
+}
+
+
+/*-----------------------------------------------------------------
+ * Note:
+ *	Memory footprint of a NVQNET: weights, scales, bias and data
+ *	buffers, as nvnet_mem_footprint().
+ * Return:
+ *	Number of bytes.
+-----------------------------------------------------------------*/
+unsigned long nvqnet_mem_footprint(const NVQNET *qnet)
+{
+	int k;
+	unsigned long size;
+	const NVQLAYER *qlayer;
+	unsigned int osize;
+
+	if(qnet==NULL)
+		return 0;
+
+	size=sizeof(NVQNET)+qnet->nl*sizeof(NVQLAYER);
+	size += nvq_align(qnet->insize)*sizeof(int8_t);
+
+	for(k=0; k< qnet->nl; k++) {
+		qlayer=qnet->layers+k;
+		osize=qlayer->nout*qlayer->ow*qlayer->oh;
+		if(qlayer->qw)
+			size += (unsigned long)qlayer->nout*qlayer->Kp*sizeof(int8_t)
+				+qlayer->nout*(sizeof(float)+sizeof(int32_t)+sizeof(float));
+		if(qlayer->cols)
+			size += (unsigned long)qlayer->ow*qlayer->Kp*sizeof(int8_t);
+		if(qlayer->qout)
+			size += nvq_align(osize)*sizeof(int8_t);
+		if(qlayer->dout)
+			size += osize*sizeof(nnc_real_t);
+	}
+
+	return size;
+}
@@ -0,0 +1,94 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#ifndef __NVQUANT_H__
+#define __NVQUANT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nnc.h"
+
+typedef struct nvq_layer NVQLAYER;
+typedef struct nvq_net   NVQNET;
+
+/*-------------------------------------------------------
+Int8 inference graph of a trained NVNET, see nvnet_quantize().
+
+1. Weights are quantized per output channel(filter/nvcell):
+	w = qw*wscale[n],	qw in [-127 127]
+   Data(inputs/outputs of layers) per tensor, with scales
+   from the calibration set:
+	x = qx*xscale,		qx in [-127 127]
+2. Dot products are accumulated in int32, then
+	u = acc*xscale*wscale[n] - bias[n]
+	y = transfunc(u)
+   and y is requantized with the next layer's xscale.
+3. MAXPOOL2X2 works on int8 data directly.
+4. Outputs of the last layer are real values, with softmax
+   if the last NVLAYER of NVNET has func_softmax.
+*------------------------------------------------------*/
+#define NVQ_KALIGN	32	/* Dot product length and int8 data buffers are padded to it with 0, for 256bit kernels */
+
+/* Layer types */
+enum nvq_layer_type {
+	NVQ_LAYER_CONV3X3 = 1,
+	NVQ_LAYER_MAXPOOL2X2,
+	NVQ_LAYER_DENSE,
+};
+
+/* Int8 dot product kernels, see nvq_set_kernel() */
+enum nvq_kernel {
+	NVQ_KERNEL_SCALAR = 0,	/* Scalar loops */
+	NVQ_KERNEL_AVX2,	/* AVX2: int8 to int16, then madd */
+	NVQ_KERNEL_VNNI,	/* AVX-VNNI or AVX512-VNNI: u8*s8 dpbusd */
+};
+
+struct nvq_layer
+{
+	int type;			/* enum nvq_layer_type */
+	unsigned int nout;		/* Number of output channels: CONV3X3/MAXPOOL2X2 nf, DENSE nc */
+	unsigned int nchan;		/* CONV3X3: number of input channels */
+	unsigned int imw, imh;		/* CONV3X3/MAXPOOL2X2: input size */
+	unsigned int ow, oh;		/* CONV3X3/MAXPOOL2X2: output size, 1x1 for DENSE */
+	unsigned int K;			/* CONV3X3/DENSE: length of dot products, nchan*9 OR nin */
+	unsigned int Kp;		/* K padded to NVQ_KALIGN */
+
+	int8_t *qw;			/* CONV3X3/DENSE: weights qw[nout][Kp], row-major, padded with 0 */
+	float *wscale;			/* Weight scales wscale[nout] */
+	int32_t *wsum;			/* wsum[n]=SUM(qw[n][:]), to offset u8 data for VNNI kernels */
+	float *bias;			/* bias[nout], as CONV3X3 dvs[] OR NVCELL dv. 0 if NO bias */
+	nnc_real_t (*transfunc)(nnc_real_t, nnc_real_t, int);	/* As CONV3X3/NVCELL transfunc */
+
+	float xscale;			/* Scale of input data */
+	float yscale;			/* Scale of output data, as xscale of the next layer */
+
+	int8_t *cols;			/* CONV3X3: im2col patches of an output row i, cols[ow][Kp], cols[j][chan*9+ii*3+jj] */
+	int8_t *qout;			/* Int8 outputs qout[nout*ow*oh], padded to NVQ_KALIGN with 0
+					 * NULL for the last CONV3X3/DENSE layer.
+					 */
+	nnc_real_t *dout;		/* The last layer: real outputs dout[nout*ow*oh] */
+};
+
+struct nvq_net
+{
+	unsigned int nl;		/* Number of layers */
+	NVQLAYER *layers;		/* layers[nl] */
+	unsigned int insize;		/* Size of input data for one sample */
+	int8_t *qin;			/* Quantized input data qin[insize], padded to NVQ_KALIGN with 0 */
+	bool softmax;			/* Apply softmax to outputs of the last layer */
+};
+
+NVQNET *nvnet_quantize(NVNET *nnet, const nnc_real_t *calib, unsigned int ncalib);
+void free_nvqnet(NVQNET *qnet);
+int nvqnet_feed_forward(NVQNET *qnet, const nnc_real_t *din, nnc_real_t *dout);
+unsigned int nvqnet_output_size(const NVQNET *qnet);
+unsigned long nvqnet_mem_footprint(const NVQNET *qnet);
+int nvq_set_kernel(int kernel);
+void nvq_cpu_dispatch(void);
+
+#endif
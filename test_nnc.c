@@ -41,12 +41,12 @@ int main(void)
 	int wm_inpnum=3; /* number of input data for each middle nvcell */
 	int wo_inpnum=3; /* number of input data for each output nvcell */
 
-	double err;
+	nnc_real_t err;
 	int ns=8; /* input sample number + teacher value */
 
 	bool gradient_checked=false;
 
-	double pin[8*4]= /* 3 input + 1 teacher value */
+	nnc_real_t pin[8*4]= /* 3 input + 1 teacher value */
 #if 0 /* when [0]+[1]+[2]>=2, output [3]=1 */
 {
 1,1,1,1,
@@ -100,7 +100,7 @@ while(1) {
 
 
 
-	double data_input[3];
+	nnc_real_t data_input[3];
 
 
 do {  /* test while */
@@ -144,7 +144,7 @@ do {  /* test while */
 		for(i=0; i<ns; i++)
     		{
 			/* 1. update data_input */
-			memcpy(data_input, pin+4*i, 3*sizeof(double));
+			memcpy(data_input, pin+4*i, 3*sizeof(nnc_real_t));
 
 			/* 2. nvnet feed forward  */
 			err += nvnet_feed_forward(nnet, pin+(3+i*4),func_lossMSE);
@@ -186,7 +186,7 @@ do {  /* test while */
 
 	/* ---- check gradient again ---- */
 	i=2;
-	memcpy(data_input, pin+4*i, 3*sizeof(double));
+	memcpy(data_input, pin+4*i, 3*sizeof(nnc_real_t));
 	nvnet_feed_forward(nnet, pin+(3+i*4),func_lossMSE);
 	nvnet_feed_backward(nnet);
 	nvnet_check_gradient(nnet, pin+(3+i*4), func_lossMSE);
@@ -197,7 +197,7 @@ do {  /* test while */
 	for(i=0;i<ns;i++)
     	{
 		/* update data_input */
-		memcpy(data_input, pin+4*i,wi_inpnum*sizeof(double));
+		memcpy(data_input, pin+4*i,wi_inpnum*sizeof(nnc_real_t));
 
 		/* feed forward wi->wm->wo layer */
 		nvlayer_feed_forward(wi_layer);
@@ -31,6 +31,7 @@ Midas Zhou
 #include <sys/stat.h>
 
 #include "nnc.h"
+#include "idxdata.h"
 #include "actfs.h"
 
 
@@ -66,9 +67,9 @@ int main(void)
          */
 
 	/* Note: each 28x28 pixles, gray values[0 255] are normalized to [0 1.0] */
-	double *train_imgdata = NULL;
+	nnc_real_t *train_imgdata = NULL;
 	if(BUFFER_IMGDATA) {
-	 	train_imgdata=(double *)malloc(TRAIN_IMGTOTAL*28*28*sizeof(double));
+	 	train_imgdata=(nnc_real_t *)malloc(TRAIN_IMGTOTAL*28*28*sizeof(nnc_real_t));
 		if(train_imgdata==NULL) exit(1);
 	}
 	unsigned char train_target[TRAIN_IMGTOTAL];	   /* digits 0~9 */
@@ -76,19 +77,19 @@ int main(void)
 	/* Test data buffer */
 	const int TEST_IMGTOTAL=5000;
 	/* Note: each 28x28 pixles, gray values[0 255] are normalized to [0 1.0] */
-	double *test_imgdata=NULL;
+	nnc_real_t *test_imgdata=NULL;
 	if(BUFFER_IMGDATA) {
-		test_imgdata= (double *)malloc(TEST_IMGTOTAL*28*28*sizeof(double));
+		test_imgdata= (nnc_real_t *)malloc(TEST_IMGTOTAL*28*28*sizeof(nnc_real_t));
 		if(test_imgdata==NULL) exit(1);
 	}
 	unsigned char test_target[TEST_IMGTOTAL];	   /* digits 0~9 */
 
 
         /* To link it to input_layer->pins */
-        double data_input[28*28]; /* Normalized to [0 1.0] */
-        double data_target[10]; /* one_hot target values. ONLY one '1' and others are '0'. */
+        nnc_real_t data_input[28*28]; /* Normalized to [0 1.0] */
+        nnc_real_t data_target[10]; /* one_hot target values. ONLY one '1' and others are '0'. */
 
-        double err, batch_err, mean_err;
+        nnc_real_t err, batch_err, mean_err;
         int nb=1;     /* number of batches */
         int bs=TRAIN_IMGTOTAL/nb; //500; /*  batch size; <=TRAIN_IMGTOTAL  input samples (numbers + teacher value) for each batch training */
 
@@ -99,132 +100,45 @@ int main(void)
 
   	////////////* Read MNIST handwriten digit database *////////////
 
-        /***   		---- Image data ---
-          [offset]   [type]          [value]             [description]
-          0000     32bit integer   0x00000803(2051)     magic number
-          0004     32bit integer   10000                number of images
-          0008     32bit integer   28                   number of rows
-          0012     32bit integer   28                   number of columns
-          (followings are all pixel data -----: pdata )
-          0016     unsigned byte   ??                   pixel
-          0017     unsigned byte   ??                   pixel
-          ... ...
-
-            		---- Label data ---
-          [offset]   [type]          [value]             [description]
-          0000     32bit integer   0x00000801(2049)     magic number
-          0004     32bit integer   10000                number of items
-          (followings are all label data -----: )
-          0008     unsigned byte   ??                   label
-          0009     unsigned byte   ??                   label
-          ... ...
-         */
-
+	/* IDX files are mmaped, see idxdata.h for the file format.
+	 * The first TRAIN_IMGTOTAL images are for training, and the next TEST_IMGTOTAL images for testing.
+	 */
 	const char *train_images_path="train-images.idx3-ubyte";
 	const char *train_labels_path="train-labels.idx1-ubyte";
 
-	int fd0, fd1;
-	struct stat  sb;
-        unsigned int magic;
-        unsigned int imgcnt, labelcnt;
-        unsigned int  nr,nc;
-	void *addr0, *addr1;
-        unsigned char *pdata0, *pdata1;
-	unsigned char *pTrainImg, *pTestImg;
-        //unsigned int offset;      /* offset from pdata */
-
-	/* ------------ Read in data for training ------------ */
-
-        /* M1. Open MNIST image data file */
-	fd0=open(train_images_path, O_RDONLY);
-        if(fd0<0) {
-                printf("%s: Fail to open image data file!\n", __func__);
+	IDXDATA *images, *labels;
+	const unsigned char *pTrainImg, *pTestImg;
+
+        /* M1. Open MNIST image/label data files */
+	images=new_idxdata(train_images_path);
+	labels=new_idxdata(train_labels_path);
+	if(images==NULL || labels==NULL)
 		exit(1);
-        }
-	if(fstat(fd0, &sb)<0)
+        printf("MNIST '%s': imgcnt=%d, nr=%d, nc=%d\n", train_images_path, images->count, images->dims[1], images->dims[2]);
+        printf("MNIST '%s': labelcnt=%d\n", train_labels_path, labels->count);
+	if( images->itemsize!=28*28 || images->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL
+	    || labels->itemsize!=1 || labels->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL ) {
+		printf("%s: Invalid MNIST data files!\n", __func__);
 		exit(1);
+	}
 
-        /* M2. MMAP image data file */
-        //addr0=mmap(NULL, 8*1024*1024, PROT_READ, MAP_PRIVATE, fd0, 0);
-        addr0=mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd0, 0);
-        if(addr0==MAP_FAILED) {
-                        printf("%s: Fail to mmap file!\n", __func__);
-			perror("mmap");
-			close(fd0);
-			exit(1);
-         }
-	pdata0 = (unsigned char *)addr0;
-
-        /* M3. Read MNIST data header */
-        magic=be32toh( *(unsigned int*)(pdata0+0) );
-        imgcnt=be32toh( *(unsigned int*)(pdata0+4) );
-        nr=be32toh( *(unsigned int*)(pdata0+8) );
-        nc=be32toh( *(unsigned int*)(pdata0+12) );
-        printf("MNIST '%s': magic=%d, imgcnt=%d, nr=%d, nc=%d\n", train_images_path, magic, imgcnt, nr,nc);
-	/* Result:  MNIST t10k-images: magic=2051, imgcnt=10000, nr=28, nc=28 */
-
-	/* M4. Assign pdata to the beginning of pixel data */
-        pdata0 +=16; //(unsigned char*)pdata+16;
-	pdata0 +=0*28*28; /* Skip some images, they may be errors. */
-
-	pTrainImg = pdata0;
-	pTestImg = pdata0+TRAIN_IMGTOTAL*28*28;
+	/* M2. Image data in place, as uint8 */
+	pTrainImg = idxdata_item(images, 0);
+	pTestImg = idxdata_item(images, TRAIN_IMGTOTAL);
 
 if(BUFFER_IMGDATA) {
-	/* M5. Copy into train_imgdata[] */
-	for(i=0; i<TRAIN_IMGTOTAL*28*28; i++)
-		train_imgdata[i] = (double)pdata0[i] / 255.0;
-
-	/* M6. Copy into test_imgdata[] */
-	for(i=0; i<TEST_IMGTOTAL*28*28; i++) {
-		test_imgdata[i] = (double)pdata0[TRAIN_IMGTOTAL*28*28+i] / 255.0;
-		//test_imgdata[i] = (double)pdata[i];
-	}
+	/* M3. Copy into train_imgdata[]/test_imgdata[] */
+	for(i=0; i<TRAIN_IMGTOTAL; i++)
+		idxdata_item_real(images, i, 1.0/255.0, train_imgdata+i*28*28);
+	for(i=0; i<TEST_IMGTOTAL; i++)
+		idxdata_item_real(images, TRAIN_IMGTOTAL+i, 1.0/255.0, test_imgdata+i*28*28);
 }
 
-        /* MA1. Open MNIST label data file. */
-        fd1=open(train_labels_path, O_RDONLY);
-        if(fd1<0) {
-                printf("%s: Fail to open label data file!\n", __func__);
-                exit(1);
-        }
-	if(fstat(fd1, &sb)<0)
-		exit(1);
-
-        /* MA2. MMAP file */
-        //addr1=mmap(NULL, 10*1024, PROT_READ, MAP_PRIVATE, fd1, 0);
-        addr1=mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd1, 0);
-        if(addr1==MAP_FAILED) {
-                        printf("%s: Fail to mmap file!\n", __func__);
-                        perror("mmap");
-                        close(fd1);
-                        exit(1);
-        }
-	pdata1 = (unsigned char *)addr1;
-
-        /* MA3. Read MNIST data header */
-        magic=be32toh( *(unsigned int*)(pdata1+0) );
-        labelcnt=be32toh( *(unsigned int*)(pdata1+4) );
-        printf("MNIST '%s': magic=%d, labelcnt=%d\n", train_labels_path, magic, labelcnt);
-
-	/* MA4. Assign pdata to the beginning of label data */
-        pdata1 +=8;
-	pdata1 +=0*1; /* Skip some images, they may be errors. */
-
-	/* MA5. Copy into train_target[] */
-	for(i=0; i<TRAIN_IMGTOTAL; i++) {
-		train_target[i] = pdata1[i];
-		//printf("train_target[%d]: %d\n", i, train_target[i]);
-	}
-
-	/* MA6. Copy into test_target[] */
-	for(i=0; i<TEST_IMGTOTAL; i++) {
-		test_target[i] = pdata1[TRAIN_IMGTOTAL+i];
-		//printf("test_target[%d]: %d\n", i, train_target[i]);
-	}
-
-
-	/* ------------ TODO:  Read in data for testing ------------ */
+	/* M4. Copy into train_target[]/test_target[] */
+	for(i=0; i<TRAIN_IMGTOTAL; i++)
+		train_target[i] = *idxdata_item(labels, i);
+	for(i=0; i<TEST_IMGTOTAL; i++)
+		test_target[i] = *idxdata_item(labels, TRAIN_IMGTOTAL+i);
 
   	////////////* END: Read MNIST handwriten digit database *//////////
 
@@ -252,6 +166,7 @@ if(BUFFER_IMGDATA) {
         nnet->nvlayers[2]=wo_layer;
 
         /* 5. Init params */
+        nnc_set_seed(2026); /* Reproducible init params */
         nvnet_init_params(nnet);
 
 /*  <<<<<<<<<<<<<<<<<  CNN Training Process  >>>>>>>>>>>>>  */
@@ -284,8 +199,7 @@ if(BUFFER_IMGDATA) {
 
                         /* 8.2.R1. update ONE sample for input: data_input, data_target */
 			#if !BUFFER_IMGDATA /* --- CORSS_CHECK T.1 --- */
-                        for(k=0; k<28*28; k++)
-				data_input[k]=pTrainImg[(nb*bs+i)*(28*28)+k]/255.0;
+			nvnet_set_input_u8(nnet, pTrainImg+(nb*bs+i)*(28*28), 1.0/255.0); /* From mmap, normalized by the first layer */
 			#else /* --- CORSS_CHECK T.1 --- */
 			conv_layer->conv3x3->din = train_imgdata+(nb*bs+i)*(28*28);
 			#endif
@@ -338,8 +252,7 @@ END_WHILE:
         {
                 /* T1. Update data_input,data_target */
 		#if !BUFFER_IMGDATA  /* --- CORSS_CHECK 8.2.R1 --- */
-                for(k=0; k<28*28; k++)
-			 data_input[k]=pTestImg[i*(28*28)+k]/255.0;
+		nvnet_set_input_u8(nnet, pTestImg+i*(28*28), 1.0/255.0); /* From mmap, normalized by the first layer */
 		#else  /* --- CORSS_CHECK 8.2.R1 --- */
 		conv_layer->conv3x3->din = test_imgdata+i*(28*28);
 		#endif
@@ -379,10 +292,8 @@ END_WHILE:
         free_nvnet(nnet); /* free nvnet also free its nvlayers and nvcells inside */
 
         /* Unmap and close */
-        munmap(addr0, 8*1024*1024);
-        close(fd0);
-        munmap(addr1, 8*1024);
-        close(fd1);
+        free_idxdata(images);
+        free_idxdata(labels);
 
 
 	return 0;
@@ -40,15 +40,42 @@ Midas Zhou
 #include <time.h>
 
 #include "nnc.h"
+#include "idxdata.h"
 #include "actfs.h"
+#include "nvmodel.h"
 
 
 
 #define ERR_LIMIT       0.0025 //0.001
 #define BUFFER_IMGDATA  0  /* 1---MNIST image data are buffered to train_imgdata/test_imgdata
-				  Except MNIST label data, they are ALWAYS buffered to train_target[]/test_target[]
+				  Except MNIST label data, they are ALWAYS buffered to test_target[]
 			      0---NO buffer, read imgdata from MMAP directly
+			      Train images/targets for training are ALWAYS prefetched by the feeder.
 			    */
+#define TRAIN_THREADS	0  /* >0---Train by mini-batches of MT_BATCH samples, with TRAIN_THREADS threads, see new_nvtrainer()
+			      0---Train in this thread
+			    */
+#define MT_BATCH	32 /* Samples of a mini-batch prefetched by the feeder, bs SHOULD be multiple of it */
+#define FEED_SLOTS	2  /* Slots of the feeder, 2 for double buffering, see new_idxfeeder() */
+#define RAND_SEED	20261017 /* Seed of init params and shuffled epochs, runs are reproducible with the same seed */
+#define MODEL_PATH	"mnist_cnn.nvm"	/* Trained model is saved here, load it by nvnet_load() */
+#define MINI_BATCH	0  /* 1---Accumulate gradients of bs samples, then update params once with averaged gradients
+			      0---Update params after each sample
+			    */
+#define GCHECK_PROBES	1000 /* Params sampled to check gradients with the first sample, 0 for ALL, see nvnet_check_gradient_sampled() */
+#define GCHECK_THREADS	4
+#ifdef NNC_FLOAT32
+#define GCHECK_FATAL	0  /* float32: A probe across a kink of ReLU/MAXPOOL2X2 by the bigger desp_params may fail */
+#define WINOGRAD_TOL	1.0e-5 /* Max. abs diff of Winograd v.s. direct douts to use it, see conv3x3_check_winograd() */
+#define FUSION_TOL	1.0e-5 /* Max. abs diff of fused v.s. layer by layer conv3x3+maxpool2x2, see conv3x3_check_fusion() */
+#else
+#define GCHECK_FATAL	1  /* Exit if the gradient check fails */
+#define WINOGRAD_TOL	1.0e-9
+#define FUSION_TOL	1.0e-12
+#endif
+#define OPTIM_TYPE	NVOPTIM_SGD /* Optimizer for MINI_BATCH/TRAIN_THREADS, see enum nvoptim_type */
+/* Learning rate of the optimizer for a batch of n samples, SGD/momentum rates are scaled by n as gradients are averaged */
+#define OPTIM_RATE(n)	(OPTIM_TYPE < NVOPTIM_RMSPROP ? instLrate*(n) : 0.001)
 
 float instLrate=0.0025; /* OR 0.005, Instant learning rate */
 
@@ -62,34 +89,35 @@ int main(void)
 	/* Train data buffer */
 	const int TRAIN_IMGTOTAL=5000; //20000;
 	/* Note: each 28x28 pixles, gray values[0 255] are normalized to [0 1.0] */
-	double *train_imgdata = NULL;
+	nnc_real_t *train_imgdata = NULL;
 	if(BUFFER_IMGDATA) {
-	 	train_imgdata=(double *)malloc(TRAIN_IMGTOTAL*28*28*sizeof(double));
+	 	train_imgdata=(nnc_real_t *)malloc(TRAIN_IMGTOTAL*28*28*sizeof(nnc_real_t));
 		if(train_imgdata==NULL) exit(1);
 	}
-	unsigned char train_target[TRAIN_IMGTOTAL];	   /* digits 0~9 */
 
 	/* Test data buffer */
 	const int TEST_IMGTOTAL=5000;
 	/* Note: each 28x28 pixles, gray values[0 255] are normalized to [0 1.0] */
-	double *test_imgdata=NULL;
+	nnc_real_t *test_imgdata=NULL;
 	if(BUFFER_IMGDATA) {
-		test_imgdata= (double *)malloc(TEST_IMGTOTAL*28*28*sizeof(double));
+		test_imgdata= (nnc_real_t *)malloc(TEST_IMGTOTAL*28*28*sizeof(nnc_real_t));
 		if(test_imgdata==NULL) exit(1);
 	}
 	unsigned char test_target[TEST_IMGTOTAL];	   /* digits 0~9 */
 
 
         /* To link it to input_layer->pins */
-        double data_input[28*28]; /* Normalized to [0 1.0] */
-        double data_target[10]; /* one_hot target values. ONLY one '1' and others are '0'. */
+        nnc_real_t data_input[28*28]; /* Normalized to [0 1.0] */
+        nnc_real_t data_target[10]; /* one_hot target values. ONLY one '1' and others are '0'. */
+        const nnc_real_t *feed_input, *feed_target; /* Input/target data of a mini-batch, in a feeder slot */
+        int n;
 
 	/* Fliters */
 	int numFilters=8;
         int numFiltersC2=32;
 
 	/* Training */
-        double err, batch_err, mean_err;
+        nnc_real_t err, batch_err, mean_err;
         int nb=1;     /* number of batches */
         int bs=TRAIN_IMGTOTAL/nb; //500; /*  batch size; <=TRAIN_IMGTOTAL  input samples (numbers + teacher value) for each batch training */
 
@@ -106,133 +134,43 @@ int main(void)
 
   	////////////* Read MNIST handwriten digit database *////////////
 
-        /* **   	---- Image data ---
-         *
-          [offset]   [type]          [value]             [description]
-          0000     32bit integer   0x00000803(2051)     magic number
-          0004     32bit integer   10000                number of images
-          0008     32bit integer   28                   number of rows
-          0012     32bit integer   28                   number of columns
-          (followings are all pixel data -----: pdata )
-          0016     unsigned byte   ??                   pixel
-          0017     unsigned byte   ??                   pixel
-          ... ...
-         */
-
-        /* **   	---- Label data ---
-         *
-          [offset]   [type]          [value]             [description]
-          0000     32bit integer   0x00000801(2049)     magic number
-          0004     32bit integer   10000                number of items
-          (followings are all label data -----: )
-          0008     unsigned byte   ??                   label
-          0009     unsigned byte   ??                   label
-          ... ...
-         */
-
+	/* IDX files are mmaped, see idxdata.h for the file format.
+	 * The first TRAIN_IMGTOTAL images are for training, and the next TEST_IMGTOTAL images for testing.
+	 */
 	const char *train_images_path="train-images.idx3-ubyte";
 	const char *train_labels_path="train-labels.idx1-ubyte";
 
-	int fd0, fd1;
-	struct stat  sb;
-        unsigned int magic;
-        unsigned int imgcnt, labelcnt;
-        unsigned int  nr,nc;
-	void *addr0, *addr1;
-        unsigned char *pdata0, *pdata1;
-	unsigned char *pTrainImg, *pTestImg;
-
-	/* ------------ Read in data for training ------------ */
-
-        /* M1. Open MNIST image data file */
-	//fd0=open("t10k-images.idx3-ubyte", O_RDONLY);
-	fd0=open(train_images_path, O_RDONLY);
-        if(fd0<0) {
-                printf("%s: Fail to open image data file!\n", __func__);
+	IDXDATA *images, *labels;
+	const unsigned char *pTrainImg, *pTestImg;
+
+        /* M1. Open MNIST image/label data files */
+	images=new_idxdata(train_images_path);
+	labels=new_idxdata(train_labels_path);
+	if(images==NULL || labels==NULL)
 		exit(1);
-        }
-	if(fstat(fd0, &sb)<0)
+        printf("MNIST '%s': imgcnt=%d, nr=%d, nc=%d\n", train_images_path, images->count, images->dims[1], images->dims[2]);
+        printf("MNIST '%s': labelcnt=%d\n", train_labels_path, labels->count);
+	if( images->itemsize!=28*28 || images->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL
+	    || labels->itemsize!=1 || labels->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL ) {
+		printf("%s: Invalid MNIST data files!\n", __func__);
 		exit(1);
+	}
 
-        /* M2. MMAP image data file */
-        //addr0=mmap(NULL, 8*1024*1024, PROT_READ, MAP_PRIVATE, fd0, 0);
-        addr0=mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd0, 0);
-        if(addr0==MAP_FAILED) {
-                        printf("%s: Fail to mmap file!\n", __func__);
-			perror("mmap");
-			close(fd0);
-			exit(1);
-         }
-	pdata0 = (unsigned char *)addr0;
-
-        /* M3. Read MNIST data header */
-        magic=be32toh( *(unsigned int*)(pdata0+0) );
-        imgcnt=be32toh( *(unsigned int*)(pdata0+4) );
-        nr=be32toh( *(unsigned int*)(pdata0+8) );
-        nc=be32toh( *(unsigned int*)(pdata0+12) );
-        printf("MNIST '%s': magic=%d, imgcnt=%d, nr=%d, nc=%d\n", train_images_path, magic, imgcnt, nr,nc);
-	/* Result:  MNIST t10k-images: magic=2051, imgcnt=10000, nr=28, nc=28 */
-
-	/* M4. Assign pdata to the beginning of pixel data */
-        pdata0 +=16; //(unsigned char*)pdata+16;
-	pdata0 +=0*28*28; /* Skip some images, they may be errors. */
-
-	pTrainImg = pdata0;
-	pTestImg = pdata0+TRAIN_IMGTOTAL*28*28;
+	/* M2. Image data in place, as uint8 */
+	pTrainImg = idxdata_item(images, 0);
+	pTestImg = idxdata_item(images, TRAIN_IMGTOTAL);
 
 if(BUFFER_IMGDATA) {
-	/* M5. Copy into train_imgdata[] */
-	for(i=0; i<TRAIN_IMGTOTAL*28*28; i++)
-		train_imgdata[i] = (double)pdata0[i] / 255.0;
-
-	/* M6. Copy into test_imgdata[] */
-	for(i=0; i<TEST_IMGTOTAL*28*28; i++) {
-		test_imgdata[i] = (double)pdata0[TRAIN_IMGTOTAL*28*28+i] / 255.0;
-		//test_imgdata[i] = (double)pdata[i];
-	}
+	/* M3. Copy into train_imgdata[]/test_imgdata[] */
+	for(i=0; i<TRAIN_IMGTOTAL; i++)
+		idxdata_item_real(images, i, 1.0/255.0, train_imgdata+i*28*28);
+	for(i=0; i<TEST_IMGTOTAL; i++)
+		idxdata_item_real(images, TRAIN_IMGTOTAL+i, 1.0/255.0, test_imgdata+i*28*28);
 }
 
-        /* MA1. Open MNIST label data file. */
-        //fd1=open("t10k-labels.idx1-ubyte", O_RDONLY);
-        fd1=open(train_labels_path, O_RDONLY);
-        if(fd1<0) {
-                printf("%s: Fail to open label data file!\n", __func__);
-                exit(1);
-        }
-	if(fstat(fd1, &sb)<0)
-		exit(1);
-
-        /* MA2. MMAP file */
-        //addr1=mmap(NULL, 10*1024, PROT_READ, MAP_PRIVATE, fd1, 0);
-        addr1=mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd1, 0);
-        if(addr1==MAP_FAILED) {
-                        printf("%s: Fail to mmap file!\n", __func__);
-                        perror("mmap");
-                        close(fd1);
-                        exit(1);
-        }
-	pdata1 = (unsigned char *)addr1;
-
-        /* MA3. Read MNIST data header */
-        magic=be32toh( *(unsigned int*)(pdata1+0) );
-        labelcnt=be32toh( *(unsigned int*)(pdata1+4) );
-        printf("MNIST '%s': magic=%d, labelcnt=%d\n", train_labels_path, magic, labelcnt);
-
-	/* MA4. Assign pdata to the beginning of label data */
-        pdata1 +=8;
-	pdata1 +=0*1; /* Skip some images, they may be errors. */
-
-	/* MA5. Copy into train_target[] */
-	for(i=0; i<TRAIN_IMGTOTAL; i++) {
-		train_target[i] = pdata1[i];
-		//printf("train_target[%d]: %d\n", i, train_target[i]);
-	}
-
-	/* MA6. Copy into test_target[] */
-	for(i=0; i<TEST_IMGTOTAL; i++) {
-		test_target[i] = pdata1[TRAIN_IMGTOTAL+i];
-//		printf("test_target[%d]: %d\n", i, train_target[i]);
-	}
+	/* M4. Copy into test_target[], train labels are fed by the feeder */
+	for(i=0; i<TEST_IMGTOTAL; i++)
+		test_target[i] = *idxdata_item(labels, TRAIN_IMGTOTAL+i);
 
   	////////////* END: Read MNIST handwriten digit database *//////////
 
@@ -240,35 +178,38 @@ if(BUFFER_IMGDATA) {
 /*  <<<<<<<<<<<<<<<<<  Create CNN(Convolution Neural Network) >>>>>>>>>>>>>  */
 	printf("Create CNN model...\n");
 
-        /* 1. Create an input CONV3X3 Layer: (numFilters, numChannels, w, h, double *din, withBias) */
+        /* 1. Create an input CONV3X3 Layer: (numFilters, numChannels, w, h, nnc_real_t *din, withBias) */
         CONV3X3 *conv3x3=new_conv3x3(numFilters, 1, 28,28, data_input, true);
         conv3x3->transfunc = func_ReLU;
         NVLAYER *conv_layer=new_nvlayer(0, NULL, false); /* An empty nvlayer to hold conv3x3 */
         conv_layer->conv3x3=conv3x3;
 
-        /* 2. Create a MAXPOOL2X2 Layer */ /* (CONV3X3 *pinconv3x3, numFilters, imw, imh,  double **din) */
+        /* 2. Create a MAXPOOL2X2 Layer */ /* (CONV3X3 *pinconv3x3, numFilters, imw, imh,  nnc_real_t **din) */
         //MAXPOOL2X2 *maxpool2x2 =new_maxpool2x2( conv3x3, 8, conv3x3->ow, conv3x3->oh, NULL); /* If conv3x3, other's are ignored */
         MAXPOOL2X2 *maxpool2x2 =new_maxpool2x2( conv3x3, 0, 0, 0, NULL); /* If conv3x3, other's are ignored */
         NVLAYER *maxpool_layer=new_nvlayer(0, NULL, false); /* An empty nvlayer to hold conv3x3 */
         maxpool_layer->maxpool2x2=maxpool2x2;
 
-        /* 2A. Create a CONV3X3 Layer: (numFilters, numChannels, w, h, double *din, withBias) */
+        /* 2A. Create a CONV3X3 Layer: (numFilters, numChannels, w, h, nnc_real_t *din, withBias) */
         CONV3X3 *conv3x3A=new_conv3x3(numFiltersC2, maxpool2x2->nf, maxpool2x2->ow, maxpool2x2->oh, &maxpool2x2->douts[0][0], true);
         conv3x3->transfunc = func_ReLU;
         conv3x3A->prederr = maxpool2x2->derr; /* Set prederr for backpropagation */
+        conv3x3_set_engine(conv3x3A, CONV3X3_ENGINE_NCHWC); /* nchan=8, one channel block per pixel is faster */
         NVLAYER *convA_layer=new_nvlayer(0, NULL, false); /* An empty nvlayer to hold conv3x3 */
         convA_layer->conv3x3=conv3x3A;
 
-        /* 3. Create a MAXPOOL2X2 Layer */ /* (CONV3X3 *pinconv3x3, numFilters, imw, imh,  double **din) */
+        /* 3. Create a MAXPOOL2X2 Layer */ /* (CONV3X3 *pinconv3x3, numFilters, imw, imh,  nnc_real_t **din) */
         MAXPOOL2X2 *maxpool2x2A =new_maxpool2x2( conv3x3A, 0, 0, 0, NULL); /* If conv3x3, other's are ignored */
         NVLAYER *maxpoolA_layer=new_nvlayer(0, NULL, false); /* An empty nvlayer to hold conv3x3 */
         maxpoolA_layer->maxpool2x2=maxpool2x2A;
 
         /* 3A. Create the output nvcell layer */
-        /*  (nin, NVCELL * const *incells, double *din, double *dw, double bias, double (*transfer)() ) */
+        /*  (nin, NVCELL * const *incells, nnc_real_t *din, nnc_real_t *dw, nnc_real_t bias, nnc_real_t (*transfer)() ) */
         NVCELL *output_tempcell=new_nvcell(maxpool2x2A->nf*maxpool2x2A->ow*maxpool2x2A->oh, NULL, &maxpool2x2A->douts[0][0], NULL, 0, NULL); //func_R$
         NVLAYER *output_layer=new_nvlayer(10, output_tempcell, true); /* true for transfunc defined */
         output_layer->transfunc = func_softmax;
+        for(k=0; k<output_layer->nc; k++)
+		output_layer->nvcells[k]->prederr = maxpool2x2A->derr[0]; /* Set prederr for backpropagation */
 
         /* 4. Create an nerve net */
         NVNET *nnet=new_nvnet(5); /* 5 layers inside */
@@ -279,8 +220,44 @@ if(BUFFER_IMGDATA) {
         nnet->nvlayers[4]=output_layer;
 
         /* 5. Init params */
+        nnc_set_seed(RAND_SEED);
         nvnet_init_params(nnet);
 
+        /* 5A. Winograd F(2x2,3x3) for conv3x3, after checking with the direct engine on the first sample */
+	#if !BUFFER_IMGDATA
+        for(k=0; k<28*28; k++)
+		data_input[k]=pTrainImg[k]/255.0;
+	#else
+	conv3x3->din = train_imgdata;
+	#endif
+        if( conv3x3_check_winograd(conv3x3, WINOGRAD_TOL)==0 )
+		conv3x3_set_engine(conv3x3, CONV3X3_ENGINE_WINOGRAD);
+
+        /* 5B. Fused conv3x3+maxpool2x2 v.s. layer by layer, on the first sample. conv3x3A gets its din from the first one */
+        if( conv3x3_check_fusion(conv3x3, maxpool2x2, FUSION_TOL)!=0 || conv3x3_check_fusion(conv3x3A, maxpool2x2A, FUSION_TOL)!=0 )
+		exit(1);
+
+#if MINI_BATCH || TRAIN_THREADS
+        /* 5A. Optimizer to update params with averaged gradients */
+        NVOPTIM *optim=new_nvoptim(nnet, OPTIM_TYPE);
+        if(optim==NULL)
+		exit(1);
+#endif
+
+#if TRAIN_THREADS
+        /* 5B. Trainer with TRAIN_THREADS replicas of nnet */
+        NVTRAINER *trainer=new_nvtrainer(nnet, TRAIN_THREADS);
+        if(trainer==NULL)
+		exit(1);
+        trainer->optim=optim;
+#endif
+
+        /* 5C. Feeder to prefetch mini-batches of train images/targets, by a producer thread, shuffled for each epoch */
+        NVSAMPLER *sampler=new_nvsampler(TRAIN_IMGTOTAL, RAND_SEED);
+        IDXFEEDER *feeder=new_idxfeeder(images, labels, 0, TRAIN_IMGTOTAL, MT_BATCH, 10, 1.0/255.0, FEED_SLOTS, sampler);
+        if(feeder==NULL)
+		exit(1);
+
 /*  <<<<<<<<<<<<<<<<<  CNN Training Process  >>>>>>>>>>>>>  */
 
         /* 6. Set learning_rate and  momentum friction */
@@ -308,40 +285,57 @@ if(BUFFER_IMGDATA) {
                 /* 8.2  batch learning */
                 for(nb=0; nb< TRAIN_IMGTOTAL/bs; nb++) {
 
-                    /* Run all samples in the batch */
-                    for(i=0; i<bs; i++) {
-                        //printf("\n    === %dth_train, batch item %d/%d ===\n", count+1, i+1, bs);
-
-                        /* 8.2.R1. update ONE sample for input: data_input, data_target */
-			#if !BUFFER_IMGDATA /* --- CORSS_CHECK T.1 --- */
-                        for(k=0; k<28*28; k++)
-				data_input[k]=pTrainImg[(nb*bs+i)*(28*28)+k]/255.0; /* From mmap */
-			#else /* --- CORSS_CHECK T.1 --- */
-			conv_layer->conv3x3->din = train_imgdata+(nb*bs+i)*(28*28);  /* From pointer train_imgdata */
-			#endif
-                        for(k=0; k<10; k++)
-                                data_target[k] = (k==train_target[nb*bs+i] ? 1.0 : 0.0);
-
-                        /* 8.2.R2. nvnet feed forward, accumlate err values for batch error
-                           NOTICE: The output layer has transfunc defined, as func_softmax().
-                         */
-                        err = nvnet_feed_forward(nnet, data_target, func_lossCrossEntropy); //func_lossMSE);
-                        if(isnan(err) || isinf(err) ) { /* If NAN */
-                                printf("Return err is nan or inf! Too big learn_rate? or input data unnormalized?\n");
-                                exit(1);
+                    /* Run the batch in mini-batches of MT_BATCH samples, prefetched by the feeder */
+                    for(i=0; i<bs; i+=n) {
+                        n=idxfeeder_next(feeder, &feed_input, &feed_target);
+
+                        /* 8.2.0 Check gradients of all layers ONCE, with the first sample */
+                        if(!gradient_checked) {
+                            nvnet_set_input(nnet, feed_input);
+                            if( nvnet_check_gradient_sampled(nnet, feed_target, func_lossCrossEntropy,
+								GCHECK_PROBES, GCHECK_THREADS, RAND_SEED) <0 ) {
+                                    printf("Gradient check fails!\n");
+                                    if(GCHECK_FATAL)
+                                    	exit(1);
+                            }
+                            gradient_checked=true;
                         }
-                        batch_err +=err;
-                        //printf("nvnet_feed_forward get err=%f\n", err);
-
-                        /* 8.2.R3. nvnet feed backward, update cell->derrs */
-                        nvnet_feed_backward(nnet);
-
-                        /* 8.2.R4. update params after feedback(backpropagation) computation */
-                        //nvnet_mmtupdate_params(nnet, 0.002); //0.01);
-                        nvnet_update_params(nnet, instLrate); /* ---0.01 learn_rate */
 
+		#if TRAIN_THREADS
+                        batch_err += nvtrainer_train_batch(trainer, feed_input, feed_target, n, func_lossCrossEntropy, OPTIM_RATE(n));
+		#else
+                        for(j=0; j<n; j++) {
+                            /* 8.2.R1. Point input to ONE sample in the feeder slot, NO copy */
+                            nvnet_set_input(nnet, feed_input+j*28*28);
+
+                            /* 8.2.R2. nvnet feed forward, accumlate err values for batch error
+                               NOTICE: The output layer has transfunc defined, as func_softmax().
+                             */
+                            err = nvnet_feed_forward(nnet, feed_target+j*10, func_lossCrossEntropy); //func_lossMSE);
+                            if(isnan(err) || isinf(err) ) { /* If NAN */
+                                    printf("Return err is nan or inf! Too big learn_rate? or input data unnormalized?\n");
+                                    exit(1);
+                            }
+                            batch_err +=err;
+
+                            /* 8.2.R3. nvnet feed backward, update cell->derrs */
+                            nvnet_feed_backward(nnet);
+
+                            /* 8.2.R4. update params after feedback(backpropagation) computation */
+			    #if !MINI_BATCH
+                            nvnet_update_params(nnet, instLrate); /* ---0.01 learn_rate */
+			    #else
+                            nvnet_accum_dparams(nnet);
+			    #endif
+                        } /* for(j) */
+		#endif
                     } /* for(i) */
 
+		    #if MINI_BATCH
+		    /* 8.2.B. update params with gradients averaged over the batch */
+		    nvoptim_step(optim, OPTIM_RATE(bs));
+		    #endif
+
                 } /* for(nb) */
 
                 /* 8.3 Mean err for batch training */
@@ -355,6 +349,12 @@ if(BUFFER_IMGDATA) {
                 printf("Epoch %d: samples=%d, mean_err=%0.8f [%02d:%02d:%02d]\n",count, TRAIN_IMGTOTAL, mean_err,
                                         tm_s->tm_hour,tm_s->tm_min,tm_s->tm_sec);
 
+		#ifdef NNC_PROFILE
+		/* 8.5 Per-layer profile of the epoch, build with 'make test TEST_NAME=test_nnc4 PROFILE=1' */
+		nvnet_print_profile(nnet);
+		nvnet_reset_profile(nnet);
+		#endif
+
         }
 
         /* 8a. End timing */
@@ -368,6 +368,17 @@ if(BUFFER_IMGDATA) {
         printf("        %dth training, mean_err=%0.8f \n",count, mean_err);
         printf("Finish %d times batch learning! time eplapsed: %02d:%02d:%02d \n",count, hours, mins, secs);
 
+        /* 9A. Save the trained model, and load it for inference only */
+        if( nvnet_save(nnet, MODEL_PATH)==0 ) {
+		printf("Model saved to '%s'.\n", MODEL_PATH);
+		nnc_set_inference(true);
+		NVNET *inet=nvnet_load(MODEL_PATH, data_input, 28*28, true);
+		nnc_set_inference(false);
+		printf("Memory footprint: training model %lu bytes, inference only model %lu bytes.\n",
+				nvnet_mem_footprint(nnet), nvnet_mem_footprint(inet));
+		free_nvnet(inet);
+	}
+
 
 /*  <<<<<<<<<<<<<<<<<  Test CNN Model  >>>>>>>>>>>>>  */
 
@@ -377,8 +388,7 @@ if(BUFFER_IMGDATA) {
         {
                 /* T1. Update data_input,data_target */
 		#if !BUFFER_IMGDATA  /* --- CORSS_CHECK 8.2.R1 --- */
-                for(k=0; k<28*28; k++)
-			 data_input[k]=pTestImg[i*(28*28)+k]/255.0;   /* From mmap */
+		nvnet_set_input_u8(nnet, pTestImg+i*(28*28), 1.0/255.0); /* From mmap, normalized by the first layer */
 		#else  /* --- CORSS_CHECK 8.2.R1 --- */
 		conv_layer->conv3x3->din = test_imgdata+i*(28*28);    /* Pointer to test_imgdata */
 		#endif
@@ -413,13 +423,19 @@ if(BUFFER_IMGDATA) {
 	free(train_imgdata);
 	free(test_imgdata);
 	free_nvcell(output_tempcell);
+        free_idxfeeder(feeder); /* before images/labels/sampler */
+        free_nvsampler(sampler);
+#if TRAIN_THREADS
+        free_nvtrainer(trainer); /* before nnet, replicas share params of nnet */
+#endif
+#if MINI_BATCH || TRAIN_THREADS
+        free_nvoptim(optim);
+#endif
         free_nvnet(nnet); /* free nvnet also free its nvlayers and nvcells inside */
 
         /* Unmap and close */
-        munmap(addr0, 8*1024*1024);
-        close(fd0);
-        munmap(addr1, 8*1024);
-        close(fd1);
+        free_idxdata(images);
+        free_idxdata(labels);
 
 	return 0;
 }
@@ -0,0 +1,240 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Neural Network Description:
+   Input(28*28) |>> CONVKXK k3s2p1 (14x14x8_out) >>|
+		 >> CONV3X3 (12x12x32_out)  >>|>> MAXPOOL2X2 (6x6x32_out) >>|<< nvCells (10_out)
+
+   The first CONV3X3+MAXPOOL2X2 stage of test_nnc4 is replaced by ONE
+   stride-2 CONVKXK, which downsamples at about a quarter of the compute.
+
+Note:
+1. Train by NVTRAINER with TRAIN_THREADS replicas, and check:
+   1.1 Gradients of all layers with the first sample.
+   1.2 Batch feed forward v.s. feed forward sample by sample.
+   1.3 The saved model, loaded by mmap for inference only, v.s. the trained one.
+   It exits with 1 if any check fails.
+2. MNIST data files as test_nnc4, in the current directory.
+
+Journal:
+2026-10-18: Create the file.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "nnc.h"
+#include "idxdata.h"
+#include "actfs.h"
+#include "nvmodel.h"
+
+#define TRAIN_IMGTOTAL	5000
+#define TEST_IMGTOTAL	5000
+#define EPOCHS		10
+#define TRAIN_THREADS	2	/* Replicas of NVTRAINER, see new_nvtrainer() */
+#define MT_BATCH	32	/* Samples of a mini-batch */
+#define FEED_SLOTS	2
+#define RAND_SEED	20261018
+#define MODEL_PATH	"mnist_kxk.nvm"
+#define GCHECK_PROBES	1000
+#define GCHECK_THREADS	4
+#ifdef NNC_FLOAT32
+#define GCHECK_FATAL	0	/* float32: A probe across a kink of ReLU/MAXPOOL2X2 by the bigger desp_params may fail */
+#else
+#define GCHECK_FATAL	1	/* Exit if the gradient check fails */
+#endif
+#define CHECK_BATCH	100	/* Test samples for the batch check */
+#define CHECK_TOL	1.0e-5	/* Max. abs diff of outputs, for batch and loaded model checks */
+
+float instLrate=0.0025;		/* Learning rate per sample, SGD rate of a mini-batch is scaled by its size */
+
+
+int main(void)
+{
+	int i, k, n, count;
+	int errcnt;
+	nnc_real_t err, batch_err, dmax;
+	nnc_real_t data_input[28*28];
+	nnc_real_t data_target[10];
+	const nnc_real_t *feed_input, *feed_target;
+	nnc_real_t *bin, *bout;
+	time_t t_start;
+
+	/* M1. Open MNIST image/label data files, the first TRAIN_IMGTOTAL for training, the next TEST_IMGTOTAL for testing */
+	IDXDATA *images=new_idxdata("train-images.idx3-ubyte");
+	IDXDATA *labels=new_idxdata("train-labels.idx1-ubyte");
+	if(images==NULL || labels==NULL)
+		exit(1);
+	if( images->itemsize!=28*28 || images->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL
+	    || labels->itemsize!=1 || labels->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL ) {
+		printf("%s: Invalid MNIST data files!\n", __func__);
+		exit(1);
+	}
+
+
+/*  <<<<<<<<<<<<<<<<<  Create CNN(Convolution Neural Network) >>>>>>>>>>>>>  */
+	printf("Create CNN model...\n");
+
+	/* 1. Stride-2 CONVKXK: (numFilters, numChannels, w, h, ks, stride, pad, din, withBias) */
+	CONVKXK *convk=new_convkxk(8, 1, 28, 28, 3, 2, 1, data_input, true);
+	if(convk==NULL)
+		exit(1);
+	convk->transfunc=func_ReLU;
+	NVLAYER *convk_layer=new_nvlayer(0, NULL, false);
+	convk_layer->convkxk=convk;
+
+	/* 2. CONV3X3 */
+	CONV3X3 *conv3x3=new_conv3x3(32, convk->nf, convk->ow, convk->oh, &convk->douts[0][0], true);
+	conv3x3->transfunc=func_ReLU;
+	conv3x3->prederr=convk->derr;
+	conv3x3_set_engine(conv3x3, CONV3X3_ENGINE_NCHWC); /* nchan=8 */
+	NVLAYER *conv_layer=new_nvlayer(0, NULL, false);
+	conv_layer->conv3x3=conv3x3;
+
+	/* 3. MAXPOOL2X2 */
+	MAXPOOL2X2 *maxpool2x2=new_maxpool2x2(conv3x3, 0, 0, 0, NULL);
+	NVLAYER *maxpool_layer=new_nvlayer(0, NULL, false);
+	maxpool_layer->maxpool2x2=maxpool2x2;
+
+	/* 4. Output nvcell layer */
+	NVCELL *output_tempcell=new_nvcell(maxpool2x2->nf*maxpool2x2->ow*maxpool2x2->oh, NULL, &maxpool2x2->douts[0][0], NULL, 0, NULL);
+	NVLAYER *output_layer=new_nvlayer(10, output_tempcell, true);
+	output_layer->transfunc=func_softmax;
+	for(k=0; k<output_layer->nc; k++)
+		output_layer->nvcells[k]->prederr=maxpool2x2->derr[0];
+
+	/* 5. Nerve net */
+	NVNET *nnet=new_nvnet(4);
+	nnet->nvlayers[0]=convk_layer;
+	nnet->nvlayers[1]=conv_layer;
+	nnet->nvlayers[2]=maxpool_layer;
+	nnet->nvlayers[3]=output_layer;
+
+	nnc_set_seed(RAND_SEED);
+	if( nvnet_init_params(nnet)!=0 )
+		exit(1);
+
+	/* 6. Trainer, optimizer and feeder */
+	NVOPTIM *optim=new_nvoptim(nnet, NVOPTIM_SGD);
+	NVTRAINER *trainer=new_nvtrainer(nnet, TRAIN_THREADS);
+	NVSAMPLER *sampler=new_nvsampler(TRAIN_IMGTOTAL, RAND_SEED);
+	IDXFEEDER *feeder=new_idxfeeder(images, labels, 0, TRAIN_IMGTOTAL, MT_BATCH, 10, 1.0/255.0, FEED_SLOTS, sampler);
+	if(optim==NULL || trainer==NULL || feeder==NULL)
+		exit(1);
+	trainer->optim=optim;
+
+
+/*  <<<<<<<<<<<<<<<<<  CNN Training Process  >>>>>>>>>>>>>  */
+	printf("NN model starts training ...\n");
+	t_start=time(NULL);
+
+	for(count=1; count<=EPOCHS; count++) {
+		batch_err=0.0;
+		for(i=0; i<TRAIN_IMGTOTAL; i+=n) {
+			n=idxfeeder_next(feeder, &feed_input, &feed_target);
+
+			/* C1. Check gradients of all layers ONCE, with the first sample */
+			if(count==1 && i==0) {
+				nvnet_set_input(nnet, feed_input);
+				if( nvnet_check_gradient_sampled(nnet, feed_target, func_lossCrossEntropy,
+								 GCHECK_PROBES, GCHECK_THREADS, RAND_SEED) <0 ) {
+					printf("Gradient check fails!\n");
+					if(GCHECK_FATAL)
+						exit(1);
+				}
+			}
+
+			err=nvtrainer_train_batch(trainer, feed_input, feed_target, n, func_lossCrossEntropy, instLrate*n);
+			if( isnan(err) || isinf(err) ) {
+				printf("Return err is nan or inf! Too big learn_rate?\n");
+				exit(1);
+			}
+			batch_err += err;
+		}
+		printf("Epoch %d: samples=%d, mean_err=%0.8f\n", count, TRAIN_IMGTOTAL, batch_err/TRAIN_IMGTOTAL);
+	}
+	printf("Finish %d epochs, time elapsed: %.0fs\n", EPOCHS, difftime(time(NULL), t_start));
+
+
+/*  <<<<<<<<<<<<<<<<<  Test CNN Model  >>>>>>>>>>>>>  */
+	printf("\n----------- Test learned NN Model -----------\n");
+
+	/* T1. Accuracy */
+	errcnt=0;
+	for(i=0; i<TEST_IMGTOTAL; i++) {
+		nvnet_set_input_u8(nnet, idxdata_item(images, TRAIN_IMGTOTAL+i), 1.0/255.0);
+		for(k=0; k<10; k++)
+			data_target[k]= (k==*idxdata_item(labels, TRAIN_IMGTOTAL+i) ? 1.0 : 0.0);
+		nvnet_feed_forward(nnet, data_target, func_lossCrossEntropy);
+		if( output_layer->douts[*idxdata_item(labels, TRAIN_IMGTOTAL+i)] <= 0.5 )
+			errcnt++;
+	}
+	printf("Err/Total: %d/%d   Accuracy: %.2f%%\n", errcnt, TEST_IMGTOTAL, 100.0*(1.0-1.0*errcnt/TEST_IMGTOTAL));
+
+	/* C2. Batch feed forward v.s. sample by sample */
+	bin=malloc(CHECK_BATCH*28*28*sizeof(nnc_real_t));
+	bout=malloc(CHECK_BATCH*10*sizeof(nnc_real_t));
+	if(bin==NULL || bout==NULL)
+		exit(1);
+	for(i=0; i<CHECK_BATCH; i++)
+		idxdata_item_real(images, TRAIN_IMGTOTAL+i, 1.0/255.0, bin+i*28*28);
+	if( nvnet_feed_forward_batch(nnet, bin, CHECK_BATCH, bout)!=0 )
+		exit(1);
+	dmax=0.0;
+	for(i=0; i<CHECK_BATCH; i++) {
+		nvnet_set_input(nnet, bin+i*28*28);
+		nvnet_feed_forward(nnet, data_target, func_lossCrossEntropy);
+		for(k=0; k<10; k++)
+			dmax=fmax(dmax, fabs(bout[i*10+k]-output_layer->douts[k]));
+	}
+	printf("Batch v.s. single feed forward: max|diff|=%e\n", dmax);
+	if(dmax > CHECK_TOL) {
+		printf("Batch check fails!\n");
+		exit(1);
+	}
+
+	/* C3. The saved model, loaded by mmap for inference only */
+	if( nvnet_save(nnet, MODEL_PATH)!=0 )
+		exit(1);
+	nnc_set_inference(true);
+	NVNET *inet=nvnet_load(MODEL_PATH, data_input, 28*28, true);
+	nnc_set_inference(false);
+	if(inet==NULL)
+		exit(1);
+	dmax=0.0;
+	for(i=0; i<CHECK_BATCH; i++) {
+		nvnet_set_input(nnet, bin+i*28*28);
+		nvnet_feed_forward(nnet, data_target, func_lossCrossEntropy);
+		nvnet_set_input(inet, bin+i*28*28);
+		nvnet_feed_forward(inet, data_target, func_lossCrossEntropy);
+		for(k=0; k<10; k++)
+			dmax=fmax(dmax, fabs(inet->nvlayers[inet->nl-1]->douts[k]-output_layer->douts[k]));
+	}
+	printf("Loaded model '%s' v.s. trained: max|diff|=%e, memory footprint %lu v.s. %lu bytes\n",
+			MODEL_PATH, dmax, nvnet_mem_footprint(inet), nvnet_mem_footprint(nnet));
+	if(dmax > CHECK_TOL) {
+		printf("Loaded model check fails!\n");
+		exit(1);
+	}
+
+	/* Free */
+	free(bin);
+	free(bout);
+	free_nvnet(inet);
+	free_nvcell(output_tempcell);
+	free_idxfeeder(feeder);		/* before images/labels/sampler */
+	free_nvsampler(sampler);
+	free_nvtrainer(trainer);	/* before nnet, replicas share params of nnet */
+	free_nvoptim(optim);
+	free_nvnet(nnet);
+	free_idxdata(images);
+	free_idxdata(labels);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+Quantize a trained model to int8, and compare it with the model.
+
+Usage:
+   1. Run test_nnc4 to train and save the model "mnist_cnn.nvm".
+   2. make test TEST_NAME=test_nvquant && ./test_nvquant
+
+   Both read MNIST images from the same train-images.idx3-ubyte,
+   the first TRAIN_IMGTOTAL images are for training/calibration,
+   and the next TEST_IMGTOTAL images are for testing.
+
+Journal:
+2026-10-17: Create the file.
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "nnc.h"
+#include "actfs.h"
+#include "nvmodel.h"
+#include "nvquant.h"
+#include "idxdata.h"
+
+#define MODEL_PATH	"mnist_cnn.nvm"	/* As saved by test_nnc4 */
+#define TRAIN_IMGTOTAL	5000
+#define TEST_IMGTOTAL	5000
+#define CALIB_IMGTOTAL	500	/* Number of train images for calibration, <=TRAIN_IMGTOTAL */
+
+/* Time in ms */
+static double tm_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000.0+tv.tv_usec/1000.0;
+}
+
+/* Index of the max. value */
+static int argmax(const nnc_real_t *data, int n)
+{
+	int i, k=0;
+
+	for(i=1; i<n; i++) {
+		if(data[i] > data[k])
+			k=i;
+	}
+	return k;
+}
+
+int main(void)
+{
+	int i,k;
+	const char *images_path="train-images.idx3-ubyte";
+	const char *labels_path="train-labels.idx1-ubyte";
+	IDXDATA *images, *labels;
+
+	nnc_real_t data_input[28*28]; /* Normalized to [0 1.0] */
+	nnc_real_t *calib;
+	nnc_real_t qout[10];
+	NVNET *nnet;
+	NVQNET *qnet;
+	NVLAYER *output_layer;
+
+	int nout;
+	int ferr=0, qerr=0, agree=0;
+	double maxdiff=0.0;
+	double ft=0.0, qt=0.0, t0;
+
+	/* 1. MNIST image/label data, mmaped */
+	images=new_idxdata(images_path);
+	labels=new_idxdata(labels_path);
+	if(images==NULL || labels==NULL)
+		exit(1);
+	if( images->itemsize!=28*28 || images->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL
+	    || labels->itemsize!=1 || labels->count < TRAIN_IMGTOTAL+TEST_IMGTOTAL ) {
+		printf("%s: Invalid MNIST data files!\n", __func__);
+		exit(1);
+	}
+
+	/* 2. Load the model, inference only */
+	nnc_set_inference(true);
+	nnet=nvnet_load(MODEL_PATH, data_input, 28*28, false);
+	nnc_set_inference(false);
+	if(nnet==NULL) {
+		printf("%s: Fail to load '%s', run test_nnc4 to train and save it.\n", __func__, MODEL_PATH);
+		exit(1);
+	}
+	output_layer=nnet->nvlayers[nnet->nl-1];
+	nout=output_layer->nc;
+
+	/* 3. Quantize with calibration images */
+	calib=malloc(CALIB_IMGTOTAL*28*28*sizeof(nnc_real_t));
+	if(calib==NULL)
+		exit(1);
+	for(i=0; i<CALIB_IMGTOTAL; i++)
+		idxdata_item_real(images, i, 1.0/255.0, calib+i*28*28);
+
+	t0=tm_ms();
+	qnet=nvnet_quantize(nnet, calib, CALIB_IMGTOTAL);
+	if(qnet==NULL) {
+		printf("%s: Fail to quantize the model!\n", __func__);
+		exit(1);
+	}
+	printf("Quantized with %d calibration images in %.1fms.\n", CALIB_IMGTOTAL, tm_ms()-t0);
+
+	/* 4. Test both models */
+	for(i=0; i<TEST_IMGTOTAL; i++) {
+		idxdata_item_real(images, TRAIN_IMGTOTAL+i, 1.0/255.0, data_input);
+
+		t0=tm_ms();
+		nvnet_feed_forward(nnet, NULL, NULL);
+		ft += tm_ms()-t0;
+
+		t0=tm_ms();
+		nvqnet_feed_forward(qnet, data_input, qout);
+		qt += tm_ms()-t0;
+
+		if( argmax(output_layer->douts, nout) != *idxdata_item(labels, TRAIN_IMGTOTAL+i) )
+			ferr++;
+		if( argmax(qout, nout) != *idxdata_item(labels, TRAIN_IMGTOTAL+i) )
+			qerr++;
+		if( argmax(output_layer->douts, nout) == argmax(qout, nout) )
+			agree++;
+		for(k=0; k<nout; k++) {
+			if( fabs(output_layer->douts[k]-qout[k]) > maxdiff )
+				maxdiff=fabs(output_layer->douts[k]-qout[k]);
+		}
+	}
+
+	/* 5. Report */
+	printf("\n----------- %s model v.s. int8 model, %d test images -----------\n",
+			sizeof(nnc_real_t)==sizeof(float) ? "float32" : "double", TEST_IMGTOTAL);
+	printf("Accuracy:          %.2f%% v.s. %.2f%%\n", 100.0*(1.0-1.0*ferr/TEST_IMGTOTAL), 100.0*(1.0-1.0*qerr/TEST_IMGTOTAL));
+	printf("Top-1 agreement:   %.2f%%\n", 100.0*agree/TEST_IMGTOTAL);
+	printf("Max. output diff:  %f\n", maxdiff);
+	printf("Memory footprint:  %lu bytes v.s. %lu bytes\n", nvnet_mem_footprint(nnet), nvqnet_mem_footprint(qnet));
+	printf("Time per image:    %.3fms v.s. %.3fms\n", ft/TEST_IMGTOTAL, qt/TEST_IMGTOTAL);
+
+	free(calib);
+	free_nvqnet(qnet);
+	free_nvnet(nnet);
+	free_idxdata(images);
+	free_idxdata(labels);
+
+	return 0;
+}
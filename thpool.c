@@ -0,0 +1,217 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+A persistent pthread pool, to run ntask tasks of a job in parallel
+and wait until all of them are done. Workers are created once and
+sleep on a condition between jobs, so a job costs only a wakeup.
+
+Journal:
+2026-10-17:
+   1. Create thpool_create(), thpool_run(), thpool_destroy().
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#include "thpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* True in threads running tasks of a pool, to avoid nested jobs */
+static __thread bool in_worker;
+
+
+/*-------------------------------------------------
+ * Run tasks of the current job until none left.
+ * Called with pool->lock held, and returns with it held.
+--------------------------------------------------*/
+static void thpool_run_tasks(THPOOL *pool)
+{
+	int index;
+	thpool_func_t func=pool->func;
+	void *arg=pool->arg;
+
+	while(pool->next < pool->ntask) {
+		index=pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		func(arg, index);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->pending==0)
+			pthread_cond_signal(&pool->cond_done);
+	}
+}
+
+
+/*-------------------------------------------------
+ * Worker thread
+--------------------------------------------------*/
+static void *thpool_worker(void *data)
+{
+	THPOOL *pool=data;
+	unsigned long jobid=0;
+
+	in_worker=true;
+
+	pthread_mutex_lock(&pool->lock);
+	while(1) {
+		/* Wait for a new job */
+		while(!pool->quit && pool->jobid==jobid)
+			pthread_cond_wait(&pool->cond_job, &pool->lock);
+		if(pool->quit)
+			break;
+
+		jobid=pool->jobid;
+		thpool_run_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+
+/*-------------------------------------------------
+ * Create a thread pool.
+ *
+ * Params:
+ *	@nth	Number of worker threads, >=0.
+ *		The caller of thpool_run() also runs tasks,
+ *		so nth=ncores-1 to use all cores.
+ * Return:
+ *	Pointer to a THPOOL	OK
+ *	NULL			Fails
+--------------------------------------------------*/
+THPOOL *thpool_create(int nth)
+{
+	int i;
+	THPOOL *pool;
+
+	if(nth<0) {
+		printf("%s: Input nth<0!\n", __func__);
+		return NULL;
+	}
+
+	pool=calloc(1, sizeof(THPOOL));
+	if(pool==NULL) {
+		printf("%s: Fail to calloc pool.\n", __func__);
+		return NULL;
+	}
+	if(nth>0) {
+		pool->threads=calloc(nth, sizeof(pthread_t));
+		if(pool->threads==NULL) {
+			printf("%s: Fail to calloc pool->threads.\n", __func__);
+			free(pool);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond_job, NULL);
+	pthread_cond_init(&pool->cond_done, NULL);
+
+	for(i=0; i<nth; i++) {
+		if( pthread_create(&pool->threads[i], NULL, thpool_worker, pool)!=0 ) {
+			printf("%s: Fail to create thread %d.\n", __func__, i);
+			break;
+		}
+		pool->nth++;
+	}
+
+	return pool;
+}
+
+
+/*-------------------------------------------------------
+ * Run func(arg, index) for index=0 ~ ntask-1 in the
+ * pool, and wait until all are done.
+ *
+ * Note:
+ *	1. Tasks are picked in order of index, but MAY
+ *	   finish in any order.
+ *	2. Called from inside a task, all tasks are run
+ *	   by the caller itself.
+ *
+ * Params:
+ *	@pool	Pointer to a THPOOL, if NULL run all tasks
+ *		in the caller thread.
+ *	@func	Task function
+ *	@arg	Argument for func
+ *	@ntask	Number of tasks
+ * Return:
+ *	0	OK
+ *	<0	Fails
+--------------------------------------------------------*/
+int thpool_run(THPOOL *pool, thpool_func_t func, void *arg, int ntask)
+{
+	int i;
+
+	if(func==NULL || ntask<0)
+		return -1;
+
+	/* Run in caller thread */
+	if(pool==NULL || pool->nth==0 || ntask==1 || in_worker) {
+		for(i=0; i<ntask; i++)
+			func(arg, i);
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->func=func;
+	pool->arg=arg;
+	pool->ntask=ntask;
+	pool->next=0;
+	pool->pending=ntask;
+	pool->jobid++;
+	pthread_cond_broadcast(&pool->cond_job);
+
+	/* Caller runs tasks too */
+	in_worker=true;
+	thpool_run_tasks(pool);
+	in_worker=false;
+
+	while(pool->pending>0)
+		pthread_cond_wait(&pool->cond_done, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+
+/*-------------------------------------------------
+ * Stop all threads and free the pool.
+--------------------------------------------------*/
+void thpool_destroy(THPOOL *pool)
+{
+	int i;
+
+	if(pool==NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit=true;
+	pthread_cond_broadcast(&pool->cond_job);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i=0; i< pool->nth; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->cond_job);
+	pthread_cond_destroy(&pool->cond_done);
+
+	free(pool->threads);
+	free(pool);
+}
+
+
+/*-------------------------------------------------
+ * Return true if the calling thread is running a
+ * task of a pool.
+--------------------------------------------------*/
+bool thpool_in_worker(void)
+{
+	return in_worker;
+}
@@ -0,0 +1,44 @@
+/*----------------------------------------------------------------------
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+
+Midas Zhou
+-----------------------------------------------------------------------*/
+#ifndef __THPOOL_H__
+#define __THPOOL_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct thread_pool THPOOL;
+
+/* A task function, called as func(arg, index), index=0 ~ ntask-1 */
+typedef void (*thpool_func_t)(void *arg, int index);
+
+struct thread_pool
+{
+	int nth;			/* number of worker threads, the caller thread also runs tasks */
+	pthread_t *threads;		/* threads[nth] */
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond_job;	/* Signaled when a new job is posted, or to quit */
+	pthread_cond_t  cond_done;	/* Signaled when all tasks of the job are done */
+
+	/* Current job, protected by lock */
+	thpool_func_t func;
+	void *arg;
+	int ntask;			/* number of tasks of the job */
+	int next;			/* next task index to run */
+	int pending;			/* tasks NOT finished yet */
+	unsigned long jobid;		/* increased for each job */
+	bool quit;
+};
+
+THPOOL *thpool_create(int nth);
+int thpool_run(THPOOL *pool, thpool_func_t func, void *arg, int ntask);
+void thpool_destroy(THPOOL *pool);
+bool thpool_in_worker(void);
+
+#endif